@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+// Counts heap allocations of the test process. The global operator new/delete
+// replacements that feed these counters are defined in MemoryTest.cpp.
+namespace alloc
+{
+	struct Stats
+	{
+		size_t allocations = 0; // number of operator new calls
+		size_t totalBytes = 0; // sum of all allocated bytes
+		size_t peakBytes = 0; // peak of live bytes above the level at the start of the scope
+	};
+
+	inline std::atomic<bool> s_enabled{ false };
+	inline std::atomic<size_t> s_allocations{ 0 };
+	inline std::atomic<size_t> s_totalBytes{ 0 };
+	inline std::atomic<ptrdiff_t> s_liveBytes{ 0 };
+	inline std::atomic<ptrdiff_t> s_peakBytes{ 0 };
+
+	inline void onAllocate(size_t size)
+	{
+		if (!s_enabled) return;
+		++s_allocations;
+		s_totalBytes += size;
+		const ptrdiff_t live = s_liveBytes += ptrdiff_t(size);
+		ptrdiff_t peak = s_peakBytes;
+		while (live > peak && !s_peakBytes.compare_exchange_weak(peak, live)) {}
+	}
+
+	inline void onFree(size_t size)
+	{
+		if (!s_enabled) return;
+		s_liveBytes -= ptrdiff_t(size);
+	}
+
+	/// measures all allocations during its lifetime (scopes must not be nested)
+	class Scope
+	{
+	public:
+		Scope()
+		{
+			s_allocations = 0;
+			s_totalBytes = 0;
+			s_liveBytes = 0;
+			s_peakBytes = 0;
+			s_enabled = true;
+		}
+		~Scope()
+		{
+			s_enabled = false;
+		}
+
+		Stats get() const
+		{
+			Stats res;
+			res.allocations = s_allocations;
+			res.totalBytes = s_totalBytes;
+			res.peakBytes = size_t(std::max<ptrdiff_t>(s_peakBytes, 0));
+			return res;
+		}
+	};
+}
@@ -0,0 +1,300 @@
+#include "pch.h"
+#include "../include/hrsf/Pvs.h"
+#include "../include/hrsf/Replay.h"
+#include <glm/glm.hpp>
+
+#define TestSuite CameraTest
+
+TEST(TestSuite, Matrices)
+{
+	Camera cam(CameraData::Default());
+	cam.data.position = glm::vec3(1.0f, 2.0f, 3.0f);
+	cam.data.far = 100.0f;
+
+	const auto m = cam.getMatrices(16.0f / 9.0f);
+	// point in front of the camera projects to the screen center
+	const auto clip = m.viewProjection * glm::vec4(1.0f, 2.0f, 13.0f, 1.0f);
+	EXPECT_NEAR(clip.x / clip.w, 0.0f, 1e-5f);
+	EXPECT_NEAR(clip.y / clip.w, 0.0f, 1e-5f);
+	EXPECT_GT(clip.w, 0.0f);
+
+	EXPECT_TRUE(m.frustum.isSphereVisible(glm::vec3(1.0f, 2.0f, 13.0f), 0.1f));
+	EXPECT_FALSE(m.frustum.isSphereVisible(glm::vec3(1.0f, 2.0f, -7.0f), 1.0f)); // behind
+	EXPECT_FALSE(m.frustum.isSphereVisible(glm::vec3(1.0f, 2.0f, 200.0f), 1.0f)); // beyond far
+	EXPECT_TRUE(m.frustum.isBoxVisible(glm::vec3(-10.0f, -10.0f, 10.0f), glm::vec3(10.0f, 10.0f, 11.0f)));
+	EXPECT_FALSE(m.frustum.isBoxVisible(glm::vec3(-10.0f, -10.0f, -10.0f), glm::vec3(10.0f, 10.0f, 0.0f)));
+}
+
+TEST(TestSuite, MatrixCache)
+{
+	Camera cam(CameraData::Default(), Path({ PathSection{2.0f, glm::vec3(10.0f, 0.0f, 0.0f)} }, 1.0f));
+
+	const auto* first = &cam.updateMatrices(1.0f);
+	const auto view = first->view;
+	EXPECT_EQ(&cam.updateMatrices(1.0f), first);
+	EXPECT_EQ(cam.updateMatrices(1.0f).view, view);
+	EXPECT_EQ(cam.getMatrices(1.0f).view, view);
+
+	// path moved
+	cam.positionPath.update(1.0f);
+	EXPECT_VEC3_EQUAL(cam.updateMatrices(1.0f).position, glm::vec3(5.0f, 0.0f, 0.0f));
+	EXPECT_NE(cam.updateMatrices(1.0f).view, view);
+
+	// data changed
+	cam.data.fov = 1.0f;
+	EXPECT_EQ(cam.updateMatrices(1.0f).projection, CameraMatrices::compute(cam.getCurrentData(), 1.0f).projection);
+
+	// other aspect ratio
+	EXPECT_EQ(cam.updateMatrices(2.0f).projection, cam.getMatrices(2.0f).projection);
+	EXPECT_NE(cam.updateMatrices(1.0f).projection, cam.getMatrices(2.0f).projection);
+
+	// batch matches stepping the paths
+	std::vector<CameraMatrices> frames(5);
+	cam.getPathMatrices(1.0f, 0.25f, frames.size(), frames.data());
+	auto copy = cam;
+	for (const auto& f : frames)
+	{
+		EXPECT_EQ(f.viewProjection, copy.getMatrices(1.0f).viewProjection);
+		copy.positionPath.update(0.25f);
+	}
+	// the camera itself was not advanced
+	EXPECT_VEC3_EQUAL(cam.getMatrices(1.0f).position, glm::vec3(5.0f, 0.0f, 0.0f));
+
+	// replaced path with the same cursor
+	Camera other = cam;
+	other.positionPath = Path({ PathSection{2.0f, glm::vec3(0.0f, 4.0f, 0.0f)} }, 1.0f);
+	other.positionPath.update(1.0f);
+	EXPECT_VEC3_EQUAL(other.updateMatrices(1.0f).position, glm::vec3(0.0f, 2.0f, 0.0f));
+	other.lookAtPath = Path({ PathSection{1.0f, glm::vec3(1.0f, 0.0f, 0.0f)}, PathSection{1.0f, glm::vec3(0.0f, 0.0f, -1.0f)} }, 1.0f);
+	EXPECT_VEC3_EQUAL(other.updateMatrices(1.0f).direction, glm::normalize(other.lookAtPath.getLookAt()));
+
+	// a zero look at keeps the data direction
+	other.lookAtPath = Path({ PathSection{1.0f, glm::vec3(0.0f)}, PathSection{1.0f, glm::vec3(0.0f)} }, 1.0f);
+	EXPECT_VEC3_EQUAL(other.getMatrices(1.0f).direction, CameraData::Default().direction);
+	EXPECT_FALSE(std::isnan(other.getMatrices(1.0f).viewProjection[0][0]));
+
+	// top-down camera (direction parallel to up)
+	auto topDown = CameraData::Default();
+	topDown.position = glm::vec3(0.0f, 50.0f, 0.0f);
+	topDown.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	topDown.up = glm::vec3(0.0f, 1.0f, 0.0f);
+	const auto down = CameraMatrices::compute(topDown, 1.0f);
+	for (int c = 0; c < 4; ++c)
+		for (int r = 0; r < 4; ++r)
+			EXPECT_FALSE(std::isnan(down.viewProjection[c][r]));
+	EXPECT_TRUE(down.frustum.isSphereVisible(glm::vec3(0.0f), 1.0f));
+	EXPECT_FALSE(down.frustum.isSphereVisible(glm::vec3(0.0f, 60.0f, 0.0f), 1.0f)); // behind
+
+	auto zero = CameraData::Default();
+	zero.direction = glm::vec3(0.0f);
+	EXPECT_THROW(CameraMatrices::compute(zero, 1.0f), std::runtime_error);
+}
+
+namespace
+{
+	// one triangle mesh at each offset (one shape per mesh)
+	SceneFormat getReplayScene()
+	{
+		std::vector<Mesh> meshes;
+		for (const auto& offset : { glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f, 0.0f, -10.0f) })
+		{
+			std::vector<float> vertices;
+			for (const auto& v : { offset, offset + glm::vec3(1.0f, 0.0f, 0.0f), offset + glm::vec3(0.0f, 1.0f, 0.0f) })
+				vertices.insert(vertices.end(), { v.x, v.y, v.z });
+			const std::vector<uint16_t> indices = { 0, 1, 2 };
+			const std::vector<bmf::Shape> shapes = { bmf::Shape{0, 3, 0, 3, 0} };
+			meshes.emplace_back(bmf::BinaryMesh16(bmf::Position, vertices, indices, shapes));
+		}
+		std::vector<Material> materials(1);
+		materials[0].name = "default";
+		materials[0].data = MaterialData::Default();
+
+		std::vector<Light> lights(1, Light{ LightData::Point });
+		lights[0].data.position = glm::vec3(0.0f);
+		lights[0].data.color = glm::vec3(1.0f);
+		lights[0].data.radius = 0.0f;
+		lights[0].path = Path({ PathSection{1.0f, glm::vec3(0.0f, 4.0f, 0.0f)} }, 1.0f);
+
+		SceneFormat scene(std::move(meshes), Camera(CameraData::Default()), lights, materials, Environment::Default());
+
+		// viewpoint and a fly-through that turns around
+		BenchmarkCamera view{ "front", Camera(CameraData::Default()), 0.0f };
+		BenchmarkCamera fly{ "turn", Camera(CameraData::Default()), 2.0f };
+		fly.camera.lookAtPath = Path({
+			PathSection{1.0f, glm::vec3(0.0f, 0.0f, 1.0f)},
+			PathSection{1.0f, glm::vec3(0.0f, 0.0f, -1.0f)} }, 1.0f);
+		scene.setBenchmarkCameras({ view, fly });
+		return scene;
+	}
+}
+
+TEST(TestSuite, BenchmarkCamerasSaveLoad)
+{
+	auto scene = getReplayScene();
+	scene.save("test_bench", true);
+	auto res = SceneFormat::load("test_bench");
+	ASSERT_EQ(res.getBenchmarkCameras().size(), 2);
+	EXPECT_EQ(res.getBenchmarkCameras()[0].name, "front");
+	EXPECT_EQ(res.getBenchmarkCameras()[0].duration, 0.0f);
+	EXPECT_EQ(res.getBenchmarkCameras()[1].name, "turn");
+	EXPECT_EQ(res.getBenchmarkCameras()[1].duration, 2.0f);
+	EXPECT_EQ(res.getBenchmarkCameras()[1].camera.lookAtPath.getSections().size(), 2);
+	EXPECT_NO_THROW(res.verify());
+}
+
+TEST(TestSuite, Replay)
+{
+	const auto scene = getReplayScene();
+	ReplaySettings settings;
+	settings.timeStep = 0.5f;
+
+	ReplayDriver view(scene, scene.getBenchmarkCameras()[0], settings);
+	EXPECT_EQ(view.getFrameCount(), 1);
+	const auto viewStats = view.run();
+	ASSERT_EQ(viewStats.size(), 1);
+	EXPECT_EQ(viewStats[0].visibleMeshes, 1);
+	EXPECT_EQ(viewStats[0].visibleTriangles, 1);
+
+	ReplayDriver fly(scene, scene.getBenchmarkCameras()[1], settings);
+	EXPECT_EQ(fly.getFrameCount(), 5);
+	ASSERT_TRUE(fly.next());
+	EXPECT_EQ(fly.getFrame().index, 0);
+	EXPECT_VEC3_EQUAL(fly.getFrame().lights[0].position, glm::vec3(0.0f));
+	ASSERT_TRUE(fly.next());
+	EXPECT_FLOAT_EQ(fly.getFrame().time, 0.5f);
+	EXPECT_VEC3_EQUAL(fly.getFrame().lights[0].position, glm::vec3(0.0f, 2.0f, 0.0f));
+
+	// deterministic
+	const auto first = fly.run();
+	const auto second = fly.run();
+	ASSERT_EQ(first.size(), 5);
+	ASSERT_EQ(second.size(), 5);
+	for (size_t i = 0; i < first.size(); ++i)
+	{
+		EXPECT_EQ(first[i].visibleShapes, second[i].visibleShapes);
+		EXPECT_EQ(first[i].visibleTriangles, second[i].visibleTriangles);
+	}
+	// the look at path starts and ends at -z and reaches +z after one second
+	EXPECT_EQ(first[0].visibleMeshes, 1);
+	EXPECT_EQ(first[2].visibleMeshes, 1);
+	EXPECT_LT(fly.getFrame().matrices.direction.z, 0.0f);
+	EXPECT_FALSE(fly.next());
+	fly.reset();
+	fly.next();
+	fly.next();
+	fly.next();
+	EXPECT_GT(fly.getFrame().matrices.direction.z, 0.0f);
+
+	// prefab instances would be missing from the statistics
+	scene.save("test_replay_prefab", true);
+	auto instanced = getReplayScene();
+	instanced.addReference("test_replay_prefab", glm::mat4(1.0f));
+	EXPECT_THROW(ReplayDriver(instanced, instanced.getBenchmarkCameras()[0], settings), std::runtime_error);
+	instanced.expandReferences();
+	ReplayDriver expanded(instanced, instanced.getBenchmarkCameras()[0], settings);
+	EXPECT_EQ(expanded.run()[0].visibleMeshes, 2);
+}
+
+TEST(TestSuite, Pvs)
+{
+	// wall at z = 5 for x < 25, small triangle behind the wall at x = 35, triangle behind the camera
+	const auto quad = [](glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d)
+	{
+		std::vector<float> vertices;
+		for (const auto& v : { a, b, c, d })
+			vertices.insert(vertices.end(), { v.x, v.y, v.z });
+		const std::vector<uint16_t> indices = { 0, 1, 2, 0, 2, 3 };
+		const std::vector<bmf::Shape> shapes = { bmf::Shape{0, 6, 0, 4, 0} };
+		return Mesh(bmf::BinaryMesh16(bmf::Position, vertices, indices, shapes));
+	};
+	std::vector<Mesh> meshes;
+	meshes.push_back(quad({ -100.0f, -100.0f, 5.0f }, { 25.0f, -100.0f, 5.0f }, { 25.0f, 100.0f, 5.0f }, { -100.0f, 100.0f, 5.0f }));
+	meshes.push_back(quad({ 35.0f, 0.0f, 10.0f }, { 36.0f, 0.0f, 10.0f }, { 36.0f, 1.0f, 10.0f }, { 35.0f, 1.0f, 10.0f }));
+	meshes.push_back(quad({ 0.0f, 0.0f, -5.0f }, { 1.0f, 0.0f, -5.0f }, { 1.0f, 1.0f, -5.0f }, { 0.0f, 1.0f, -5.0f }));
+	std::vector<Material> materials(1);
+	materials[0].name = "default";
+	materials[0].data = MaterialData::Default();
+
+	// camera moves from x = 0 to x = 40 in 4 seconds
+	Camera cam(CameraData::Default(), Path({ PathSection{4.0f, glm::vec3(40.0f, 0.0f, 0.0f)} }, 1.0f));
+	SceneFormat scene(std::move(meshes), cam, {}, materials, Environment::Default());
+
+	PvsSettings settings;
+	settings.cellDuration = 1.0f;
+	const auto pvs = Pvs::build(scene, settings);
+	ASSERT_EQ(pvs.getCellCount(), 4);
+	ASSERT_EQ(pvs.getEntries().size(), 3);
+
+	EXPECT_TRUE(pvs.isVisible(0, 0));
+	EXPECT_FALSE(pvs.isVisible(0, 1)); // occluded by the wall
+	EXPECT_TRUE(pvs.isVisible(0, 2));
+	EXPECT_EQ(pvs.getVisibleCount(0), 2);
+	EXPECT_TRUE(pvs.isVisible(3, 1)); // camera passed the wall
+	EXPECT_EQ(pvs.getVisibleCount(3), 3);
+
+	// lookup by time and path state
+	EXPECT_EQ(pvs.getCell(0.5f), 0);
+	EXPECT_EQ(pvs.getCell(3.5f), 3);
+	EXPECT_EQ(pvs.getCell(4.5f), 0); // path restarts
+	auto path = cam.positionPath;
+	path.update(2.5f);
+	EXPECT_EQ(pvs.getCell(path.getCursor()), 2);
+
+	// save and load
+	pvs.save("test.pvs");
+	const auto loaded = Pvs::load("test.pvs");
+	ASSERT_EQ(loaded.getCellCount(), pvs.getCellCount());
+	for (uint32_t c = 0; c < pvs.getCellCount(); ++c)
+		EXPECT_EQ(loaded.getBits(c)[0], pvs.getBits(c)[0]);
+
+	const auto cached = Pvs::loadOrBuild("test_pvs.json", scene, settings);
+	EXPECT_EQ(cached.getBits(3)[0], pvs.getBits(3)[0]);
+
+	// path duration that is not a multiple of the cell duration: the last cell is shorter
+	settings.cellDuration = 1.5f;
+	const auto partial = Pvs::build(scene, settings);
+	ASSERT_EQ(partial.getCellCount(), 3);
+	EXPECT_EQ(partial.getCell(3.9f), 2);
+	EXPECT_EQ(partial.getCell(4.2f), 0); // path restarts after 4 seconds
+	EXPECT_EQ(partial.getCell(5.6f), 1);
+	partial.save("test.pvs");
+	EXPECT_EQ(Pvs::load("test.pvs").getCell(4.2f), 0);
+
+	// same buffers split into more shapes => the cache is not reused
+	auto split = scene.getMeshes();
+	split[0] = Mesh(bmf::BinaryMesh16(bmf::Position, split[0].triangle.getVertices(), split[0].triangle.getIndices(),
+		{ bmf::Shape{0, 3, 0, 4, 0}, bmf::Shape{3, 3, 0, 4, 0} }));
+	const SceneFormat splitScene(std::move(split), cam, {}, materials, Environment::Default());
+	EXPECT_EQ(Pvs::loadOrBuild("test_pvs.json", splitScene, settings).getEntries().size(), 4);
+}
+
+TEST(TestSuite, PvsSubPixel)
+{
+	// tiny triangles far away in front of the camera (much smaller than a pixel) and behind a wall
+	const auto triangle = [](glm::vec3 a, float size)
+	{
+		std::vector<float> vertices;
+		for (const auto& v : { a, a + glm::vec3(size, 0.0f, 0.0f), a + glm::vec3(0.0f, size, 0.0f) })
+			vertices.insert(vertices.end(), { v.x, v.y, v.z });
+		const std::vector<uint16_t> indices = { 0, 1, 2 };
+		const std::vector<bmf::Shape> shapes = { bmf::Shape{0, 3, 0, 3, 0} };
+		return Mesh(bmf::BinaryMesh16(bmf::Position, vertices, indices, shapes));
+	};
+	std::vector<Mesh> meshes;
+	meshes.push_back(triangle({ 3.3f, 7.1f, -1000.0f }, 0.05f));
+	meshes.push_back(triangle({ 0.3f, 0.2f, 1000.0f }, 0.05f));
+	// wall at z = 5 in front of the second triangle
+	meshes.push_back(triangle({ -200.0f, -200.0f, 5.0f }, 600.0f));
+	std::vector<Material> materials(1);
+	materials[0].name = "default";
+	materials[0].data = MaterialData::Default();
+	SceneFormat scene(std::move(meshes), Camera(CameraData::Default()), {}, materials, Environment::Default());
+
+	PvsSettings settings;
+	settings.samplesPerCell = 1;
+	const auto pvs = Pvs::build(scene, settings);
+	ASSERT_EQ(pvs.getCellCount(), 1);
+	EXPECT_TRUE(pvs.isVisible(0, 0));
+	EXPECT_FALSE(pvs.isVisible(0, 1));
+	EXPECT_TRUE(pvs.isVisible(0, 2));
+}
@@ -0,0 +1,208 @@
+#include "pch.h"
+#include "../include/hrsf/HdrImage.h"
+#include "../include/hrsf/EnvironmentBake.h"
+#include "../include/hrsf/EnvironmentSampling.h"
+#include <fstream>
+
+#define TestSuite EnvironmentTest
+
+TEST(TestSuite, HdrSaveLoad)
+{
+	HdrImage img(64, 16);
+	for (size_t y = 0; y < img.height; ++y)
+		for (size_t x = 0; x < img.width; ++x)
+			img.at(x, y) = glm::vec3(float(x) * 0.25f, float(y < 8 ? 1.0f : 100.0f), 0.5f);
+
+	img.save("test.hdr");
+	auto res = HdrImage::load("test.hdr");
+	ASSERT_EQ(res.width, img.width);
+	ASSERT_EQ(res.height, img.height);
+	for (size_t i = 0; i < img.pixels.size(); ++i)
+	{
+		// rgbe has 8 bits of mantissa
+		const auto diff = glm::abs(res.pixels[i] - img.pixels[i]);
+		const float maxValue = std::max(img.pixels[i].x, std::max(img.pixels[i].y, img.pixels[i].z));
+		EXPECT_LE(std::max(diff.x, std::max(diff.y, diff.z)), maxValue / 128.0f);
+	}
+}
+
+TEST(TestSuite, HdrInvalidResolution)
+{
+	for (const char* resolution : { "-Y 4 +X 0", "-Y 0 +X 4", "-Y 100000000 +X 100000000" })
+	{
+		{
+			std::ofstream file("test_invalid.hdr", std::ios::binary);
+			file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n" << resolution << "\n";
+			file << std::string(64, '\x01');
+		}
+		EXPECT_THROW(HdrImage::load("test_invalid.hdr"), std::runtime_error);
+	}
+}
+
+TEST(TestSuite, EquirectMapping)
+{
+	const glm::vec3 dirs[] = { {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, -1.0f}, glm::normalize(glm::vec3(0.3f, 0.5f, -0.2f)) };
+	for (const auto& d : dirs)
+		EXPECT_VEC3_EQUAL(equirectToDirection(directionToEquirect(d)), d);
+	EXPECT_VEC3_EQUAL(equirectToDirection(glm::vec2(0.25f, 0.5f)), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+TEST(TestSuite, ShIrradiance)
+{
+	// uniform environment => irradiance is pi * radiance
+	HdrImage img(128, 64);
+	std::fill(img.pixels.begin(), img.pixels.end(), glm::vec3(1.0f, 0.5f, 0.25f));
+	auto sh = radianceToIrradianceSh(projectRadianceSh(img));
+	const float pi = 3.14159265f;
+	EXPECT_LE(glm::length(evalSh(sh, glm::vec3(0.0f, 1.0f, 0.0f)) - pi * glm::vec3(1.0f, 0.5f, 0.25f)), 0.01f);
+	EXPECT_LE(glm::length(evalSh(sh, glm::vec3(1.0f, 0.0f, 0.0f)) - pi * glm::vec3(1.0f, 0.5f, 0.25f)), 0.01f);
+
+	// bright sky => upward facing normals receive more light
+	for (size_t y = 0; y < img.height / 2; ++y)
+		for (size_t x = 0; x < img.width; ++x)
+			img.at(x, y) = glm::vec3(4.0f);
+	sh = radianceToIrradianceSh(projectRadianceSh(img));
+	EXPECT_GT(evalSh(sh, glm::vec3(0.0f, 1.0f, 0.0f)).x, evalSh(sh, glm::vec3(0.0f, -1.0f, 0.0f)).x);
+
+	// environment cache
+	img.save("test_env.hdr");
+	Environment env = Environment::Default();
+	env.map = "test_env.hdr";
+	EXPECT_FALSE(isAmbientIrradianceValid(env));
+	EXPECT_TRUE(updateAmbientIrradiance(env));
+	EXPECT_TRUE(isAmbientIrradianceValid(env));
+	EXPECT_FALSE(updateAmbientIrradiance(env));
+
+	SceneFormat::saveEnvironment("test_env", env);
+	auto res = SceneFormat::loadEnvironment("test_env");
+	EXPECT_EQ(res.ambientIrradianceKey, env.ambientIrradianceKey);
+	for (size_t i = 0; i < env.ambientIrradiance.size(); ++i)
+		EXPECT_VEC3_EQUAL(res.ambientIrradiance[i], env.ambientIrradiance[i]);
+}
+
+TEST(TestSuite, SamplingTables)
+{
+	HdrImage img(64, 32);
+	std::fill(img.pixels.begin(), img.pixels.end(), glm::vec3(0.1f));
+	img.at(10, 5) = glm::vec3(1000.0f); // bright sun
+	img.save("test_sampling.hdr");
+
+	auto t = EnvironmentSamplingTables::loadOrBuild("test_sampling.hdr");
+	ASSERT_EQ(t.marginalCdf.size(), 33);
+	ASSERT_EQ(t.conditionalCdf.size(), 65 * 32);
+	ASSERT_EQ(t.aliasTable.size(), 64 * 32);
+	EXPECT_EQ(t.marginalCdf.back(), 1.0f);
+
+	// pdf integrates to one over the sphere
+	double sum = 0.0;
+	for (size_t y = 0; y < img.height; ++y)
+		for (size_t x = 0; x < img.width; ++x)
+		{
+			const auto dir = equirectToDirection(glm::vec2((float(x) + 0.5f) / 64.0f, (float(y) + 0.5f) / 32.0f));
+			sum += double(t.getPdf(dir) * equirectPixelSolidAngle(y, 64, 32));
+		}
+	EXPECT_NEAR(sum, 1.0, 0.001);
+
+	// most samples should go to the sun for both methods
+	const auto sunDir = equirectToDirection(glm::vec2(10.5f / 64.0f, 5.5f / 32.0f));
+	int cdfHits = 0, aliasHits = 0;
+	for (int i = 0; i < 1000; ++i)
+	{
+		const glm::vec2 xi((float(i) + 0.5f) / 1000.0f, float((i * 7919) % 1000) / 1000.0f);
+		float pdf;
+		const auto d1 = t.sample(xi, pdf);
+		EXPECT_NEAR(pdf, t.getPdf(d1), pdf * 0.01f);
+		if (glm::dot(d1, sunDir) > 0.99f) ++cdfHits;
+		const auto d2 = t.sampleAlias(xi, pdf);
+		if (glm::dot(d2, sunDir) > 0.99f) ++aliasHits;
+	}
+	EXPECT_GT(cdfHits, 750); // the sun has ~80% of the energy
+	EXPECT_GT(aliasHits, 750);
+
+	// second call uses the cache file
+	auto cached = EnvironmentSamplingTables::loadOrBuild("test_sampling.hdr");
+	EXPECT_EQ(cached.conditionalCdf, t.conditionalCdf);
+	EXPECT_EQ(cached.integral, t.integral);
+}
+
+TEST(TestSuite, SpecularMips)
+{
+	HdrImage img(64, 32);
+	std::fill(img.pixels.begin(), img.pixels.end(), glm::vec3(0.5f));
+	img.at(20, 10) = glm::vec3(500.0f);
+	img.save("test_spec.hdr");
+
+	SpecularBakeSettings settings;
+	settings.levels = 4;
+	settings.sampleCount = 64;
+
+	const auto mips = prefilterSpecular(img, settings);
+	ASSERT_EQ(mips.size(), 4);
+	EXPECT_EQ(mips[1].width, 32);
+	EXPECT_EQ(mips[1].height, 16);
+	// the highlight gets blurred with increasing roughness
+	EXPECT_GT(mips[0].at(20, 10).x, mips[1].at(10, 5).x);
+	EXPECT_GT(mips[3].at(0, 0).x, 0.5f);
+
+	// deterministic
+	const auto mips2 = prefilterSpecular(img, settings);
+	EXPECT_EQ(mips2[2].pixels, mips[2].pixels);
+
+	Environment env = Environment::Default();
+	env.map = fs::absolute("test_spec.hdr");
+	EXPECT_TRUE(updateSpecularMips(env, settings));
+	EXPECT_TRUE(isSpecularMipsValid(env, settings));
+	EXPECT_FALSE(updateSpecularMips(env, settings));
+	settings.sampleCount = 32;
+	EXPECT_FALSE(isSpecularMipsValid(env, settings));
+
+	SceneFormat::saveEnvironment(fs::absolute("test_spec_env"), env);
+	auto res = SceneFormat::loadEnvironment("test_spec_env");
+	EXPECT_EQ(res.specularMipsKey, env.specularMipsKey);
+	ASSERT_EQ(res.specularMips.size(), env.specularMips.size());
+	EXPECT_EQ(fs::absolute(res.specularMips[3]), env.specularMips[3]);
+}
+
+TEST(TestSuite, CubeMap)
+{
+	// upper hemisphere red, lower hemisphere blue
+	HdrImage img(128, 64);
+	for (size_t y = 0; y < img.height; ++y)
+		for (size_t x = 0; x < img.width; ++x)
+			img.at(x, y) = y < 32 ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+	img.save("test_cube.hdr");
+
+	CubeMapSettings settings;
+	settings.faceSize = 16;
+	const auto faces = equirectToCubeMap(img, settings);
+	EXPECT_EQ(faces[0].width, 16);
+	EXPECT_VEC3_EQUAL(faces[2].at(8, 8), glm::vec3(1.0f, 0.0f, 0.0f)); // +y
+	EXPECT_VEC3_EQUAL(faces[3].at(8, 8), glm::vec3(0.0f, 0.0f, 1.0f)); // -y
+	EXPECT_VEC3_EQUAL(faces[4].at(8, 1), glm::vec3(1.0f, 0.0f, 0.0f)); // +z top row
+	EXPECT_VEC3_EQUAL(faces[4].at(8, 14), glm::vec3(0.0f, 0.0f, 1.0f)); // +z bottom row
+
+	for (size_t f = 0; f < 6; ++f)
+	{
+		const auto dir = cubeFaceToDirection(f, glm::vec2(0.5f));
+		EXPECT_FLOAT_EQ(std::max(std::abs(dir.x), std::max(std::abs(dir.y), std::abs(dir.z))), 1.0f);
+	}
+
+	Environment env = Environment::Default();
+	env.map = fs::absolute("test_cube.hdr");
+	updateCubeMap(env, settings, true);
+	EXPECT_TRUE(isCubeMapValid(env, settings));
+	ASSERT_EQ(env.cubeMap.size(), 6);
+
+	// a fresh environment picks up the cached faces
+	Environment env2 = Environment::Default();
+	env2.map = env.map;
+	EXPECT_TRUE(updateCubeMap(env2, settings));
+	EXPECT_EQ(env2.cubeMap, env.cubeMap);
+	EXPECT_FALSE(updateCubeMap(env2, settings));
+
+	SceneFormat::saveEnvironment(fs::absolute("test_cube_env"), env);
+	auto res = SceneFormat::loadEnvironment("test_cube_env");
+	EXPECT_EQ(res.cubeMapKey, env.cubeMapKey);
+	ASSERT_EQ(res.cubeMap.size(), 6);
+	EXPECT_EQ(HdrImage::load(res.cubeMap[2]).width, 16);
+}
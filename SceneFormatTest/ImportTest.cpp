@@ -0,0 +1,568 @@
+#include "pch.h"
+#include "../include/hrsf/Importer.h"
+#include "../include/hrsf/SceneWriter.h"
+#include <fstream>
+#include <map>
+
+#define TestSuite ImportTest
+
+namespace
+{
+	void writeText(const std::string& filename, const std::string& text)
+	{
+		std::ofstream file(filename, std::ios::binary);
+		file << text;
+	}
+
+	std::string toBase64(const std::vector<uint8_t>& data)
+	{
+		const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		std::string res;
+		for (size_t i = 0; i < data.size(); i += 3)
+		{
+			uint32_t bits = uint32_t(data[i]) << 16;
+			if (i + 1 < data.size()) bits |= uint32_t(data[i + 1]) << 8;
+			if (i + 2 < data.size()) bits |= data[i + 2];
+			res.push_back(chars[(bits >> 18) & 63]);
+			res.push_back(chars[(bits >> 12) & 63]);
+			res.push_back(i + 1 < data.size() ? chars[(bits >> 6) & 63] : '=');
+			res.push_back(i + 2 < data.size() ? chars[bits & 63] : '=');
+		}
+		return res;
+	}
+
+	template<class T>
+	void append(std::vector<uint8_t>& dst, const std::vector<T>& src)
+	{
+		const auto p = reinterpret_cast<const uint8_t*>(src.data());
+		dst.insert(dst.end(), p, p + src.size() * sizeof(T));
+	}
+
+	const char* s_obj =
+		"# test file\n"
+		"mtllib import_test.mtl\n"
+		"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+		"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+		"vn 0 0 1\n"
+		"f 1/1/1 2/2/1 3/3/1 4/4/1\n" // quad without material => default
+		"usemtl red\n"
+		"v 0 0 1\nv 1 0 1\nv 1 1 1\n"
+		"f -3 -2 -1\n" // relative indices, no normals
+		"usemtl glass\n"
+		"f 5//1 6//1 7//1\n"
+		"usemtl red\n"
+		"f 1 2 5\n";
+
+	const char* s_mtl =
+		"newmtl red\n"
+		"Kd 1 0 0\n"
+		"Ns 0\n"
+		"map_Kd textures/red.png\n"
+		"newmtl glass\n"
+		"Kd 0.5 0.5 0.5\n"
+		"d 0.25\n"
+		"Ni 1.5\n";
+}
+
+TEST(TestSuite, Obj)
+{
+	writeText("import_test.obj", s_obj);
+	writeText("import_test.mtl", s_mtl);
+
+	// tiny chunks => faces reference vertices and materials of previous chunks
+	for (size_t chunkSize : { size_t(1), size_t(32), size_t(1) << 20 })
+	{
+		ImportSettings settings;
+		settings.chunkSize = chunkSize;
+		const auto scene = importScene("import_test.obj", settings);
+
+		ASSERT_EQ(scene.getMaterials().size(), 3);
+		EXPECT_EQ(scene.getMaterials()[0].name, "red");
+		EXPECT_VEC3_EQUAL(scene.getMaterials()[0].data.albedo, glm::vec3(1.0f, 0.0f, 0.0f));
+		EXPECT_FLOAT_EQ(scene.getMaterials()[0].data.roughness, 1.0f);
+		EXPECT_EQ(scene.getMaterials()[0].textures.albedo, fs::absolute("textures/red.png"));
+		EXPECT_EQ(scene.getMaterials()[1].name, "glass");
+		EXPECT_FLOAT_EQ(scene.getMaterials()[1].data.coverage, 0.25f);
+		EXPECT_FLOAT_EQ(scene.getMaterials()[1].data.ior, 1.5f);
+		EXPECT_TRUE(scene.getMaterials()[1].data.flags & MaterialData::Transparent);
+		EXPECT_EQ(scene.getMaterials()[2].name, "default");
+
+		ASSERT_EQ(scene.getMeshes().size(), 1);
+		const auto& mesh = scene.getMeshes()[0].triangle;
+		EXPECT_NO_THROW(scene.verify());
+		EXPECT_EQ(mesh.getAttributes(), bmf::Position | bmf::Normal | bmf::Texcoord0);
+		ASSERT_EQ(mesh.getShapes().size(), 3);
+		// shapes are sorted by material
+		EXPECT_EQ(mesh.getShapes()[0].materialId, 0);
+		EXPECT_EQ(mesh.getShapes()[0].indexCount, 6); // 2 triangles
+		EXPECT_EQ(mesh.getShapes()[1].materialId, 1);
+		EXPECT_EQ(mesh.getShapes()[1].indexCount, 3);
+		EXPECT_EQ(mesh.getShapes()[2].materialId, 2);
+		EXPECT_EQ(mesh.getShapes()[2].indexCount, 6); // triangulated quad
+		EXPECT_EQ(mesh.getShapes()[2].vertexCount, 4);
+
+		// first triangle of the red shape: -3 -2 -1 => vertices 5 6 7 with a smooth normal of (0, 0, 1)
+		const auto& s = mesh.getShapes()[0];
+		const auto stride = bmf::getAttributeElementStride(mesh.getAttributes());
+		const auto normalOffset = bmf::getAttributeElementOffset(mesh.getAttributes(), bmf::Normal);
+		const float* v = mesh.getVertices().data() + (s.vertexOffset + mesh.getIndices()[s.indexOffset + 2]) * stride;
+		EXPECT_VEC3_EQUAL(glm::vec3(v[0], v[1], v[2]), glm::vec3(1.0f, 1.0f, 1.0f));
+		EXPECT_VEC3_EQUAL(glm::vec3(v[normalOffset], v[normalOffset + 1], v[normalOffset + 2]), glm::vec3(0.0f, 0.0f, 1.0f));
+	}
+}
+
+TEST(TestSuite, ObjShapeSplit)
+{
+	// 70000 unique vertices for a single material => 2 shapes
+	std::string obj;
+	const size_t triangles = 70000 / 3 + 1;
+	for (size_t i = 0; i < triangles * 3; ++i)
+		obj += "v " + std::to_string(i % 100) + " " + std::to_string(i / 100) + " 0\n";
+	for (size_t t = 0; t < triangles; ++t)
+		obj += "f " + std::to_string(t * 3 + 1) + " " + std::to_string(t * 3 + 2) + " " + std::to_string(t * 3 + 3) + "\n";
+	writeText("import_split.obj", obj);
+
+	ImportSettings settings;
+	settings.chunkSize = 64 * 1024;
+	const auto scene = importScene("import_split.obj", settings);
+	const auto& mesh = scene.getMeshes().at(0).triangle;
+	ASSERT_EQ(mesh.getShapes().size(), 2);
+	EXPECT_EQ(mesh.getShapes()[0].vertexCount, 65535);
+	EXPECT_EQ(mesh.getShapes()[1].vertexOffset, 65535);
+	EXPECT_EQ(mesh.getShapes()[0].indexCount + mesh.getShapes()[1].indexCount, triangles * 3);
+	EXPECT_EQ(mesh.getNumVertices(), triangles * 3);
+	EXPECT_NO_THROW(scene.verify());
+}
+
+TEST(TestSuite, Gltf)
+{
+	// one triangle with indices
+	std::vector<uint8_t> bin;
+	append(bin, std::vector<float>{ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f });
+	append(bin, std::vector<float>{ 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f });
+	append(bin, std::vector<uint16_t>{ 0, 1, 2, 0 }); // padded to 4 bytes
+
+	nlohmann::json j;
+	j["asset"]["version"] = "2.0";
+	j["scene"] = 0;
+	j["scenes"] = { { { "nodes", { 0, 2, 3 } } } };
+	j["nodes"] = {
+		{ { "mesh", 0 }, { "translation", { 10.0, 0.0, 0.0 } }, { "scale", { 2.0, 2.0, 2.0 } }, { "children", { 1 } } },
+		{ { "mesh", 0 }, { "translation", { 0.0, 5.0, 0.0 } } },
+		{ { "extensions", { { "KHR_lights_punctual", { { "light", 0 } } } } }, { "translation", { 1.0, 2.0, 3.0 } } },
+		{ { "camera", 0 }, { "translation", { 0.0, 0.0, 5.0 } } },
+	};
+	j["meshes"] = { { { "primitives", { { { "attributes", { { "POSITION", 0 }, { "NORMAL", 1 } } }, { "indices", 2 }, { "material", 0 } } } } } };
+	j["materials"] = { {
+		{ "name", "glass" },
+		{ "alphaMode", "BLEND" },
+		{ "pbrMetallicRoughness", { { "baseColorFactor", { 0.5, 0.25, 1.0, 0.5 } }, { "metallicFactor", 0.0 }, { "roughnessFactor", 0.3 } } },
+	} };
+	j["accessors"] = {
+		{ { "bufferView", 0 }, { "componentType", 5126 }, { "count", 3 }, { "type", "VEC3" } },
+		{ { "bufferView", 0 }, { "byteOffset", 36 }, { "componentType", 5126 }, { "count", 3 }, { "type", "VEC3" } },
+		{ { "bufferView", 1 }, { "componentType", 5123 }, { "count", 3 }, { "type", "SCALAR" } },
+	};
+	j["bufferViews"] = {
+		{ { "buffer", 0 }, { "byteOffset", 0 }, { "byteLength", 72 } },
+		{ { "buffer", 0 }, { "byteOffset", 72 }, { "byteLength", 6 } },
+	};
+	j["extensions"]["KHR_lights_punctual"]["lights"] = { { { "type", "point" }, { "color", { 1.0, 0.5, 0.0 } }, { "intensity", 2.0 } } };
+	j["cameras"] = { { { "type", "perspective" }, { "perspective", { { "yfov", 0.8 }, { "znear", 0.1 } } } } };
+
+	// embedded base64 buffer
+	auto gltf = j;
+	gltf["buffers"] = { { { "byteLength", bin.size() }, { "uri", "data:application/octet-stream;base64," + toBase64(bin) } } };
+	writeText("import_test.gltf", gltf.dump());
+
+	// glb with binary chunk
+	auto glb = j;
+	glb["buffers"] = { { { "byteLength", bin.size() } } };
+	auto jsonText = glb.dump();
+	while (jsonText.size() % 4) jsonText.push_back(' ');
+	std::vector<uint8_t> glbData;
+	const auto appendU32 = [&glbData](uint32_t v) { append(glbData, std::vector<uint32_t>{ v }); };
+	appendU32(0x46546C67);
+	appendU32(2);
+	appendU32(uint32_t(12 + 8 + jsonText.size() + 8 + bin.size()));
+	appendU32(uint32_t(jsonText.size()));
+	appendU32(0x4E4F534A);
+	glbData.insert(glbData.end(), jsonText.begin(), jsonText.end());
+	appendU32(uint32_t(bin.size()));
+	appendU32(0x004E4942);
+	glbData.insert(glbData.end(), bin.begin(), bin.end());
+	writeText("import_test.glb", std::string(glbData.begin(), glbData.end()));
+
+	for (const char* filename : { "import_test.gltf", "import_test.glb" })
+	{
+		const auto scene = importScene(filename);
+		EXPECT_NO_THROW(scene.verify());
+
+		ASSERT_EQ(scene.getMaterials().size(), 1);
+		const auto& mat = scene.getMaterials()[0];
+		EXPECT_EQ(mat.name, "glass");
+		EXPECT_VEC3_EQUAL(mat.data.albedo, glm::vec3(0.5f, 0.25f, 1.0f));
+		EXPECT_FLOAT_EQ(mat.data.coverage, 0.5f);
+		EXPECT_FLOAT_EQ(mat.data.roughness, 0.3f);
+		EXPECT_TRUE(mat.data.flags & MaterialData::Transparent);
+
+		// node 0 and its child
+		ASSERT_EQ(scene.getMeshes().size(), 2);
+		for (size_t m = 0; m < 2; ++m)
+		{
+			const auto& mesh = scene.getMeshes()[m].triangle;
+			ASSERT_EQ(mesh.getShapes().size(), 1);
+			EXPECT_EQ(mesh.getIndices().size(), 3);
+			const auto stride = bmf::getAttributeElementStride(mesh.getAttributes());
+			const float* v1 = mesh.getVertices().data() + mesh.getIndices()[1] * stride;
+			// parent: scale 2, translate 10. child: translate (0, 5, 0) in parent space
+			const auto expected = m == 0 ? glm::vec3(12.0f, 0.0f, 0.0f) : glm::vec3(12.0f, 10.0f, 0.0f);
+			EXPECT_VEC3_EQUAL(glm::vec3(v1[0], v1[1], v1[2]), expected);
+			EXPECT_VEC3_EQUAL(glm::vec3(v1[3], v1[4], v1[5]), glm::vec3(0.0f, 0.0f, 1.0f));
+		}
+
+		ASSERT_EQ(scene.getLights().size(), 1);
+		EXPECT_EQ(scene.getLights()[0].data.type, LightData::Point);
+		EXPECT_VEC3_EQUAL(scene.getLights()[0].data.position, glm::vec3(1.0f, 2.0f, 3.0f));
+		EXPECT_VEC3_EQUAL(scene.getLights()[0].data.color, glm::vec3(2.0f, 1.0f, 0.0f));
+
+		const auto& cam = scene.getCamera().data;
+		EXPECT_VEC3_EQUAL(cam.position, glm::vec3(0.0f, 0.0f, 5.0f));
+		EXPECT_VEC3_EQUAL(cam.direction, glm::vec3(0.0f, 0.0f, -1.0f));
+		EXPECT_FLOAT_EQ(cam.fov, 0.8f);
+		EXPECT_FLOAT_EQ(cam.near, 0.1f);
+	}
+}
+
+TEST(TestSuite, TexcoordConvention)
+{
+	// the same textured quad: the texture top (obj v = 1, gltf v = 0) is at y = 1
+	writeText("import_uv.obj",
+		"v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+		"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+		"vn 0 0 1\n"
+		"f 1/1/1 2/2/1 3/3/1 4/4/1\n");
+
+	std::vector<uint8_t> bin;
+	append(bin, std::vector<float>{ 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f });
+	append(bin, std::vector<float>{ 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f });
+	append(bin, std::vector<float>{ 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f, 0.0f });
+	append(bin, std::vector<uint16_t>{ 0, 1, 2, 0, 2, 3 });
+
+	nlohmann::json j;
+	j["asset"]["version"] = "2.0";
+	j["scene"] = 0;
+	j["scenes"] = { { { "nodes", { 0 } } } };
+	j["nodes"] = { { { "mesh", 0 } } };
+	j["meshes"] = { { { "primitives", { { { "attributes", { { "POSITION", 0 }, { "NORMAL", 1 }, { "TEXCOORD_0", 2 } } }, { "indices", 3 } } } } } };
+	j["accessors"] = {
+		{ { "bufferView", 0 }, { "componentType", 5126 }, { "count", 4 }, { "type", "VEC3" } },
+		{ { "bufferView", 0 }, { "byteOffset", 48 }, { "componentType", 5126 }, { "count", 4 }, { "type", "VEC3" } },
+		{ { "bufferView", 0 }, { "byteOffset", 96 }, { "componentType", 5126 }, { "count", 4 }, { "type", "VEC2" } },
+		{ { "bufferView", 1 }, { "componentType", 5123 }, { "count", 6 }, { "type", "SCALAR" } },
+	};
+	j["bufferViews"] = {
+		{ { "buffer", 0 }, { "byteOffset", 0 }, { "byteLength", 128 } },
+		{ { "buffer", 0 }, { "byteOffset", 128 }, { "byteLength", 12 } },
+	};
+	j["buffers"] = { { { "byteLength", bin.size() }, { "uri", "data:application/octet-stream;base64," + toBase64(bin) } } };
+	writeText("import_uv.gltf", j.dump());
+
+	// texcoord of every vertex by position
+	const auto getTexcoords = [](const char* filename)
+	{
+		const auto scene = importScene(filename);
+		std::map<std::pair<float, float>, glm::vec2> res;
+		if (scene.getMeshes().size() != 1) return res;
+		const auto& mesh = scene.getMeshes()[0].triangle;
+		const auto stride = bmf::getAttributeElementStride(mesh.getAttributes());
+		const auto offset = bmf::getAttributeElementOffset(mesh.getAttributes(), bmf::Texcoord0);
+		for (size_t v = 0; v < mesh.getNumVertices(); ++v)
+		{
+			const float* p = mesh.getVertices().data() + v * stride;
+			res[{ p[0], p[1] }] = glm::vec2(p[offset], p[offset + 1]);
+		}
+		return res;
+	};
+
+	const auto obj = getTexcoords("import_uv.obj");
+	const auto gltf = getTexcoords("import_uv.gltf");
+	ASSERT_EQ(obj.size(), 4);
+	ASSERT_EQ(gltf.size(), 4);
+	for (const auto& v : obj)
+	{
+		const auto& other = gltf.at(v.first);
+		EXPECT_FLOAT_EQ(v.second.x, other.x);
+		EXPECT_FLOAT_EQ(v.second.y, other.y);
+	}
+	EXPECT_FLOAT_EQ(obj.at({ 0.0f, 1.0f }).y, 0.0f);
+}
+
+TEST(TestSuite, SceneWriter)
+{
+	writeText("import_test.obj", s_obj);
+	writeText("import_test.mtl", s_mtl);
+
+	// streaming import into files
+	SceneWriter writer("import_written");
+	importScene("import_test.obj", writer);
+	EXPECT_EQ(writer.getMeshCount(), 1);
+	writer.finish();
+
+	const auto expected = importScene("import_test.obj");
+	const auto loaded = SceneFormat::load("import_written");
+	ASSERT_EQ(loaded.getMeshes().size(), 1);
+	EXPECT_EQ(loaded.getMeshes()[0].triangle.getVertices(), expected.getMeshes()[0].triangle.getVertices());
+	EXPECT_EQ(loaded.getMeshes()[0].triangle.getIndices(), expected.getMeshes()[0].triangle.getIndices());
+	ASSERT_EQ(loaded.getMaterials().size(), expected.getMaterials().size());
+	EXPECT_EQ(loaded.getMaterials()[1].name, "glass");
+	// mesh with a transparent material => same filename as SceneFormat::save
+	EXPECT_TRUE(fs::exists("import_writtenTrans.json"));
+}
+
+TEST(TestSuite, GlbExport)
+{
+	writeText("import_test.obj", s_obj);
+	writeText("import_test.mtl", s_mtl);
+	const auto imported = importScene("import_test.obj");
+
+	std::vector<Mesh> meshes = { imported.getMeshes()[0] };
+	meshes[0].position = Path({ { 2.0f, glm::vec3(1.0f, 0.0f, 0.0f) }, { 1.0f, glm::vec3(0.0f) } }, 1.0f);
+	auto camData = CameraData::Default();
+	camData.position = glm::vec3(0.0f, 1.0f, 5.0f);
+	camData.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+	Light light;
+	light.data.type = LightData::Point;
+	light.data.position = glm::vec3(1.0f, 2.0f, 3.0f);
+	light.data.color = glm::vec3(2.0f, 1.0f, 0.0f);
+	light.data.radius = 0.0f;
+	SceneFormat scene(std::move(meshes), Camera(camData), { light }, imported.getMaterials(), Environment());
+	scene.saveGlb("export_test.glb");
+
+	// the vertex view is the unmodified bmf vertex array
+	std::ifstream file("export_test.glb", std::ios::binary);
+	std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	ASSERT_GT(data.size(), 20);
+	uint32_t jsonLength;
+	std::memcpy(&jsonLength, data.data() + 12, 4);
+	const auto j = nlohmann::json::parse(data.begin() + 20, data.begin() + 20 + jsonLength);
+	const char* bin = data.data() + 20 + jsonLength + 8;
+	const auto& mesh = scene.getMeshes()[0].triangle;
+	const auto& vertexView = j["bufferViews"][0];
+	EXPECT_EQ(vertexView["byteStride"].get<size_t>(), bmf::getAttributeElementStride(mesh.getAttributes()) * sizeof(float));
+	ASSERT_EQ(vertexView["byteLength"].get<size_t>(), mesh.getVertices().size() * sizeof(float));
+	EXPECT_EQ(std::memcmp(bin + vertexView["byteOffset"].get<size_t>(), mesh.getVertices().data(), mesh.getVertices().size() * sizeof(float)), 0);
+
+	// path => cubic spline with one key per section and the end key
+	ASSERT_EQ(j["animations"].size(), 1);
+	const auto& sampler = j["animations"][0]["samplers"][0];
+	EXPECT_EQ(sampler["interpolation"], "CUBICSPLINE");
+	EXPECT_EQ(j["accessors"][sampler["input"].get<size_t>()]["count"], 3);
+	EXPECT_FLOAT_EQ(j["accessors"][sampler["input"].get<size_t>()]["max"][0].get<float>(), 3.0f);
+
+	const auto loaded = importScene("export_test.glb");
+	EXPECT_NO_THROW(loaded.verify());
+	ASSERT_EQ(loaded.getMeshes().size(), 1);
+	const auto& res = loaded.getMeshes()[0].triangle;
+	ASSERT_EQ(res.getShapes().size(), mesh.getShapes().size());
+	EXPECT_EQ(res.getIndices(), mesh.getIndices());
+	ASSERT_EQ(res.getVertices().size(), mesh.getVertices().size());
+	for (size_t i = 0; i < res.getVertices().size(); ++i)
+		EXPECT_NEAR(res.getVertices()[i], mesh.getVertices()[i], 1e-5f);
+
+	ASSERT_EQ(loaded.getMaterials().size(), scene.getMaterials().size());
+	for (size_t i = 0; i < loaded.getMaterials().size(); ++i)
+	{
+		const auto& expected = scene.getMaterials()[i];
+		const auto& mat = loaded.getMaterials()[i];
+		EXPECT_EQ(mat.name, expected.name);
+		EXPECT_VEC3_EQUAL(mat.data.albedo, expected.data.albedo);
+		EXPECT_FLOAT_EQ(mat.data.roughness, expected.data.roughness);
+		EXPECT_FLOAT_EQ(mat.data.ior, expected.data.ior);
+		EXPECT_EQ(mat.data.flags & MaterialData::Transparent, expected.data.flags & MaterialData::Transparent);
+		EXPECT_EQ(mat.textures.albedo.filename(), expected.textures.albedo.filename());
+	}
+
+	ASSERT_EQ(loaded.getLights().size(), 1);
+	EXPECT_VEC3_EQUAL(loaded.getLights()[0].data.position, light.data.position);
+	EXPECT_VEC3_EQUAL(loaded.getLights()[0].data.color, light.data.color);
+	EXPECT_VEC3_EQUAL(loaded.getCamera().data.position, camData.position);
+	EXPECT_VEC3_EQUAL(loaded.getCamera().data.direction, camData.direction);
+
+	// camera look at path => sampled rotation keys
+	const Camera turningCam(camData, {}, Path({ { 1.0f, glm::vec3(1.0f, 0.0f, 0.0f) }, { 1.0f, glm::vec3(0.0f, 0.0f, -1.0f) } }, 1.0f));
+	SceneFormat turning({ imported.getMeshes()[0] }, turningCam, {}, imported.getMaterials(), Environment());
+	turning.saveGlb("export_turn.glb");
+	std::ifstream turnFile("export_turn.glb", std::ios::binary);
+	std::vector<char> turnData((std::istreambuf_iterator<char>(turnFile)), std::istreambuf_iterator<char>());
+	std::memcpy(&jsonLength, turnData.data() + 12, 4);
+	const auto turnJson = nlohmann::json::parse(turnData.begin() + 20, turnData.begin() + 20 + jsonLength);
+	ASSERT_EQ(turnJson["animations"].size(), 1);
+	const auto& turnAnimation = turnJson["animations"][0];
+	EXPECT_EQ(turnAnimation["channels"][0]["target"]["path"], "rotation");
+	const auto& input = turnJson["accessors"][turnAnimation["samplers"][0]["input"].get<size_t>()];
+	EXPECT_EQ(input["count"], 33); // 16 keys per section and the end key
+	EXPECT_FLOAT_EQ(input["max"][0].get<float>(), 2.0f);
+	// the path starts at the last section => looking along -z is the identity rotation
+	const auto& output = turnJson["accessors"][turnAnimation["samplers"][0]["output"].get<size_t>()];
+	const auto& outputView = turnJson["bufferViews"][output["bufferView"].get<size_t>()];
+	float firstKey[4];
+	std::memcpy(firstKey, turnData.data() + 20 + jsonLength + 8 + outputView["byteOffset"].get<size_t>(), sizeof(firstKey));
+	EXPECT_NEAR(std::abs(firstKey[3]), 1.0f, 1e-5f);
+
+	// the mesh axis that faces the look at target is not defined
+	std::vector<Mesh> rotating = { imported.getMeshes()[0] };
+	rotating[0].lookAt = turningCam.lookAtPath;
+	SceneFormat rejected(std::move(rotating), Camera(camData), {}, imported.getMaterials(), Environment());
+	EXPECT_THROW(rejected.saveGlb("export_rejected.glb"), std::runtime_error);
+}
+
+TEST(TestSuite, PlyAscii)
+{
+	writeText("import_test.ply",
+		"ply\n"
+		"format ascii 1.0\n"
+		"comment test\n"
+		"element vertex 3\n"
+		"property float x\nproperty float y\nproperty float z\n"
+		"property float nx\nproperty float ny\nproperty float nz\n"
+		"property uchar red\nproperty uchar green\nproperty uchar blue\n"
+		"property float radius\n"
+		"element face 0\n"
+		"property list uchar int vertex_indices\n"
+		"end_header\n"
+		"0 0 0 0 0 1 255 0 0 0.5\n"
+		"1 2 3 0 1 0 0 0 255 0.25\n"
+		"-1 0 0 1 0 0 255 0 0 1\n");
+
+	const auto scene = importScene("import_test.ply");
+	EXPECT_NO_THROW(scene.verify());
+	ASSERT_EQ(scene.getMaterials().size(), 2); // red and blue
+	EXPECT_VEC3_EQUAL(scene.getMaterials()[0].data.albedo, glm::vec3(0.0f, 0.0f, 1.0f));
+	EXPECT_VEC3_EQUAL(scene.getMaterials()[1].data.albedo, glm::vec3(1.0f, 0.0f, 0.0f));
+
+	ASSERT_EQ(scene.getMeshes().size(), 1);
+	const auto& mesh = scene.getMeshes()[0];
+	EXPECT_EQ(mesh.type, Mesh::Billboard);
+	const auto attribs = mesh.billboard.getAttributes();
+	EXPECT_EQ(attribs, bmf::Position | bmf::Normal | bmf::Texcoord0 | bmf::Material);
+	EXPECT_EQ(mesh.billboard.getNumVertices(), 3);
+	EXPECT_EQ(mesh.billboard.getMaterialAttribBuffer(), std::vector<uint32_t>({ 1, 0, 1 }));
+
+	const auto stride = bmf::getAttributeElementStride(attribs);
+	const float* v = mesh.billboard.getVertices().data() + stride;
+	EXPECT_VEC3_EQUAL(glm::vec3(v[0], v[1], v[2]), glm::vec3(1.0f, 2.0f, 3.0f));
+	const auto n = bmf::getAttributeElementOffset(attribs, bmf::Normal);
+	EXPECT_VEC3_EQUAL(glm::vec3(v[n], v[n + 1], v[n + 2]), glm::vec3(0.0f, 1.0f, 0.0f));
+	EXPECT_FLOAT_EQ(v[bmf::getAttributeElementOffset(attribs, bmf::Texcoord0)], 0.25f);
+}
+
+TEST(TestSuite, PlyAsciiManyProperties)
+{
+	// the position comes after 70 unused properties
+	std::string header = "ply\nformat ascii 1.0\nelement vertex 2\n";
+	std::string line0, line1;
+	for (int i = 0; i < 70; ++i)
+	{
+		header += "property float extra" + std::to_string(i) + "\n";
+		line0 += "9 ";
+		line1 += "9 ";
+	}
+	header += "property float x\nproperty float y\nproperty float z\nend_header\n";
+	writeText("import_test.ply", header + line0 + "1 2 3\n" + line1 + "4 5 6\n");
+
+	const auto scene = importScene("import_test.ply");
+	ASSERT_EQ(scene.getMeshes().size(), 1);
+	const auto& mesh = scene.getMeshes()[0];
+	ASSERT_EQ(mesh.billboard.getNumVertices(), 2);
+	const auto stride = bmf::getAttributeElementStride(mesh.billboard.getAttributes());
+	const float* v = mesh.billboard.getVertices().data();
+	EXPECT_VEC3_EQUAL(glm::vec3(v[0], v[1], v[2]), glm::vec3(1.0f, 2.0f, 3.0f));
+	EXPECT_VEC3_EQUAL(glm::vec3(v[stride], v[stride + 1], v[stride + 2]), glm::vec3(4.0f, 5.0f, 6.0f));
+}
+
+TEST(TestSuite, PlyAsciiMalformed)
+{
+	const std::string header = "ply\nformat ascii 1.0\nelement vertex 2\nproperty float x\nproperty float y\nproperty float z\nend_header\n";
+	for (const char* second : { "4 5\n", "4 five 6\n" })
+	{
+		writeText("import_test.ply", header + "1 2 3\n" + second);
+		try
+		{
+			importScene("import_test.ply");
+			ADD_FAILURE() << "expected an exception for " << second;
+		}
+		catch (const std::runtime_error& e)
+		{
+			// the message names the line
+			EXPECT_NE(std::string(e.what()).find("line 9"), std::string::npos) << e.what();
+		}
+	}
+}
+
+TEST(TestSuite, PlyBinarySplit)
+{
+	// two clusters of 500 points each
+	const auto writePly = [](const char* filename, bool bigEndian)
+	{
+		std::string data = std::string("ply\nformat ") + (bigEndian ? "binary_big_endian" : "binary_little_endian")
+			+ " 1.0\nelement vertex 1000\nproperty float x\nproperty float y\nproperty float z\nproperty uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n";
+		for (int i = 0; i < 1000; ++i)
+		{
+			const float pos[3] = { float(i % 10) * 0.1f + (i < 500 ? -100.0f : 100.0f), float(i / 10 % 10) * 0.1f, float(i / 100) * 0.1f };
+			for (float f : pos)
+			{
+				char bytes[4];
+				memcpy(bytes, &f, 4);
+				if (bigEndian) std::reverse(bytes, bytes + 4);
+				data.append(bytes, 4);
+			}
+			const uint8_t color[3] = { uint8_t(i < 500 ? 255 : 0), 128, 0 };
+			data.append(reinterpret_cast<const char*>(color), 3);
+		}
+		writeText(filename, data);
+	};
+	writePly("import_le.ply", false);
+	writePly("import_be.ply", true);
+
+	PlySettings settings;
+	settings.chunkPoints = 64;
+	settings.maxPointsPerMesh = 100;
+	for (const char* filename : { "import_le.ply", "import_be.ply" })
+	{
+		SceneFormat scene;
+		{
+			struct Collector : ImportTarget
+			{
+				std::vector<Mesh> meshes;
+				std::vector<Material> materials;
+				void setMaterials(std::vector<Material> m) override { EXPECT_TRUE(meshes.empty()); materials = std::move(m); }
+				void addMesh(Mesh mesh) override { meshes.push_back(std::move(mesh)); }
+				void setLights(std::vector<Light>) override {}
+				void setCamera(Camera) override {}
+			} collector;
+			importPly(filename, collector, settings);
+			scene = SceneFormat(std::move(collector.meshes), Camera(CameraData::Default()), {}, std::move(collector.materials), Environment::Default());
+		}
+
+		EXPECT_NO_THROW(scene.verify());
+		EXPECT_EQ(scene.getMaterials().size(), 2);
+		EXPECT_GE(scene.getMeshes().size(), 10);
+		size_t total = 0;
+		for (const auto& m : scene.getMeshes())
+		{
+			const auto count = m.billboard.getNumVertices();
+			EXPECT_LE(count, settings.maxPointsPerMesh);
+			total += count;
+			// meshes do not mix clusters
+			const auto& verts = m.billboard.getVertices();
+			const auto stride = bmf::getAttributeElementStride(m.billboard.getAttributes());
+			for (size_t i = 0; i < count; ++i)
+			{
+				EXPECT_EQ(verts[i * stride] < 0.0f, verts[0] < 0.0f);
+				EXPECT_LE(std::abs(verts[i * stride + 1]), 1.0f);
+			}
+		}
+		EXPECT_EQ(total, 1000);
+	}
+}
@@ -0,0 +1,561 @@
+#include "pch.h"
+#include "../include/hrsf/LightBvh.h"
+#include "../include/hrsf/LightClusters.h"
+#include "../include/hrsf/LightInfluence.h"
+#include "../include/hrsf/ShadowCasters.h"
+#include "../include/hrsf/ShadowCascades.h"
+#include <algorithm>
+#include <random>
+
+#define TestSuite LightTest
+
+namespace
+{
+	std::vector<Light> getRandomLights(size_t count)
+	{
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> col(0.0f, 1.0f);
+		std::vector<Light> lights;
+		for (size_t i = 0; i < count; ++i)
+		{
+			lights.emplace_back(Light{ LightData::Point });
+			lights.back().data.position = glm::vec3(pos(rng), pos(rng), pos(rng));
+			lights.back().data.radius = 0.1f;
+			lights.back().data.color = glm::vec3(col(rng), col(rng), col(rng));
+		}
+		return lights;
+	}
+
+	bool contains(const LightBvhNode& node, const glm::vec3& p)
+	{
+		return p.x >= node.boundsMin.x && p.y >= node.boundsMin.y && p.z >= node.boundsMin.z &&
+			p.x <= node.boundsMax.x && p.y <= node.boundsMax.y && p.z <= node.boundsMax.z;
+	}
+
+	// checks that every light is referenced once and contained in all ancestor bounds
+	void verifyBvh(const LightBvh& bvh, const std::vector<Light>& lights)
+	{
+		std::vector<int> refCount(lights.size(), 0);
+		const auto& nodes = bvh.getNodes();
+		std::vector<std::pair<uint32_t, std::vector<uint32_t>>> stack = { {0u, {}} };
+		while (!stack.empty())
+		{
+			auto [cur, parents] = stack.back();
+			stack.pop_back();
+			parents.push_back(cur);
+			if (nodes[cur].isLeaf())
+			{
+				for (uint32_t i = nodes[cur].childOrFirst; i < nodes[cur].childOrFirst + nodes[cur].count; ++i)
+				{
+					const auto light = bvh.getLightIndices()[i];
+					++refCount[light];
+					for (auto p : parents)
+						EXPECT_TRUE(contains(nodes[p], lights[light].getPosition()));
+				}
+				continue;
+			}
+			stack.push_back({ cur + 1, parents });
+			stack.push_back({ nodes[cur].childOrFirst, parents });
+		}
+		for (size_t i = 0; i < lights.size(); ++i)
+			EXPECT_EQ(refCount[i], lights[i].data.type == LightData::Point ? 1 : 0);
+	}
+}
+
+TEST(TestSuite, LightBvhBuild)
+{
+	auto lights = getRandomLights(5000);
+	lights.emplace_back(Light{ LightData::Directional });
+	lights.back().data.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	lights.back().data.color = glm::vec3(1.0f);
+
+	LightBvh bvh(lights);
+	EXPECT_EQ(bvh.getInfiniteLights().size(), 1);
+	EXPECT_EQ(bvh.getLightIndices().size(), 5000);
+	verifyBvh(bvh, lights);
+
+	// refit after movement
+	for (auto& l : lights)
+		if (l.data.type == LightData::Point)
+			l.data.position *= 2.0f;
+	bvh.refit(lights);
+	verifyBvh(bvh, lights);
+
+	// serialization
+	bvh.save("test_lights.bvh");
+	auto res = LightBvh::load("test_lights.bvh");
+	ASSERT_EQ(res.getNodes().size(), bvh.getNodes().size());
+	EXPECT_EQ(std::memcmp(res.getNodes().data(), bvh.getNodes().data(), bvh.getNodes().size() * sizeof(LightBvhNode)), 0);
+	EXPECT_EQ(res.getLightIndices(), bvh.getLightIndices());
+}
+
+TEST(TestSuite, LightBvhSample)
+{
+	auto lights = getRandomLights(64);
+	LightBvh bvh(lights);
+
+	const glm::vec3 position(10.0f, 0.0f, -20.0f);
+	const int numSamples = 200000;
+	std::vector<int> histogram(lights.size(), 0);
+	std::vector<float> pmfs(lights.size(), 0.0f);
+	for (int i = 0; i < numSamples; ++i)
+	{
+		float pmf;
+		const auto light = bvh.sample(position, (float(i) + 0.5f) / float(numSamples), pmf);
+		ASSERT_LT(light, lights.size());
+		ASSERT_GT(pmf, 0.0f);
+		++histogram[light];
+		pmfs[light] = pmf;
+	}
+
+	// sampling frequency matches the returned probabilities
+	float pmfSum = 0.0f;
+	for (size_t i = 0; i < lights.size(); ++i)
+	{
+		pmfSum += pmfs[i];
+		EXPECT_NEAR(float(histogram[i]) / float(numSamples), pmfs[i], 0.002f);
+	}
+	EXPECT_NEAR(pmfSum, 1.0f, 0.001f);
+}
+
+namespace
+{
+	bool clusterContains(const LightClusterGrid& grid, uint32_t cluster, uint32_t light)
+	{
+		const auto& offsets = grid.getOffsets();
+		const auto& indices = grid.getLightIndices();
+		return std::find(indices.begin() + offsets[cluster], indices.begin() + offsets[cluster + 1], light) != indices.begin() + offsets[cluster + 1];
+	}
+}
+
+TEST(TestSuite, LightClusters)
+{
+	auto camera = CameraData::Default();
+	camera.near = 0.1f;
+	camera.far = 1000.0f;
+	LightClusterSettings settings;
+
+	// light in the screen center, one behind the camera and a directional light
+	std::vector<Light> lights(3, Light{ LightData::Point });
+	lights[0].data.position = glm::vec3(0.0f, 0.0f, 50.0f);
+	lights[0].data.color = glm::vec3(0.01f);
+	lights[1].data.position = glm::vec3(0.0f, 0.0f, -50.0f);
+	lights[1].data.color = glm::vec3(0.01f);
+	lights[2].data.type = LightData::Directional;
+
+	LightClusterGrid grid;
+	grid.build(camera, lights, settings);
+	ASSERT_EQ(grid.getClusterCount(), settings.tilesX * settings.tilesY * settings.slices);
+	ASSERT_EQ(grid.getOffsets().back(), grid.getLightIndices().size());
+
+	const auto slice = grid.getSlice(50.0f);
+	EXPECT_LE(grid.getSliceDepth(slice), 50.0f);
+	EXPECT_GT(grid.getSliceDepth(slice + 1), 50.0f);
+	EXPECT_TRUE(clusterContains(grid, grid.getClusterIndex(settings.tilesX / 2, settings.tilesY / 2, slice), 0));
+	for (uint32_t l : grid.getLightIndices())
+		EXPECT_EQ(l, 0);
+
+	// every light inside the frustum is assigned to the cluster of its center
+	lights = getRandomLights(2000);
+	grid.build(camera, lights, settings);
+	const float tanY = std::tan(camera.fov * 0.5f);
+	const float tanX = tanY * float(settings.width) / float(settings.height);
+	size_t visible = 0;
+	for (uint32_t i = 0; i < uint32_t(lights.size()); ++i)
+	{
+		// default camera looks along +z with +y up => view space x points to -x
+		const auto p = lights[i].getPosition();
+		if (p.z <= camera.near) continue;
+		const float ndcX = -p.x / (p.z * tanX);
+		const float ndcY = p.y / (p.z * tanY);
+		if (std::abs(ndcX) >= 1.0f || std::abs(ndcY) >= 1.0f) continue;
+		const auto tileX = uint32_t((ndcX * 0.5f + 0.5f) * float(settings.tilesX));
+		const auto tileY = uint32_t((0.5f - ndcY * 0.5f) * float(settings.tilesY));
+		EXPECT_TRUE(clusterContains(grid, grid.getClusterIndex(tileX, tileY, grid.getSlice(p.z)), i));
+		++visible;
+	}
+	EXPECT_GT(visible, 0);
+
+	// rebuild reuses the buffers and gives the same result
+	const auto indices = grid.getLightIndices();
+	grid.build(camera, lights, settings);
+	EXPECT_EQ(indices, grid.getLightIndices());
+
+	// looking along the up vector
+	camera.direction = camera.up;
+	lights.assign(1, Light{ LightData::Point });
+	lights[0].data.position = 50.0f * camera.up;
+	lights[0].data.color = glm::vec3(0.01f);
+	grid.build(camera, lights, settings);
+	EXPECT_TRUE(clusterContains(grid, grid.getClusterIndex(settings.tilesX / 2, settings.tilesY / 2, grid.getSlice(50.0f)), 0));
+}
+
+TEST(TestSuite, LightsDataLayout)
+{
+	std::vector<Light> lights(2, Light{ LightData::Point });
+	lights[0].data.position = glm::vec3(1.0f, 2.0f, 3.0f);
+	lights[0].data.color = glm::vec3(0.5f, 0.25f, 0.125f);
+	lights[0].data.radius = 0.5f;
+	lights[1].data.type = LightData::Directional;
+	lights[1].data.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	lights[1].data.color = glm::vec3(1.0f);
+	// moving light
+	lights[0].path = Path({ PathSection{1.0f, glm::vec3(1.0f, 0.0f, 0.0f)} }, 1.0f);
+
+	SceneFormat f({}, Camera{ CameraData::Default() }, lights, {}, Environment{ Environment::Default() });
+
+	// std430: vec3 members start at 16 byte boundaries
+	std::vector<uint8_t> buffer(lights.size() * getLightStride(BufferLayout::Std430));
+	EXPECT_EQ(f.getLightsData(buffer.data(), BufferLayout::Std430), 2);
+	glm::vec3 position, color;
+	int type;
+	float radius;
+	std::memcpy(&type, buffer.data(), sizeof(type));
+	std::memcpy(&position, buffer.data() + 16, sizeof(position));
+	std::memcpy(&color, buffer.data() + 32, sizeof(color));
+	std::memcpy(&radius, buffer.data() + 44, sizeof(radius));
+	EXPECT_EQ(type, LightData::Point);
+	EXPECT_VEC3_EQUAL(position, lights[0].data.position);
+	EXPECT_VEC3_EQUAL(color, lights[0].data.color);
+	EXPECT_EQ(radius, 0.5f);
+	std::memcpy(&type, buffer.data() + 48, sizeof(type));
+	EXPECT_EQ(type, LightData::Directional);
+
+	// a new state writes everything, then nothing moved
+	LightExportState state;
+	EXPECT_EQ(f.getLightsData(buffer.data(), BufferLayout::Std430, state), 2);
+	EXPECT_EQ(f.getLightsData(buffer.data(), BufferLayout::Std430, state), 0);
+
+	// only the first light follows a path
+	f.update(0.5f);
+	std::fill(buffer.begin(), buffer.end(), uint8_t(0));
+	EXPECT_EQ(f.getLightsData(buffer.data(), BufferLayout::Std430, state), 1);
+	std::memcpy(&position, buffer.data() + 16, sizeof(position));
+	EXPECT_VEC3_EQUAL(position, glm::vec3(1.5f, 2.0f, 3.0f));
+	std::memcpy(&type, buffer.data() + 48, sizeof(type));
+	EXPECT_EQ(type, 0); // untouched
+
+	// a second buffer (frame in flight) has its own state => it receives the changes as well
+	std::vector<uint8_t> buffer2(buffer.size());
+	LightExportState state2;
+	EXPECT_EQ(f.getLightsData(buffer2.data(), BufferLayout::Std430, state2), 2);
+	f.update(0.25f);
+	EXPECT_EQ(f.getLightsData(buffer.data(), BufferLayout::Std430, state), 1);
+	EXPECT_EQ(f.getLightsData(buffer2.data(), BufferLayout::Std430, state2), 1);
+	EXPECT_EQ(std::memcmp(buffer.data() + 16, buffer2.data() + 16, sizeof(glm::vec3)), 0);
+
+	// scalar layout matches LightData
+	buffer.resize(lights.size() * getLightStride(BufferLayout::Scalar));
+	EXPECT_EQ(f.getLightsData(buffer.data(), BufferLayout::Scalar, state), 2);
+	const auto data = f.getLightsData();
+	EXPECT_EQ(std::memcmp(buffer.data(), data.data(), buffer.size()), 0);
+}
+
+TEST(TestSuite, LightInfluence)
+{
+	auto lights = getRandomLights(1001);
+	lights[0].path = Path({ PathSection{1.0f, glm::vec3(10.0f, 0.0f, 0.0f)} }, 1.0f);
+	lights.emplace_back(Light{ LightData::Directional });
+	lights.back().data.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	lights.back().data.color = glm::vec3(1.0f);
+
+	LightInfluence influence(0.01f);
+	influence.update(lights);
+	ASSERT_EQ(influence.size(), lights.size());
+	ASSERT_EQ(influence.getAnimatedLights().size(), 1);
+	EXPECT_TRUE(std::isinf(influence.getRanges().back()));
+
+	float importanceSum = 0.0f;
+	for (float i : influence.getImportance())
+		importanceSum += i;
+	EXPECT_NEAR(importanceSum, 1.0f, 0.001f);
+	{
+		// point lights (at distance 1) and directional lights are ranked by their irradiance
+		std::vector<Light> mixed(2, Light{ LightData::Point });
+		mixed[0].data.color = glm::vec3(1.0f);
+		mixed[1].data.type = LightData::Directional;
+		mixed[1].data.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+		mixed[1].data.color = glm::vec3(1.0f);
+		LightInfluence mixedInfluence;
+		mixedInfluence.update(mixed);
+		EXPECT_FLOAT_EQ(mixedInfluence.getImportance()[0], 0.5f);
+		EXPECT_FLOAT_EQ(mixedInfluence.getImportance()[1], 0.5f);
+	}
+
+	// intensity at the range equals the cutoff
+	const auto& d = lights[1].data;
+	const float range = influence.getRanges()[1] - d.radius;
+	EXPECT_NEAR(std::max(d.color.x, std::max(d.color.y, d.color.z)) / (range * range), 0.01f, 1e-5f);
+
+	// animated light follows its path
+	lights[0].path.update(0.5f);
+	influence.update(lights);
+	EXPECT_FLOAT_EQ(influence.getX()[0], lights[0].getPosition().x);
+
+	// culling matches a brute force test
+	const glm::vec3 center(5.0f, -3.0f, 20.0f);
+	std::vector<uint32_t> culled;
+	influence.cull(center, 15.0f, culled);
+	std::vector<uint32_t> expected;
+	for (uint32_t i = 0; i < uint32_t(lights.size()); ++i)
+	{
+		const float r = influence.getRanges()[i] + 15.0f;
+		const glm::vec3 p(influence.getX()[i], influence.getY()[i], influence.getZ()[i]);
+		const glm::vec3 diff = p - center;
+		if (glm::dot(diff, diff) <= r * r) expected.push_back(i);
+	}
+	EXPECT_EQ(culled, expected);
+	EXPECT_EQ(culled.back(), lights.size() - 1); // directional light is never culled
+
+	// prioritization is sorted
+	std::vector<uint32_t> important;
+	influence.getMostImportant(center, 8, important);
+	ASSERT_GE(important.size(), 2);
+	ASSERT_LE(important.size(), 8);
+	for (size_t i = 1; i < important.size(); ++i)
+	{
+		const auto weight = [&](uint32_t l)
+		{
+			if (std::isinf(influence.getRanges()[l])) return influence.getLuminances()[l];
+			const glm::vec3 diff = glm::vec3(influence.getX()[l], influence.getY()[l], influence.getZ()[l]) - center;
+			return influence.getLuminances()[l] / std::max(glm::dot(diff, diff), 1e-4f);
+		};
+		EXPECT_GE(weight(important[i - 1]), weight(important[i]));
+	}
+
+	// point and directional lights are ranked by their irradiance at the position
+	std::vector<Light> mixed(2, Light{ LightData::Point });
+	mixed[0].data.type = LightData::Directional;
+	mixed[0].data.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	mixed[0].data.color = glm::vec3(1.0f);
+	mixed[1].data.position = glm::vec3(0.0f);
+	mixed[1].data.color = glm::vec3(0.5f);
+	mixed[1].data.radius = 0.0f;
+	influence.update(mixed);
+	important.clear();
+	influence.getMostImportant(glm::vec3(1.0f, 0.0f, 0.0f), 2, important); // point irradiance 0.5
+	EXPECT_EQ(important, std::vector<uint32_t>({ 0, 1 }));
+	important.clear();
+	influence.getMostImportant(glm::vec3(0.5f, 0.0f, 0.0f), 2, important); // point irradiance 2
+	EXPECT_EQ(important, std::vector<uint32_t>({ 1, 0 }));
+}
+
+namespace
+{
+	// one triangle shape per position
+	Mesh getTriangleMesh(const std::vector<glm::vec3>& positions)
+	{
+		std::vector<float> vertices;
+		std::vector<uint16_t> indices;
+		std::vector<bmf::Shape> shapes;
+		for (const auto& p : positions)
+		{
+			const auto first = uint32_t(vertices.size() / 3);
+			for (const auto& v : { p, p + glm::vec3(1.0f, 0.0f, 0.0f), p + glm::vec3(0.0f, 1.0f, 0.0f) })
+			{
+				vertices.push_back(v.x);
+				vertices.push_back(v.y);
+				vertices.push_back(v.z);
+			}
+			shapes.push_back(bmf::Shape{ uint32_t(indices.size()), 3, first, 3, 0 });
+			indices.insert(indices.end(), { 0, 1, 2 });
+		}
+		return Mesh(bmf::BinaryMesh16(bmf::Position, vertices, indices, shapes));
+	}
+
+	std::vector<ShadowCaster> getExpectedCasters(const std::vector<Mesh>& meshes, const LightInfluence& influence, size_t light)
+	{
+		std::vector<ShadowCaster> res;
+		const glm::vec3 center(influence.getX()[light], influence.getY()[light], influence.getZ()[light]);
+		for (uint32_t m = 0; m < uint32_t(meshes.size()); ++m)
+		{
+			const auto bounds = getShapeBounds(meshes[m]);
+			for (uint32_t s = 0; s < uint32_t(bounds.size()); ++s)
+				if (getWorldBounds(meshes[m], bounds[s]).intersectsSphere(center, influence.getRanges()[light]))
+					res.push_back({ m, s });
+		}
+		return res;
+	}
+
+	void verifyCasters(const ShadowCasterLists& lists, const std::vector<Mesh>& meshes, const LightInfluence& influence)
+	{
+		ASSERT_EQ(lists.getLightCount(), influence.size());
+		for (size_t l = 0; l < influence.size(); ++l)
+		{
+			const auto expected = getExpectedCasters(meshes, influence, l);
+			const auto& casters = lists.getCasters(l);
+			ASSERT_EQ(casters.size(), expected.size());
+			for (size_t i = 0; i < casters.size(); ++i)
+			{
+				EXPECT_EQ(casters[i].mesh, expected[i].mesh);
+				EXPECT_EQ(casters[i].shape, expected[i].shape);
+			}
+		}
+	}
+}
+
+TEST(TestSuite, ShadowCasters)
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+	std::vector<Mesh> meshes;
+	std::vector<std::vector<glm::vec3>> meshPositions(3);
+	for (auto& positions : meshPositions)
+	{
+		for (int i = 0; i < 300; ++i)
+			positions.emplace_back(pos(rng), pos(rng), pos(rng));
+		meshes.push_back(getTriangleMesh(positions));
+	}
+
+	auto lights = getRandomLights(200);
+	for (auto& l : lights)
+		l.data.color *= 50.0f; // larger ranges
+	lights.emplace_back(Light{ LightData::Directional });
+	lights.back().data.color = glm::vec3(1.0f);
+
+	LightInfluence influence;
+	influence.update(lights);
+
+	// static scene: cached on disk
+	const std::filesystem::path sceneFile = "test_casters.json";
+	auto lists = ShadowCasterLists::loadOrBuild(sceneFile, meshes, influence);
+	EXPECT_TRUE(lists.isStatic());
+	verifyCasters(lists, meshes, influence);
+	EXPECT_EQ(lists.getCasters(lights.size() - 1).size(), 900); // directional light
+	auto cached = ShadowCasterLists::loadOrBuild(sceneFile, meshes, influence);
+	verifyCasters(cached, meshes, influence);
+
+	// scene with mesh files: cache next to the scene
+	{
+		std::vector<Material> materials(1);
+		materials[0].name = "default";
+		materials[0].data = MaterialData::Default();
+		SceneFormat(meshes, Camera(CameraData::Default()), lights, materials, Environment::Default()).save("test_casters_scene", false);
+		const auto scene = SceneFormat::load("test_casters_scene");
+		auto fromFiles = ShadowCasterLists::loadOrBuild("test_casters_scene.json", scene.getMeshes(), influence);
+		verifyCasters(fromFiles, scene.getMeshes(), influence);
+		auto fromCache = ShadowCasterLists::loadOrBuild("test_casters_scene.json", scene.getMeshes(), influence);
+		verifyCasters(fromCache, scene.getMeshes(), influence);
+
+		// the bounds of cached lists are computed by the first update
+		auto movedLights = lights;
+		movedLights[0].data.position += glm::vec3(30.0f, 0.0f, 0.0f);
+		LightInfluence movedInfluence;
+		movedInfluence.update(movedLights);
+		EXPECT_TRUE(fromCache.update(scene.getMeshes(), movedInfluence));
+		verifyCasters(fromCache, scene.getMeshes(), movedInfluence);
+
+		// moving shapes keeps the mesh bounds and counts (and the mesh json) => the lists must be rebuilt
+		auto swapped = meshPositions;
+		for (auto& positions : swapped)
+			std::reverse(positions.begin(), positions.end());
+		std::vector<Mesh> swappedMeshes;
+		for (const auto& positions : swapped)
+			swappedMeshes.push_back(getTriangleMesh(positions));
+		auto fromMemory = ShadowCasterLists::loadOrBuild("test_casters_scene.json", swappedMeshes, influence);
+		verifyCasters(fromMemory, swappedMeshes, influence);
+
+		SceneFormat(swappedMeshes, Camera(CameraData::Default()), lights, materials, Environment::Default()).save("test_casters_scene", false);
+		const auto swappedScene = SceneFormat::load("test_casters_scene");
+		auto rebuilt = ShadowCasterLists::loadOrBuild("test_casters_scene.json", swappedScene.getMeshes(), influence);
+		verifyCasters(rebuilt, swappedScene.getMeshes(), influence);
+		bool changed = false;
+		for (size_t l = 0; l < influence.size(); ++l)
+			changed = changed || rebuilt.getCasters(l).size() != fromFiles.getCasters(l).size() ||
+				!std::equal(rebuilt.getCasters(l).begin(), rebuilt.getCasters(l).end(), fromFiles.getCasters(l).begin(),
+					[](const ShadowCaster& a, const ShadowCaster& b) { return a.mesh == b.mesh && a.shape == b.shape; });
+		EXPECT_TRUE(changed);
+	}
+
+	// animated mesh and light
+	meshes[1].position = Path({ PathSection{1.0f, glm::vec3(50.0f, 0.0f, 0.0f)} }, 1.0f);
+	lights[3].path = Path({ PathSection{1.0f, glm::vec3(0.0f, 0.0f, -80.0f)} }, 1.0f);
+	influence.invalidate();
+	influence.update(lights);
+	lists.build(meshes, influence);
+	EXPECT_FALSE(lists.isStatic());
+	verifyCasters(lists, meshes, influence);
+
+	meshes[1].position.update(0.5f);
+	lights[3].path.update(0.5f);
+	influence.update(lights);
+	EXPECT_TRUE(lists.update(meshes, influence));
+	verifyCasters(lists, meshes, influence);
+}
+
+TEST(TestSuite, ShadowCascades)
+{
+	auto camera = CameraData::Default(); // far = 100000
+	camera.position = glm::vec3(0.0f, 5.0f, -40.0f);
+	LightData sun = Light{ LightData::Directional }.data;
+	sun.direction = glm::normalize(glm::vec3(0.3f, -1.0f, 0.2f));
+	const BoundingBox scene = { glm::vec3(-50.0f, 0.0f, -50.0f), glm::vec3(50.0f, 20.0f, 50.0f) };
+	CascadeSettings settings;
+
+	ShadowCascades res;
+	fitShadowCascades(camera, sun, scene, settings, res);
+	ASSERT_EQ(res.cascades.size(), settings.cascadeCount);
+	EXPECT_FLOAT_EQ(res.cascades.front().nearDepth, camera.near);
+	// far plane is clipped to the scene (farthest corner is 90 units away)
+	EXPECT_LT(res.cascades.back().farDepth, 100.0f);
+	EXPECT_GE(res.cascades.back().farDepth, 90.0f);
+	for (size_t i = 0; i < res.cascades.size(); ++i)
+	{
+		const auto& c = res.cascades[i];
+		EXPECT_LT(c.nearDepth, c.farDepth);
+		if (i > 0)
+		{
+			EXPECT_FLOAT_EQ(c.nearDepth, res.cascades[i - 1].farDepth);
+		}
+		EXPECT_LE(c.lightMin.x, c.lightMax.x);
+		EXPECT_LE(c.lightMin.z, c.lightMax.z);
+		// snapped to texels
+		EXPECT_NEAR(c.lightMin.x / c.texelSize, std::round(c.lightMin.x / c.texelSize), 1e-3f);
+		EXPECT_NEAR(c.lightMax.y / c.texelSize, std::round(c.lightMax.y / c.texelSize), 1e-3f);
+	}
+	EXPECT_FLOAT_EQ(glm::length(res.right), 1.0f);
+	EXPECT_NEAR(glm::dot(res.right, res.forward), 0.0f, 1e-5f);
+
+	// small camera movement keeps the texel size and moves the bounds in whole texels
+	auto moved = res;
+	camera.position.x += 0.01f;
+	fitShadowCascades(camera, sun, scene, settings, moved);
+	for (size_t i = 0; i < res.cascades.size(); ++i)
+	{
+		EXPECT_FLOAT_EQ(moved.cascades[i].texelSize, res.cascades[i].texelSize);
+		const float shift = (moved.cascades[i].lightMin.x - res.cascades[i].lightMin.x) / res.cascades[i].texelSize;
+		EXPECT_NEAR(shift, std::round(shift), 1e-2f);
+	}
+
+	// the extent matches the shadow map resolution while the camera moves (also close to the scene border)
+	for (int step = 0; step < 20; ++step)
+	{
+		camera.position += glm::vec3(2.37f, 0.0f, 4.53f);
+		fitShadowCascades(camera, sun, scene, settings, moved);
+		for (const auto& c : moved.cascades)
+		{
+			EXPECT_NEAR((c.lightMax.x - c.lightMin.x) / float(settings.resolution), c.texelSize, c.texelSize * 1e-3f);
+			EXPECT_NEAR((c.lightMax.y - c.lightMin.y) / float(settings.resolution), c.texelSize, c.texelSize * 1e-3f);
+		}
+	}
+
+	// top-down camera (direction parallel to up)
+	auto topDown = CameraData::Default();
+	topDown.position = glm::vec3(0.0f, 60.0f, 0.0f);
+	topDown.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+	topDown.up = glm::vec3(0.0f, 1.0f, 0.0f);
+	fitShadowCascades(topDown, sun, scene, settings, moved);
+	ASSERT_EQ(moved.cascades.size(), settings.cascadeCount);
+	for (const auto& c : moved.cascades)
+	{
+		EXPECT_FALSE(std::isnan(c.farDepth));
+		EXPECT_FALSE(std::isnan(c.lightMin.x) || std::isnan(c.lightMin.y) || std::isnan(c.lightMin.z));
+		EXPECT_FALSE(std::isnan(c.lightMax.x) || std::isnan(c.lightMax.y) || std::isnan(c.lightMax.z));
+		EXPECT_LT(c.lightMin.x, c.lightMax.x);
+		EXPECT_LT(c.lightMin.y, c.lightMax.y);
+	}
+
+	// other light types are rejected
+	EXPECT_THROW(fitShadowCascades(camera, Light{ LightData::Point }.data, scene, settings, res), std::runtime_error);
+}
@@ -0,0 +1,158 @@
+#include "pch.h"
+#include "AllocationCounter.h"
+#include <cstdlib>
+#include <new>
+
+// replace the global allocation functions => every block stores its size in a header
+namespace
+{
+	constexpr size_t s_header = alignof(std::max_align_t) > sizeof(size_t) ? alignof(std::max_align_t) : sizeof(size_t);
+
+	void* allocate(size_t size)
+	{
+		auto p = static_cast<char*>(std::malloc(size + s_header));
+		if (!p) throw std::bad_alloc();
+		*reinterpret_cast<size_t*>(p) = size;
+		alloc::onAllocate(size);
+		return p + s_header;
+	}
+
+	void release(void* ptr)
+	{
+		if (!ptr) return;
+		auto p = static_cast<char*>(ptr) - s_header;
+		alloc::onFree(*reinterpret_cast<size_t*>(p));
+		std::free(p);
+	}
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	try { return allocate(size); }
+	catch (...) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	try { return allocate(size); }
+	catch (...) { return nullptr; }
+}
+void operator delete(void* ptr) noexcept { release(ptr); }
+void operator delete[](void* ptr) noexcept { release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { release(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { release(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { release(ptr); }
+
+#define TestSuite MemoryTest
+
+namespace
+{
+	/// \param billboardCapacity reserved vertex floats of the billboard mesh (0 = no unused capacity)
+	SceneFormat createMemoryTestScene(size_t billboardCapacity = 0)
+	{
+		// 1000 triangles in 10 shapes
+		std::vector<float> vertices;
+		std::vector<uint16_t> indices;
+		std::vector<bmf::Shape> shapes;
+		for (uint32_t s = 0; s < 10; ++s)
+		{
+			shapes.push_back(bmf::Shape{ uint32_t(indices.size()), 300, uint32_t(vertices.size() / 3), 300, s % 2 });
+			for (uint16_t i = 0; i < 300; ++i)
+			{
+				vertices.insert(vertices.end(), { float(s), float(i), float(i % 3) });
+				indices.push_back(i);
+			}
+		}
+		bmf::BinaryMesh16 triangle(bmf::Position, vertices, indices, shapes);
+		// 500 billboards
+		std::vector<float> billboardVertices(500 * 3, 1.0f);
+		bmf::BinaryMesh billboard(bmf::Position, billboardVertices, {}, {});
+
+		std::vector<Mesh> meshes;
+		meshes.emplace_back(std::move(triangle));
+		meshes.emplace_back(std::move(billboard));
+		meshes.back().position = Path({ PathSection{ 1.0f, glm::vec3(1.0f) }, PathSection{ 2.0f, glm::vec3(2.0f) } }, 1.0f);
+		meshes.back().billboard.getVertices().reserve(billboardCapacity);
+
+		Camera cam(CameraData::Default());
+		std::vector<Light> lights(2, Light{ LightData::Point });
+		std::vector<Material> materials(2);
+		materials[0].name = "material with a name that does not fit into the string object";
+		materials[0].data = MaterialData::Default();
+		materials[1].name = "spec";
+		materials[1].data = MaterialData::Default();
+		materials[1].textures.albedo = "a/long/path/to/the/albedo/texture/of/the/material.png";
+
+		return SceneFormat(std::move(meshes), cam, lights, materials, Environment::Default());
+	}
+}
+
+TEST(TestSuite, Usage)
+{
+	const auto f = createMemoryTestScene();
+	const auto usage = f.memoryUsage();
+
+	ASSERT_EQ(usage.meshes.size(), 2);
+	const auto& triangle = f.getMeshes()[0].triangle;
+	EXPECT_EQ(usage.meshes[0].vertices, triangle.getVertices().capacity() * sizeof(float));
+	EXPECT_EQ(usage.meshes[0].indices, triangle.getIndices().capacity() * sizeof(uint16_t));
+	EXPECT_EQ(usage.meshes[0].shapes, triangle.getShapes().capacity() * sizeof(bmf::Shape));
+	EXPECT_EQ(usage.meshes[0].paths, 0);
+	EXPECT_EQ(usage.meshes[1].vertices, 500 * 3 * sizeof(float));
+	EXPECT_EQ(usage.meshes[1].indices, 0);
+	EXPECT_GE(usage.meshes[1].paths, 2 * sizeof(PathSection));
+	EXPECT_GT(usage.materials, 2 * sizeof(Material)); // names and filenames are counted as well
+	EXPECT_GE(usage.lights, 2 * sizeof(Light));
+
+	const auto meshTotal = usage.getMeshTotal();
+	EXPECT_EQ(meshTotal.vertices, usage.meshes[0].vertices + usage.meshes[1].vertices);
+	EXPECT_GT(usage.total(), meshTotal.total());
+	EXPECT_NE(usage.toString().find("mesh 1:"), std::string::npos);
+
+	// unused capacity is reported as slack
+	const auto withSlack = createMemoryTestScene(1000 * 3);
+	const auto& billboard = withSlack.getMeshes()[1].billboard;
+	ASSERT_GE(billboard.getVertices().capacity(), 1000 * 3);
+	const auto reserved = withSlack.memoryUsage();
+	EXPECT_EQ(reserved.meshes[1].vertices, billboard.getVertices().capacity() * sizeof(float));
+	EXPECT_EQ(reserved.meshes[1].slack, usage.meshes[1].slack + (billboard.getVertices().capacity() - 500 * 3) * sizeof(float));
+}
+
+TEST(TestSuite, LoadSaveAllocations)
+{
+	const auto f = createMemoryTestScene();
+	const auto usage = f.memoryUsage();
+
+	alloc::Stats saveStats;
+	{
+		alloc::Scope scope;
+		f.save("memory_test", true);
+		saveStats = scope.get();
+	}
+
+	alloc::Stats loadStats;
+	size_t loadedBytes = 0;
+	{
+		alloc::Scope scope;
+		auto res = SceneFormat::load("memory_test");
+		loadStats = scope.get();
+		loadedBytes = res.memoryUsage().total();
+	}
+
+	// reported for benchmark tracking
+	RecordProperty("saveAllocations", int(saveStats.allocations));
+	RecordProperty("savePeakBytes", int(saveStats.peakBytes));
+	RecordProperty("loadAllocations", int(loadStats.allocations));
+	RecordProperty("loadTotalBytes", int(loadStats.totalBytes));
+	RecordProperty("loadPeakBytes", int(loadStats.peakBytes));
+
+	EXPECT_GT(saveStats.allocations, 0);
+	// the loaded scene is alive at the end of the scope => peak >= its mesh data
+	EXPECT_GE(loadStats.peakBytes, usage.getMeshTotal().vertices);
+	EXPECT_GE(loadStats.totalBytes, loadStats.peakBytes);
+	EXPECT_GE(loadedBytes, usage.getMeshTotal().vertices + usage.getMeshTotal().indices);
+	// regression guard: loading should not need more than a few copies of the scene data
+	EXPECT_LE(loadStats.peakBytes, 8 * loadedBytes + 256 * 1024);
+}
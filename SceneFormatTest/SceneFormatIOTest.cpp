@@ -1,4 +1,8 @@
 #include "pch.h"
+#include "../include/hrsf/Pvs.h"
+#include "../include/hrsf/SceneStatistics.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <fstream>
 
 #define TestSuite SceneFormatIOTest
 
@@ -240,6 +244,68 @@ TEST(TestSuite, VerifyFail)
 	EXPECT_THROW(f.verify(), std::runtime_error);
 }
 
+TEST(TestSuite, VerifyReport)
+{
+	// triangle mesh with an out of bound material
+	const std::vector<float> vertices = {
+		0.0f, 0.0f, 0.0f,
+		1.0f, 0.0f, 1.0f,
+		0.0f, 1.0f, 0.0f,
+	};
+	const std::vector<bmf::Shape> shapes = {
+		bmf::Shape{0, 3, 0, 3, 0},
+		bmf::Shape{0, 3, 0, 3, 5},
+	};
+	bmf::BinaryMesh16 triangle(bmf::Position, vertices, { 0, 1, 2 }, shapes);
+
+	// billboard mesh with out of bound material ids at vertex 2 and 9
+	std::vector<float> billboardVertices;
+	for (uint32_t v = 0; v < 11; ++v)
+	{
+		const uint32_t matId = (v == 2 || v == 9) ? 7 : 0;
+		float matFloat;
+		memcpy(&matFloat, &matId, sizeof(matFloat));
+		billboardVertices.insert(billboardVertices.end(), { float(v), 0.0f, 0.0f, matFloat });
+	}
+	bmf::BinaryMesh billboard(bmf::Position | bmf::Material, billboardVertices, {}, {});
+
+	Camera cam;
+	cam.data = CameraData::Default();
+	std::vector<Light> lights(1);
+	lights[0].path = Path({ PathSection{ -1.0f, glm::vec3(1.0f) } }, 1.0f); // negative time
+
+	std::vector<Material> materials(1);
+	materials[0].name = "mat0";
+	materials[0].data = MaterialData::Default();
+
+	std::vector<Mesh> meshes;
+	meshes.emplace_back(std::move(triangle));
+	meshes.emplace_back(std::move(billboard));
+	SceneFormat f(std::move(meshes), cam, lights, materials, Environment::Default());
+
+	// all problems are reported in mesh order
+	const auto report = f.getVerifyReport();
+	ASSERT_EQ(report.issues.size(), 4);
+	EXPECT_EQ(report.issues[0].location, "mesh 0 shape 1");
+	EXPECT_EQ(report.issues[1].location, "mesh 1 vertex 2");
+	EXPECT_EQ(report.issues[2].location, "mesh 1 vertex 9");
+	EXPECT_EQ(report.issues[3].location, "light 0 path");
+	EXPECT_FALSE(report.isValid());
+	EXPECT_THROW(f.verify(), std::runtime_error);
+
+	// strided material kernel (uses the simd path for the first 8 vertices)
+	std::vector<size_t> invalid;
+	const auto& verts = f.getMeshes()[1].billboard.getVertices();
+	EXPECT_EQ(findInvalidMaterialIds(verts.data(), 11, 4, 3, 1, invalid, 16), 2);
+	EXPECT_EQ(invalid, std::vector<size_t>({ 2, 9 }));
+	invalid.clear();
+	EXPECT_EQ(findInvalidMaterialIds(verts.data(), 11, 4, 3, 1, invalid, 1), 2);
+	EXPECT_EQ(invalid.size(), 1);
+	invalid.clear();
+	EXPECT_EQ(findInvalidMaterialIds(verts.data(), 11, 4, 3, 8, invalid, 16), 0);
+	EXPECT_EQ(findInvalidMaterialIds(verts.data(), 11, 4, 3, 0, invalid, 0), 11);
+}
+
 TEST(TestSuite, PathSectionLoad)
 {
 	std::vector<PathSection> sections;
@@ -256,4 +322,334 @@ TEST(TestSuite, PathSectionLoad)
 	EXPECT_EQ(origPath.getSections().size(), loadPath.getSections().size());
 	EXPECT_EQ(origPath.getSections()[0].time, loadPath.getSections()[0].time);
 	EXPECT_EQ(origPath.getSections()[2].position, loadPath.getSections()[2].position);
-}
\ No newline at end of file
+}
+
+TEST(TestSuite, Statistics)
+{
+	// 2 shapes with 1 triangle each
+	const std::vector<float> vertices = {
+		0.0f, 0.0f, 0.0f,
+		1.0f, 0.0f, 1.0f,
+		0.0f, 1.0f, 0.0f,
+	};
+	bmf::BinaryMesh16 triangle(bmf::Position, vertices, { 0, 1, 2, 2, 1, 0 }, { bmf::Shape{0, 3, 0, 3, 0}, bmf::Shape{3, 3, 0, 3, 1} });
+	// 3 billboards with material 1
+	float mat1;
+	const uint32_t one = 1;
+	memcpy(&mat1, &one, sizeof(mat1));
+	bmf::BinaryMesh billboard(bmf::Position | bmf::Material, { 0.0f, 0.0f, 0.0f, mat1, 1.0f, 0.0f, 0.0f, mat1, 2.0f, 0.0f, 0.0f, mat1 }, {}, {});
+
+	std::vector<Mesh> meshes;
+	meshes.emplace_back(std::move(triangle));
+	meshes.emplace_back(std::move(billboard));
+	meshes.back().position = Path({ PathSection{ 1.0f, glm::vec3(1.0f) } }, 1.0f);
+
+	std::vector<Light> lights = { Light{ LightData::Point }, Light{ LightData::Directional }, Light{ LightData::Point } };
+	std::vector<Material> materials(2);
+	materials[0].name = "a";
+	materials[0].data = MaterialData::Default();
+	materials[0].textures.albedo = "albedo.png";
+	materials[1].name = "b";
+	materials[1].data = MaterialData::Default();
+	materials[1].textures.albedo = "albedo.png";
+	materials[1].textures.specular = "specular.png";
+
+	SceneFormat f(std::move(meshes), Camera(CameraData::Default()), lights, materials, Environment::Default());
+	f.save("stats_test", false);
+
+	const auto check = [](const SceneStatistics& s, bool materialUsage)
+	{
+		ASSERT_EQ(s.meshes.size(), 2);
+		EXPECT_EQ(s.meshes[0].triangles, 2);
+		EXPECT_EQ(s.meshes[0].vertices, 3);
+		EXPECT_EQ(s.meshes[0].shapes, 2);
+		EXPECT_EQ(s.meshes[0].gpuBytes, 9 * sizeof(float) + 6 * sizeof(uint16_t));
+		EXPECT_EQ(s.meshes[1].billboards, 3);
+		EXPECT_EQ(s.meshes[1].pathSections, 1);
+		EXPECT_EQ(s.getTriangleCount(), 2);
+		EXPECT_EQ(s.getBillboardCount(), 3);
+		EXPECT_EQ(s.pointLights, 2);
+		EXPECT_EQ(s.directionalLights, 1);
+		EXPECT_EQ(s.textures.size(), 2);
+		EXPECT_EQ(s.getGpuBytes(), 9 * sizeof(float) + 6 * sizeof(uint16_t) + 12 * sizeof(float) + 3 * sizeof(LightData) + 2 * sizeof(MaterialData));
+		if (materialUsage)
+			EXPECT_EQ(s.materialUsage, std::vector<size_t>({ 1, 4 }));
+		else
+			EXPECT_TRUE(s.materialUsage.empty());
+		EXPECT_EQ(s.toJson()["billboards"].get<size_t>(), 3);
+	};
+
+	check(SceneStatistics::compute(f), true);
+	check(SceneStatistics::load("stats_test", true), true);
+	// reads only the json counts
+	check(SceneStatistics::load("stats_test", false), false);
+}
+
+TEST(TestSuite, Merge)
+{
+	// scene with one triangle mesh (materials 0 and 1) and one billboard mesh (material 1 per vertex)
+	const auto makeScene = [](const std::string& secondName, glm::vec3 secondAlbedo)
+	{
+		const std::vector<float> vertices = {
+			0.0f, 0.0f, 0.0f,
+			1.0f, 0.0f, 0.0f,
+			0.0f, 1.0f, 0.0f,
+		};
+		bmf::BinaryMesh16 triangle(bmf::Position, vertices, { 0, 1, 2, 0, 1, 2 },
+			{ bmf::Shape{ 0, 3, 0, 3, 0 }, bmf::Shape{ 3, 3, 0, 3, 1 } });
+		const std::vector<float> points = {
+			0.0f, 0.0f, 0.0f, bmf::asFloat(1),
+			1.0f, 0.0f, 0.0f, bmf::asFloat(1),
+		};
+		bmf::BinaryMesh billboard(bmf::Position | bmf::Material, points, {}, {});
+
+		std::vector<Mesh> meshes;
+		meshes.emplace_back(std::move(triangle));
+		meshes.emplace_back(std::move(billboard));
+		std::vector<Material> materials(2);
+		materials[0].name = "default";
+		materials[0].data = MaterialData::Default();
+		materials[0].textures.albedo = fs::path("textures") / ".." / "textures" / "wood.png";
+		materials[1].name = secondName;
+		materials[1].data = MaterialData::Default();
+		materials[1].data.albedo = secondAlbedo;
+		std::vector<Light> lights(1);
+		lights[0].data.type = LightData::Point;
+		return SceneFormat(std::move(meshes), Camera(CameraData::Default()), std::move(lights), std::move(materials), Environment());
+	};
+
+	const auto getBillboardMaterial = [](const SceneFormat& s, size_t mesh)
+	{
+		return s.getMeshes()[mesh].billboard.getMaterialAttribBuffer().front();
+	};
+
+	// without deduplication
+	{
+		auto a = makeScene("red", glm::vec3(1.0f, 0.0f, 0.0f));
+		auto b = makeScene("green", glm::vec3(0.0f, 1.0f, 0.0f));
+		const float* vertexData = b.getMeshes()[0].triangle.getVertices().data();
+		a.merge(std::move(b));
+		EXPECT_TRUE(b.getMeshes().empty());
+		ASSERT_EQ(a.getMeshes().size(), 4);
+		ASSERT_EQ(a.getMaterials().size(), 4);
+		EXPECT_EQ(a.getLights().size(), 2);
+		// moved, not copied
+		EXPECT_EQ(a.getMeshes()[2].triangle.getVertices().data(), vertexData);
+		EXPECT_EQ(a.getMeshes()[2].triangle.getShapes()[0].materialId, 2);
+		EXPECT_EQ(a.getMeshes()[2].triangle.getShapes()[1].materialId, 3);
+		EXPECT_EQ(getBillboardMaterial(a, 1), 1);
+		EXPECT_EQ(getBillboardMaterial(a, 3), 3);
+		EXPECT_NO_THROW(a.verify());
+	}
+
+	// with deduplication: the default materials and both red materials are equal
+	{
+		std::vector<SceneFormat> scenes;
+		scenes.push_back(makeScene("red", glm::vec3(1.0f, 0.0f, 0.0f)));
+		scenes.push_back(makeScene("green", glm::vec3(0.0f, 1.0f, 0.0f)));
+		scenes.push_back(makeScene("red2", glm::vec3(1.0f, 0.0f, 0.0f)));
+		MergeSettings settings;
+		settings.deduplicateMaterials = true;
+		const auto merged = SceneFormat::mergeAll(std::move(scenes), settings);
+		ASSERT_EQ(merged.getMeshes().size(), 6);
+		ASSERT_EQ(merged.getMaterials().size(), 3);
+		EXPECT_EQ(merged.getMaterials()[0].textures.albedo, fs::path("textures/wood.png").lexically_normal());
+		EXPECT_EQ(merged.getMaterials()[2].name, "green");
+		EXPECT_EQ(merged.getMeshes()[2].triangle.getShapes()[0].materialId, 0);
+		EXPECT_EQ(merged.getMeshes()[2].triangle.getShapes()[1].materialId, 2);
+		EXPECT_EQ(merged.getMeshes()[4].triangle.getShapes()[1].materialId, 1);
+		EXPECT_EQ(getBillboardMaterial(merged, 3), 2);
+		EXPECT_EQ(getBillboardMaterial(merged, 5), 1);
+		EXPECT_EQ(merged.getLights().size(), 3);
+		EXPECT_NO_THROW(merged.verify());
+	}
+
+	// invalid material ids are detected before anything is moved
+	{
+		auto a = makeScene("red", glm::vec3(1.0f, 0.0f, 0.0f));
+		auto c = makeScene("blue", glm::vec3(0.0f, 0.0f, 1.0f));
+		auto meshes = c.getMeshes();
+		meshes[1].billboard.getVertices()[3] = bmf::asFloat(7);
+		c = SceneFormat(std::move(meshes), Camera(CameraData::Default()), c.getLights(), c.getMaterials(), Environment());
+		EXPECT_THROW(a.merge(std::move(c)), std::runtime_error);
+		for (const auto* s : { &a, &c })
+		{
+			EXPECT_EQ(s->getMeshes().size(), 2);
+			EXPECT_EQ(s->getMaterials().size(), 2);
+			EXPECT_EQ(s->getLights().size(), 1);
+		}
+		EXPECT_EQ(a.getMeshes()[0].triangle.getShapes()[1].materialId, 1);
+		EXPECT_EQ(getBillboardMaterial(c, 1), 7);
+	}
+}
+
+TEST(TestSuite, References)
+{
+	// single triangle in the xy plane with material 0
+	const auto makeScene = [](const std::string& materialName, bool withLight)
+	{
+		const std::vector<float> vertices = {
+			0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+			1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+			0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+		};
+		std::vector<Mesh> meshes;
+		meshes.emplace_back(bmf::BinaryMesh16(bmf::Position | bmf::Normal, vertices, { 0, 1, 2 }, { bmf::Shape{ 0, 3, 0, 3, 0 } }));
+		std::vector<Material> materials(1);
+		materials[0].name = materialName;
+		materials[0].data = MaterialData::Default();
+		std::vector<Light> lights;
+		if (withLight)
+		{
+			lights.emplace_back(Light{ LightData::Point });
+			lights.back().data.position = glm::vec3(0.0f, 0.0f, 1.0f);
+			lights.back().data.color = glm::vec3(1.0f);
+			lights.back().data.radius = 0.0f;
+		}
+		return SceneFormat(std::move(meshes), Camera(CameraData::Default()), std::move(lights), std::move(materials), Environment::Default());
+	};
+	const auto translation = [](float x, float y, float z) { return glm::translate(glm::mat4(1.0f), glm::vec3(x, y, z)); };
+
+	makeScene("leaf", true).save("prefab_leaf", true);
+	{
+		auto house = makeScene("wall", false);
+		house.addReference("prefab_leaf", translation(0.0f, 1.0f, 0.0f));
+		EXPECT_EQ(house.getMaterials().size(), 2);
+		house.save("prefab_house", true);
+	}
+	{
+		auto root = makeScene("ground", false);
+		root.addReference("prefab_house", translation(10.0f, 0.0f, 0.0f));
+		root.addReference("prefab_house", glm::scale(glm::mat4(1.0f), glm::vec3(-1.0f, 1.0f, 1.0f)));
+		root.addReference("prefab_leaf.json", glm::mat4(1.0f));
+		root.save("prefab_root", true);
+	}
+
+	auto scene = SceneFormat::load("prefab_root");
+	EXPECT_EQ(scene.getReferences().size(), 3);
+	// house and leaf are loaded once
+	ASSERT_EQ(scene.getPrefabs().size(), 2);
+	// house, nested leaf, house, nested leaf, leaf
+	ASSERT_EQ(scene.getInstances().size(), 5);
+	ASSERT_EQ(scene.getMaterials().size(), 3);
+	EXPECT_EQ(scene.getMaterials()[0].name, "ground");
+	EXPECT_EQ(scene.getMaterials()[scene.getPrefabs()[1].materialOffset].name, "leaf");
+	EXPECT_EQ(scene.getMeshes().size(), 1);
+	EXPECT_TRUE(scene.getLights().empty());
+
+	// nested leaf of the first house
+	const auto& nested = scene.getInstances()[1];
+	EXPECT_EQ(nested.prefab, 1);
+	const auto leafMeshes = scene.getInstanceMeshes(1);
+	ASSERT_EQ(leafMeshes.size(), 1);
+	EXPECT_FLOAT_EQ(leafMeshes[0].triangle.getVertices()[0], 10.0f);
+	EXPECT_FLOAT_EQ(leafMeshes[0].triangle.getVertices()[1], 1.0f);
+	EXPECT_EQ(leafMeshes[0].triangle.getShapes()[0].materialId, scene.getPrefabs()[1].materialOffset);
+	const auto leafLights = scene.getInstanceLights(1);
+	ASSERT_EQ(leafLights.size(), 1);
+	EXPECT_VEC3_EQUAL(leafLights[0].data.position, glm::vec3(10.0f, 1.0f, 1.0f));
+
+	// mirrored house => flipped winding
+	const auto mirrored = scene.getInstanceMeshes(2);
+	EXPECT_EQ(mirrored[0].triangle.getIndices(), std::vector<uint16_t>({ 0, 2, 1 }));
+	EXPECT_FLOAT_EQ(mirrored[0].triangle.getVertices()[6], -1.0f);
+
+	// saving keeps the references and does not duplicate the prefab materials
+	scene.save("prefab_root2", true);
+	EXPECT_EQ(SceneFormat::load("prefab_root2").getMaterials().size(), 3);
+
+	// files with references have a newer version (older readers would ignore the references)
+	const auto getVersion = [](const char* filename)
+	{
+		std::ifstream file(filename);
+		nlohmann::json j;
+		file >> j;
+		return j["version"].get<size_t>();
+	};
+	EXPECT_EQ(getVersion("prefab_leaf.json"), 7);
+	EXPECT_EQ(getVersion("prefab_root2.json"), 8);
+
+	// consumers see each prefab once and the instances
+	const auto stats = SceneStatistics::compute(scene);
+	ASSERT_EQ(stats.meshes.size(), 3); // ground, wall, leaf
+	EXPECT_EQ(stats.meshes[2].instances, 3);
+	EXPECT_EQ(stats.meshes[2].prefab, scene.getPrefabs()[1].file);
+	EXPECT_EQ(stats.prefabInstances, 5);
+	EXPECT_EQ(stats.getTriangleCount(), 3);
+	EXPECT_EQ(stats.getInstancedTriangleCount(), 6);
+	EXPECT_EQ(stats.materialUsage, std::vector<size_t>({ 1, 1, 1 }));
+	EXPECT_EQ(stats.pointLights, 3);
+	EXPECT_EQ(SceneStatistics::load("prefab_root").meshes.size(), 3);
+	EXPECT_EQ(SceneStatistics::load("prefab_root", false).materialNames.size(), 3);
+	EXPECT_TRUE(scene.getVerifyReport().isValid());
+	EXPECT_THROW(Pvs::build(scene), std::runtime_error);
+
+	// glb: the prefab meshes are exported once and referenced by the instance nodes
+	{
+		scene.saveGlb("prefab_root.glb");
+		std::ifstream file("prefab_root.glb", std::ios::binary);
+		uint32_t header[5];
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		std::string text(header[3], ' ');
+		file.read(&text[0], std::streamsize(text.size()));
+		const auto j = nlohmann::json::parse(text);
+		EXPECT_EQ(j["meshes"].size(), 3);
+		size_t instanceNodes = 0, meshNodes = 0;
+		for (const auto& n : j["nodes"])
+		{
+			if (n.count("matrix")) ++instanceNodes;
+			if (n.count("mesh")) ++meshNodes;
+		}
+		EXPECT_EQ(instanceNodes, 5);
+		EXPECT_EQ(meshNodes, 6);
+		EXPECT_EQ(j["extensions"]["KHR_lights_punctual"]["lights"].size(), 3);
+	}
+
+	// verify reports prefab meshes by their prefab file
+	{
+		auto mesh = scene.getMeshes()[0];
+		mesh.triangle.getShapes()[0].materialId = 5;
+		std::vector<Mesh> meshes;
+		meshes.push_back(std::move(mesh));
+		SceneFormat(std::move(meshes), Camera(CameraData::Default()), {}, { scene.getMaterials()[0] }, Environment::Default()).save("prefab_broken", true);
+		auto withBroken = makeScene("ground", false);
+		withBroken.addReference("prefab_broken", translation(1.0f, 0.0f, 0.0f));
+		const auto report = withBroken.getVerifyReport();
+		ASSERT_EQ(report.issues.size(), 1);
+		EXPECT_NE(report.issues[0].location.find("prefab 0"), std::string::npos);
+		EXPECT_NE(report.issues[0].location.find("mesh 0 shape 0"), std::string::npos);
+	}
+
+	// lookAt paths rotate around the mesh origin => they cannot be translated by an instance
+	{
+		Mesh animated = scene.getMeshes()[0];
+		animated.lookAt = Path({ PathSection{1.0f, glm::vec3(1.0f, 0.0f, 0.0f)}, PathSection{1.0f, glm::vec3(0.0f, 0.0f, 1.0f)} }, 1.0f);
+		EXPECT_NO_THROW(transformMesh(animated, glm::scale(glm::mat4(1.0f), glm::vec3(2.0f)), 0));
+		EXPECT_THROW(transformMesh(animated, translation(1.0f, 0.0f, 0.0f), 0), std::runtime_error);
+	}
+
+	// light radius follows the scale
+	{
+		Light light{ LightData::Point };
+		light.data.position = glm::vec3(1.0f, 0.0f, 0.0f);
+		light.data.radius = 0.5f;
+		const auto scaled = transformLight(light, glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 3.0f, 2.0f)));
+		EXPECT_FLOAT_EQ(scaled.data.radius, 1.5f);
+	}
+
+	scene.expandReferences();
+	EXPECT_TRUE(scene.getInstances().empty());
+	EXPECT_EQ(scene.getMeshes().size(), 6);
+	EXPECT_EQ(scene.getLights().size(), 3);
+	EXPECT_NO_THROW(scene.verify());
+
+	// cycles are detected
+	{
+		auto cycle = makeScene("cycle", false);
+		cycle.save("prefab_cycle", true);
+		auto j = nlohmann::json::parse(std::ifstream("prefab_cycle.json"));
+		j["references"] = { { { "file", "prefab_cycle.json" }, { "translation", { 1.0, 0.0, 0.0 } } } };
+		std::ofstream("prefab_cycle.json") << j.dump();
+	}
+	EXPECT_THROW(SceneFormat::load("prefab_cycle"), std::runtime_error);
+}
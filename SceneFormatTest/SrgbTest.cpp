@@ -0,0 +1,53 @@
+#include "pch.h"
+
+#define TestSuite SrgbTest
+
+TEST(TestSuite, Srgb8RoundTrip)
+{
+	for (int i = 0; i < 256; ++i)
+	{
+		EXPECT_EQ(fromSrgb8(uint8_t(i)), fromSrgb(float(i) / 255.0f));
+		EXPECT_EQ(toSrgb8(fromSrgb8(uint8_t(i))), i);
+	}
+
+	// batch version
+	std::vector<uint8_t> srgb(256);
+	for (int i = 0; i < 256; ++i)
+		srgb[i] = uint8_t(i);
+	std::vector<float> linear(srgb.size());
+	fromSrgb8(srgb.data(), linear.data(), srgb.size());
+	std::vector<uint8_t> res(srgb.size());
+	toSrgb8(linear.data(), res.data(), linear.size());
+	EXPECT_EQ(res, srgb);
+
+	// clamping
+	EXPECT_EQ(toSrgb8(-1.0f), 0);
+	EXPECT_EQ(toSrgb8(2.0f), 255);
+}
+
+TEST(TestSuite, FastApproximation)
+{
+	// odd size to test the scalar remainder
+	const size_t count = 100003;
+	std::vector<float> values(count);
+	for (size_t i = 0; i < count; ++i)
+		values[i] = float(i) / float(count - 1);
+
+	std::vector<float> fast(count);
+	toSrgbFast(values.data(), fast.data(), count);
+	for (size_t i = 0; i < count; ++i)
+		ASSERT_LE(std::abs(fast[i] - toSrgb(values[i])), 2e-5f) << values[i];
+
+	fromSrgbFast(values.data(), fast.data(), count);
+	for (size_t i = 0; i < count; ++i)
+		ASSERT_LE(std::abs(fast[i] - fromSrgb(values[i])), 3e-5f) << values[i];
+
+	// in place vec3 conversion
+	std::vector<glm::vec3> colors = { glm::vec3(0.0f), glm::vec3(0.2f, 0.5f, 1.0f), glm::vec3(-1.0f, 0.001f, 4.0f) };
+	auto exact = colors;
+	fromSrgb(exact.data(), exact.data(), exact.size());
+	fromSrgbFast(colors.data(), colors.data(), colors.size());
+	EXPECT_VEC3_EQUAL(colors[0], exact[0]);
+	EXPECT_VEC3_EQUAL(colors[1], exact[1]);
+	EXPECT_VEC3_EQUAL(colors[2], glm::vec3(0.0f, exact[2].y, 1.0f)); // fast version clamps
+}
@@ -0,0 +1,410 @@
+#include "pch.h"
+#include "../include/hrsf/MeshPrefetcher.h"
+#include "../include/hrsf/MeshResidency.h"
+#include "../include/hrsf/TiledScene.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define TestSuite StreamingTest
+
+namespace
+{
+	// single triangle at the offset
+	Mesh getTriangle(const glm::vec3& offset)
+	{
+		std::vector<float> vertices;
+		for (const auto& v : { offset, offset + glm::vec3(1.0f, 0.0f, 0.0f), offset + glm::vec3(0.0f, 1.0f, 0.0f) })
+			vertices.insert(vertices.end(), { v.x, v.y, v.z });
+		const std::vector<uint16_t> indices = { 0, 1, 2 };
+		const std::vector<bmf::Shape> shapes = { bmf::Shape{0, 3, 0, 3, 0} };
+		return Mesh(bmf::BinaryMesh16(bmf::Position, vertices, indices, shapes));
+	}
+
+	// meshes along the x axis, the last one is behind the camera
+	void saveStreamingScene(const fs::path& filename)
+	{
+		std::vector<Mesh> meshes;
+		for (float x : { 10.0f, 30.0f, 50.0f, 70.0f, -40.0f })
+			meshes.push_back(getTriangle(glm::vec3(x, 0.0f, 0.0f)));
+
+		Camera cam(CameraData::Default());
+		std::vector<Material> materials(1);
+		materials[0].name = "default";
+		materials[0].data = MaterialData::Default();
+		SceneFormat f(std::move(meshes), cam, {}, materials, Environment::Default());
+		f.save(filename, false);
+	}
+
+	// triangles of the streaming scene, a mesh that spans several tiles and a moving triangle
+	SceneFormat getTilingScene()
+	{
+		std::vector<Mesh> meshes;
+		for (float x : { 10.0f, 30.0f, 50.0f, 70.0f, -40.0f })
+			meshes.push_back(getTriangle(glm::vec3(x, 0.0f, 0.0f)));
+
+		std::vector<float> vertices;
+		for (float x : { 5.0f, 45.0f })
+			for (const auto& v : { glm::vec3(x, 0.0f, 0.0f), glm::vec3(x + 1.0f, 0.0f, 0.0f), glm::vec3(x, 1.0f, 0.0f) })
+				vertices.insert(vertices.end(), { v.x, v.y, v.z });
+		const std::vector<uint16_t> indices = { 0, 1, 2, 3, 4, 5 };
+		meshes.emplace_back(bmf::BinaryMesh16(bmf::Position, vertices, indices, { bmf::Shape{0, 6, 0, 6, 0} }));
+
+		meshes.push_back(getTriangle(glm::vec3(0.0f)));
+		meshes.back().position = Path({ PathSection{1.0f, glm::vec3(10.0f, 0.0f, 0.0f)} }, 1.0f);
+
+		std::vector<Material> materials(1);
+		materials[0].name = "default";
+		materials[0].data = MaterialData::Default();
+		return SceneFormat(std::move(meshes), Camera(CameraData::Default()), {}, materials, Environment::Default());
+	}
+}
+
+TEST(TestSuite, MeshInfo)
+{
+	saveStreamingScene("test_stream");
+	const auto infos = SceneFormat::loadMeshInfos("test_stream");
+	ASSERT_EQ(infos.size(), 5);
+	EXPECT_EQ(infos[0].type, Mesh::Triangle);
+	EXPECT_FALSE(infos[0].bounds.isEmpty());
+	EXPECT_VEC3_EQUAL(infos[1].bounds.min, glm::vec3(30.0f, 0.0f, 0.0f));
+	EXPECT_VEC3_EQUAL(infos[1].bounds.max, glm::vec3(31.0f, 1.0f, 0.0f));
+	EXPECT_TRUE(infos[1].isStatic());
+}
+
+TEST(TestSuite, Prefetch)
+{
+	saveStreamingScene("test_stream");
+
+	// camera looks along +x, the first mesh is to the side and only becomes visible later
+	Camera cam(CameraData::Default());
+	cam.data.position = glm::vec3(0.0f, 0.0f, -20.0f);
+	cam.data.direction = glm::vec3(1.0f, 0.0f, 0.0f);
+	cam.data.fov = 0.5f;
+	cam.data.far = 1000.0f;
+	cam.positionPath = Path({ PathSection{4.0f, glm::vec3(0.0f, 0.0f, 20.0f)} }, 1.0f);
+
+	PrefetchSettings settings;
+	settings.horizon = 4.0f;
+	settings.aspect = 1.0f;
+	MeshPrefetcher prefetcher(SceneFormat::loadMeshInfos("test_stream"), settings);
+	prefetcher.update(cam);
+
+	// mesh 4 is behind the camera for the whole horizon
+	const auto& requests = prefetcher.getLastRequests();
+	ASSERT_EQ(requests.size(), 4);
+	EXPECT_EQ(std::find(requests.begin(), requests.end(), 4u), requests.end());
+	// far meshes enter the (narrow) frustum first
+	EXPECT_EQ(requests.front(), 3u);
+	EXPECT_EQ(requests.back(), 0u);
+
+	for (uint32_t i = 0; i < 5; ++i)
+	{
+		const auto mesh = prefetcher.get(i);
+		ASSERT_TRUE(mesh);
+		EXPECT_EQ(mesh->triangle.getShapes().size(), 1);
+		EXPECT_TRUE(prefetcher.isLoaded(i));
+	}
+	EXPECT_EQ(prefetcher.getPendingCount(), 0);
+
+	// loaded meshes are not requested again
+	prefetcher.update(cam);
+	EXPECT_TRUE(prefetcher.getLastRequests().empty());
+
+	// a held mesh stays valid after unload
+	const auto held = prefetcher.get(2);
+	prefetcher.unload(2);
+	EXPECT_FALSE(prefetcher.isLoaded(2));
+	EXPECT_EQ(held->triangle.getShapes().size(), 1);
+	prefetcher.update(cam);
+	ASSERT_EQ(prefetcher.getLastRequests().size(), 1);
+	EXPECT_EQ(prefetcher.get(2)->triangle.getShapes().size(), 1);
+}
+
+TEST(TestSuite, TilingRegular)
+{
+	TilingSettings settings;
+	settings.tileSize = 20.0f;
+	const auto index = writeTiles(getTilingScene(), "test_tiles", settings);
+
+	// cells 0, 2, 3, 4 and 5 along the x axis. The spanning mesh is split into cell 2 and 4
+	ASSERT_EQ(index.tiles.size(), 5);
+	size_t meshes = 0, primitives = 0;
+	for (const auto& t : index.tiles)
+	{
+		meshes += t.meshCount;
+		primitives += t.primitiveCount;
+	}
+	EXPECT_EQ(meshes, 7);
+	EXPECT_EQ(primitives, 7);
+	EXPECT_EQ(index.tiles[1].meshCount, 2);
+	EXPECT_VEC3_EQUAL(index.tiles[1].bounds.min, glm::vec3(5.0f, 0.0f, 0.0f));
+	EXPECT_VEC3_EQUAL(index.tiles[1].bounds.max, glm::vec3(11.0f, 1.0f, 0.0f));
+	EXPECT_VEC3_EQUAL(index.bounds.min, glm::vec3(-40.0f, 0.0f, 0.0f));
+
+	// the moving mesh stays in the scene
+	const auto scene = SceneFormat::load("test_tiles");
+	ASSERT_EQ(scene.getMeshes().size(), 1);
+	EXPECT_FALSE(scene.getMeshes()[0].isStatic());
+	EXPECT_EQ(scene.getMaterials().size(), 1);
+
+	const auto loaded = TileIndex::load("test_tiles_tiles.json");
+	ASSERT_EQ(loaded.tiles.size(), index.tiles.size());
+	EXPECT_EQ(loaded.scene, index.scene);
+	for (size_t i = 0; i < loaded.tiles.size(); ++i)
+	{
+		EXPECT_EQ(loaded.tiles[i].file, index.tiles[i].file);
+		EXPECT_VEC3_EQUAL(loaded.tiles[i].bounds.min, index.tiles[i].bounds.min);
+		EXPECT_VEC3_EQUAL(loaded.tiles[i].bounds.max, index.tiles[i].bounds.max);
+		EXPECT_EQ(loaded.tiles[i].primitiveCount, index.tiles[i].primitiveCount);
+	}
+
+	// tiles are regular scene files
+	const auto tile = SceneFormat::load(index.tiles[3].file);
+	ASSERT_EQ(tile.getMeshes().size(), 2);
+	EXPECT_EQ(tile.getMaterials().size(), 1);
+}
+
+TEST(TestSuite, TilingAdaptive)
+{
+	TilingSettings settings;
+	settings.maxTilePrimitives = 2;
+	settings.splitMeshes = false;
+	const auto index = writeTiles(getTilingScene(), "test_tiles_adaptive", settings);
+
+	EXPECT_GT(index.tiles.size(), 1);
+	size_t meshes = 0, primitives = 0;
+	for (const auto& t : index.tiles)
+	{
+		EXPECT_LE(t.primitiveCount, 2);
+		meshes += t.meshCount;
+		primitives += t.primitiveCount;
+	}
+	EXPECT_EQ(meshes, 6);
+	EXPECT_EQ(primitives, 7);
+
+	// the spanning mesh is split into two parts
+	settings.splitMeshes = true;
+	meshes = primitives = 0;
+	for (const auto& t : writeTiles(getTilingScene(), "test_tiles_adaptive", settings).tiles)
+	{
+		meshes += t.meshCount;
+		primitives += t.primitiveCount;
+	}
+	EXPECT_EQ(meshes, 7);
+	EXPECT_EQ(primitives, 7);
+}
+
+TEST(TestSuite, TilingReferences)
+{
+	// prefab with a triangle and a light, referenced twice
+	{
+		std::vector<Mesh> meshes;
+		meshes.push_back(getTriangle(glm::vec3(0.0f)));
+		std::vector<Light> lights(1, Light{ LightData::Point });
+		lights[0].data.position = glm::vec3(0.0f, 1.0f, 0.0f);
+		lights[0].data.color = glm::vec3(1.0f);
+		lights[0].data.radius = 0.0f;
+		std::vector<Material> materials(1);
+		materials[0].name = "prefab";
+		materials[0].data = MaterialData::Default();
+		SceneFormat(std::move(meshes), Camera(CameraData::Default()), lights, materials, Environment::Default()).save("test_tiles_prefab", true);
+	}
+	auto scene = getTilingScene();
+	scene.addReference("test_tiles_prefab", glm::translate(glm::mat4(1.0f), glm::vec3(100.0f, 0.0f, 0.0f)));
+	scene.addReference("test_tiles_prefab", glm::translate(glm::mat4(1.0f), glm::vec3(-100.0f, 0.0f, 0.0f)));
+
+	TilingSettings settings;
+	settings.tileSize = 20.0f;
+	const auto index = writeTiles(scene, "test_tiles_references", settings);
+	size_t meshes = 0;
+	for (const auto& t : index.tiles)
+		meshes += t.meshCount;
+	EXPECT_EQ(meshes, 9);
+
+	const auto tiled = SceneFormat::load("test_tiles_references");
+	ASSERT_EQ(tiled.getLights().size(), 2);
+	EXPECT_VEC3_EQUAL(tiled.getLights()[0].data.position, glm::vec3(100.0f, 1.0f, 0.0f));
+	EXPECT_VEC3_EQUAL(tiled.getLights()[1].data.position, glm::vec3(-100.0f, 1.0f, 0.0f));
+}
+
+TEST(TestSuite, TilingEmpty)
+{
+	// only a moving mesh => no tiles
+	std::vector<Mesh> meshes;
+	meshes.push_back(getTriangle(glm::vec3(0.0f)));
+	meshes.back().position = Path({ PathSection{1.0f, glm::vec3(10.0f, 0.0f, 0.0f)} }, 1.0f);
+	std::vector<Material> materials(1);
+	materials[0].name = "default";
+	materials[0].data = MaterialData::Default();
+	const SceneFormat scene(std::move(meshes), Camera(CameraData::Default()), {}, materials, Environment::Default());
+
+	for (float tileSize : { 0.0f, 20.0f })
+	{
+		TilingSettings settings;
+		settings.tileSize = tileSize;
+		const auto index = writeTiles(scene, "test_tiles_empty", settings);
+		EXPECT_TRUE(index.tiles.empty());
+		EXPECT_TRUE(index.bounds.isEmpty());
+	}
+
+	const auto loaded = TileIndex::load("test_tiles_empty_tiles.json");
+	EXPECT_TRUE(loaded.tiles.empty());
+	EXPECT_TRUE(loaded.bounds.isEmpty());
+	EXPECT_EQ(SceneFormat::load("test_tiles_empty").getMeshes().size(), 1);
+}
+
+TEST(TestSuite, TiledScene)
+{
+	TilingSettings tiling;
+	tiling.tileSize = 20.0f;
+	writeTiles(getTilingScene(), "test_tiles", tiling);
+
+	TiledSceneSettings settings;
+	settings.loadDistance = 15.0f;
+	settings.unloadDistance = 30.0f;
+	TiledScene scene("test_tiles_tiles.json", settings);
+	EXPECT_EQ(scene.getScene().getMeshes().size(), 1);
+	EXPECT_EQ(scene.getIndex().tiles.size(), 5);
+
+	scene.update(glm::vec3(10.0f, 0.0f, 0.0f));
+	scene.wait();
+	EXPECT_EQ(scene.getPendingCount(), 0);
+	ASSERT_EQ(scene.getLoadedTiles(), std::vector<uint32_t>{ 1 });
+	const auto tile = scene.getTile(1);
+	ASSERT_TRUE(tile);
+	EXPECT_EQ(tile->size(), 2);
+	EXPECT_FALSE(scene.getTile(0));
+
+	// tile 1 is out of range, tile 3 is between the load and unload distance
+	scene.update(glm::vec3(60.0f, 0.0f, 0.0f));
+	scene.wait();
+	EXPECT_EQ(scene.getLoadedTiles(), (std::vector<uint32_t>{ 3, 4 }));
+	scene.update(glm::vec3(75.0f, 0.0f, 0.0f));
+	EXPECT_EQ(scene.getLoadedTiles(), (std::vector<uint32_t>{ 3, 4 }));
+	scene.update(glm::vec3(100.0f, 0.0f, 0.0f));
+	EXPECT_EQ(scene.getLoadedTiles(), std::vector<uint32_t>{ 4 });
+
+	// held tiles stay valid after unloading
+	EXPECT_FALSE(scene.getTile(1));
+	EXPECT_EQ(tile->size(), 2);
+}
+
+TEST(TestSuite, Residency)
+{
+	saveStreamingScene("test_residency");
+	MeshResidency residency(SceneFormat::loadMeshInfos("test_residency"));
+
+	// all meshes have the same size
+	EXPECT_EQ(residency.acquire(0)->triangle.getShapes().size(), 1);
+	const auto meshBytes = residency.getCounters().residentBytes;
+	ASSERT_GT(meshBytes, 0);
+
+	residency.setBudget(2 * meshBytes);
+	residency.acquire(1);
+	residency.acquire(0);
+	// mesh 1 is the least recently used
+	auto held = residency.acquire(2);
+	EXPECT_TRUE(residency.isResident(0));
+	EXPECT_FALSE(residency.isResident(1));
+	EXPECT_TRUE(residency.isResident(2));
+	EXPECT_FALSE(residency.tryAcquire(1));
+
+	auto counters = residency.getCounters();
+	EXPECT_EQ(counters.hits, 1);
+	EXPECT_EQ(counters.misses, 4);
+	EXPECT_EQ(counters.loads, 3);
+	EXPECT_EQ(counters.evictions, 1);
+	EXPECT_EQ(counters.bytesLoaded, 3 * meshBytes);
+	EXPECT_EQ(counters.bytesEvicted, meshBytes);
+	EXPECT_EQ(counters.residentBytes, 2 * meshBytes);
+	EXPECT_EQ(counters.peakResidentBytes, 2 * meshBytes);
+
+	// pinned meshes are kept even if the budget is exceeded
+	residency.pin(0);
+	residency.pin(2);
+	residency.acquire(3);
+	EXPECT_EQ(residency.getCounters().residentBytes, 3 * meshBytes);
+	residency.unpin(0);
+	EXPECT_FALSE(residency.isResident(0));
+	EXPECT_TRUE(residency.isResident(2));
+	EXPECT_TRUE(residency.isResident(3));
+	EXPECT_THROW(residency.unpin(0), std::runtime_error);
+
+	// background loads
+	residency.resetCounters();
+	residency.setBudget(10 * meshBytes);
+	residency.request(4, 1.0f);
+	residency.request(1, 2.0f);
+	residency.wait();
+	EXPECT_EQ(residency.getPendingCount(), 0);
+	EXPECT_TRUE(residency.isResident(1));
+	EXPECT_TRUE(residency.isResident(4));
+	counters = residency.getCounters();
+	EXPECT_EQ(counters.loads, 2);
+	EXPECT_EQ(counters.hits + counters.misses, 0);
+	EXPECT_EQ(counters.residentBytes, 4 * meshBytes);
+
+	// held meshes are not evicted and stay counted
+	residency.unpin(2);
+	residency.setBudget(0);
+	EXPECT_TRUE(residency.isResident(2));
+	EXPECT_FALSE(residency.isResident(1));
+	EXPECT_FALSE(residency.isResident(3));
+	EXPECT_FALSE(residency.isResident(4));
+	EXPECT_EQ(residency.getCounters().residentBytes, meshBytes);
+	residency.evict(2);
+	EXPECT_TRUE(residency.isResident(2));
+	// a second acquire returns the same copy
+	EXPECT_EQ(residency.acquire(2), held);
+
+	held.reset();
+	residency.evict(2);
+	EXPECT_FALSE(residency.isResident(2));
+	EXPECT_EQ(residency.getCounters().residentBytes, 0);
+}
+
+TEST(TestSuite, ResidencyWaitEvict)
+{
+	saveStreamingScene("test_residency_wait");
+	MeshResidency residency(SceneFormat::loadMeshInfos("test_residency_wait"), ResidencySettings{ size_t(1) << 30, 1 });
+
+	// wait() is called in a loop while requests are evicted before the loader picks them up.
+	// Evicting the last queued request must wake up a blocked wait()
+	std::atomic<bool> done(false);
+	std::atomic<size_t> waits(0);
+	std::thread waiter([&]()
+	{
+		while (!done)
+		{
+			residency.wait();
+			++waits;
+		}
+	});
+
+	bool stuck = false;
+	for (int i = 0; i < 200 && !stuck; ++i)
+	{
+		const size_t index = size_t(i) % 5;
+		residency.request(index, 1.0f);
+		residency.evict(index);
+		residency.evict(index); // loaded before the first evict
+		// the waiter continues unless it is blocked without pending work
+		const auto count = waits.load();
+		const auto start = std::chrono::steady_clock::now();
+		while (waits == count && !stuck)
+		{
+			std::this_thread::yield();
+			stuck = std::chrono::steady_clock::now() - start > std::chrono::seconds(5);
+		}
+	}
+	EXPECT_FALSE(stuck);
+
+	done = true;
+	// a finished load wakes up the waiter if it is stuck
+	residency.evict(0);
+	residency.acquire(0);
+	waiter.join();
+	EXPECT_EQ(residency.getPendingCount(), 0);
+}
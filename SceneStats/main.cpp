@@ -0,0 +1,46 @@
+// prints size statistics of a scene without writing code:
+// SceneStats [--json] [--fast] <scene>
+//   --json  print json instead of text
+//   --fast  only read the mesh json files (bmf files are read for meshes without counts), no material usage
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/SceneStatistics.h"
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	bool json = false;
+	bool fast = false;
+	std::filesystem::path scene;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--json") json = true;
+		else if (arg == "--fast") fast = true;
+		else if (scene.empty() && !arg.empty() && arg[0] != '-') scene = arg;
+		else
+		{
+			std::cerr << "unknown argument " << arg << "\n";
+			return 1;
+		}
+	}
+
+	if (scene.empty())
+	{
+		std::cerr << "usage: SceneStats [--json] [--fast] <scene>\n";
+		return 1;
+	}
+
+	try
+	{
+		const auto stats = hrsf::SceneStatistics::load(scene, !fast);
+		if (json) std::cout << stats.toJson().dump(3) << "\n";
+		else std::cout << stats.toString();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
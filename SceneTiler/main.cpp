@@ -0,0 +1,63 @@
+// partitions the static meshes of a scene into tiles that can be streamed with hrsf::TiledScene:
+// SceneTiler [--size s] [--max-primitives n] [--depth d] [--no-split] <scene> <output>
+//   --size            edge length of the regular grid cells (default: adaptive grid)
+//   --max-primitives  adaptive grid: cells with more triangles or billboards are split (default 1048576)
+//   --depth           adaptive grid: maximum number of splits (default 8)
+//   --no-split        assign meshes that overlap several cells by their center instead of splitting them
+// writes <output>.json, <output>_tile<i>.json and the index <output>_tiles.json
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Tiling.h"
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+	hrsf::TilingSettings settings;
+	std::filesystem::path scene;
+	std::filesystem::path output;
+	try
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg = argv[i];
+			const bool hasValue = i + 1 < argc;
+			if (arg == "--size" && hasValue) settings.tileSize = std::stof(argv[++i]);
+			else if (arg == "--max-primitives" && hasValue) settings.maxTilePrimitives = std::stoull(argv[++i]);
+			else if (arg == "--depth" && hasValue) settings.maxDepth = uint32_t(std::stoul(argv[++i]));
+			else if (arg == "--no-split") settings.splitMeshes = false;
+			else if (scene.empty() && !arg.empty() && arg[0] != '-') scene = arg;
+			else if (output.empty() && !arg.empty() && arg[0] != '-') output = arg;
+			else
+			{
+				std::cerr << "unknown argument " << arg << "\n";
+				return 1;
+			}
+		}
+	}
+	catch (const std::exception&)
+	{
+		std::cerr << "invalid number\n";
+		return 1;
+	}
+
+	if (scene.empty() || output.empty())
+	{
+		std::cerr << "usage: SceneTiler [--size s] [--max-primitives n] [--depth d] [--no-split] <scene> <output>\n";
+		return 1;
+	}
+
+	try
+	{
+		const auto index = hrsf::writeTiles(hrsf::SceneFormat::load(scene), output, settings);
+		size_t primitives = 0;
+		for (const auto& t : index.tiles)
+			primitives += t.primitiveCount;
+		std::cout << index.tiles.size() << " tiles, " << primitives << " primitives\n";
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include "Camera.h"
+
+namespace hrsf
+{
+	/// named camera for reproducible performance measurements.
+	/// A fly-through is a camera with paths and a duration > 0, a viewpoint has a duration of 0
+	struct BenchmarkCamera
+	{
+		std::string name;
+		Camera camera;
+		float duration = 0.0f; // seconds
+	};
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "Mesh.h"
+
+namespace hrsf
+{
+	/// axis aligned bounding box
+	struct BoundingBox
+	{
+		glm::vec3 min;
+		glm::vec3 max;
+
+		/// box that contains nothing (min > max)
+		static BoundingBox Empty()
+		{
+			const float inf = std::numeric_limits<float>::infinity();
+			return BoundingBox{ glm::vec3(inf), glm::vec3(-inf) };
+		}
+
+		bool isEmpty() const
+		{
+			return min.x > max.x || min.y > max.y || min.z > max.z;
+		}
+
+		void extend(const glm::vec3& p)
+		{
+			min = glm::vec3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+			max = glm::vec3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+		}
+
+		void extend(const BoundingBox& b)
+		{
+			if (b.isEmpty()) return;
+			extend(b.min);
+			extend(b.max);
+		}
+
+		glm::vec3 getCenter() const
+		{
+			return (min + max) * 0.5f;
+		}
+
+		glm::vec3 getSize() const
+		{
+			return max - min;
+		}
+
+		bool intersects(const BoundingBox& b) const
+		{
+			return min.x <= b.max.x && min.y <= b.max.y && min.z <= b.max.z &&
+				b.min.x <= max.x && b.min.y <= max.y && b.min.z <= max.z;
+		}
+
+		/// \brief box sphere intersection (infinite radius intersects every non empty box)
+		bool intersectsSphere(const glm::vec3& center, float radius) const
+		{
+			float dist2 = 0.0f;
+			for (int i = 0; i < 3; ++i)
+			{
+				const float d = std::max(min[i] - center[i], 0.0f) + std::max(center[i] - max[i], 0.0f);
+				dist2 += d * d;
+			}
+			return !isEmpty() && dist2 <= radius * radius;
+		}
+	};
+
+	/// \brief bounds of the vertex positions of the shape (the shape references the vertices [vertexOffset, vertexOffset + vertexCount))
+	template<class IndexT>
+	BoundingBox getShapeBounds(const bmf::BinaryMeshT<IndexT>& mesh, const bmf::Shape& shape)
+	{
+		auto res = BoundingBox::Empty();
+		if (!(mesh.getAttributes() & bmf::Position)) return res;
+		const auto stride = bmf::getAttributeElementStride(mesh.getAttributes());
+		const auto offset = bmf::getAttributeElementOffset(mesh.getAttributes(), bmf::Position);
+		const auto& vertices = mesh.getVertices();
+		for (size_t v = shape.vertexOffset; v < size_t(shape.vertexOffset) + shape.vertexCount; ++v)
+		{
+			const float* p = vertices.data() + v * stride + offset;
+			res.extend(glm::vec3(p[0], p[1], p[2]));
+		}
+		return res;
+	}
+
+	/// \brief local space bounds of each shape of the mesh.
+	/// Billboard meshes without shapes return a single box for all vertices
+	std::vector<BoundingBox> getShapeBounds(const Mesh& mesh);
+
+	/// \brief conservative world space bounds of a local box for the current path state of the mesh.
+	/// Meshes with a lookAt path may be rotated arbitrarily around their origin => the rotation invariant bounds are used
+	BoundingBox getWorldBounds(const Mesh& mesh, const BoundingBox& local);
+	/// \brief see getWorldBounds(const Mesh&, const BoundingBox&)
+	BoundingBox getWorldBounds(const Path& position, const Path& lookAt, const BoundingBox& local);
+	/// \brief world space bounds of all meshes for the current path state
+	BoundingBox getSceneBounds(const std::vector<Mesh>& meshes);
+}
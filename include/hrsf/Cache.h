@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+
+namespace hrsf
+{
+	/// \brief 64 bit hash of the file content (not cryptographic).
+	/// Used as key for precomputed data that is derived from the file.
+	uint64_t hashFile(const std::filesystem::path& filename);
+	/// \brief 64 bit hash of the memory range (same hash as hashFile() for a file with that content)
+	uint64_t hashData(const void* data, size_t size);
+
+	/// \brief combines two keys (e.g. the file hash and bake settings)
+	inline uint64_t combineKeys(uint64_t a, uint64_t b)
+	{
+		return (a ^ (b + 0x9e3779b97f4a7c15ull + (a << 6) + (a >> 2))) * 0x100000001b3ull;
+	}
+
+	/// \brief 16 digit hex representation of the key
+	std::string keyToString(uint64_t key);
+	/// \brief inverse of keyToString
+	uint64_t keyFromString(const std::string& str);
+
+	/// \brief filename for data that is derived from source: <directory>/<stem>.<key><suffix>
+	/// example: getCacheFilename("sky.hdr", key, ".sh.bin") => "sky.0123456789abcdef.sh.bin"
+	std::filesystem::path getCacheFilename(const std::filesystem::path& source, uint64_t key, const std::string& suffix);
+
+	/// \brief writes a cache file through a temporary file in the same directory that is renamed to filename.
+	/// Readers (also other processes) never see a partially written file, a crash only leaves the temporary file behind.
+	/// \param write writes the data to the given (temporary) filename
+	void writeCacheFile(const std::filesystem::path& filename, const std::function<void(const std::filesystem::path&)>& write);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <array>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 #include "Path.h"
 
 namespace hrsf
@@ -40,10 +42,72 @@ namespace hrsf
 		}
 	};
 
+	/// view frustum planes (xyz = normal pointing inside, w = distance).
+	/// A point p is inside the plane if dot(xyz, p) + w >= 0
+	struct Frustum
+	{
+		enum Plane
+		{
+			Left,
+			Right,
+			Bottom,
+			Top,
+			Near,
+			Far
+		};
+
+		std::array<glm::vec4, 6> planes;
+
+		/// \brief extracts the normalized planes from a view projection matrix
+		static Frustum fromMatrix(const glm::mat4& viewProj);
+
+		bool isSphereVisible(const glm::vec3& center, float radius) const;
+		/// \brief conservative box test (may return true for boxes close to the frustum corners)
+		bool isBoxVisible(const glm::vec3& min, const glm::vec3& max) const;
+	};
+
+	/// matrices of a pinhole camera (glm::lookAt and glm::perspective conventions)
+	struct CameraMatrices
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		glm::vec3 position; // including the path offset
+		glm::vec3 direction; // normalized, derived from the look at path if present
+		Frustum frustum;
+
+		/// \brief computes the matrices for the camera data (paths are ignored). Throws if the direction is zero
+		static CameraMatrices compute(const CameraData& data, float aspect);
+		/// \brief batch version (multithreaded for large counts)
+		static void compute(const CameraData* data, size_t count, float aspect, CameraMatrices* out);
+	};
+
 	struct Camera
 	{
 		CameraData data;
 		Path positionPath; // automated camera movement
 		Path lookAtPath;
+
+		Camera() = default;
+		explicit Camera(const CameraData& data, Path positionPath = {}, Path lookAtPath = {});
+
+		/// \brief camera data with the path position and look at direction applied
+		CameraData getCurrentData() const;
+
+		/// \brief matrices at the current path time (computed on every call, thread safe)
+		CameraMatrices getMatrices(float aspect) const;
+
+		/// \brief cached matrices at the current path time.
+		/// Only recomputed if the data with the paths applied (see getCurrentData()) or the aspect ratio changed.
+		/// The reference stays valid until the next updateMatrices() call or the destruction of the camera
+		const CameraMatrices& updateMatrices(float aspect);
+
+		/// \brief matrices for the next frames: frame i is the state after advancing the paths i * dt seconds.
+		/// The camera itself is not modified
+		void getPathMatrices(float aspect, float dt, size_t frameCount, CameraMatrices* out) const;
+	private:
+		CameraMatrices m_cache;
+		CameraData m_cacheData = {}; // getCurrentData() of the cached matrices
+		float m_cacheAspect = 0.0f; // 0 = invalid cache
 	};
 }
@@ -1,8 +1,10 @@
 #pragma once
 #include <string>
 #include <array>
+#include <vector>
 #include <filesystem>
 #include <glm/vec3.hpp>
+#include "SphericalHarmonics.h"
 
 namespace hrsf
 {
@@ -14,6 +16,15 @@ namespace hrsf
 		glm::vec3 ambientUp; // ambient color for normals facing upwards
 		glm::vec3 ambientDown; // ambient color for normals facing downwards
 		glm::vec3 color; // either multiplied with the envmap or background color
+		// precomputed irradiance of the ambient map (or map if ambient is not set). Evaluate with evalSh()
+		ShCoefficients ambientIrradiance;
+		uint64_t ambientIrradianceKey; // hashFile() of the source map, 0 if ambientIrradiance was not computed
+		// roughness prefiltered versions of map (equirectangular .hdr), level i has roughness i / (count - 1)
+		std::vector<std::filesystem::path> specularMips;
+		uint64_t specularMipsKey; // map hash combined with the bake settings, 0 if specularMips was not computed
+		// cube map version of map (.hdr faces in the order +x, -x, +y, -y, +z, -z)
+		std::vector<std::filesystem::path> cubeMap;
+		uint64_t cubeMapKey; // map hash combined with the conversion settings, 0 if cubeMap was not computed
 		// TODO add fogg https://docs.unrealengine.com/en-US/Engine/Components/Rendering/index.html
 
 		static const Environment& Default()
@@ -24,7 +35,13 @@ namespace hrsf
 				"",
 				glm::vec3(0.0f),
 				glm::vec3(0.0f),
-				glm::vec3(0.0f)
+				glm::vec3(0.0f),
+				{},
+				0,
+				{},
+				0,
+				{},
+				0
 			};
 			return e;
 		}
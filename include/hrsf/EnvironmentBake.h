@@ -0,0 +1,61 @@
+#pragma once
+#include <array>
+#include <vector>
+#include <glm/vec2.hpp>
+#include "Environment.h"
+#include "HdrImage.h"
+
+namespace hrsf
+{
+	struct SpecularBakeSettings
+	{
+		uint32_t baseWidth = 0; // width of the first level (0 = width of the map). height is baseWidth / 2
+		uint32_t levels = 6; // number of roughness levels (each level has half the resolution of the previous)
+		uint32_t sampleCount = 256; // ggx samples per texel
+	};
+
+	struct CubeMapSettings
+	{
+		uint32_t faceSize = 0; // width and height of each face (0 = width of the map / 4)
+		uint32_t samplesPerAxis = 2; // 1 = bilinear, n > 1 = n * n bilinear samples per texel (box filtered)
+	};
+
+	// Precomputation of environment map data that would otherwise be computed by every renderer at startup.
+	// The results are referenced by the Environment and are saved with the environment json.
+
+	/// \brief map that is used for the ambient lighting (ambient if set, otherwise map)
+	const std::filesystem::path& getAmbientSource(const Environment& env);
+
+	/// \brief returns true if env.ambientIrradiance matches the current content of the ambient source
+	bool isAmbientIrradianceValid(const Environment& env);
+	/// \brief projects the ambient source (radiance .hdr) onto spherical harmonics if the coefficients are missing or outdated
+	/// \param force recompute even if the cached coefficients are valid
+	/// \return true if the coefficients were recomputed
+	bool updateAmbientIrradiance(Environment& env, bool force = false);
+
+	/// \brief prefilters the equirectangular map with the ggx distribution (split sum approximation, n = v = r).
+	/// Level i uses the perceptual roughness i / (levels - 1) (alpha = roughness^2).
+	/// The result is deterministic (fixed hammersley sequence, no thread dependent summation).
+	std::vector<HdrImage> prefilterSpecular(const HdrImage& equirect, const SpecularBakeSettings& settings);
+
+	/// \brief returns true if env.specularMips exist and match the current content of env.map and the settings
+	bool isSpecularMipsValid(const Environment& env, const SpecularBakeSettings& settings = {});
+	/// \brief bakes the prefiltered mips of env.map if missing or outdated.
+	/// The levels are saved next to the map as <map>.<key>.spec<level>.hdr
+	/// \return true if the mips were recomputed
+	bool updateSpecularMips(Environment& env, const SpecularBakeSettings& settings = {}, bool force = false);
+
+	/// \brief resamples the equirectangular map to cube faces (multithreaded).
+	/// Faces are ordered +x, -x, +y, -y, +z, -z and use the usual cube map orientation
+	/// (e.g. +x: u => -z, v => -y)
+	std::array<HdrImage, 6> equirectToCubeMap(const HdrImage& equirect, const CubeMapSettings& settings);
+	/// \brief direction through the texel coordinates (u, v in [0, 1]) of the cube face
+	glm::vec3 cubeFaceToDirection(size_t face, glm::vec2 uv);
+
+	/// \brief returns true if env.cubeMap exists and matches the current content of env.map and the settings
+	bool isCubeMapValid(const Environment& env, const CubeMapSettings& settings = {});
+	/// \brief converts env.map to cube faces if missing or outdated.
+	/// The faces are saved next to the map as <map>.<key>.face<index>.hdr
+	/// \return true if the faces were recomputed
+	bool updateCubeMap(Environment& env, const CubeMapSettings& settings = {}, bool force = false);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include <filesystem>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace hrsf
+{
+	struct HdrImage;
+
+	/// entry of the alias table (one per pixel)
+	struct EnvironmentAliasEntry
+	{
+		float probability; // probability to keep this pixel, otherwise alias is taken
+		uint32_t alias; // pixel index
+	};
+
+	/// importance sampling tables for an equirectangular environment map.
+	/// Pixels are weighted by luminance * solid angle.
+	/// All arrays are tightly packed and can be uploaded to the gpu as they are.
+	struct EnvironmentSamplingTables
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		float integral = 0.0f; // sum of luminance * solid angle over all pixels
+
+		// height + 1 entries, marginalCdf[0] = 0, marginalCdf[height] = 1
+		std::vector<float> marginalCdf;
+		// height rows of width + 1 entries, each row goes from 0 to 1
+		std::vector<float> conditionalCdf;
+		// width * height entries
+		std::vector<EnvironmentAliasEntry> aliasTable;
+
+		/// \brief builds the tables (multithreaded)
+		static EnvironmentSamplingTables build(const HdrImage& equirect);
+
+		/// \brief samples a direction with the cdf tables
+		/// \param xi uniform random numbers in [0, 1)
+		/// \param pdf probability density with respect to the solid angle
+		glm::vec3 sample(glm::vec2 xi, float& pdf) const;
+		/// \brief samples a direction with the alias table
+		/// \param xi uniform random numbers in [0, 1)
+		/// \param pdf probability density with respect to the solid angle
+		glm::vec3 sampleAlias(glm::vec2 xi, float& pdf) const;
+		/// \brief probability density of sampling the direction (with respect to the solid angle)
+		float getPdf(const glm::vec3& dir) const;
+
+		/// \brief binary file with all tables
+		void save(const std::filesystem::path& filename) const;
+		static EnvironmentSamplingTables load(const std::filesystem::path& filename);
+
+		/// \brief loads the tables from the cache next to the map or builds and caches them.
+		/// The cache filename contains the hash of the map content => stale caches are never used.
+		static EnvironmentSamplingTables loadOrBuild(const std::filesystem::path& map);
+	private:
+		float getPixelPdf(size_t x, size_t y) const;
+		glm::vec3 getPixelDirection(float x, float y) const;
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <filesystem>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace hrsf
+{
+	/// linear rgb float image (row major, first row is the top of the image)
+	struct HdrImage
+	{
+		size_t width = 0;
+		size_t height = 0;
+		std::vector<glm::vec3> pixels;
+
+		HdrImage() = default;
+		HdrImage(size_t width, size_t height)
+			:
+		width(width), height(height), pixels(width * height, glm::vec3(0.0f))
+		{}
+
+		glm::vec3& at(size_t x, size_t y)
+		{
+			return pixels[y * width + x];
+		}
+		const glm::vec3& at(size_t x, size_t y) const
+		{
+			return pixels[y * width + x];
+		}
+
+		/// \brief bilinear lookup for equirectangular images (wraps horizontally, clamps vertically)
+		/// \param uv texture coordinates in [0, 1]
+		glm::vec3 sampleEquirect(glm::vec2 uv) const;
+
+		/// \brief loads a radiance (.hdr) file
+		static HdrImage load(const std::filesystem::path& filename);
+		/// \brief saves a radiance (.hdr) file with run length encoded scanlines
+		void save(const std::filesystem::path& filename) const;
+	};
+
+	// Equirectangular mapping used for all environment maps (y is up):
+	// u = 0 => phi = 0 (+x), u = 0.25 => +z, v = 0 => +y (top row), v = 1 => -y
+	// direction = (sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)) with phi = 2 * pi * u, theta = pi * v
+
+	/// \brief converts equirectangular texture coordinates to a normalized direction
+	glm::vec3 equirectToDirection(glm::vec2 uv);
+	/// \brief converts a normalized direction to equirectangular texture coordinates
+	glm::vec2 directionToEquirect(const glm::vec3& dir);
+	/// \brief solid angle of a pixel in row y of an equirectangular image
+	float equirectPixelSolidAngle(size_t y, size_t width, size_t height);
+}
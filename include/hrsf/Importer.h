@@ -0,0 +1,61 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include "Camera.h"
+#include "Light.h"
+#include "Material.h"
+#include "Mesh.h"
+
+namespace hrsf
+{
+	class SceneFormat;
+
+	/// receives the components of an imported scene (see SceneWriter for a target that writes directly to disk)
+	class ImportTarget
+	{
+	public:
+		virtual ~ImportTarget() = default;
+		/// \brief called once before the first mesh
+		virtual void setMaterials(std::vector<Material> materials) = 0;
+		/// \brief called from the importing thread in a deterministic order
+		virtual void addMesh(Mesh mesh) = 0;
+		virtual void setLights(std::vector<Light> lights) = 0;
+		/// \brief only called if the file contains a camera
+		virtual void setCamera(Camera camera) = 0;
+	};
+
+	struct ImportSettings
+	{
+		float scale = 1.0f; // applied to positions
+		size_t chunkSize = size_t(4) << 20; // bytes per obj parsing task
+		size_t meshBatchSize = 0; // gltf meshes that are built in parallel before they are passed to the target. 0 = thread count
+	};
+
+	struct PlySettings
+	{
+		float scale = 1.0f; // applied to positions and radii
+		size_t chunkPoints = size_t(1) << 20; // points that are read and converted at once
+		size_t maxPointsPerMesh = size_t(1) << 22; // larger point sets are split into octants
+		uint32_t colorBits = 5; // bits per color channel [1, 8]. One material is created for every used color
+		bool radiusAsTexcoord = true; // stores the "radius" property in texcoord0.x
+		std::filesystem::path tempDirectory; // for the octant files, empty = system temp directory
+	};
+
+	/// \brief imports a wavefront obj file (and the referenced mtl files) as a single triangle mesh with one shape per material.
+	/// The file is parsed in parallel chunks, shapes with more than 65536 vertices are split.
+	/// Texture coordinates are flipped vertically (bmf uses the gltf convention with v = 0 at the top of the image)
+	void importObj(const std::filesystem::path& filename, ImportTarget& target, const ImportSettings& settings = {});
+	/// \brief imports a gltf 2.0 file (.gltf or .glb). Every mesh instance in the default scene becomes a triangle mesh
+	/// with one shape per primitive. KHR_lights_punctual lights and the first perspective camera are imported as well.
+	/// Buffers are decoded in parallel
+	void importGltf(const std::filesystem::path& filename, ImportTarget& target, const ImportSettings& settings = {});
+	/// \brief streams a binary or ascii ply point cloud into billboard meshes.
+	/// Positions, normals, colors (as palette materials) and radii are converted in chunks of PlySettings::chunkPoints.
+	/// Point sets with more than maxPointsPerMesh points are recursively split into octants through temporary files,
+	/// so memory usage is bounded by the chunk size and maxPointsPerMesh. The file is read twice (bounds and colors first)
+	void importPly(const std::filesystem::path& filename, ImportTarget& target, const PlySettings& settings = {});
+	/// \brief imports .obj, .gltf, .glb or .ply based on the file extension
+	void importScene(const std::filesystem::path& filename, ImportTarget& target, const ImportSettings& settings = {});
+	/// \brief imports .obj, .gltf, .glb or .ply into memory
+	SceneFormat importScene(const std::filesystem::path& filename, const ImportSettings& settings = {});
+}
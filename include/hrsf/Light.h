@@ -1,10 +1,13 @@
 #pragma once
+#include <cstddef>
+#include <vector>
 #include <glm/vec3.hpp>
 #include "Path.h"
 
 namespace hrsf
 {
 	// light structure that is aligned to 16 byte for the graphics card
+	// (matches the GLSL struct { int type; vec3 position; vec3 color; float radius; } with the scalar block layout)
 	struct LightData
 	{
 		enum Type
@@ -24,9 +27,73 @@ namespace hrsf
 		float radius; // for point light
 	};
 
+	/// memory layout rules of the shader buffer that receives the light data
+	enum class BufferLayout
+	{
+		Std140, // uniform buffers
+		Std430, // shader storage buffers
+		Scalar // GL_EXT_scalar_block_layout (same as LightData)
+	};
+
+	/// LightData with std430 alignment: vec3 members are aligned to 16 bytes
+	struct LightDataStd430
+	{
+		int type;
+		float padding0[3];
+		glm::vec3 position; // position or direction
+		float padding1;
+		glm::vec3 color;
+		float radius;
+	};
+
+	/// the light struct contains no arrays => std140 only differs in the (already 16 byte aligned) array stride
+	using LightDataStd140 = LightDataStd430;
+
+	static_assert(sizeof(glm::vec3) == 12, "glm::vec3 must be tightly packed");
+	static_assert(offsetof(LightData, type) == 0, "scalar layout mismatch");
+	static_assert(offsetof(LightData, position) == 4, "scalar layout mismatch");
+	static_assert(offsetof(LightData, color) == 16, "scalar layout mismatch");
+	static_assert(offsetof(LightData, radius) == 28, "scalar layout mismatch");
+	static_assert(sizeof(LightData) == 32, "scalar layout mismatch");
+	static_assert(offsetof(LightDataStd430, type) == 0, "std430 layout mismatch");
+	static_assert(offsetof(LightDataStd430, position) == 16, "std430 layout mismatch");
+	static_assert(offsetof(LightDataStd430, color) == 32, "std430 layout mismatch");
+	static_assert(offsetof(LightDataStd430, radius) == 44, "std430 layout mismatch");
+	static_assert(sizeof(LightDataStd430) == 48, "std430 layout mismatch");
+	static_assert(sizeof(LightDataStd140) % 16 == 0, "std140 array stride must be a multiple of 16");
+
+	/// \brief size of one light in a buffer with the given layout
+	constexpr size_t getLightStride(BufferLayout layout)
+	{
+		return layout == BufferLayout::Scalar ? sizeof(LightData) : sizeof(LightDataStd430);
+	}
+
+	/// what was written into one light buffer by SceneFormat::getLightsData(dst, layout, state).
+	/// Keep one object per buffer (e.g. per frame in flight) => every buffer receives all changes since its own last update
+	struct LightExportState
+	{
+		std::vector<glm::vec3> positions; // current light positions in the buffer
+		BufferLayout layout = BufferLayout::Scalar;
+	};
+
 	struct Light
 	{
 		LightData data;
 		Path path;
+
+		/// current position of a point light (including the path offset)
+		glm::vec3 getPosition() const
+		{
+			return data.position + path.getPosition();
+		}
+
+		/// light data with the current path offset applied
+		LightData getCurrentData() const
+		{
+			auto res = data;
+			if (data.type == LightData::Point)
+				res.position = getPosition();
+			return res;
+		}
 	};
 }
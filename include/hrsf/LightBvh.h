@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <filesystem>
+#include <glm/vec3.hpp>
+#include "Light.h"
+
+namespace hrsf
+{
+	/// node of the light bvh (64 bytes). Matches the GLSL struct
+	/// { vec3 boundsMin; float power; vec3 boundsMax; float cosTheta; vec3 coneAxis; uint childOrFirst; uint count; }
+	/// with the std140 and std430 layouts (the struct size is rounded up to 64 bytes, do not declare the padding in GLSL).
+	/// Nodes are stored depth first: the left child of an interior node i is i + 1.
+	struct LightBvhNode
+	{
+		glm::vec3 boundsMin;
+		float power; // sum of the power of all lights in the subtree
+		glm::vec3 boundsMax;
+		float cosTheta; // cosine of the orientation cone angle, -1 for omnidirectional emitters
+		glm::vec3 coneAxis;
+		uint32_t childOrFirst; // interior node: index of the right child. leaf: first index into getLightIndices()
+		uint32_t count; // 0 for interior nodes, number of lights for leaves
+		uint32_t padding[3]; // implicit struct padding on the GPU
+
+		bool isLeaf() const { return count != 0; }
+	};
+	static_assert(offsetof(LightBvhNode, power) == 12, "std140 layout mismatch");
+	static_assert(offsetof(LightBvhNode, boundsMax) == 16, "std140 layout mismatch");
+	static_assert(offsetof(LightBvhNode, cosTheta) == 28, "std140 layout mismatch");
+	static_assert(offsetof(LightBvhNode, coneAxis) == 32, "std140 layout mismatch");
+	static_assert(offsetof(LightBvhNode, childOrFirst) == 44, "std140 layout mismatch");
+	static_assert(offsetof(LightBvhNode, count) == 48, "std140 layout mismatch");
+	static_assert(sizeof(LightBvhNode) == 64, "std140 struct size mismatch");
+
+	struct LightBvhSettings
+	{
+		uint32_t maxLeafSize = 4;
+		uint32_t binCount = 16; // number of bins for the split search
+	};
+
+	/// bounding volume hierarchy over point lights for many light sampling.
+	/// Directional lights have no position and are kept in a separate list.
+	/// Light positions include the current path offset (Light::getPosition()).
+	class LightBvh
+	{
+	public:
+		LightBvh() = default;
+		/// \brief builds the hierarchy (large subtrees are built in parallel)
+		explicit LightBvh(const std::vector<Light>& lights, const LightBvhSettings& settings = {});
+
+		/// \brief updates bounds and power after lights moved (e.g. after Path::update).
+		/// The topology stays the same => quality may degrade for large movements
+		/// \param lights same lights (same order and count) as used for construction
+		void refit(const std::vector<Light>& lights);
+
+		/// \brief picks a light from the hierarchy proportional to its estimated contribution at position
+		/// \param u uniform random number in [0, 1)
+		/// \param pmf probability of the chosen light
+		/// \return index into the lights vector
+		uint32_t sample(const glm::vec3& position, float u, float& pmf) const;
+
+		const std::vector<LightBvhNode>& getNodes() const { return m_nodes; }
+		/// light indices referenced by the leaves
+		const std::vector<uint32_t>& getLightIndices() const { return m_indices; }
+		/// power of the lights in getLightIndices() order
+		const std::vector<float>& getLightPowers() const { return m_powers; }
+		/// indices of directional lights
+		const std::vector<uint32_t>& getInfiniteLights() const { return m_infinite; }
+
+		/// \brief binary file with nodes and index lists
+		void save(const std::filesystem::path& filename) const;
+		static LightBvh load(const std::filesystem::path& filename);
+	private:
+		struct BuildLight
+		{
+			glm::vec3 min;
+			glm::vec3 max;
+			glm::vec3 center;
+			float power;
+		};
+
+		std::vector<LightBvhNode> buildRecursive(std::vector<uint32_t>& indices, const std::vector<BuildLight>& lights,
+			size_t begin, size_t end, size_t depth) const;
+		static LightBvhNode makeLeaf(const std::vector<uint32_t>& indices, const std::vector<BuildLight>& lights, size_t begin, size_t end);
+		static float getImportance(const LightBvhNode& node, const glm::vec3& position);
+
+		LightBvhSettings m_settings;
+		std::vector<LightBvhNode> m_nodes;
+		std::vector<uint32_t> m_indices;
+		std::vector<float> m_powers;
+		std::vector<uint32_t> m_infinite;
+	};
+}
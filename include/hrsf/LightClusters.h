@@ -0,0 +1,69 @@
+#pragma once
+#include <vector>
+#include "Camera.h"
+#include "Light.h"
+
+namespace hrsf
+{
+	struct LightClusterSettings
+	{
+		uint32_t width = 1920; // render resolution
+		uint32_t height = 1080;
+		uint32_t tilesX = 16; // number of screen space tiles in x direction
+		uint32_t tilesY = 9;
+		uint32_t slices = 24; // number of exponential depth slices between near and far
+		float cutoff = 0.01f; // intensity at which a point light is considered to have no influence
+	};
+
+	/// assigns point lights to the clusters (froxels) of the camera frustum for forward+ / clustered shading.
+	/// Directional lights affect all clusters and are not part of the grid.
+	/// Keep the object alive between frames: all internal buffers are reused.
+	class LightClusterGrid
+	{
+	public:
+		/// \brief bins the point lights into the froxel grid (multithreaded over the depth slices)
+		/// \param camera camera with the current path position and look at already applied
+		void build(const CameraData& camera, const std::vector<Light>& lights, const LightClusterSettings& settings);
+
+		/// \brief cluster index for the tile and slice: (slice * tilesY + tileY) * tilesX + tileX
+		/// tileY = 0 is the top of the screen
+		uint32_t getClusterIndex(uint32_t tileX, uint32_t tileY, uint32_t slice) const;
+		/// \brief slice that contains the view space depth (distance along the view direction)
+		uint32_t getSlice(float depth) const;
+		/// \brief view space depth of the near plane of the slice (slice = slices returns the far plane)
+		float getSliceDepth(uint32_t slice) const;
+
+		/// clusterCount + 1 entries. Lights of cluster c are getLightIndices()[offsets[c]] to getLightIndices()[offsets[c + 1] - 1]
+		const std::vector<uint32_t>& getOffsets() const { return m_offsets; }
+		/// indices into the lights vector
+		const std::vector<uint32_t>& getLightIndices() const { return m_indices; }
+		size_t getClusterCount() const { return m_offsets.empty() ? 0 : m_offsets.size() - 1; }
+	private:
+		// view space light spheres (structure of arrays, padded to a multiple of 4)
+		struct SphereList
+		{
+			std::vector<float> x, y, z, radius;
+			std::vector<uint32_t> index;
+			void clear();
+			void push(float x, float y, float z, float r, uint32_t idx);
+			void pad();
+		};
+
+		void buildSlice(uint32_t slice);
+
+		LightClusterSettings m_settings;
+		float m_near = 0.0f;
+		float m_far = 0.0f;
+		float m_logFarNear = 0.0f;
+		float m_tanX = 0.0f; // tan(fov / 2) * aspect
+		float m_tanY = 0.0f; // tan(fov / 2)
+
+		SphereList m_spheres; // all lights inside the frustum
+		std::vector<SphereList> m_sliceSpheres; // per slice candidates
+		std::vector<std::vector<uint32_t>> m_sliceIndices; // per slice: concatenated light indices of its clusters
+		std::vector<std::vector<uint32_t>> m_sliceCounts; // per slice: light count of each cluster
+
+		std::vector<uint32_t> m_offsets;
+		std::vector<uint32_t> m_indices;
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "Light.h"
+
+namespace hrsf
+{
+	/// \brief power of the light (luminance of the color times the solid angle of the emission)
+	float getLightPower(const LightData& light);
+	/// \brief distance at which the intensity of the point light drops below cutoff (inverse square falloff).
+	/// Returns infinity for directional lights
+	float getLightRange(const LightData& light, float cutoff);
+
+	/// influence spheres and importance of all lights (structure of arrays for culling and prioritization).
+	/// Keep the object alive between frames: after the first update() only lights with paths are recomputed.
+	class LightInfluence
+	{
+	public:
+		/// \param cutoff intensity at which a point light is considered to have no influence
+		explicit LightInfluence(float cutoff = 0.01f);
+
+		/// \brief updates the light positions of animated lights.
+		/// Everything is recomputed if the light count changed or after invalidate()
+		void update(const std::vector<Light>& lights);
+		/// \brief forces a full recomputation on the next update (call after changing light data)
+		void invalidate();
+		void setCutoff(float cutoff);
+		float getCutoff() const { return m_cutoff; }
+
+		/// current position of the light center (0 for directional lights)
+		const std::vector<float>& getX() const { return m_x; }
+		const std::vector<float>& getY() const { return m_y; }
+		const std::vector<float>& getZ() const { return m_z; }
+		/// influence radius (infinity for directional lights)
+		const std::vector<float>& getRanges() const { return m_ranges; }
+		/// see getLightPower()
+		const std::vector<float>& getPowers() const { return m_powers; }
+		/// luminance of the color (intensity of point lights, irradiance of directional lights)
+		const std::vector<float>& getLuminances() const { return m_luminances; }
+		/// irradiance divided by the irradiance of all lights. Point lights are measured at a distance of 1 (their intensity),
+		/// directional lights everywhere => both light types are ranked in the same unit
+		const std::vector<float>& getImportance() const { return m_importance; }
+		/// indices of the lights that follow a path
+		const std::vector<uint32_t>& getAnimatedLights() const { return m_animated; }
+		size_t size() const { return m_ranges.size(); }
+
+		/// \brief appends the indices of all lights whose influence sphere intersects the sphere
+		void cull(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+		/// \brief appends the indices of the maxCount most important lights for the position (sorted by importance).
+		/// Lights are weighted by their irradiance at the position (see getLuminances(): divided by distance^2 for point lights,
+		/// constant for directional lights). Point lights outside their range are skipped. Thread safe
+		void getMostImportant(const glm::vec3& position, size_t maxCount, std::vector<uint32_t>& out) const;
+	private:
+		void rebuild(const std::vector<Light>& lights);
+
+		float m_cutoff;
+		bool m_dirty = true;
+
+		std::vector<float> m_x;
+		std::vector<float> m_y;
+		std::vector<float> m_z;
+		std::vector<float> m_ranges;
+		std::vector<float> m_powers;
+		std::vector<float> m_luminances;
+		std::vector<float> m_importance;
+		std::vector<uint32_t> m_animated;
+	};
+}
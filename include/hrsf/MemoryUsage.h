@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace hrsf
+{
+	struct Mesh;
+
+	/// heap bytes of a single mesh. All values include the unused vector capacity,
+	/// slack is the part of the total that is allocated but unused.
+	struct MeshMemoryUsage
+	{
+		size_t vertices = 0;
+		size_t indices = 0;
+		size_t shapes = 0;
+		size_t paths = 0; // position and lookAt path
+		size_t slack = 0;
+
+		size_t total() const { return vertices + indices + shapes + paths; }
+	};
+
+	/// \brief heap bytes of the mesh
+	MeshMemoryUsage getMeshMemoryUsage(const Mesh& mesh);
+
+	/// heap bytes of a SceneFormat (see SceneFormat::memoryUsage())
+	struct MemoryUsage
+	{
+		std::vector<MeshMemoryUsage> meshes;
+		size_t meshArray = 0; // the mesh vector itself
+		size_t materials = 0; // material array, names and texture filenames
+		size_t lights = 0; // light array and paths
+		size_t camera = 0; // camera paths
+		size_t benchmarks = 0; // benchmark cameras, names and paths
+		size_t environment = 0; // filenames
+		size_t other = 0; // scene references, prefab instances and shared prefab scenes (counted again by every scene that holds them)
+		size_t slack = 0; // unused capacity of everything except meshes
+
+		MeshMemoryUsage getMeshTotal() const;
+		size_t total() const;
+		/// \brief human readable table with one line per component and mesh
+		std::string toString() const;
+	};
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <filesystem>
+#include "Bounds.h"
+#include "Mesh.h"
+#include "Path.h"
+
+namespace hrsf
+{
+	/// description of a mesh that can be obtained without loading the bmf file
+	struct MeshInfo
+	{
+		std::filesystem::path file; // mesh json (can be loaded with SceneFormat::loadMesh())
+		Mesh::Type type = Mesh::Triangle;
+		BoundingBox bounds; // local space bounds. Empty if the mesh json was written by an older version
+		// bmf sizes. All zero if the mesh json was written by an older version
+		uint32_t attributes = 0;
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		size_t shapeCount = 0;
+		Path position;
+		Path lookAt;
+
+		bool hasCounts() const
+		{
+			return attributes != 0;
+		}
+
+		bool isStatic() const
+		{
+			return position.isStatic() && lookAt.isStatic();
+		}
+	};
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Camera.h"
+#include "MeshInfo.h"
+
+namespace hrsf
+{
+	struct PrefetchSettings
+	{
+		float horizon = 2.0f; // seconds the camera path is evaluated ahead
+		float timeStep = 0.1f; // time between two evaluated camera states
+		float distance = 0.0f; // meshes closer to the camera than this are loaded as well (0 = frustum only)
+		float aspect = 16.0f / 9.0f; // camera aspect ratio
+		uint32_t threadCount = 2; // number of background loader threads
+	};
+
+	/// loads meshes in the background before the camera path reaches them.
+	/// update() evaluates the camera (and mesh) paths for the next horizon seconds and queues all meshes
+	/// that enter the frustum or the distance range, ordered by the time they become relevant.
+	/// Meshes without bounds in their json (written by older versions) are treated as always relevant.
+	class MeshPrefetcher
+	{
+	public:
+		/// \param meshes mesh descriptions (see SceneFormat::loadMeshInfos())
+		MeshPrefetcher(std::vector<MeshInfo> meshes, const PrefetchSettings& settings = {});
+		~MeshPrefetcher();
+		MeshPrefetcher(const MeshPrefetcher&) = delete;
+		MeshPrefetcher& operator=(const MeshPrefetcher&) = delete;
+
+		/// \brief advances the mesh paths and replaces the queue of pending loads
+		/// \param camera camera at the current path time
+		/// \param dt time since the last update (advances the mesh paths)
+		void update(const Camera& camera, float dt = 0.0f);
+
+		/// \brief returns the mesh. Waits for a pending load or loads the mesh synchronously if it was not requested.
+		/// The mesh stays valid while the pointer is held, even if it is unloaded.
+		/// Exceptions of the background load are rethrown
+		std::shared_ptr<const Mesh> get(size_t index);
+		bool isLoaded(size_t index) const;
+		/// \brief releases the mesh (the memory is freed when the last pointer returned by get() is released, the mesh may be requested again)
+		void unload(size_t index);
+
+		/// number of meshes that are queued or currently loading
+		size_t getPendingCount() const;
+		/// mesh indices that were queued by the last update() in priority order
+		const std::vector<uint32_t>& getLastRequests() const { return m_lastRequests; }
+		const std::vector<MeshInfo>& getMeshInfos() const { return m_infos; }
+	private:
+		enum class State
+		{
+			Unloaded,
+			Queued,
+			Loading,
+			Loaded,
+			Failed
+		};
+
+		struct Slot
+		{
+			State state = State::Unloaded;
+			std::shared_ptr<const Mesh> mesh;
+			std::exception_ptr error;
+		};
+
+		void worker();
+
+		std::vector<MeshInfo> m_infos;
+		PrefetchSettings m_settings;
+		std::vector<uint32_t> m_lastRequests;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_workAvailable;
+		std::condition_variable m_loadFinished;
+		std::vector<Slot> m_slots;
+		std::vector<uint32_t> m_queue; // pending loads, highest priority last
+		bool m_stop = false;
+		std::vector<std::thread> m_threads;
+
+		// scratch buffers of update()
+		std::vector<CameraMatrices> m_frames;
+		std::vector<float> m_priority;
+	};
+}
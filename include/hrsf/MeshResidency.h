@@ -0,0 +1,121 @@
+#pragma once
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "MeshInfo.h"
+
+namespace hrsf
+{
+	struct ResidencySettings
+	{
+		size_t budget = size_t(1) << 30; // bytes of resident mesh data (see getMeshMemoryUsage())
+		uint32_t threadCount = 2; // number of background loader threads
+	};
+
+	struct ResidencyCounters
+	{
+		size_t hits = 0; // acquire() and tryAcquire() calls that found the mesh resident
+		size_t misses = 0; // acquire() and tryAcquire() calls that did not
+		size_t loads = 0; // meshes loaded (in the background or by acquire())
+		size_t evictions = 0;
+		size_t bytesLoaded = 0;
+		size_t bytesEvicted = 0;
+		size_t residentBytes = 0;
+		size_t peakResidentBytes = 0;
+	};
+
+	/// keeps the mesh data of a scene within a memory budget.
+	/// Meshes are loaded on request (in the background by priority or synchronously by acquire()).
+	/// If a load exceeds the budget, the least recently used meshes that are not pinned or held are evicted.
+	/// Space for a load is made before the bmf file is read if the mesh json contains the bmf sizes.
+	/// Pinned meshes and meshes that are still held through a pointer returned by acquire() are never evicted,
+	/// the budget can be exceeded if all resident meshes are pinned or held
+	class MeshResidency
+	{
+	public:
+		/// \param meshes mesh descriptions (see SceneFormat::loadMeshInfos())
+		MeshResidency(std::vector<MeshInfo> meshes, const ResidencySettings& settings = {});
+		~MeshResidency();
+		MeshResidency(const MeshResidency&) = delete;
+		MeshResidency& operator=(const MeshResidency&) = delete;
+
+		/// \brief queues the mesh for a background load (higher priorities are loaded first).
+		/// Changes the priority of queued meshes and retries failed loads. Resident and loading meshes are ignored
+		void request(size_t index, float priority = 0.0f);
+		/// \brief returns the mesh and marks it as recently used. Waits for a pending load or loads the mesh synchronously.
+		/// Exceptions of the load are rethrown
+		std::shared_ptr<const Mesh> acquire(size_t index);
+		/// \brief returns the mesh and marks it as recently used or nullptr if it is not resident
+		std::shared_ptr<const Mesh> tryAcquire(size_t index);
+		bool isResident(size_t index) const;
+
+		/// \brief pinned meshes are not evicted (pins are counted and may be set before the mesh is resident)
+		void pin(size_t index);
+		void unpin(size_t index);
+		/// \brief frees the mesh memory unless it is pinned, held or loading
+		void evict(size_t index);
+
+		/// \brief changes the budget and evicts meshes if the resident bytes exceed it
+		void setBudget(size_t bytes);
+		size_t getBudget() const;
+
+		ResidencyCounters getCounters() const;
+		/// \brief resets hits, misses, loads and evictions (resident bytes are kept, the peak is set to the resident bytes)
+		void resetCounters();
+		/// number of meshes that are queued or currently loading
+		size_t getPendingCount() const;
+		/// \brief blocks until all queued meshes are loaded
+		void wait() const;
+		const std::vector<MeshInfo>& getMeshInfos() const { return m_infos; }
+	private:
+		enum class State
+		{
+			Unloaded,
+			Queued,
+			Loading,
+			Resident,
+			Failed
+		};
+
+		struct Slot
+		{
+			State state = State::Unloaded;
+			std::shared_ptr<const Mesh> mesh;
+			std::exception_ptr error;
+			size_t bytes = 0; // bytes of the resident mesh
+			uint32_t pins = 0;
+			float priority = 0.0f; // of the queued mesh
+			std::list<uint32_t>::iterator lru; // position in m_lru if resident
+		};
+
+		// all functions below expect a locked m_mutex
+		/// \brief loads the mesh of a slot in the Loading state (the lock is released while reading the file)
+		void load(std::unique_lock<std::mutex>& lock, uint32_t index);
+		/// \brief evicts least recently used meshes until the additional bytes fit into the budget
+		void makeRoom(size_t bytes);
+		void release(uint32_t index);
+		/// \brief pinned or held by a caller
+		bool isLocked(uint32_t index) const;
+		void touch(uint32_t index);
+		void worker();
+
+		std::vector<MeshInfo> m_infos;
+		size_t m_budget;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_workAvailable;
+		mutable std::condition_variable m_loadFinished;
+		std::vector<Slot> m_slots;
+		std::set<std::pair<float, uint32_t>> m_queue; // pending loads (negated priority, index) => highest priority first
+		std::list<uint32_t> m_lru; // resident meshes, most recently used first
+		size_t m_reservedBytes = 0; // estimated bytes of the meshes that are loading
+		ResidencyCounters m_counters;
+		bool m_stop = false;
+		std::vector<std::thread> m_threads;
+	};
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hrsf
+{
+	/// \brief number of worker threads used by the parallel algorithms
+	inline size_t getThreadCount()
+	{
+		return std::max<size_t>(1, std::thread::hardware_concurrency());
+	}
+
+	/// \brief calls func(i) for every i in [begin, end) on all hardware threads.
+	/// Indices are handed out in blocks of grainSize. The first exception thrown
+	/// by func will be rethrown on the calling thread after all workers finished.
+	template<class Func>
+	void parallelFor(size_t begin, size_t end, Func&& func, size_t grainSize = 1)
+	{
+		if (begin >= end) return;
+		grainSize = std::max<size_t>(1, grainSize);
+		const size_t numBlocks = (end - begin + grainSize - 1) / grainSize;
+		const size_t numThreads = std::min(getThreadCount(), numBlocks);
+
+		std::atomic<size_t> nextBlock = 0;
+		std::exception_ptr error;
+		std::mutex errorMutex;
+
+		auto worker = [&]()
+		{
+			try
+			{
+				for (size_t block = nextBlock++; block < numBlocks; block = nextBlock++)
+				{
+					const size_t first = begin + block * grainSize;
+					const size_t last = std::min(end, first + grainSize);
+					for (size_t i = first; i < last; ++i)
+						func(i);
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error) error = std::current_exception();
+				nextBlock = numBlocks; // stop the other workers
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(numThreads - 1);
+		for (size_t t = 1; t < numThreads; ++t)
+			threads.emplace_back(worker);
+		worker();
+		for (auto& t : threads)
+			t.join();
+
+		if (error) std::rethrow_exception(error);
+	}
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include <array>
+#include <cassert>
+#include <stdexcept>
 #include <vector>
 #include <glm/vec3.hpp>
 
@@ -12,6 +14,16 @@ namespace hrsf
 		glm::vec3 position;
 	};
 
+	/// current state of a path (changes with every update that advances the time)
+	struct PathCursor
+	{
+		size_t section = 0;
+		float time = 0.0f;
+
+		bool operator==(const PathCursor& o) const { return section == o.section && time == o.time; }
+		bool operator!=(const PathCursor& o) const { return !(*this == o); }
+	};
+
 	/// describes the path an object takes.
 	/// 
 	/// For position paths (getPosition()):
@@ -66,18 +78,30 @@ namespace hrsf
 				return m_sections.front().position * (m_time / m_sections.front().time);
 			}
 			// spline interpolation
+			const auto cp = getControlPoints(m_curSection);
+			return getBezierPoint(cp[0], cp[1], cp[2], cp[3], m_time / m_sections[m_curSection].time);
+		}
+		/// \brief bezier control points of a position path section.
+		/// The section moves from [0] to [3] in getSections()[section].time seconds
+		std::array<glm::vec3, 4> getControlPoints(size_t section) const
+		{
+			assert(section < m_sections.size());
+			if (m_sections.size() == 1)
+			{
+				// linear interpolation (the single section is not scaled, see getPosition())
+				const auto p = m_sections.front().position;
+				return { glm::vec3(0.0f), p / 3.0f, p * (2.0f / 3.0f), p };
+			}
 			// previous point
-			const auto preLeft = getPoint(int(m_curSection) - 1);
-			const auto left = getPoint(int(m_curSection));
-			const auto right = getPoint(int(m_curSection) + 1);
-			const auto postRight = getPoint(int(m_curSection) + 2);
+			const auto preLeft = getPoint(int(section) - 1);
+			const auto left = getPoint(int(section));
+			const auto right = getPoint(int(section) + 1);
+			const auto postRight = getPoint(int(section) + 2);
 
 			// control point 1
 			const auto cp1 = left + (right - preLeft) / 6.0f;
 			const auto cp2 = right + (left - postRight) / 6.0f;
-
-			// get spline
-			return getBezierPoint(left, cp1, cp2, right, m_time / m_sections[m_curSection].time);
+			return { left, cp1, cp2, right };
 		}
 		glm::vec3 getLookAt() const
 		{
@@ -113,6 +137,16 @@ namespace hrsf
 		{
 			return m_sections.empty();
 		}
+		PathCursor getCursor() const
+		{
+			return { m_curSection, m_time };
+		}
+		/// \brief moves the path back to its start
+		void reset()
+		{
+			m_curSection = 0;
+			m_time = 0.0f;
+		}
 		// throws an exception if negative section times are present
 		void verify() const
 		{
@@ -165,8 +199,8 @@ namespace hrsf
 	private:
 		std::vector<PathSection> m_sections;
 		size_t m_curSection = 0;
-		float m_scale;
+		float m_scale = 1.0f;
 		float m_time = 0.0f;
-		bool m_isCircle;
+		bool m_isCircle = false;
 	};
 }
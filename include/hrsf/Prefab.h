@@ -0,0 +1,45 @@
+#pragma once
+#include <filesystem>
+#include <memory>
+#include <glm/mat4x4.hpp>
+#include "Light.h"
+#include "Mesh.h"
+
+namespace hrsf
+{
+	class SceneFormat;
+
+	/// reference to another scene file as written in the "references" array of the scene json:
+	/// { "file": "building.json", "matrix": [16 floats, column major] }
+	/// instead of "matrix", "translation", "rotation" (quaternion x y z w) and "scale" may be used (like gltf nodes)
+	struct SceneReference
+	{
+		std::filesystem::path file; // absolute filename of the scene json
+		glm::mat4 transform; // referenced scene to referencing scene space
+	};
+
+	/// scene that is referenced one or more times (directly or by other prefabs).
+	/// Every file is loaded once, the data is shared by all instances
+	struct Prefab
+	{
+		std::filesystem::path file;
+		/// meshes, materials and lights of the file (references of the file are resolved by the root scene)
+		std::shared_ptr<const SceneFormat> scene;
+		/// the prefab materials start at this index in the root scene materials.
+		/// It must be added to the material ids of the prefab meshes
+		uint32_t materialOffset;
+	};
+
+	struct PrefabInstance
+	{
+		uint32_t prefab; // index into SceneFormat::getPrefabs()
+		glm::mat4 transform; // prefab to root scene space (transforms of nested references are already combined)
+	};
+
+	/// \brief copy of the mesh with transformed positions, normals and paths.
+	/// The winding order is flipped for mirroring transforms.
+	/// Throws if the mesh has a lookAt path and the transform has a translation (the rotation would pivot around the wrong origin)
+	Mesh transformMesh(const Mesh& mesh, const glm::mat4& transform, uint32_t materialOffset);
+	/// \brief copy of the light with transformed position (or direction), path and radius (scaled by the largest axis scale)
+	Light transformLight(const Light& light, const glm::mat4& transform);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include "Camera.h"
+#include "Path.h"
+
+namespace hrsf
+{
+	class SceneFormat;
+
+	struct PvsSettings
+	{
+		float cellDuration = 0.5f; // camera path time covered by one cell
+		uint32_t samplesPerCell = 4; // camera positions per cell
+		uint32_t resolution = 64; // resolution of each cube face of the software rasterizer
+		float near = 0.05f;
+	};
+
+	/// shape of a mesh (entry of the potentially visible set)
+	struct PvsEntry
+	{
+		uint32_t mesh;
+		uint32_t shape; // 0 for billboard meshes without shapes
+	};
+
+	/// potentially visible sets along the camera position path.
+	/// The path is divided into cells of equal duration. For each cell, the scene is rasterized into cube maps
+	/// (all view directions) at several positions on the path and every shape that is not completely occluded is marked visible.
+	/// The sets are conservative: shapes are tested against every pixel that they touch (including sub-pixel triangles),
+	/// occluders only hide the pixels that they cover completely.
+	/// Meshes with paths are always visible (they are not used as occluders either).
+	/// Billboards are rasterized as points and do not occlude.
+	class Pvs
+	{
+	public:
+		Pvs() = default;
+
+		/// \brief builds the sets (multithreaded over the cells). Throws if the scene has prefab instances (see SceneFormat::expandReferences())
+		static Pvs build(const SceneFormat& scene, const PvsSettings& settings = {});
+
+		/// \brief cell for the path state. O(1)
+		uint32_t getCell(const PathCursor& cursor) const;
+		/// \brief cell for the time since the path start (wraps around after the path duration). O(1)
+		uint32_t getCell(float time) const;
+		uint32_t getCellCount() const { return m_cellCount; }
+
+		/// \brief O(1) lookup
+		bool isVisible(uint32_t cell, size_t entry) const
+		{
+			return (m_bits[size_t(cell) * m_wordsPerCell + entry / 64] >> (entry % 64)) & 1;
+		}
+		/// bitset of the cell (getWordsPerCell() words, bit i = entry i)
+		const uint64_t* getBits(uint32_t cell) const { return m_bits.data() + size_t(cell) * m_wordsPerCell; }
+		size_t getWordsPerCell() const { return m_wordsPerCell; }
+		/// \brief number of visible entries of the cell
+		size_t getVisibleCount(uint32_t cell) const;
+		/// all shapes ordered by mesh and shape
+		const std::vector<PvsEntry>& getEntries() const { return m_entries; }
+
+		void save(const std::filesystem::path& filename) const;
+		static Pvs load(const std::filesystem::path& filename);
+		/// \brief loads the sets from the cache next to the scene file or builds and caches them.
+		/// The cache key is derived from the camera path, the mesh vertices, indices and shapes and the settings.
+		static Pvs loadOrBuild(const std::filesystem::path& sceneFile, const SceneFormat& scene, const PvsSettings& settings = {});
+	private:
+		float m_cellDuration = 1.0f;
+		float m_duration = 0.0f; // camera path duration (the last cell may be shorter than m_cellDuration)
+		uint32_t m_cellCount = 0;
+		std::vector<float> m_sectionStart; // start time of each path section
+		size_t m_wordsPerCell = 0;
+		std::vector<PvsEntry> m_entries;
+		std::vector<uint64_t> m_bits;
+	};
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Benchmark.h"
+#include "Bounds.h"
+#include "Camera.h"
+#include "Light.h"
+
+namespace hrsf
+{
+	class SceneFormat;
+
+	struct ReplaySettings
+	{
+		float timeStep = 1.0f / 60.0f; // fixed time between two frames
+		float aspect = 16.0f / 9.0f;
+		bool computeStats = true; // frustum culling per frame
+	};
+
+	/// scene statistics of one frame (view frustum culling of the shape bounds)
+	struct FrameStats
+	{
+		size_t visibleMeshes = 0;
+		size_t visibleShapes = 0;
+		size_t visibleTriangles = 0; // triangle meshes
+		size_t visibleBillboards = 0; // billboard meshes
+	};
+
+	/// mesh transformation at the frame time
+	struct MeshState
+	{
+		glm::vec3 position; // position path offset
+		glm::vec3 lookAt; // look at path target (0 if the mesh has no look at path)
+	};
+
+	struct ReplayFrame
+	{
+		uint32_t index = 0;
+		float time = 0.0f; // index * timeStep
+		CameraData camera; // with the paths applied
+		CameraMatrices matrices;
+		std::vector<MeshState> meshes;
+		std::vector<LightData> lights; // with the paths applied
+		FrameStats stats;
+	};
+
+	/// deterministic replay of a benchmark camera.
+	/// All paths (camera, meshes and lights) start at time 0 and are advanced with a fixed time step,
+	/// which makes every run produce exactly the same frames.
+	/// The scene must outlive the driver.
+	class ReplayDriver
+	{
+	public:
+		/// \brief throws if the scene has prefab instances (see SceneFormat::expandReferences())
+		ReplayDriver(const SceneFormat& scene, const BenchmarkCamera& camera, const ReplaySettings& settings = {});
+
+		/// \brief number of frames: duration / timeStep + 1 (1 for viewpoints)
+		uint32_t getFrameCount() const { return m_frameCount; }
+		/// \brief computes the next frame. The first call returns frame 0
+		/// \return false if all frames were played
+		bool next();
+		const ReplayFrame& getFrame() const { return m_frame; }
+		/// \brief restarts the replay
+		void reset();
+
+		/// \brief plays all frames and returns the statistics of each frame
+		std::vector<FrameStats> run();
+	private:
+		void computeFrame();
+
+		const SceneFormat& m_scene;
+		BenchmarkCamera m_camera;
+		ReplaySettings m_settings;
+		uint32_t m_frameCount;
+		bool m_started = false;
+
+		std::vector<std::pair<Path, Path>> m_meshPaths; // position and look at
+		std::vector<Path> m_lightPaths;
+
+		// per shape: mesh, local bounds and primitive count
+		std::vector<uint32_t> m_shapeMesh;
+		std::vector<BoundingBox> m_shapeBounds;
+		std::vector<uint32_t> m_shapePrimitives;
+
+		ReplayFrame m_frame;
+	};
+}
@@ -1,14 +1,20 @@
 #pragma once
 #include <string>
+#include <unordered_map>
 #include "../../dependencies/bmf/include/bmf/BinaryMesh.h"
+#include "Benchmark.h"
 #include "Camera.h"
 #include "Light.h"
 #include "Material.h"
 #include "Mesh.h"
+#include "MemoryUsage.h"
+#include "MeshInfo.h"
+#include "Prefab.h"
 #include "../../dependencies/json/single_include/nlohmann/json.hpp"
 #include "Environment.h"
 #include <filesystem>
 #include "srgb.h"
+#include "VerifyReport.h"
 
 namespace hrsf
 {
@@ -25,9 +31,17 @@ namespace hrsf
 		All = 0xFFFFFFFF
 	};
 
+	struct MergeSettings
+	{
+		// materials with equal data and textures (compared after normalizing the texture paths) share one id
+		bool deduplicateMaterials = false;
+	};
+
 	class SceneFormat
 	{
 		using json = nlohmann::json;
+		friend class SceneWriter;
+		friend class TileWriter;
 	public:
 		SceneFormat() = default;
 		SceneFormat(std::vector<Mesh> meshes, Camera cam, std::vector<Light> lights, std::vector<Material> materials, Environment env);
@@ -36,23 +50,82 @@ namespace hrsf
 
 		const std::vector<Mesh>& getMeshes() const;
 		const Camera& getCamera() const;
+		/// named viewpoints and fly-throughs (see Replay.h)
+		const std::vector<BenchmarkCamera>& getBenchmarkCameras() const;
+		void setBenchmarkCameras(std::vector<BenchmarkCamera> cameras);
 		const std::vector<Light>& getLights() const;
 		const std::vector<Material>& getMaterials() const;
 		std::vector<MaterialData> getMaterialsData() const;
+		/// \brief light data with the current path offsets (colors are already linear)
+		std::vector<LightData> getLightsData() const;
+		/// \brief packs the current light data into a (mapped) gpu buffer
+		/// \param dst buffer with space for getLights().size() * getLightStride(layout) bytes.
+		///        Light i is written to dst + i * getLightStride(layout)
+		/// \return number of lights that were written (all)
+		size_t getLightsData(void* dst, BufferLayout layout) const;
+		/// \brief packs the lights whose position changed since the last call with the same state (the buffer of the state).
+		/// All lights are written if the state is new, the previous call used a different layout or the light count changed
+		/// \return number of lights that were written
+		size_t getLightsData(void* dst, BufferLayout layout, LightExportState& state) const;
 		const Environment& getEnvironment() const;
+		void setEnvironment(Environment env);
+
+		/// \brief advances the camera and light paths
+		/// \param dt time in seconds
+		void update(float dt);
 
 		void removeUnusedMaterials();
 		// adds the offset to each material index
 		void offsetMaterials(uint32_t offset);
-		/// \brief throws an exception if something seems wrong
+		/// \brief moves the meshes, lights, materials and benchmark cameras of other into this scene (camera and environment are kept).
+		/// Meshes are moved without copying their data, only the material ids are remapped (in parallel). other is left empty.
+		/// Scene references of both scenes are expanded first. Throws before anything is moved if a material id is out of range
+		void merge(SceneFormat&& other, const MergeSettings& settings = {});
+		/// \brief merges all scenes into the first one (see merge()). All vectors are reserved once
+		static SceneFormat mergeAll(std::vector<SceneFormat> scenes, const MergeSettings& settings = {});
+		/// references to other scene files as declared in this scene (written by save())
+		const std::vector<SceneReference>& getReferences() const;
+		/// every referenced file of the hierarchy (loaded once). The prefab materials are appended to getMaterials()
+		const std::vector<Prefab>& getPrefabs() const;
+		/// all (nested) prefab instances. getMeshes() and getLights() only contain the objects of this scene
+		const std::vector<PrefabInstance>& getInstances() const;
+		/// \brief references the scene file with the transform. The file (and its references) are only loaded if they are not already used
+		/// \param components Mesh, Material and Lights are loaded from the referenced files
+		void addReference(const fs::path& file, const glm::mat4& transform, Component components = Component::All);
+		/// \brief transformed copies of the instance meshes (with material ids of this scene)
+		std::vector<Mesh> getInstanceMeshes(size_t instance) const;
+		/// \brief transformed copies of the instance lights
+		std::vector<Light> getInstanceLights(size_t instance) const;
+		/// \brief appends the meshes and lights of all instances (in parallel) and removes the references.
+		/// The prefab materials stay in getMaterials()
+		void expandReferences();
+		/// \brief copy of the scene with expanded references (for consumers that need the flat mesh and light lists)
+		SceneFormat getExpanded() const;
+
+		/// \brief throws an exception if something seems wrong (the message lists all problems)
 		void verify() const;
+		/// \brief checks all meshes, material ids and paths in parallel and collects every problem.
+		/// Prefab meshes and lights are checked once ("prefab i (file) mesh j" refers to the mesh list of the prefab file),
+		/// the instance list is checked for invalid transforms
+		VerifyReport getVerifyReport() const;
+		/// \brief heap bytes per component and mesh (including unused vector capacity)
+		MemoryUsage memoryUsage() const;
 
 		/// \brief loads the scene from the filesystem
+		/// Referenced scenes are loaded once and instanced (see getPrefabs() and getInstances())
 		/// \param filename filename without extension
-		static SceneFormat load(fs::path filename);
+		/// \param components components that will be loaded. Missing components are left empty or default.
+		///        References are only loaded with the Mesh component
+		static SceneFormat load(fs::path filename, Component components = Component::All);
 		/// \brief loads the camera from the filesystem
 		/// \param filename filename without extension
 		static Mesh loadMesh(fs::path filename);
+		/// \brief loads the mesh descriptions of the scene without loading the bmf files (references are not resolved)
+		/// \param filename filename without extension
+		static std::vector<MeshInfo> loadMeshInfos(fs::path filename);
+		/// \brief loads the mesh description without loading the bmf file
+		/// \param filename filename without extension
+		static MeshInfo loadMeshInfo(fs::path filename);
 		/// \brief loads the camera from the filesystem
 		/// \param filename filename without extension
 		static Camera loadCamera(fs::path filename);
@@ -74,6 +147,14 @@ namespace hrsf
 		/// \param components components that will be written into the file.
 		///        If a component is missing and singleFile is false, the filename reference will be written but not the component file itself.
 		void save(const fs::path& filename, bool singleFile, Component components = Component::All) const;
+		/// \brief exports the scene as binary gltf 2.0.
+		/// Vertex and index arrays are referenced by the buffer views without conversion (one primitive per shape),
+		/// materials become pbr metallic roughness materials, position paths become cubic spline animations and the camera
+		/// look at path becomes sampled rotation keys. Throws for meshes with a lookAt path and files above 4 GiB.
+		/// The binary chunk is written by all threads. Prefab meshes are exported once, every instance becomes a node
+		/// with the instance transform that references them
+		/// \param filename filename including the .glb extension
+		void saveGlb(const fs::path& filename) const;
 		static void saveMesh(const fs::path& filename, const Mesh& mesh);
 		static void saveCamera(const fs::path& filename, const Camera& camera);
 		static void saveMaterials(const fs::path& filename, const std::vector<Material>& materials);
@@ -81,18 +162,33 @@ namespace hrsf
 		static void saveEnvironment(const fs::path& filename, const Environment& env);
 		static void savePath(const fs::path& filename, const Path& path);
 	private:
+		void mergeScenes(const std::vector<SceneFormat*>& others, const MergeSettings& settings);
+		/// \brief loads the scene without resolving its references (m_references is set)
+		static SceneFormat loadUnresolved(fs::path filename, Component components);
+		/// \brief loads the prefab (if it is not already loaded) and adds the instances of it and its references
+		/// \param stack files of the current reference chain (to detect cycles)
+		void addInstances(const fs::path& file, const glm::mat4& transform, Component components, std::vector<fs::path>& stack);
+		/// number of materials before the prefab materials
+		size_t getOwnMaterialCount() const;
+		static json getReferencesJson(const std::vector<SceneReference>& references, const fs::path& root);
+		static std::vector<SceneReference> loadReferencesJson(const json& j, const fs::path& root);
+
 		static json getMeshJson(const Mesh& mesh, const fs::path& root, const fs::path& bmfFilename);
 		static json getMaterialsJson(const std::vector<Material>& materials, const fs::path& root);
 		static json getLightsJson(const std::vector<Light>& lights);
 		static json getCameraJson(const Camera& camera);
+		static json getBenchmarkCamerasJson(const std::vector<BenchmarkCamera>& cameras);
 		static json getEnvironmentJson(const Environment& env, const fs::path& root);
 		static json getPathJson(const Path& path);
 		static json openFile(fs::path filename);
+		/// \brief throws if the scene json version is not supported
+		static void checkVersion(const json& j, const fs::path& filename);
 		static void saveFile(const json& j, fs::path filename);
 		static Mesh loadMeshJson(const json& j, const fs::path& root);
 		static Material loadMaterialJson(const json& j, const fs::path& root);
 		static std::vector<Material> loadMaterialsJson(const json& j, const fs::path& root);
 		static Camera loadCameraJson(const json& j, const fs::path& root);
+		static std::vector<BenchmarkCamera> loadBenchmarkCamerasJson(const json& j, const fs::path& root);
 		static Environment loadEnvironmentJson(const json& j, const fs::path& root);
 		static std::vector<Light> loadLightsJson(const json& j, const fs::path& root);
 		static Light loadLightJson(const json& j, const fs::path& root);
@@ -100,14 +196,15 @@ namespace hrsf
 		static PathSection loadPathSectionJson(const json& j);
 
 		/// generates a mesh suffix based on the mesh properties
-		std::string generateMeshSuffix(const Mesh& mesh) const;
+		static std::string generateMeshSuffix(const Mesh& mesh, const std::vector<Material>& materials);
+		/// \brief unique mesh filename (without extension) based on the scene filename and the mesh suffix
+		static fs::path getMeshFilename(const fs::path& sceneFilename, const Mesh& mesh, const std::vector<Material>& materials,
+			std::unordered_map<std::string, size_t>& usedSuffixMap);
 
 		/// \brief retrieves the value from the json. if the json does not contain the value
 		/// the default value is returned instead
 		template<class T>
 		static T getOrDefault(const json& j, const char* name, T defaultValue);
-		template<>
-		static glm::vec3 getOrDefault(const json& j, const char* name, glm::vec3 defaultValue);
 		static Path getPathOrDefault(const json& j, const char* name, const fs::path& root);
 
 		static fs::path getFilename(const json& j, const char* name, const fs::path& root);
@@ -120,13 +217,24 @@ namespace hrsf
 
 		std::vector<Mesh> m_meshes;
 		Camera m_camera;
+		std::vector<BenchmarkCamera> m_benchmarkCameras;
 		std::vector<Light> m_lights;
 		std::vector<Material> m_materials;
 		Environment m_environment;
+		std::vector<SceneReference> m_references;
+		std::vector<Prefab> m_prefabs;
+		std::vector<PrefabInstance> m_instances;
+
 
 		static constexpr size_t s_version = 7;
+		// scenes with "references" (version 7 readers would load them without the referenced objects)
+		static constexpr size_t s_referenceVersion = 8;
 	};
 
+	// explicit specializations must be declared at namespace scope
+	template<>
+	glm::vec3 SceneFormat::getOrDefault(const json& j, const char* name, glm::vec3 defaultValue);
+
 	inline Component operator|(Component a, Component b)
 	{
 		return Component(uint32_t(a) | uint32_t(b));
@@ -0,0 +1,74 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "../../dependencies/json/single_include/nlohmann/json.hpp"
+#include "Mesh.h"
+
+namespace hrsf
+{
+	class SceneFormat;
+
+	struct MeshStatistics
+	{
+		std::filesystem::path file; // mesh json, empty if the statistics were computed from a loaded scene
+		std::filesystem::path prefab; // referenced scene of prefab meshes, empty for meshes of the scene itself
+		size_t instances = 1; // number of prefab instances that use the mesh (the mesh data exists once)
+		Mesh::Type type = Mesh::Triangle;
+		uint32_t attributes = 0; // bmf::Attributes
+		size_t vertices = 0;
+		size_t indices = 0;
+		size_t triangles = 0;
+		size_t billboards = 0;
+		size_t shapes = 0;
+		size_t pathSections = 0; // position and lookAt path
+		size_t gpuBytes = 0; // vertex and index buffer
+	};
+
+	/// size overview of a scene (see the SceneStats tool)
+	struct SceneStatistics
+	{
+		/// meshes of the scene followed by the meshes of each prefab (listed once, see MeshStatistics::instances)
+		std::vector<MeshStatistics> meshes;
+		size_t prefabs = 0;
+		size_t prefabInstances = 0;
+		std::vector<std::string> materialNames;
+		/// triangles and billboards per material. Empty if only the mesh descriptions were read
+		std::vector<size_t> materialUsage;
+		size_t invalidMaterialUsage = 0; // primitives with an out of bound material id
+		std::vector<std::filesystem::path> textures; // unique material and environment textures
+		size_t pointLights = 0; // including the lights of all prefab instances
+		size_t directionalLights = 0;
+		size_t animatedLights = 0;
+		size_t lightPathSections = 0;
+		size_t cameraPathSections = 0;
+		size_t benchmarkCameras = 0;
+		// estimated gpu memory
+		size_t lightBytes = 0;
+		size_t materialBytes = 0;
+		size_t textureFileBytes = 0; // size of the existing texture files (compressed)
+
+		size_t getVertexCount() const;
+		size_t getTriangleCount() const;
+		size_t getBillboardCount() const;
+		/// triangles that are rendered (prefab meshes are counted once per instance)
+		size_t getInstancedTriangleCount() const;
+		size_t getInstancedBillboardCount() const;
+		size_t getMeshPathSections() const;
+		/// \brief vertex, index, light and material buffers (textures are not included)
+		size_t getGpuBytes() const;
+
+		std::string toString() const;
+		nlohmann::json toJson() const;
+
+		/// \brief computes the statistics of a loaded scene (meshes are processed in parallel).
+		/// Prefab meshes are counted once (material usage included), prefab lights are counted per instance
+		static SceneStatistics compute(const SceneFormat& scene);
+		/// \brief computes the statistics of a scene file
+		/// \param filename filename without extension
+		/// \param readMeshes if false, bmf files are only read for meshes whose json has no counts (materialUsage stays empty).
+		///        Otherwise all bmf files are read in parallel (one mesh per thread is in memory at a time).
+		///        Scenes with references are always loaded (see compute())
+		static SceneStatistics load(const std::filesystem::path& filename, bool readMeshes = true);
+	};
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Environment.h"
+#include "Importer.h"
+
+namespace hrsf
+{
+	/// writes a scene mesh by mesh, so meshes do not need to stay in memory.
+	/// The result is the same as SceneFormat::save(filename, true)
+	class SceneWriter : public ImportTarget
+	{
+	public:
+		/// \param filename filename without extension
+		explicit SceneWriter(std::filesystem::path filename);
+
+		/// \brief materials should be set before the first mesh (transparent meshes get a different filename)
+		void setMaterials(std::vector<Material> materials) override;
+		/// \brief writes the bmf and mesh json immediately
+		void addMesh(Mesh mesh) override;
+		void setLights(std::vector<Light> lights) override;
+		void setCamera(Camera camera) override;
+		void setEnvironment(Environment env);
+
+		size_t getMeshCount() const;
+		/// \brief writes the scene json. Must be called after the last mesh was added
+		void finish();
+	private:
+		std::filesystem::path m_filename; // absolute
+		std::vector<Material> m_materials;
+		std::vector<Light> m_lights;
+		Camera m_camera;
+		Environment m_environment;
+		std::vector<std::string> m_meshFiles;
+		std::unordered_map<std::string, size_t> m_usedSuffixMap;
+	};
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "Bounds.h"
+#include "Camera.h"
+#include "Light.h"
+
+namespace hrsf
+{
+	struct CascadeSettings
+	{
+		uint32_t cascadeCount = 4;
+		float lambda = 0.75f; // practical split scheme: 0 = uniform splits, 1 = logarithmic splits
+		uint32_t resolution = 2048; // shadow map resolution of one cascade (used for texel snapping)
+		float aspect = 16.0f / 9.0f; // camera aspect ratio (width / height)
+	};
+
+	struct ShadowCascade
+	{
+		float nearDepth; // view space depth range of the cascade
+		float farDepth;
+		glm::vec3 lightMin; // orthographic bounds in light space (see ShadowCascades basis)
+		glm::vec3 lightMax;
+		float texelSize; // world space size of one shadow map texel
+	};
+
+	/// shadow cascades of one directional light.
+	/// Light space: x = dot(p, right), y = dot(p, up), z = dot(p, forward) where forward is the light direction.
+	/// z increases away from the light, lightMin.z is the near plane of the orthographic projection.
+	struct ShadowCascades
+	{
+		glm::vec3 right;
+		glm::vec3 up;
+		glm::vec3 forward;
+		std::vector<ShadowCascade> cascades;
+	};
+
+	/// \brief computes the cascade splits and fits the light space bounds (no allocations if result is reused).
+	/// The camera depth range is clipped to the scene bounds before splitting => large far planes do not waste resolution.
+	/// The xy bounds of each cascade are derived from the bounding sphere of the frustum slice (constant size under rotation)
+	/// and snapped to the texel grid to avoid shimmering: lightMax.xy - lightMin.xy is always resolution * texelSize.
+	/// \param camera camera with the current path position and look at already applied
+	/// \param light directional light
+	/// \param sceneBounds world space bounds of all shadow casters (see getSceneBounds(), compute once for static scenes)
+	void fitShadowCascades(const CameraData& camera, const LightData& light, const BoundingBox& sceneBounds,
+		const CascadeSettings& settings, ShadowCascades& result);
+
+	/// \brief practical split scheme: lambda * logarithmic + (1 - lambda) * uniform split
+	/// \param index split index in [0, count]. 0 returns nearDepth, count returns farDepth
+	float getCascadeSplit(float nearDepth, float farDepth, uint32_t index, uint32_t count, float lambda);
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include "Bounds.h"
+#include "Light.h"
+#include "LightInfluence.h"
+#include "Mesh.h"
+
+namespace hrsf
+{
+	/// shape that may cast a shadow for a light
+	struct ShadowCaster
+	{
+		uint32_t mesh; // index into the mesh vector
+		uint32_t shape; // index into the shapes of the mesh (0 for billboard meshes without shapes)
+	};
+
+	struct ShadowCasterSettings
+	{
+		float cellSize = 0.0f; // cell size of the spatial grid. 0 = derived from the shape sizes
+		uint32_t maxCellsPerAxis = 64;
+	};
+
+	/// list of shapes that overlap the influence volume of each light.
+	/// Shapes of static meshes are stored in a uniform grid, shapes of meshes with paths are tested brute force.
+	/// Call update() after the paths moved: only lists of moved lights are rebuilt from the grid.
+	class ShadowCasterLists
+	{
+	public:
+		/// \brief builds all lists (multithreaded over the lights)
+		/// \param influence influence spheres of the lights (LightInfluence::update() must have been called)
+		void build(const std::vector<Mesh>& meshes, const LightInfluence& influence, const ShadowCasterSettings& settings = {});
+		/// \brief updates the lists after meshes or lights moved along their paths.
+		/// Mesh shapes and the light count must not have changed since build()
+		/// \return true if any list was recomputed
+		bool update(const std::vector<Mesh>& meshes, const LightInfluence& influence);
+
+		/// shadow casters of the light sorted by mesh and shape
+		const std::vector<ShadowCaster>& getCasters(size_t light) const { return m_lists[light]; }
+		size_t getLightCount() const { return m_lists.size(); }
+		/// indicates that neither meshes nor lights have paths
+		bool isStatic() const { return m_dynamicEntries.empty() && m_animatedLights.empty(); }
+
+		/// \brief loads the lists from the cache next to the scene file or builds and caches them.
+		/// The cache is only used for static scenes, its key is derived from the mesh buffers (vertices, indices and shapes), the mesh offsets and the light volumes.
+		/// \param sceneFile scene filename (cache location)
+		static ShadowCasterLists loadOrBuild(const std::filesystem::path& sceneFile, const std::vector<Mesh>& meshes,
+			const LightInfluence& influence, const ShadowCasterSettings& settings = {});
+	private:
+		void buildEntries(const std::vector<Mesh>& meshes);
+		void buildLists(const LightInfluence& influence);
+		void buildGrid();
+		void queryGrid(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const;
+		void updateStaticList(size_t light, const LightInfluence& influence);
+		void updateDynamicList(size_t light, const LightInfluence& influence);
+		void combineLists(size_t light);
+		/// \brief key from the vertices, indices, shapes and offsets of the meshes
+		static uint64_t getGeometryKey(const std::vector<Mesh>& meshes);
+		void saveLists(const std::filesystem::path& filename, uint64_t key) const;
+		bool loadLists(const std::filesystem::path& filename, uint64_t key, const std::vector<Mesh>& meshes);
+
+		ShadowCasterSettings m_settings;
+
+		// all shapes
+		std::vector<ShadowCaster> m_entries;
+		std::vector<BoundingBox> m_localBounds; // empty if the lists were loaded from the cache (computed by the first update())
+		std::vector<BoundingBox> m_worldBounds;
+		std::vector<uint32_t> m_dynamicEntries; // entries of meshes with paths
+
+		// uniform grid over static entries
+		BoundingBox m_gridBounds = BoundingBox::Empty();
+		float m_cellSize = 1.0f;
+		uint32_t m_gridDim[3] = { 0, 0, 0 };
+		std::vector<uint32_t> m_cellOffsets; // cellCount + 1. Empty if the grid was not built yet
+		std::vector<uint32_t> m_cellEntries;
+
+		// per light (entry indices)
+		std::vector<std::vector<uint32_t>> m_staticLists;
+		std::vector<std::vector<uint32_t>> m_dynamicLists;
+		std::vector<std::vector<ShadowCaster>> m_lists;
+		std::vector<glm::vec3> m_lightPositions; // positions used for the static lists
+		std::vector<float> m_lightRanges;
+		std::vector<uint32_t> m_animatedLights;
+	};
+}
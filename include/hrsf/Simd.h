@@ -0,0 +1,7 @@
+#pragma once
+
+// SSE2 is part of every x64 target, HRSF_SSE2 is not defined for other architectures (scalar fallbacks are used)
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define HRSF_SSE2
+#include <emmintrin.h>
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+#include <array>
+#include <glm/vec3.hpp>
+
+namespace hrsf
+{
+	struct HdrImage;
+
+	/// 9 coefficients of the spherical harmonics bands 0 to 2
+	/// order: Y00, Y1-1, Y10, Y11, Y2-2, Y2-1, Y20, Y21, Y22 with
+	/// Y1-1 ~ y, Y10 ~ z, Y11 ~ x, Y2-2 ~ xy, Y2-1 ~ yz, Y20 ~ 3z^2 - 1, Y21 ~ xz, Y22 ~ x^2 - y^2
+	using ShCoefficients = std::array<glm::vec3, 9>;
+
+	/// \brief projects the radiance of an equirectangular image onto the sh basis (multithreaded)
+	ShCoefficients projectRadianceSh(const HdrImage& equirect);
+	/// \brief convolves radiance coefficients with the clamped cosine lobe.
+	/// The result can be evaluated with evalSh to get the irradiance for a normal
+	ShCoefficients radianceToIrradianceSh(const ShCoefficients& radiance);
+	/// \brief evaluates the sh coefficients in the (normalized) direction n
+	glm::vec3 evalSh(const ShCoefficients& sh, const glm::vec3& n);
+}
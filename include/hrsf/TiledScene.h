@@ -0,0 +1,82 @@
+#pragma once
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "SceneFormat.h"
+#include "Tiling.h"
+
+namespace hrsf
+{
+	struct TiledSceneSettings
+	{
+		float loadDistance = 100.0f; // tiles closer to the camera than this are loaded
+		float unloadDistance = 150.0f; // loaded tiles further away than this are unloaded (>= loadDistance)
+		uint32_t threadCount = 2; // number of background loader threads
+	};
+
+	/// scene written by writeTiles().
+	/// The scene (materials, lights, camera, environment and moving meshes) is loaded by the constructor,
+	/// the tiles are loaded and unloaded in the background depending on the camera position (see update())
+	class TiledScene
+	{
+	public:
+		/// \param indexFile tile index (filename_tiles.json)
+		TiledScene(const std::filesystem::path& indexFile, const TiledSceneSettings& settings = {});
+		~TiledScene();
+		TiledScene(const TiledScene&) = delete;
+		TiledScene& operator=(const TiledScene&) = delete;
+
+		/// \brief queues the tiles within the load distance (closest first) and unloads tiles beyond the unload distance.
+		/// Queued tiles that are out of range again are dropped
+		void update(const glm::vec3& position);
+
+		/// \brief meshes of the tile or nullptr if the tile is not loaded (yet).
+		/// The meshes stay valid while the pointer is held, even if the tile is unloaded.
+		/// Exceptions of the background load are rethrown
+		std::shared_ptr<const std::vector<Mesh>> getTile(size_t index) const;
+		/// indices of the loaded tiles
+		std::vector<uint32_t> getLoadedTiles() const;
+		/// number of tiles that are queued or currently loading
+		size_t getPendingCount() const;
+		/// \brief blocks until all queued tiles are loaded
+		void wait() const;
+
+		const SceneFormat& getScene() const { return m_scene; }
+		const TileIndex& getIndex() const { return m_index; }
+	private:
+		enum class State
+		{
+			Unloaded,
+			Queued,
+			Loading,
+			Loaded,
+			Failed
+		};
+
+		struct Slot
+		{
+			State state = State::Unloaded;
+			std::shared_ptr<const std::vector<Mesh>> meshes;
+			std::exception_ptr error;
+		};
+
+		void worker();
+		static std::vector<Mesh> loadTile(const std::filesystem::path& file);
+
+		TileIndex m_index;
+		SceneFormat m_scene;
+		TiledSceneSettings m_settings;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_workAvailable;
+		mutable std::condition_variable m_loadFinished;
+		std::vector<Slot> m_slots;
+		std::vector<uint32_t> m_queue; // pending loads, highest priority last
+		bool m_stop = false;
+		std::vector<std::thread> m_threads;
+	};
+}
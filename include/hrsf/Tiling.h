@@ -0,0 +1,48 @@
+#pragma once
+#include <filesystem>
+#include <vector>
+#include "Bounds.h"
+
+namespace hrsf
+{
+	class SceneFormat;
+
+	struct TilingSettings
+	{
+		float tileSize = 0.0f; // edge length of the regular grid cells in x and z. 0 = adaptive grid
+		// adaptive grid: cells with more triangles or billboards are split into four.
+		// Shapes (and chunks of 4096 billboards) are not divided while building the grid => parts of split meshes can exceed the limit
+		size_t maxTilePrimitives = size_t(1) << 20;
+		uint32_t maxDepth = 8; // adaptive grid: maximum number of splits
+		bool splitMeshes = true; // static meshes that overlap several cells are split by triangle or billboard centers
+	};
+
+	struct TileInfo
+	{
+		std::filesystem::path file; // tile manifest (can be loaded with SceneFormat::load())
+		BoundingBox bounds; // world space bounds of the tile meshes
+		size_t meshCount = 0;
+		size_t primitiveCount = 0; // triangles and billboards
+	};
+
+	/// index of a tiled scene:
+	/// { "version": 1, "scene": "world.json", "min": [...], "max": [...],
+	///   "tiles": [{ "file": "world_tile0.json", "min": [...], "max": [...], "meshes": 3, "primitives": 1024 }] }
+	/// The scene contains the materials, lights, camera, environment and moving meshes.
+	/// Tile manifests only contain static meshes and reference the material, camera and environment files of the scene
+	struct TileIndex
+	{
+		std::filesystem::path scene; // absolute filename of the scene json
+		BoundingBox bounds; // bounds of all tiles
+		std::vector<TileInfo> tiles;
+
+		void save(const std::filesystem::path& filename) const;
+		static TileIndex load(const std::filesystem::path& filename);
+	};
+
+	/// \brief partitions the static meshes (including expanded prefab instances) into tiles of a grid in the xz plane.
+	/// Meshes are assigned by their bounds center or split if they overlap several cells (see TilingSettings::splitMeshes).
+	/// Writes filename.json (scene with separate component files), filename_tile<i>.json and the index filename_tiles.json.
+	/// Tiles are written in parallel
+	TileIndex writeTiles(const SceneFormat& scene, const std::filesystem::path& filename, const TilingSettings& settings = {});
+}
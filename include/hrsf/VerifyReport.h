@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace hrsf
+{
+	/// problem that was found by SceneFormat::getVerifyReport()
+	struct VerifyIssue
+	{
+		std::string location; // e.g. "mesh 3 shape 1", "light 0 path"
+		std::string message;
+	};
+
+	struct VerifyReport
+	{
+		std::vector<VerifyIssue> issues;
+
+		bool isValid() const { return issues.empty(); }
+		/// \brief one line per issue: "<location>: <message>"
+		std::string toString() const;
+	};
+
+	/// \brief finds material ids >= materialCount in an interleaved vertex buffer (SSE2 if available)
+	/// \param vertices interleaved vertex data
+	/// \param stride number of floats per vertex
+	/// \param offset float offset of the material attribute in a vertex
+	/// \param out receives the first maxOut vertex indices with invalid materials
+	/// \return number of vertices with invalid materials
+	size_t findInvalidMaterialIds(const float* vertices, size_t vertexCount, size_t stride, size_t offset,
+		uint32_t materialCount, std::vector<size_t>& out, size_t maxOut);
+}
@@ -1,10 +1,14 @@
 #pragma once
 #include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
 #include <glm/glm.hpp>
+#include "Simd.h"
 
 namespace hrsf
 {
-	inline constexpr float toSrgb(float value)
+	inline float toSrgb(float value)
 	{
 		//if (value >= 1.0f) return 1.0f;
 		if (value == 1.0f) return 1.0f;
@@ -21,13 +25,13 @@ namespace hrsf
 		return value;
 	}
 
-	inline constexpr float fromSrgb(float value)
+	inline float fromSrgb(float value)
 	{
 		//if (value >= 1.0f) return 1.0f;
 		if (value == 1.0f) return 1.0f;
 		if (value <= 0.0f) return 0.0f;
 		if (value <= 0.04045f) return value / 12.92f;
-		return pow((value + 0.055f) / 1.055f, 2.4f);
+		return std::pow((value + 0.055f) / 1.055f, 2.4f);
 	}
 
 	inline glm::vec3 fromSrgb(glm::vec3 value)
@@ -37,4 +41,188 @@ namespace hrsf
 		value[2] = fromSrgb(value[2]);
 		return value;
 	}
-}
\ No newline at end of file
+
+	/// \brief exact conversion of count floats (src and dst may be the same array)
+	inline void toSrgb(const float* src, float* dst, size_t count)
+	{
+		std::transform(src, src + count, dst, [](float v) { return toSrgb(v); });
+	}
+
+	inline void toSrgb(const glm::vec3* src, glm::vec3* dst, size_t count)
+	{
+		static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be tightly packed");
+		toSrgb(&src->x, &dst->x, count * 3);
+	}
+
+	/// \brief exact conversion of count floats (src and dst may be the same array)
+	inline void fromSrgb(const float* src, float* dst, size_t count)
+	{
+		std::transform(src, src + count, dst, [](float v) { return fromSrgb(v); });
+	}
+
+	inline void fromSrgb(const glm::vec3* src, glm::vec3* dst, size_t count)
+	{
+		fromSrgb(&src->x, &dst->x, count * 3);
+	}
+
+	// Fast approximations for bulk data.
+	// Inputs are clamped to [0, 1] (hdr values are not supported, use the exact versions for those).
+	// toSrgbFast: a*sqrt(x) + b*x^(1/4) + c*x^(1/8) + d*x + e*x^(3/2) + f, absolute error < 2e-5
+	// fromSrgbFast: polynomial of degree 5, absolute error < 3e-5
+	// Both stay well below half an 8 bit step (0.00196), use the Srgb8Table for exact 8 bit round trips.
+	namespace detail
+	{
+		constexpr float s_toSrgbCoeffs[6] = { 0.713420106f, 0.590815606f, -0.247342546f, -0.0468136029f, 0.00870114042f, -0.0187732406f };
+		constexpr float s_fromSrgbCoeffs[6] = { 0.00101059951f, 0.0301537103f, 0.538859635f, 0.611390668f, -0.241176426f, 0.0597828476f };
+	}
+
+	inline float toSrgbFast(float value)
+	{
+		using namespace detail;
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		if (value <= 0.0031308f) return 12.92f * value;
+		const float s1 = std::sqrt(value);
+		const float s2 = std::sqrt(s1);
+		const float s3 = std::sqrt(s2);
+		return s_toSrgbCoeffs[0] * s1 + s_toSrgbCoeffs[1] * s2 + s_toSrgbCoeffs[2] * s3
+			+ s_toSrgbCoeffs[3] * value + s_toSrgbCoeffs[4] * (value * s1) + s_toSrgbCoeffs[5];
+	}
+
+	inline float fromSrgbFast(float value)
+	{
+		using namespace detail;
+		value = std::min(std::max(value, 0.0f), 1.0f);
+		if (value <= 0.04045f) return value * (1.0f / 12.92f);
+		// horner scheme
+		float res = s_fromSrgbCoeffs[5];
+		res = res * value + s_fromSrgbCoeffs[4];
+		res = res * value + s_fromSrgbCoeffs[3];
+		res = res * value + s_fromSrgbCoeffs[2];
+		res = res * value + s_fromSrgbCoeffs[1];
+		return res * value + s_fromSrgbCoeffs[0];
+	}
+
+	/// \brief approximated conversion of count floats (src and dst may be the same array)
+	inline void toSrgbFast(const float* src, float* dst, size_t count)
+	{
+		size_t i = 0;
+#ifdef HRSF_SSE2
+		using namespace detail;
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 linearLimit = _mm_set1_ps(0.0031308f);
+		const __m128 linearScale = _mm_set1_ps(12.92f);
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+			const __m128 s1 = _mm_sqrt_ps(x);
+			const __m128 s2 = _mm_sqrt_ps(s1);
+			const __m128 s3 = _mm_sqrt_ps(s2);
+			// same evaluation order as the scalar version
+			__m128 curve = _mm_mul_ps(_mm_set1_ps(s_toSrgbCoeffs[0]), s1);
+			curve = _mm_add_ps(curve, _mm_mul_ps(_mm_set1_ps(s_toSrgbCoeffs[1]), s2));
+			curve = _mm_add_ps(curve, _mm_mul_ps(_mm_set1_ps(s_toSrgbCoeffs[2]), s3));
+			curve = _mm_add_ps(curve, _mm_mul_ps(_mm_set1_ps(s_toSrgbCoeffs[3]), x));
+			curve = _mm_add_ps(curve, _mm_mul_ps(_mm_set1_ps(s_toSrgbCoeffs[4]), _mm_mul_ps(x, s1)));
+			curve = _mm_add_ps(curve, _mm_set1_ps(s_toSrgbCoeffs[5]));
+			const __m128 linear = _mm_mul_ps(linearScale, x);
+			const __m128 isLinear = _mm_cmple_ps(x, linearLimit);
+			_mm_storeu_ps(dst + i, _mm_or_ps(_mm_and_ps(isLinear, linear), _mm_andnot_ps(isLinear, curve)));
+		}
+#endif
+		for (; i < count; ++i)
+			dst[i] = toSrgbFast(src[i]);
+	}
+
+	inline void toSrgbFast(const glm::vec3* src, glm::vec3* dst, size_t count)
+	{
+		toSrgbFast(&src->x, &dst->x, count * 3);
+	}
+
+	/// \brief approximated conversion of count floats (src and dst may be the same array)
+	inline void fromSrgbFast(const float* src, float* dst, size_t count)
+	{
+		size_t i = 0;
+#ifdef HRSF_SSE2
+		using namespace detail;
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 linearLimit = _mm_set1_ps(0.04045f);
+		const __m128 linearScale = _mm_set1_ps(1.0f / 12.92f);
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+			__m128 curve = _mm_set1_ps(s_fromSrgbCoeffs[5]);
+			curve = _mm_add_ps(_mm_mul_ps(curve, x), _mm_set1_ps(s_fromSrgbCoeffs[4]));
+			curve = _mm_add_ps(_mm_mul_ps(curve, x), _mm_set1_ps(s_fromSrgbCoeffs[3]));
+			curve = _mm_add_ps(_mm_mul_ps(curve, x), _mm_set1_ps(s_fromSrgbCoeffs[2]));
+			curve = _mm_add_ps(_mm_mul_ps(curve, x), _mm_set1_ps(s_fromSrgbCoeffs[1]));
+			curve = _mm_add_ps(_mm_mul_ps(curve, x), _mm_set1_ps(s_fromSrgbCoeffs[0]));
+			const __m128 linear = _mm_mul_ps(x, linearScale);
+			const __m128 isLinear = _mm_cmple_ps(x, linearLimit);
+			_mm_storeu_ps(dst + i, _mm_or_ps(_mm_and_ps(isLinear, linear), _mm_andnot_ps(isLinear, curve)));
+		}
+#endif
+		for (; i < count; ++i)
+			dst[i] = fromSrgbFast(src[i]);
+	}
+
+	inline void fromSrgbFast(const glm::vec3* src, glm::vec3* dst, size_t count)
+	{
+		fromSrgbFast(&src->x, &dst->x, count * 3);
+	}
+
+	/// lookup tables for 8 bit srgb values.
+	/// toLinear[i] is exactly fromSrgb(i / 255.0f).
+	/// thresholds[i] is the linear value of the srgb midpoint between i and i + 1,
+	/// which makes toSrgb8(fromSrgb8(i)) == i for all 256 values.
+	struct Srgb8Table
+	{
+		std::array<float, 256> toLinear;
+		std::array<float, 255> thresholds;
+
+		static const Srgb8Table& Get()
+		{
+			static const Srgb8Table t = []()
+			{
+				Srgb8Table res;
+				for (size_t i = 0; i < res.toLinear.size(); ++i)
+					res.toLinear[i] = fromSrgb(float(i) / 255.0f);
+				for (size_t i = 0; i < res.thresholds.size(); ++i)
+				{
+					// use double precision for the decision boundaries
+					const double srgb = (double(i) + 0.5) / 255.0;
+					res.thresholds[i] = float(srgb <= 0.04045 ? srgb / 12.92 : std::pow((srgb + 0.055) / 1.055, 2.4));
+				}
+				return res;
+			}();
+			return t;
+		}
+	};
+
+	inline float fromSrgb8(uint8_t value)
+	{
+		return Srgb8Table::Get().toLinear[value];
+	}
+
+	/// \brief quantizes the linear value to the nearest 8 bit srgb value
+	inline uint8_t toSrgb8(float value)
+	{
+		const auto& t = Srgb8Table::Get().thresholds;
+		return uint8_t(std::upper_bound(t.begin(), t.end(), value) - t.begin());
+	}
+
+	inline void fromSrgb8(const uint8_t* src, float* dst, size_t count)
+	{
+		const auto& t = Srgb8Table::Get().toLinear;
+		for (size_t i = 0; i < count; ++i)
+			dst[i] = t[src[i]];
+	}
+
+	inline void toSrgb8(const float* src, uint8_t* dst, size_t count)
+	{
+		const auto& t = Srgb8Table::Get().thresholds;
+		for (size_t i = 0; i < count; ++i)
+			dst[i] = uint8_t(std::upper_bound(t.begin(), t.end(), src[i]) - t.begin());
+	}
+}
@@ -0,0 +1,62 @@
+#include "../include/hrsf/Bounds.h"
+#include <glm/glm.hpp>
+
+namespace hrsf
+{
+	namespace
+	{
+		template<class IndexT>
+		std::vector<BoundingBox> getBounds(const bmf::BinaryMeshT<IndexT>& mesh)
+		{
+			std::vector<BoundingBox> res;
+			res.reserve(mesh.getShapes().size());
+			for (const auto& s : mesh.getShapes())
+				res.push_back(getShapeBounds(mesh, s));
+			return res;
+		}
+	}
+
+	std::vector<BoundingBox> getShapeBounds(const Mesh& mesh)
+	{
+		if (mesh.type == Mesh::Triangle)
+			return getBounds(mesh.triangle);
+
+		if (!mesh.billboard.getShapes().empty())
+			return getBounds(mesh.billboard);
+
+		bmf::Shape all = {};
+		all.vertexCount = uint32_t(mesh.billboard.getNumVertices());
+		return { getShapeBounds(mesh.billboard, all) };
+	}
+
+	BoundingBox getWorldBounds(const Mesh& mesh, const BoundingBox& local)
+	{
+		return getWorldBounds(mesh.position, mesh.lookAt, local);
+	}
+
+	BoundingBox getWorldBounds(const Path& position, const Path& lookAt, const BoundingBox& local)
+	{
+		if (local.isEmpty()) return local;
+		auto res = local;
+		if (!lookAt.isStatic())
+		{
+			// farthest corner from the origin
+			const glm::vec3 corner = glm::max(glm::abs(local.min), glm::abs(local.max));
+			const float radius = glm::length(corner);
+			res = BoundingBox{ glm::vec3(-radius), glm::vec3(radius) };
+		}
+		const auto offset = position.getPosition();
+		res.min += offset;
+		res.max += offset;
+		return res;
+	}
+
+	BoundingBox getSceneBounds(const std::vector<Mesh>& meshes)
+	{
+		auto res = BoundingBox::Empty();
+		for (const auto& m : meshes)
+			for (const auto& b : getShapeBounds(m))
+				res.extend(getWorldBounds(m, b));
+		return res;
+	}
+}
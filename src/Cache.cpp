@@ -0,0 +1,108 @@
+#include "../include/hrsf/Cache.h"
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		// FNV-1a over 64 bit words
+		constexpr uint64_t s_prime = 0x100000001b3ull;
+		constexpr uint64_t s_offsetBasis = 0xcbf29ce484222325ull;
+
+		// count must be a multiple of 8 unless it is the last chunk
+		uint64_t hashChunk(uint64_t hash, const char* data, size_t count)
+		{
+			size_t i = 0;
+			for (; i + 8 <= count; i += 8)
+			{
+				uint64_t word;
+				std::memcpy(&word, data + i, 8);
+				hash = (hash ^ word) * s_prime;
+			}
+			for (; i < count; ++i)
+				hash = (hash ^ uint8_t(data[i])) * s_prime;
+			return hash;
+		}
+	}
+
+	uint64_t hashFile(const std::filesystem::path& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not open " + filename.string());
+
+		uint64_t hash = s_offsetBasis;
+
+		std::vector<char> buffer(1 << 20);
+		uint64_t totalSize = 0;
+		while (file)
+		{
+			file.read(buffer.data(), std::streamsize(buffer.size()));
+			const auto count = size_t(file.gcount());
+			totalSize += count;
+			hash = hashChunk(hash, buffer.data(), count);
+		}
+
+		// files that only differ in trailing zeros should not collide
+		return (hash ^ totalSize) * s_prime;
+	}
+
+	uint64_t hashData(const void* data, size_t size)
+	{
+		const auto hash = hashChunk(s_offsetBasis, static_cast<const char*>(data), size);
+		return (hash ^ uint64_t(size)) * s_prime;
+	}
+
+	std::string keyToString(uint64_t key)
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string res(16, '0');
+		for (size_t i = 0; i < 16; ++i)
+			res[15 - i] = digits[(key >> (i * 4)) & 0xF];
+		return res;
+	}
+
+	uint64_t keyFromString(const std::string& str)
+	{
+		return std::stoull(str, nullptr, 16);
+	}
+
+	std::filesystem::path getCacheFilename(const std::filesystem::path& source, uint64_t key, const std::string& suffix)
+	{
+		return source.parent_path() / (source.stem().string() + "." + keyToString(key) + suffix);
+	}
+
+	void writeCacheFile(const std::filesystem::path& filename, const std::function<void(const std::filesystem::path&)>& write)
+	{
+		// unique between processes (random) and threads (counter)
+		static const uint64_t s_random = (uint64_t(std::random_device()()) << 32) | std::random_device()();
+		static std::atomic<uint32_t> s_counter{ 0 };
+		auto temp = filename;
+		temp += "." + keyToString(s_random) + "_" + std::to_string(s_counter++) + ".tmp";
+
+		std::error_code ec;
+		try
+		{
+			write(temp);
+		}
+		catch (...)
+		{
+			std::filesystem::remove(temp, ec);
+			throw;
+		}
+
+		std::filesystem::rename(temp, filename, ec);
+		if (ec)
+		{
+			std::filesystem::remove(temp, ec);
+			// the file may be locked by a reader that opened the version of another process
+			if (!std::filesystem::exists(filename))
+				throw std::runtime_error("could not write " + filename.string());
+		}
+	}
+}
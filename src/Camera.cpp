@@ -0,0 +1,138 @@
+#include "../include/hrsf/Camera.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace hrsf
+{
+	Frustum Frustum::fromMatrix(const glm::mat4& viewProj)
+	{
+		const auto row = [&viewProj](int i)
+		{
+			return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+		};
+
+		Frustum f;
+		f.planes[Left] = row(3) + row(0);
+		f.planes[Right] = row(3) - row(0);
+		f.planes[Bottom] = row(3) + row(1);
+		f.planes[Top] = row(3) - row(1);
+#ifdef GLM_FORCE_DEPTH_ZERO_TO_ONE
+		f.planes[Near] = row(2);
+#else
+		f.planes[Near] = row(3) + row(2);
+#endif
+		f.planes[Far] = row(3) - row(2);
+
+		for (auto& p : f.planes)
+			p = p / glm::length(glm::vec3(p));
+		return f;
+	}
+
+	bool Frustum::isSphereVisible(const glm::vec3& center, float radius) const
+	{
+		for (const auto& p : planes)
+			if (glm::dot(glm::vec3(p), center) + p.w < -radius)
+				return false;
+		return true;
+	}
+
+	bool Frustum::isBoxVisible(const glm::vec3& min, const glm::vec3& max) const
+	{
+		for (const auto& p : planes)
+		{
+			// corner that is farthest along the plane normal
+			const glm::vec3 v(p.x >= 0.0f ? max.x : min.x, p.y >= 0.0f ? max.y : min.y, p.z >= 0.0f ? max.z : min.z);
+			if (glm::dot(glm::vec3(p), v) + p.w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	CameraMatrices CameraMatrices::compute(const CameraData& data, float aspect)
+	{
+		if (data.direction == glm::vec3(0.0f))
+			throw std::runtime_error("camera direction must not be zero");
+
+		CameraMatrices m;
+		m.position = data.position;
+		m.direction = glm::normalize(data.direction);
+		// up and direction are parallel (top-down view) => same fallback axis as the light clusters
+		auto up = data.up;
+		if (glm::length(glm::cross(m.direction, up)) < 1e-6f)
+			up = std::abs(m.direction.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		m.view = glm::lookAt(m.position, m.position + m.direction, up);
+		m.projection = glm::perspective(data.fov, aspect, data.near, data.far);
+		m.viewProjection = m.projection * m.view;
+		m.frustum = Frustum::fromMatrix(m.viewProjection);
+		return m;
+	}
+
+	void CameraMatrices::compute(const CameraData* data, size_t count, float aspect, CameraMatrices* out)
+	{
+		parallelFor(0, count, [=](size_t i)
+		{
+			out[i] = compute(data[i], aspect);
+		}, 64);
+	}
+
+	Camera::Camera(const CameraData& data, Path positionPath, Path lookAtPath)
+		:
+		data(data),
+		positionPath(std::move(positionPath)),
+		lookAtPath(std::move(lookAtPath))
+	{}
+
+	CameraData Camera::getCurrentData() const
+	{
+		auto res = data;
+		res.position += positionPath.getPosition();
+		// look at target = position + lookAtPath.getLookAt() (see Path), the direction is ignored.
+		// A zero look at has no direction => the data direction is kept
+		if (!lookAtPath.isStatic())
+		{
+			const auto lookAt = lookAtPath.getLookAt();
+			if (lookAt != glm::vec3(0.0f))
+				res.direction = lookAt;
+		}
+		return res;
+	}
+
+	CameraMatrices Camera::getMatrices(float aspect) const
+	{
+		return CameraMatrices::compute(getCurrentData(), aspect);
+	}
+
+	const CameraMatrices& Camera::updateMatrices(float aspect)
+	{
+		// the key is the evaluated data => replaced paths with equal cursors are detected as well
+		const auto current = getCurrentData();
+		if (m_cacheAspect == aspect && std::memcmp(&m_cacheData, &current, sizeof(CameraData)) == 0)
+			return m_cache;
+
+		m_cache = CameraMatrices::compute(current, aspect);
+		m_cacheData = current;
+		m_cacheAspect = aspect;
+		return m_cache;
+	}
+
+	void Camera::getPathMatrices(float aspect, float dt, size_t frameCount, CameraMatrices* out) const
+	{
+		// paths are stepped sequentially, the matrices are computed in parallel
+		auto cam = *this;
+		std::vector<CameraData> frames(frameCount);
+		for (size_t i = 0; i < frameCount; ++i)
+		{
+			if (i != 0)
+			{
+				cam.positionPath.update(dt);
+				cam.lookAtPath.update(dt);
+			}
+			frames[i] = cam.getCurrentData();
+		}
+		CameraMatrices::compute(frames.data(), frameCount, aspect, out);
+	}
+}
@@ -0,0 +1,321 @@
+#include "../include/hrsf/EnvironmentBake.h"
+#include "../include/hrsf/HdrImage.h"
+#include "../include/hrsf/Cache.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr float s_pi = 3.14159265358979f;
+
+		// 2x2 box filter
+		HdrImage downsample(const HdrImage& src)
+		{
+			HdrImage dst(std::max<size_t>(src.width / 2, 1), std::max<size_t>(src.height / 2, 1));
+			parallelFor(0, dst.height, [&](size_t y)
+			{
+				const size_t y0 = std::min(y * 2, src.height - 1);
+				const size_t y1 = std::min(y * 2 + 1, src.height - 1);
+				for (size_t x = 0; x < dst.width; ++x)
+				{
+					const size_t x0 = std::min(x * 2, src.width - 1);
+					const size_t x1 = std::min(x * 2 + 1, src.width - 1);
+					dst.at(x, y) = (src.at(x0, y0) + src.at(x1, y0) + src.at(x0, y1) + src.at(x1, y1)) * 0.25f;
+				}
+			}, 8);
+			return dst;
+		}
+
+		glm::vec2 hammersley(uint32_t i, uint32_t count)
+		{
+			uint32_t bits = i;
+			bits = (bits << 16u) | (bits >> 16u);
+			bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+			bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+			bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+			bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+			return glm::vec2(float(i) / float(count), float(bits) * 2.3283064365386963e-10f);
+		}
+
+		struct GgxSample
+		{
+			glm::vec3 h; // half vector in tangent space (z is the normal)
+			float lod; // source mip level for filtered importance sampling
+		};
+
+		// precomputes the tangent space samples for one roughness level
+		std::vector<GgxSample> getGgxSamples(float roughness, uint32_t count, size_t srcWidth, size_t srcHeight)
+		{
+			const float alpha = roughness * roughness;
+			const float a2 = alpha * alpha;
+			const float texelSolidAngle = 4.0f * s_pi / float(srcWidth * srcHeight);
+
+			std::vector<GgxSample> samples(count);
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				const auto xi = hammersley(i, count);
+				const float phi = 2.0f * s_pi * xi.x;
+				const float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (a2 - 1.0f) * xi.y));
+				const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+				auto& s = samples[i];
+				s.h = glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+
+				// pdf of l = reflect(-v, h) with n = v: D(h) * cos / (4 * dot(v, h)) = D(h) / 4
+				const float denom = cosTheta * cosTheta * (a2 - 1.0f) + 1.0f;
+				const float d = a2 / (s_pi * denom * denom);
+				const float sampleSolidAngle = 1.0f / (float(count) * d / 4.0f + 1e-6f);
+				s.lod = std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+			}
+			return samples;
+		}
+
+		glm::vec3 sampleChain(const std::vector<HdrImage>& chain, glm::vec2 uv, float lod)
+		{
+			lod = std::min(lod, float(chain.size() - 1));
+			const size_t l0 = size_t(lod);
+			const size_t l1 = std::min(l0 + 1, chain.size() - 1);
+			const float t = lod - float(l0);
+			return glm::mix(chain[l0].sampleEquirect(uv), chain[l1].sampleEquirect(uv), t);
+		}
+
+		bool allFilesExist(const std::vector<std::filesystem::path>& files)
+		{
+			return std::all_of(files.begin(), files.end(), [](const std::filesystem::path& f)
+			{
+				return std::filesystem::exists(f);
+			});
+		}
+
+		uint64_t getCubeMapKey(const Environment& env, const CubeMapSettings& settings)
+		{
+			auto key = hashFile(env.map);
+			key = combineKeys(key, settings.faceSize);
+			key = combineKeys(key, settings.samplesPerAxis);
+			return key;
+		}
+
+		uint64_t getSpecularKey(const Environment& env, const SpecularBakeSettings& settings)
+		{
+			auto key = hashFile(env.map);
+			key = combineKeys(key, settings.baseWidth);
+			key = combineKeys(key, settings.levels);
+			key = combineKeys(key, settings.sampleCount);
+			return key;
+		}
+	}
+
+	const std::filesystem::path& getAmbientSource(const Environment& env)
+	{
+		return env.ambient.empty() ? env.map : env.ambient;
+	}
+
+	bool isAmbientIrradianceValid(const Environment& env)
+	{
+		const auto& source = getAmbientSource(env);
+		if (source.empty() || env.ambientIrradianceKey == 0) return false;
+		return hashFile(source) == env.ambientIrradianceKey;
+	}
+
+	bool updateAmbientIrradiance(Environment& env, bool force)
+	{
+		const auto& source = getAmbientSource(env);
+		if (source.empty())
+			throw std::runtime_error("environment has no ambient map");
+
+		const auto key = hashFile(source);
+		if (!force && key == env.ambientIrradianceKey)
+			return false;
+
+		env.ambientIrradiance = radianceToIrradianceSh(projectRadianceSh(HdrImage::load(source)));
+		env.ambientIrradianceKey = key;
+		return true;
+	}
+
+	std::vector<HdrImage> prefilterSpecular(const HdrImage& equirect, const SpecularBakeSettings& settings)
+	{
+		if (settings.levels == 0 || settings.sampleCount == 0)
+			throw std::runtime_error("specular bake needs at least one level and sample");
+
+		// source mip chain for filtered importance sampling
+		std::vector<HdrImage> chain;
+		chain.push_back(equirect);
+		while (chain.back().width > 1 || chain.back().height > 1)
+			chain.push_back(downsample(chain.back()));
+
+		const size_t baseWidth = settings.baseWidth ? settings.baseWidth : equirect.width;
+		std::vector<HdrImage> res;
+		res.reserve(settings.levels);
+		for (uint32_t level = 0; level < settings.levels; ++level)
+		{
+			const size_t width = std::max<size_t>(baseWidth >> level, 1);
+			const size_t height = std::max<size_t>(width / 2, 1);
+			HdrImage dst(width, height);
+			const float roughness = settings.levels > 1 ? float(level) / float(settings.levels - 1) : 0.0f;
+			const auto samples = getGgxSamples(roughness, settings.sampleCount, equirect.width, equirect.height);
+
+			parallelFor(0, height, [&](size_t y)
+			{
+				for (size_t x = 0; x < width; ++x)
+				{
+					const glm::vec2 uv((float(x) + 0.5f) / float(width), (float(y) + 0.5f) / float(height));
+					if (level == 0 && roughness == 0.0f)
+					{
+						// mirror reflection => resample only
+						dst.at(x, y) = equirect.sampleEquirect(uv);
+						continue;
+					}
+
+					// tangent frame around n
+					const auto n = equirectToDirection(uv);
+					const auto up = std::abs(n.y) < 0.999f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+					const auto t = glm::normalize(glm::cross(up, n));
+					const auto b = glm::cross(n, t);
+
+					glm::vec3 sum(0.0f);
+					float weight = 0.0f;
+					for (const auto& s : samples)
+					{
+						const auto h = t * s.h.x + b * s.h.y + n * s.h.z;
+						const auto l = 2.0f * glm::dot(n, h) * h - n;
+						const float nDotL = glm::dot(n, l);
+						if (nDotL <= 0.0f) continue;
+						sum += sampleChain(chain, directionToEquirect(l), s.lod) * nDotL;
+						weight += nDotL;
+					}
+					dst.at(x, y) = weight > 0.0f ? sum / weight : glm::vec3(0.0f);
+				}
+			});
+
+			res.push_back(std::move(dst));
+		}
+
+		return res;
+	}
+
+	bool isSpecularMipsValid(const Environment& env, const SpecularBakeSettings& settings)
+	{
+		if (env.map.empty() || env.specularMipsKey == 0 || env.specularMips.size() != settings.levels)
+			return false;
+		if (!allFilesExist(env.specularMips))
+			return false;
+		return getSpecularKey(env, settings) == env.specularMipsKey;
+	}
+
+	bool updateSpecularMips(Environment& env, const SpecularBakeSettings& settings, bool force)
+	{
+		if (env.map.empty())
+			throw std::runtime_error("environment has no map");
+
+		const auto key = getSpecularKey(env, settings);
+		env.specularMips.clear();
+		for (uint32_t i = 0; i < settings.levels; ++i)
+			env.specularMips.push_back(getCacheFilename(env.map, key, ".spec" + std::to_string(i) + ".hdr"));
+
+		// files with the same key were produced from the same input (e.g. by another process)
+		if (!force && allFilesExist(env.specularMips))
+		{
+			const bool changed = env.specularMipsKey != key;
+			env.specularMipsKey = key;
+			return changed;
+		}
+
+		// files appear complete or not at all => an interrupted bake is repeated
+		const auto levels = prefilterSpecular(HdrImage::load(env.map), settings);
+		for (size_t i = 0; i < levels.size(); ++i)
+			writeCacheFile(env.specularMips[i], [&](const std::filesystem::path& f) { levels[i].save(f); });
+		env.specularMipsKey = key;
+		return true;
+	}
+
+	glm::vec3 cubeFaceToDirection(size_t face, glm::vec2 uv)
+	{
+		const float u = uv.x * 2.0f - 1.0f;
+		const float v = uv.y * 2.0f - 1.0f;
+		glm::vec3 dir;
+		switch (face)
+		{
+		case 0: dir = glm::vec3(1.0f, -v, -u); break;
+		case 1: dir = glm::vec3(-1.0f, -v, u); break;
+		case 2: dir = glm::vec3(u, 1.0f, v); break;
+		case 3: dir = glm::vec3(u, -1.0f, -v); break;
+		case 4: dir = glm::vec3(u, -v, 1.0f); break;
+		case 5: dir = glm::vec3(-u, -v, -1.0f); break;
+		default: throw std::runtime_error("invalid cube face " + std::to_string(face));
+		}
+		return glm::normalize(dir);
+	}
+
+	std::array<HdrImage, 6> equirectToCubeMap(const HdrImage& equirect, const CubeMapSettings& settings)
+	{
+		const size_t size = settings.faceSize ? settings.faceSize : std::max<size_t>(equirect.width / 4, 1);
+		const size_t samples = std::max<uint32_t>(settings.samplesPerAxis, 1);
+
+		std::array<HdrImage, 6> faces;
+		for (auto& f : faces)
+			f = HdrImage(size, size);
+
+		// one task per face row
+		parallelFor(0, 6 * size, [&](size_t row)
+		{
+			const size_t face = row / size;
+			const size_t y = row % size;
+			for (size_t x = 0; x < size; ++x)
+			{
+				glm::vec3 sum(0.0f);
+				for (size_t sy = 0; sy < samples; ++sy)
+				{
+					for (size_t sx = 0; sx < samples; ++sx)
+					{
+						const glm::vec2 uv(
+							(float(x) + (float(sx) + 0.5f) / float(samples)) / float(size),
+							(float(y) + (float(sy) + 0.5f) / float(samples)) / float(size));
+						sum += equirect.sampleEquirect(directionToEquirect(cubeFaceToDirection(face, uv)));
+					}
+				}
+				faces[face].at(x, y) = sum / float(samples * samples);
+			}
+		}, 4);
+
+		return faces;
+	}
+
+	bool isCubeMapValid(const Environment& env, const CubeMapSettings& settings)
+	{
+		if (env.map.empty() || env.cubeMapKey == 0 || env.cubeMap.size() != 6)
+			return false;
+		if (!allFilesExist(env.cubeMap))
+			return false;
+		return getCubeMapKey(env, settings) == env.cubeMapKey;
+	}
+
+	bool updateCubeMap(Environment& env, const CubeMapSettings& settings, bool force)
+	{
+		if (env.map.empty())
+			throw std::runtime_error("environment has no map");
+
+		const auto key = getCubeMapKey(env, settings);
+		env.cubeMap.clear();
+		for (size_t i = 0; i < 6; ++i)
+			env.cubeMap.push_back(getCacheFilename(env.map, key, ".face" + std::to_string(i) + ".hdr"));
+
+		// files with the same key were produced from the same input (e.g. by another process)
+		if (!force && allFilesExist(env.cubeMap))
+		{
+			const bool changed = env.cubeMapKey != key;
+			env.cubeMapKey = key;
+			return changed;
+		}
+
+		// files appear complete or not at all => an interrupted bake is repeated
+		const auto faces = equirectToCubeMap(HdrImage::load(env.map), settings);
+		for (size_t i = 0; i < faces.size(); ++i)
+			writeCacheFile(env.cubeMap[i], [&](const std::filesystem::path& f) { faces[i].save(f); });
+		env.cubeMapKey = key;
+		return true;
+	}
+}
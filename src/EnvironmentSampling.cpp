@@ -0,0 +1,243 @@
+#include "../include/hrsf/EnvironmentSampling.h"
+#include "../include/hrsf/HdrImage.h"
+#include "../include/hrsf/Parallel.h"
+#include "../include/hrsf/Cache.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr float s_pi = 3.14159265358979f;
+		constexpr uint32_t s_magic = 0x53535248; // "HRSS"
+		constexpr uint32_t s_fileVersion = 1;
+
+		float getLuminance(const glm::vec3& c)
+		{
+			return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+		}
+
+		// index of the interval [cdf[i], cdf[i + 1]) that contains u
+		size_t findInterval(const float* cdf, size_t count, float u)
+		{
+			const auto it = std::upper_bound(cdf, cdf + count + 1, u);
+			return std::min(size_t(std::max<ptrdiff_t>(it - cdf - 1, 0)), count - 1);
+		}
+
+		template<class T>
+		void writeVector(std::ostream& file, const std::vector<T>& v)
+		{
+			file.write(reinterpret_cast<const char*>(v.data()), std::streamsize(v.size() * sizeof(T)));
+		}
+
+		template<class T>
+		void readVector(std::istream& file, std::vector<T>& v, size_t count)
+		{
+			v.resize(count);
+			file.read(reinterpret_cast<char*>(v.data()), std::streamsize(v.size() * sizeof(T)));
+		}
+	}
+
+	EnvironmentSamplingTables EnvironmentSamplingTables::build(const HdrImage& equirect)
+	{
+		if (equirect.width == 0 || equirect.height == 0)
+			throw std::runtime_error("environment map is empty");
+
+		EnvironmentSamplingTables t;
+		t.width = uint32_t(equirect.width);
+		t.height = uint32_t(equirect.height);
+		const size_t rowSize = size_t(t.width) + 1;
+		t.conditionalCdf.resize(rowSize * t.height);
+		t.marginalCdf.resize(size_t(t.height) + 1);
+
+		// pixel weights and (unnormalized) row cdfs
+		std::vector<double> rowSums(t.height);
+		parallelFor(0, t.height, [&](size_t y)
+		{
+			const float dOmega = equirectPixelSolidAngle(y, t.width, t.height);
+			float* cdf = &t.conditionalCdf[y * rowSize];
+			double sum = 0.0;
+			cdf[0] = 0.0f;
+			for (size_t x = 0; x < t.width; ++x)
+			{
+				sum += double(std::max(getLuminance(equirect.at(x, y)), 0.0f) * dOmega);
+				cdf[x + 1] = float(sum);
+			}
+			rowSums[y] = sum;
+
+			// normalize row (uniform if the row is black)
+			for (size_t x = 1; x <= t.width; ++x)
+				cdf[x] = sum > 0.0 ? float(double(cdf[x]) / sum) : float(x) / float(t.width);
+			cdf[t.width] = 1.0f;
+		}, 16);
+
+		double total = 0.0;
+		t.marginalCdf[0] = 0.0f;
+		for (size_t y = 0; y < t.height; ++y)
+		{
+			total += rowSums[y];
+			t.marginalCdf[y + 1] = float(total);
+		}
+		for (size_t y = 1; y <= t.height; ++y)
+			t.marginalCdf[y] = total > 0.0 ? float(double(t.marginalCdf[y]) / total) : float(y) / float(t.height);
+		t.marginalCdf[t.height] = 1.0f;
+		t.integral = float(total);
+
+		// alias table (Vose)
+		const size_t numPixels = size_t(t.width) * t.height;
+		// discrete pixel probabilities times the number of pixels
+		std::vector<float> scaled(numPixels);
+		parallelFor(0, t.height, [&](size_t y)
+		{
+			for (size_t x = 0; x < t.width; ++x)
+				scaled[y * t.width + x] = t.getPixelPdf(x, y);
+		}, 16);
+
+		t.aliasTable.resize(numPixels);
+		std::vector<uint32_t> small, large;
+		small.reserve(numPixels);
+		large.reserve(numPixels);
+		for (uint32_t i = 0; i < uint32_t(numPixels); ++i)
+			(scaled[i] < 1.0f ? small : large).push_back(i);
+
+		while (!small.empty() && !large.empty())
+		{
+			const auto s = small.back(); small.pop_back();
+			const auto l = large.back();
+			t.aliasTable[s] = { scaled[s], l };
+			scaled[l] = (scaled[l] + scaled[s]) - 1.0f;
+			if (scaled[l] < 1.0f)
+			{
+				large.pop_back();
+				small.push_back(l);
+			}
+		}
+		// remaining entries have probability 1 (up to rounding errors)
+		for (auto i : large) t.aliasTable[i] = { 1.0f, i };
+		for (auto i : small) t.aliasTable[i] = { 1.0f, i };
+
+		return t;
+	}
+
+	float EnvironmentSamplingTables::getPixelPdf(size_t x, size_t y) const
+	{
+		// probability of the pixel times the number of pixels (=> pdf in uv space)
+		const size_t rowSize = size_t(width) + 1;
+		const float pRow = marginalCdf[y + 1] - marginalCdf[y];
+		const float pCol = conditionalCdf[y * rowSize + x + 1] - conditionalCdf[y * rowSize + x];
+		return pRow * pCol * float(width) * float(height);
+	}
+
+	glm::vec3 EnvironmentSamplingTables::getPixelDirection(float x, float y) const
+	{
+		return equirectToDirection(glm::vec2(x / float(width), y / float(height)));
+	}
+
+	glm::vec3 EnvironmentSamplingTables::sample(glm::vec2 xi, float& pdf) const
+	{
+		const size_t rowSize = size_t(width) + 1;
+		const size_t y = findInterval(marginalCdf.data(), height, xi.y);
+		const float* cdf = &conditionalCdf[y * rowSize];
+		const size_t x = findInterval(cdf, width, xi.x);
+
+		// continuous offset inside the pixel
+		const float rowWidth = marginalCdf[y + 1] - marginalCdf[y];
+		const float colWidth = cdf[x + 1] - cdf[x];
+		const float dy = rowWidth > 0.0f ? (xi.y - marginalCdf[y]) / rowWidth : 0.5f;
+		const float dx = colWidth > 0.0f ? (xi.x - cdf[x]) / colWidth : 0.5f;
+
+		const float theta = s_pi * (float(y) + 0.5f) / float(height);
+		pdf = getPixelPdf(x, y) / (2.0f * s_pi * s_pi * std::sin(theta));
+		return getPixelDirection(float(x) + dx, float(y) + dy);
+	}
+
+	glm::vec3 EnvironmentSamplingTables::sampleAlias(glm::vec2 xi, float& pdf) const
+	{
+		const size_t numPixels = aliasTable.size();
+		const float scaled = xi.x * float(numPixels);
+		size_t i = std::min(size_t(scaled), numPixels - 1);
+		const float remainder = scaled - float(i);
+		const float probability = aliasTable[i].probability;
+		// reuse the remainder for the position inside the pixel
+		float dx;
+		if (remainder < probability)
+		{
+			dx = remainder / probability;
+		}
+		else
+		{
+			dx = (remainder - probability) / (1.0f - probability);
+			i = aliasTable[i].alias;
+		}
+
+		const size_t x = i % width;
+		const size_t y = i / width;
+		const float theta = s_pi * (float(y) + 0.5f) / float(height);
+		pdf = getPixelPdf(x, y) / (2.0f * s_pi * s_pi * std::sin(theta));
+		return getPixelDirection(float(x) + std::min(dx, 0.99999994f), float(y) + xi.y);
+	}
+
+	float EnvironmentSamplingTables::getPdf(const glm::vec3& dir) const
+	{
+		const auto uv = directionToEquirect(dir);
+		const size_t x = std::min(size_t(uv.x * float(width)), size_t(width) - 1);
+		const size_t y = std::min(size_t(uv.y * float(height)), size_t(height) - 1);
+		const float theta = s_pi * (float(y) + 0.5f) / float(height);
+		return getPixelPdf(x, y) / (2.0f * s_pi * s_pi * std::sin(theta));
+	}
+
+	void EnvironmentSamplingTables::save(const std::filesystem::path& filename) const
+	{
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not save " + filename.string());
+
+		const uint32_t header[4] = { s_magic, s_fileVersion, width, height };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&integral), sizeof(integral));
+		writeVector(file, marginalCdf);
+		writeVector(file, conditionalCdf);
+		writeVector(file, aliasTable);
+		if (!file)
+			throw std::runtime_error("could not write " + filename.string());
+	}
+
+	EnvironmentSamplingTables EnvironmentSamplingTables::load(const std::filesystem::path& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not open " + filename.string());
+
+		uint32_t header[4];
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		if (!file || header[0] != s_magic || header[1] != s_fileVersion)
+			throw std::runtime_error(filename.string() + " is not a valid sampling table file");
+
+		EnvironmentSamplingTables t;
+		t.width = header[2];
+		t.height = header[3];
+		file.read(reinterpret_cast<char*>(&t.integral), sizeof(t.integral));
+		readVector(file, t.marginalCdf, size_t(t.height) + 1);
+		readVector(file, t.conditionalCdf, (size_t(t.width) + 1) * t.height);
+		readVector(file, t.aliasTable, size_t(t.width) * t.height);
+		if (!file)
+			throw std::runtime_error("unexpected end of " + filename.string());
+		return t;
+	}
+
+	EnvironmentSamplingTables EnvironmentSamplingTables::loadOrBuild(const std::filesystem::path& map)
+	{
+		const auto cacheName = getCacheFilename(map, hashFile(map), ".sampling.bin");
+		if (std::filesystem::exists(cacheName))
+			return load(cacheName);
+
+		// written through a temporary file => load never sees a partial file from a crashed or concurrent process
+		auto t = build(HdrImage::load(map));
+		writeCacheFile(cacheName, [&](const std::filesystem::path& f) { t.save(f); });
+		return t;
+	}
+}
@@ -0,0 +1,597 @@
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Bounds.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		using json = nlohmann::json;
+
+		constexpr uint32_t s_glbMagic = 0x46546C67; // "glTF"
+		constexpr uint32_t s_glbJsonChunk = 0x4E4F534A; // "JSON"
+		constexpr uint32_t s_glbBinChunk = 0x004E4942; // "BIN\0"
+		constexpr int s_floatType = 5126;
+		constexpr int s_ushortType = 5123;
+		constexpr int s_uintType = 5125;
+		constexpr int s_arrayBuffer = 34962;
+		constexpr int s_elementArrayBuffer = 34963;
+		constexpr size_t s_writeTaskSize = size_t(16) << 20; // bytes that are written with one file handle
+		constexpr size_t s_lookAtKeysPerSection = 16; // linear rotation keys that sample one look at path section
+
+		size_t align4(size_t value)
+		{
+			return (value + 3) & ~size_t(3);
+		}
+
+		json toJson(const glm::vec3& v)
+		{
+			return json::array({ v.x, v.y, v.z });
+		}
+
+		/// range of the binary chunk
+		struct BinBlock
+		{
+			const uint8_t* data;
+			size_t size;
+			size_t offset; // relative to the start of the binary chunk
+		};
+
+		/// collects the gltf json and the buffer views of the binary chunk.
+		/// Buffer views reference the scene memory directly, nothing is copied before write()
+		class GlbWriter
+		{
+		public:
+			json j;
+
+			GlbWriter()
+			{
+				j["asset"] = { {"version", "2.0"}, {"generator", "hrsf"} };
+			}
+
+			/// \brief adds a view of data (data must stay valid until write() finished)
+			/// \param stride byte stride for interleaved vertex data, 0 for tightly packed data
+			size_t addView(const void* data, size_t size, size_t stride, int target)
+			{
+				const size_t offset = m_binSize;
+				m_blocks.push_back({ static_cast<const uint8_t*>(data), size, offset });
+				m_binSize = align4(offset + size);
+
+				json view = { {"buffer", 0}, {"byteOffset", offset}, {"byteLength", size} };
+				if (stride) view["byteStride"] = stride;
+				if (target) view["target"] = target;
+				j["bufferViews"].push_back(view);
+				return j["bufferViews"].size() - 1;
+			}
+
+			/// \brief adds a view of data that is generated during the export (animation keys)
+			size_t addView(std::vector<float> data)
+			{
+				m_ownedData.push_back(std::move(data));
+				return addView(m_ownedData.back().data(), m_ownedData.back().size() * sizeof(float), 0, 0);
+			}
+
+			size_t addAccessor(json accessor)
+			{
+				j["accessors"].push_back(std::move(accessor));
+				return j["accessors"].size() - 1;
+			}
+
+			size_t addNode(json node)
+			{
+				j["nodes"].push_back(std::move(node));
+				return j["nodes"].size() - 1;
+			}
+
+			/// \brief writes the glb file. The binary chunk is split into tasks that are written
+			/// by all threads with separate file handles
+			void write(const fs::path& filename)
+			{
+				if (m_binSize)
+					j["buffers"] = json::array({ { {"byteLength", m_binSize} } });
+
+				auto text = j.dump();
+				text.resize(align4(text.size()), ' ');
+				const size_t binStart = 12 + 8 + text.size() + 8;
+				const size_t totalSize = m_binSize ? binStart + m_binSize : binStart - 8;
+				// all glb sizes are 32 bit
+				if (totalSize > std::numeric_limits<uint32_t>::max())
+					throw std::runtime_error("glb files are limited to 4 GiB, " + filename.string() + " would have " + std::to_string(totalSize) + " bytes");
+
+				{
+					std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+					if (!file.is_open())
+						throw std::runtime_error("could not open " + filename.string());
+					const uint32_t header[] = { s_glbMagic, 2, uint32_t(totalSize), uint32_t(text.size()), s_glbJsonChunk };
+					file.write(reinterpret_cast<const char*>(header), sizeof(header));
+					file.write(text.data(), std::streamsize(text.size()));
+					if (m_binSize)
+					{
+						const uint32_t binHeader[] = { uint32_t(m_binSize), s_glbBinChunk };
+						file.write(reinterpret_cast<const char*>(binHeader), sizeof(binHeader));
+					}
+					if (!file)
+						throw std::runtime_error("could not write " + filename.string());
+				}
+				if (!m_binSize) return;
+
+				// the alignment padding between the views is zero filled by the resize
+				fs::resize_file(filename, totalSize);
+
+				const auto tasks = getWriteTasks();
+				parallelFor(0, tasks.size(), [&](size_t t)
+				{
+					std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+					if (!file.is_open())
+						throw std::runtime_error("could not open " + filename.string());
+					for (const auto& b : tasks[t])
+					{
+						file.seekp(std::streamoff(binStart + b.offset));
+						file.write(reinterpret_cast<const char*>(b.data), std::streamsize(b.size));
+					}
+					if (!file)
+						throw std::runtime_error("could not write " + filename.string());
+				});
+			}
+		private:
+			/// \brief groups small blocks and splits large blocks into tasks of about s_writeTaskSize bytes
+			std::vector<std::vector<BinBlock>> getWriteTasks() const
+			{
+				std::vector<std::vector<BinBlock>> res(1);
+				size_t taskBytes = 0;
+				for (const auto& b : m_blocks)
+				{
+					for (size_t start = 0; start < b.size; start += s_writeTaskSize)
+					{
+						if (taskBytes >= s_writeTaskSize)
+						{
+							res.emplace_back();
+							taskBytes = 0;
+						}
+						const size_t size = std::min(s_writeTaskSize, b.size - start);
+						res.back().push_back({ b.data + start, size, b.offset + start });
+						taskBytes += size;
+					}
+				}
+				return res;
+			}
+
+			std::vector<BinBlock> m_blocks;
+			std::deque<std::vector<float>> m_ownedData; // deque => references stay valid
+			size_t m_binSize = 0;
+		};
+
+		/// \brief primitive attributes of an interleaved bmf vertex range
+		template<class IndexT>
+		json getAttributesJson(GlbWriter& writer, const bmf::BinaryMeshT<IndexT>& mesh, size_t vertexView,
+			uint32_t vertexOffset, uint32_t vertexCount, const BoundingBox& bounds)
+		{
+			const auto attributes = mesh.getAttributes();
+			const size_t stride = bmf::getAttributeElementStride(attributes) * sizeof(float);
+			const auto accessor = [&](bmf::Attributes a, const char* type)
+			{
+				return json{
+					{"bufferView", vertexView},
+					{"byteOffset", vertexOffset * stride + bmf::getAttributeElementOffset(attributes, a) * sizeof(float)},
+					{"componentType", s_floatType},
+					{"count", vertexCount},
+					{"type", type}
+				};
+			};
+
+			json res;
+			auto position = accessor(bmf::Position, "VEC3");
+			position["min"] = toJson(bounds.min);
+			position["max"] = toJson(bounds.max);
+			res["POSITION"] = writer.addAccessor(position);
+			if (attributes & bmf::Normal)
+				res["NORMAL"] = writer.addAccessor(accessor(bmf::Normal, "VEC3"));
+			if (attributes & bmf::Texcoord0)
+				res["TEXCOORD_0"] = writer.addAccessor(accessor(bmf::Texcoord0, "VEC2"));
+			return res;
+		}
+
+		/// \brief gltf mesh that references the bmf arrays (null if the mesh has no positions)
+		/// \param materialOffset added to the material ids (prefab meshes)
+		json getGltfMeshJson(GlbWriter& writer, const Mesh& mesh, const std::vector<BoundingBox>& shapeBounds, uint32_t materialOffset)
+		{
+			json primitives = json::array();
+			if (mesh.type == Mesh::Triangle)
+			{
+				const auto& m = mesh.triangle;
+				if (!(m.getAttributes() & bmf::Position) || m.getShapes().empty()) return json();
+				const size_t stride = bmf::getAttributeElementStride(m.getAttributes()) * sizeof(float);
+				const auto vertexView = writer.addView(m.getVertices().data(), m.getVertices().size() * sizeof(float), stride, s_arrayBuffer);
+				const auto indexView = writer.addView(m.getIndices().data(), m.getIndices().size() * sizeof(uint16_t), 0, s_elementArrayBuffer);
+				for (size_t i = 0; i < m.getShapes().size(); ++i)
+				{
+					// shape indices are relative to the vertex offset => the accessors start at the vertex offset
+					const auto& s = m.getShapes()[i];
+					if (!s.vertexCount || !s.indexCount) continue;
+					json prim;
+					prim["attributes"] = getAttributesJson(writer, m, vertexView, s.vertexOffset, s.vertexCount, shapeBounds[i]);
+					prim["indices"] = writer.addAccessor({
+						{"bufferView", indexView},
+						{"byteOffset", s.indexOffset * sizeof(uint16_t)},
+						{"componentType", s_ushortType},
+						{"count", s.indexCount},
+						{"type", "SCALAR"}
+					});
+					prim["material"] = s.materialId + materialOffset;
+					primitives.push_back(prim);
+				}
+			}
+			else
+			{
+				// billboards are exported as points (per vertex materials are not exported)
+				const auto& m = mesh.billboard;
+				if (!(m.getAttributes() & bmf::Position) || !m.getNumVertices()) return json();
+				const size_t stride = bmf::getAttributeElementStride(m.getAttributes()) * sizeof(float);
+				const auto vertexView = writer.addView(m.getVertices().data(), m.getVertices().size() * sizeof(float), stride, s_arrayBuffer);
+				if (m.getShapes().empty())
+				{
+					primitives.push_back({
+						{"attributes", getAttributesJson(writer, m, vertexView, 0, uint32_t(m.getNumVertices()), shapeBounds.front())},
+						{"mode", 0}
+					});
+				}
+				else
+				{
+					const auto indexView = writer.addView(m.getIndices().data(), m.getIndices().size() * sizeof(uint32_t), 0, s_elementArrayBuffer);
+					for (size_t i = 0; i < m.getShapes().size(); ++i)
+					{
+						const auto& s = m.getShapes()[i];
+						if (!s.vertexCount || !s.indexCount) continue;
+						json prim;
+						prim["attributes"] = getAttributesJson(writer, m, vertexView, s.vertexOffset, s.vertexCount, shapeBounds[i]);
+						prim["indices"] = writer.addAccessor({
+							{"bufferView", indexView},
+							{"byteOffset", s.indexOffset * sizeof(uint32_t)},
+							{"componentType", s_uintType},
+							{"count", s.indexCount},
+							{"type", "SCALAR"}
+						});
+						prim["material"] = s.materialId + materialOffset;
+						prim["mode"] = 0;
+						primitives.push_back(prim);
+					}
+				}
+			}
+			if (primitives.empty()) return json();
+			return json{ {"primitives", primitives} };
+		}
+
+		json getGltfMaterialJson(const Material& material)
+		{
+			const auto& d = material.data;
+			json pbr;
+			pbr["baseColorFactor"] = { d.albedo.x, d.albedo.y, d.albedo.z, d.coverage };
+			pbr["metallicFactor"] = d.metalness;
+			pbr["roughnessFactor"] = d.roughness;
+
+			json res;
+			res["name"] = material.name;
+			res["pbrMetallicRoughness"] = pbr;
+			res["alphaMode"] = (d.flags & MaterialData::Transparent) ? "BLEND" : "OPAQUE";
+			// gltf emissive factors are in [0, 1] => larger values are stored with the emissive strength extension
+			const float emissionScale = std::max(std::max(d.emission.x, d.emission.y), d.emission.z);
+			if (emissionScale > 1.0f)
+			{
+				res["emissiveFactor"] = toJson(d.emission / emissionScale);
+				res["extensions"]["KHR_materials_emissive_strength"] = { {"emissiveStrength", emissionScale} };
+			}
+			else if (emissionScale > 0.0f)
+				res["emissiveFactor"] = toJson(d.emission);
+			if (d.flags & MaterialData::Volume)
+				res["doubleSided"] = true;
+			res["extensions"]["KHR_materials_ior"] = { {"ior", d.ior} };
+			res["extensions"]["KHR_materials_specular"] = { {"specularFactor", d.specular} };
+			if (d.translucency > 0.0f)
+				res["extensions"]["KHR_materials_transmission"] = { {"transmissionFactor", d.translucency} };
+			return res;
+		}
+
+		/// \brief adds the image and texture for a referenced file (textures are not embedded)
+		size_t addTexture(GlbWriter& writer, const fs::path& filename, const fs::path& root)
+		{
+			auto uri = fs::relative(filename, root).generic_u8string();
+			if (uri.empty()) uri = filename.generic_u8string();
+			// keep the uri valid for spaces and percent signs
+			std::string escaped;
+			for (const auto c : uri)
+			{
+				if (c == ' ') escaped += "%20";
+				else if (c == '%') escaped += "%25";
+				else escaped += c;
+			}
+			writer.j["images"].push_back({ {"uri", escaped} });
+			writer.j["textures"].push_back({ {"source", writer.j["images"].size() - 1} });
+			return writer.j["textures"].size() - 1;
+		}
+
+		/// \brief cubic spline keys of a position path: every section becomes one hermite segment
+		/// (the bezier control points of the path give the tangents)
+		/// \param offset added to all positions (base position of the animated node)
+		void addPathAnimation(GlbWriter& writer, const Path& path, const glm::vec3& offset, size_t node, json& animations)
+		{
+			const auto& sections = path.getSections();
+			std::vector<float> times;
+			// in tangent, value, out tangent for every key
+			std::vector<float> values;
+			const auto push = [&values](const glm::vec3& v) { values.insert(values.end(), { v.x, v.y, v.z }); };
+
+			float time = 0.0f;
+			glm::vec3 inTangent = glm::vec3(0.0f);
+			for (size_t s = 0; s < sections.size(); ++s)
+			{
+				const auto cp = path.getControlPoints(s);
+				const float dt = sections[s].time;
+				times.push_back(time);
+				push(inTangent);
+				push(cp[0] + offset);
+				push((cp[1] - cp[0]) * 3.0f / dt);
+				inTangent = (cp[3] - cp[2]) * 3.0f / dt;
+				time += dt;
+			}
+			// the last key ends the loop
+			times.push_back(time);
+			push(inTangent);
+			push(path.getControlPoints(sections.size() - 1)[3] + offset);
+			push(glm::vec3(0.0f));
+
+			const auto input = writer.addAccessor({
+				{"bufferView", writer.addView(times)},
+				{"componentType", s_floatType},
+				{"count", times.size()},
+				{"type", "SCALAR"},
+				{"min", json::array({ times.front() })},
+				{"max", json::array({ times.back() })}
+			});
+			const auto output = writer.addAccessor({
+				{"bufferView", writer.addView(std::move(values))},
+				{"componentType", s_floatType},
+				{"count", times.size() * 3},
+				{"type", "VEC3"}
+			});
+			json animation;
+			animation["samplers"] = json::array({ { {"input", input}, {"output", output}, {"interpolation", "CUBICSPLINE"} } });
+			animation["channels"] = json::array({ { {"sampler", 0}, {"target", { {"node", node}, {"path", "translation"} }} } });
+			animations.push_back(animation);
+		}
+
+		/// \brief rotation that maps -z to direction and y to up (gltf cameras and lights point along -z)
+		glm::quat getRotation(const glm::vec3& direction, const glm::vec3& up)
+		{
+			const auto z = -glm::normalize(direction);
+			auto x = glm::cross(up, z);
+			if (glm::length(x) < 1e-6f) // up and direction are parallel
+				x = glm::cross(std::abs(z.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), z);
+			x = glm::normalize(x);
+			const auto y = glm::cross(z, x);
+			glm::mat3 m;
+			m[0] = x;
+			m[1] = y;
+			m[2] = z;
+			return glm::quat_cast(m);
+		}
+
+		json getRotationJson(const glm::vec3& direction, const glm::vec3& up)
+		{
+			const auto q = getRotation(direction, up);
+			return { q.x, q.y, q.z, q.w };
+		}
+
+		/// \brief linear rotation keys of a camera look at path (the spline of the look at target has no exact quaternion form => sampled).
+		/// \param direction used while the look at target is zero (see Camera::getCurrentData())
+		void addLookAtAnimation(GlbWriter& writer, const Path& path, const glm::vec3& direction, const glm::vec3& up, size_t node, json& animations)
+		{
+			const auto& sections = path.getSections();
+			std::vector<float> times;
+			std::vector<float> values;
+			float start = 0.0f;
+			glm::quat prev(1.0f, 0.0f, 0.0f, 0.0f);
+			for (size_t s = 0; s < sections.size(); ++s)
+			{
+				// the last section also gets its end key
+				const size_t keyCount = s + 1 == sections.size() ? s_lookAtKeysPerSection + 1 : s_lookAtKeysPerSection;
+				for (size_t k = 0; k < keyCount; ++k)
+				{
+					const float t = start + sections[s].time * float(k) / float(s_lookAtKeysPerSection);
+					auto p = path;
+					p.reset();
+					p.update(t);
+					const auto target = p.getLookAt();
+					auto q = getRotation(target != glm::vec3(0.0f) ? target : direction, up);
+					// shortest interpolation between the keys
+					if (!times.empty() && glm::dot(prev, q) < 0.0f) q = -q;
+					prev = q;
+					times.push_back(t);
+					values.insert(values.end(), { q.x, q.y, q.z, q.w });
+				}
+				start += sections[s].time;
+			}
+
+			const auto input = writer.addAccessor({
+				{"bufferView", writer.addView(times)},
+				{"componentType", s_floatType},
+				{"count", times.size()},
+				{"type", "SCALAR"},
+				{"min", json::array({ times.front() })},
+				{"max", json::array({ times.back() })}
+			});
+			const auto output = writer.addAccessor({
+				{"bufferView", writer.addView(std::move(values))},
+				{"componentType", s_floatType},
+				{"count", times.size()},
+				{"type", "VEC4"}
+			});
+			json animation;
+			animation["samplers"] = json::array({ { {"input", input}, {"output", output}, {"interpolation", "LINEAR"} } });
+			animation["channels"] = json::array({ { {"sampler", 0}, {"target", { {"node", node}, {"path", "rotation"} }} } });
+			animations.push_back(animation);
+		}
+	}
+
+	void SceneFormat::saveGlb(const fs::path& filename) const
+	{
+		const auto root = fs::absolute(filename).parent_path();
+		GlbWriter writer;
+		json sceneNodes = json::array();
+		json animations = json::array();
+
+		// meshes of the scene followed by the meshes of each prefab (prefab meshes are exported once and instanced by nodes)
+		std::vector<const Mesh*> meshes;
+		for (const auto& m : m_meshes)
+			meshes.push_back(&m);
+		std::vector<size_t> prefabStart;
+		for (const auto& p : m_prefabs)
+		{
+			prefabStart.push_back(meshes.size());
+			for (const auto& m : p.scene->m_meshes)
+				meshes.push_back(&m);
+		}
+
+		// the only per vertex pass: accessor bounds (required for positions) of all shapes in parallel
+		std::vector<std::vector<BoundingBox>> bounds(meshes.size());
+		parallelFor(0, meshes.size(), [&](size_t i)
+		{
+			bounds[i] = getShapeBounds(*meshes[i]);
+		});
+
+		// gltf mesh index or -1 if the mesh has no positions
+		std::vector<ptrdiff_t> gltfMeshes(meshes.size(), -1);
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			const auto prefab = std::upper_bound(prefabStart.begin(), prefabStart.end(), i) - prefabStart.begin() - 1;
+			const auto materialOffset = prefab < 0 ? 0u : m_prefabs[size_t(prefab)].materialOffset;
+			auto mesh = getGltfMeshJson(writer, *meshes[i], bounds[i], materialOffset);
+			if (mesh.is_null()) continue;
+			writer.j["meshes"].push_back(std::move(mesh));
+			gltfMeshes[i] = ptrdiff_t(writer.j["meshes"].size() - 1);
+		}
+
+		// node index or -1
+		const auto addMeshNode = [&](size_t i)
+		{
+			if (gltfMeshes[i] < 0) return ptrdiff_t(-1);
+			// the format does not define which mesh axis faces the look at target
+			if (!meshes[i]->lookAt.isStatic())
+				throw std::runtime_error("glb export: meshes with a lookAt path are not supported");
+			const auto node = writer.addNode({ {"mesh", gltfMeshes[i]} });
+			if (!meshes[i]->position.isStatic())
+				addPathAnimation(writer, meshes[i]->position, glm::vec3(0.0f), node, animations);
+			return ptrdiff_t(node);
+		};
+		for (size_t i = 0; i < m_meshes.size(); ++i)
+		{
+			const auto node = addMeshNode(i);
+			if (node >= 0) sceneNodes.push_back(node);
+		}
+
+		for (const auto& m : m_materials)
+		{
+			auto material = getGltfMaterialJson(m);
+			if (!m.textures.albedo.empty())
+				material["pbrMetallicRoughness"]["baseColorTexture"] = { {"index", addTexture(writer, m.textures.albedo, root)} };
+			writer.j["materials"].push_back(std::move(material));
+		}
+
+		// camera
+		{
+			const auto& data = m_camera.data;
+			writer.j["cameras"].push_back({
+				{"type", "perspective"},
+				{"perspective", { {"yfov", data.fov}, {"znear", data.near}, {"zfar", data.far} }}
+			});
+			const auto node = writer.addNode({
+				{"camera", 0},
+				{"translation", toJson(data.position)},
+				{"rotation", getRotationJson(data.direction, data.up)}
+			});
+			sceneNodes.push_back(node);
+			if (!m_camera.positionPath.isStatic())
+				addPathAnimation(writer, m_camera.positionPath, data.position, node, animations);
+			if (!m_camera.lookAtPath.isStatic())
+				addLookAtAnimation(writer, m_camera.lookAtPath, data.direction, data.up, node, animations);
+		}
+
+		// lights (KHR_lights_punctual has no light radius)
+		json lights = json::array();
+		const auto addLightNode = [&](const Light& l)
+		{
+			const float intensity = std::max(std::max(l.data.color.x, l.data.color.y), l.data.color.z);
+			json light = { {"color", toJson(intensity > 0.0f ? l.data.color / intensity : l.data.color)}, {"intensity", intensity} };
+			json node = { {"extensions", { {"KHR_lights_punctual", { {"light", lights.size()} }} }} };
+			if (l.data.type == LightData::Directional)
+			{
+				light["type"] = "directional";
+				node["rotation"] = getRotationJson(l.data.direction, std::abs(l.data.direction.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f));
+			}
+			else
+			{
+				light["type"] = "point";
+				node["translation"] = toJson(l.data.position);
+			}
+			lights.push_back(light);
+			const auto nodeIndex = writer.addNode(node);
+			if (l.data.type == LightData::Point && !l.path.isStatic())
+				addPathAnimation(writer, l.path, l.data.position, nodeIndex, animations);
+			return nodeIndex;
+		};
+		for (const auto& l : m_lights)
+			sceneNodes.push_back(addLightNode(l));
+
+		// prefab instances: one node with the instance transform, the prefab meshes and lights are its children
+		for (const auto& instance : m_instances)
+		{
+			json children = json::array();
+			const auto& prefab = m_prefabs[instance.prefab];
+			for (size_t m = 0; m < prefab.scene->m_meshes.size(); ++m)
+			{
+				const auto node = addMeshNode(prefabStart[instance.prefab] + m);
+				if (node >= 0) children.push_back(node);
+			}
+			for (const auto& l : prefab.scene->m_lights)
+				children.push_back(addLightNode(l));
+
+			std::vector<float> matrix;
+			for (int c = 0; c < 4; ++c)
+				for (int r = 0; r < 4; ++r)
+					matrix.push_back(instance.transform[c][r]);
+			json node = { {"matrix", matrix} };
+			if (!children.empty()) node["children"] = children;
+			sceneNodes.push_back(writer.addNode(node));
+		}
+
+		std::vector<std::string> extensions;
+		const auto useExtension = [&extensions](const std::string& name)
+		{
+			if (std::find(extensions.begin(), extensions.end(), name) == extensions.end())
+				extensions.push_back(name);
+		};
+		if (!lights.empty())
+		{
+			writer.j["extensions"]["KHR_lights_punctual"]["lights"] = lights;
+			useExtension("KHR_lights_punctual");
+		}
+		for (const auto& m : writer.j.value("materials", json::array()))
+			for (const auto& ext : m["extensions"].items())
+				useExtension(ext.key());
+		if (!extensions.empty())
+			writer.j["extensionsUsed"] = extensions;
+		if (!animations.empty())
+			writer.j["animations"] = animations;
+
+		writer.j["scenes"] = json::array({ { {"nodes", sceneNodes} } });
+		writer.j["scene"] = 0;
+		writer.write(filename);
+	}
+}
@@ -0,0 +1,590 @@
+#include "../include/hrsf/Importer.h"
+#include "../include/hrsf/Parallel.h"
+#include "../dependencies/json/single_include/nlohmann/json.hpp"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace hrsf
+{
+	namespace
+	{
+		namespace fs = std::filesystem;
+		using json = nlohmann::json;
+
+		constexpr uint32_t s_glbMagic = 0x46546C67; // "glTF"
+		constexpr uint32_t s_glbJsonChunk = 0x4E4F534A; // "JSON"
+		constexpr uint32_t s_glbBinChunk = 0x004E4942; // "BIN\0"
+		constexpr size_t s_maxShapeVertices = size_t(std::numeric_limits<uint16_t>::max()) + 1;
+
+		std::vector<uint8_t> readBinaryFile(const fs::path& filename)
+		{
+			std::ifstream file(filename, std::ios::binary | std::ios::ate);
+			if (!file.is_open())
+				throw std::runtime_error("could not open " + filename.string());
+			std::vector<uint8_t> res(size_t(file.tellg()));
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(res.data()), std::streamsize(res.size()));
+			return res;
+		}
+
+		std::vector<uint8_t> decodeBase64(const std::string& text, size_t start)
+		{
+			static const auto s_table = []()
+			{
+				std::array<int8_t, 256> t;
+				t.fill(-1);
+				const char* chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+				for (int8_t i = 0; i < 64; ++i)
+					t[uint8_t(chars[i])] = i;
+				return t;
+			}();
+
+			std::vector<uint8_t> res;
+			res.reserve((text.size() - start) / 4 * 3);
+			uint32_t bits = 0;
+			int bitCount = 0;
+			for (size_t i = start; i < text.size(); ++i)
+			{
+				const auto value = s_table[uint8_t(text[i])];
+				if (value < 0) continue; // padding and whitespace
+				bits = (bits << 6) | uint32_t(value);
+				bitCount += 6;
+				if (bitCount >= 8)
+				{
+					bitCount -= 8;
+					res.push_back(uint8_t(bits >> bitCount));
+				}
+			}
+			return res;
+		}
+
+		/// uris may contain percent encoded characters
+		fs::path getUriPath(const std::string& uri, const fs::path& root)
+		{
+			std::string res;
+			for (size_t i = 0; i < uri.size(); ++i)
+			{
+				if (uri[i] == '%' && i + 2 < uri.size())
+				{
+					res.push_back(char(std::stoi(uri.substr(i + 1, 2), nullptr, 16)));
+					i += 2;
+				}
+				else res.push_back(uri[i]);
+			}
+			return fs::absolute(root / fs::u8path(res));
+		}
+
+		struct GltfFile
+		{
+			json j;
+			std::vector<std::vector<uint8_t>> buffers;
+			fs::path root;
+
+			/// \brief reads an accessor as floats (integer types are converted, normalized if requested)
+			/// \param components expected number of components per element
+			std::vector<float> readFloats(size_t accessorIndex, size_t components) const
+			{
+				const auto view = getAccessorView(accessorIndex, components);
+				std::vector<float> res(view.count * components, 0.0f);
+				if (!view.data) return res; // no buffer view => all zero
+
+				if (view.componentType == 5126 && view.stride == components * sizeof(float))
+				{
+					// tightly packed floats => single copy
+					std::memcpy(res.data(), view.data, res.size() * sizeof(float));
+					return res;
+				}
+
+				const size_t componentSize = getComponentSize(view.componentType);
+				for (size_t e = 0; e < view.count; ++e)
+					for (size_t c = 0; c < components; ++c)
+						res[e * components + c] = readComponent(view.data + e * view.stride + c * componentSize, view.componentType, view.normalized);
+				return res;
+			}
+
+			std::vector<uint32_t> readIndices(size_t accessorIndex) const
+			{
+				const auto view = getAccessorView(accessorIndex, 1);
+				std::vector<uint32_t> res(view.count, 0);
+				if (!view.data) return res;
+				for (size_t i = 0; i < view.count; ++i)
+				{
+					const uint8_t* src = view.data + i * view.stride;
+					switch (view.componentType)
+					{
+					case 5121: res[i] = *src; break;
+					case 5123: { uint16_t v; std::memcpy(&v, src, 2); res[i] = v; break; }
+					case 5125: std::memcpy(&res[i], src, 4); break;
+					default: throw std::runtime_error("invalid gltf index type " + std::to_string(view.componentType));
+					}
+				}
+				return res;
+			}
+
+			/// \brief absolute filename of a texture (empty for textures that are embedded into buffers)
+			fs::path getTexture(const json& textureInfo) const
+			{
+				if (!textureInfo.count("index")) return {};
+				const auto& texture = j["textures"].at(textureInfo["index"].get<size_t>());
+				if (!texture.count("source")) return {};
+				const auto& image = j["images"].at(texture["source"].get<size_t>());
+				if (!image.count("uri")) return {};
+				const auto uri = image["uri"].get<std::string>();
+				if (uri.rfind("data:", 0) == 0) return {};
+				return getUriPath(uri, root);
+			}
+
+		private:
+			struct AccessorView
+			{
+				const uint8_t* data; // nullptr if the accessor has no buffer view
+				size_t count;
+				size_t stride;
+				int componentType;
+				bool normalized;
+			};
+
+			AccessorView getAccessorView(size_t accessorIndex, size_t components) const
+			{
+				const auto& a = j["accessors"].at(accessorIndex);
+				if (a.count("sparse"))
+					throw std::runtime_error("sparse gltf accessors are not supported");
+
+				AccessorView res;
+				res.data = nullptr;
+				res.count = a["count"].get<size_t>();
+				res.componentType = a["componentType"].get<int>();
+				res.normalized = a.value("normalized", false);
+				const size_t componentSize = getComponentSize(res.componentType);
+				res.stride = componentSize * components;
+				if (!a.count("bufferView")) return res;
+
+				const auto& view = j["bufferViews"].at(a["bufferView"].get<size_t>());
+				const auto& buffer = buffers.at(view["buffer"].get<size_t>());
+				res.stride = view.value("byteStride", size_t(0)) ? view["byteStride"].get<size_t>() : res.stride;
+				const size_t offset = view.value("byteOffset", size_t(0)) + a.value("byteOffset", size_t(0));
+				if (res.count && offset + (res.count - 1) * res.stride + componentSize * components > buffer.size())
+					throw std::runtime_error("gltf accessor " + std::to_string(accessorIndex) + " is out of bound");
+				res.data = buffer.data() + offset;
+				return res;
+			}
+
+			static size_t getComponentSize(int componentType)
+			{
+				switch (componentType)
+				{
+				case 5120: case 5121: return 1;
+				case 5122: case 5123: return 2;
+				case 5125: case 5126: return 4;
+				}
+				throw std::runtime_error("invalid gltf component type " + std::to_string(componentType));
+			}
+
+			static float readComponent(const uint8_t* src, int componentType, bool normalized)
+			{
+				switch (componentType)
+				{
+				case 5120: { int8_t v; std::memcpy(&v, src, 1); return normalized ? std::max(float(v) / 127.0f, -1.0f) : float(v); }
+				case 5121: return normalized ? float(*src) / 255.0f : float(*src);
+				case 5122: { int16_t v; std::memcpy(&v, src, 2); return normalized ? std::max(float(v) / 32767.0f, -1.0f) : float(v); }
+				case 5123: { uint16_t v; std::memcpy(&v, src, 2); return normalized ? float(v) / 65535.0f : float(v); }
+				case 5125: { uint32_t v; std::memcpy(&v, src, 4); return float(v); }
+				}
+				float v;
+				std::memcpy(&v, src, 4);
+				return v;
+			}
+		};
+
+		GltfFile loadGltf(const fs::path& filename)
+		{
+			GltfFile res;
+			res.root = fs::absolute(filename).parent_path();
+			auto data = readBinaryFile(filename);
+
+			std::vector<uint8_t> binChunk;
+			uint32_t magic = 0;
+			if (data.size() >= 4) std::memcpy(&magic, data.data(), 4);
+			if (magic == s_glbMagic)
+			{
+				// glb container: 12 byte header, json chunk, optional binary chunk
+				size_t pos = 12;
+				while (pos + 8 <= data.size())
+				{
+					uint32_t length, type;
+					std::memcpy(&length, data.data() + pos, 4);
+					std::memcpy(&type, data.data() + pos + 4, 4);
+					pos += 8;
+					if (pos + length > data.size())
+						throw std::runtime_error(filename.string() + " invalid glb chunk length");
+					if (type == s_glbJsonChunk)
+						res.j = json::parse(data.begin() + pos, data.begin() + pos + length);
+					else if (type == s_glbBinChunk && binChunk.empty())
+						binChunk.assign(data.begin() + pos, data.begin() + pos + length);
+					pos += length;
+				}
+				if (res.j.is_null())
+					throw std::runtime_error(filename.string() + " has no json chunk");
+			}
+			else res.j = json::parse(data.begin(), data.end());
+			data = {};
+
+			if (res.j["asset"].value("version", std::string()).rfind("2.", 0) != 0)
+				throw std::runtime_error(filename.string() + " is not a gltf 2.0 file");
+
+			// decode buffers in parallel
+			const auto buffers = res.j.value("buffers", json::array());
+			res.buffers.resize(buffers.size());
+			parallelFor(0, buffers.size(), [&](size_t i)
+			{
+				const auto& b = buffers[i];
+				if (!b.count("uri"))
+					res.buffers[i] = binChunk; // glb binary chunk
+				else
+				{
+					const auto uri = b["uri"].get<std::string>();
+					if (uri.rfind("data:", 0) == 0)
+					{
+						const auto comma = uri.find(',');
+						if (comma == std::string::npos || uri.rfind(";base64", comma) == std::string::npos)
+							throw std::runtime_error("unsupported gltf data uri");
+						res.buffers[i] = decodeBase64(uri, comma + 1);
+					}
+					else res.buffers[i] = readBinaryFile(getUriPath(uri, res.root));
+				}
+				if (res.buffers[i].size() < b["byteLength"].get<size_t>())
+					throw std::runtime_error("gltf buffer " + std::to_string(i) + " is too small");
+			});
+			return res;
+		}
+
+		glm::mat4 getLocalTransform(const json& node)
+		{
+			if (node.count("matrix"))
+			{
+				const auto m = node["matrix"].get<std::vector<float>>();
+				glm::mat4 res;
+				for (int c = 0; c < 4; ++c)
+					for (int r = 0; r < 4; ++r)
+						res[c][r] = m.at(c * 4 + r);
+				return res;
+			}
+
+			const auto t = node.value("translation", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+			const auto r = node.value("rotation", std::vector<float>{ 0.0f, 0.0f, 0.0f, 1.0f }); // x y z w
+			const auto s = node.value("scale", std::vector<float>{ 1.0f, 1.0f, 1.0f });
+			glm::mat4 res = glm::mat4_cast(glm::quat(r.at(3), r.at(0), r.at(1), r.at(2)));
+			for (int c = 0; c < 3; ++c)
+				res[c] = res[c] * s.at(c);
+			res[3] = glm::vec4(t.at(0), t.at(1), t.at(2), 1.0f);
+			return res;
+		}
+
+		struct NodeInstance
+		{
+			size_t index; // mesh, light or camera index
+			glm::mat4 transform;
+		};
+
+		struct SceneInstances
+		{
+			std::vector<NodeInstance> meshes;
+			std::vector<NodeInstance> lights;
+			std::vector<NodeInstance> cameras;
+		};
+
+		void collectInstances(const json& nodes, size_t node, const glm::mat4& parent, size_t depth, SceneInstances& res)
+		{
+			if (depth > nodes.size())
+				throw std::runtime_error("gltf node hierarchy contains a cycle");
+			const auto& n = nodes.at(node);
+			const auto transform = parent * getLocalTransform(n);
+			if (n.count("mesh")) res.meshes.push_back({ n["mesh"].get<size_t>(), transform });
+			if (n.count("camera")) res.cameras.push_back({ n["camera"].get<size_t>(), transform });
+			auto ext = n.find("extensions");
+			if (ext != n.end() && ext->count("KHR_lights_punctual"))
+				res.lights.push_back({ (*ext)["KHR_lights_punctual"]["light"].get<size_t>(), transform });
+			for (const auto& c : n.value("children", std::vector<size_t>()))
+				collectInstances(nodes, c, transform, depth + 1, res);
+		}
+
+		SceneInstances getSceneInstances(const json& j)
+		{
+			SceneInstances res;
+			const auto nodes = j.value("nodes", json::array());
+			std::vector<size_t> roots;
+			if (j.count("scenes") && !j["scenes"].empty())
+				roots = j["scenes"].at(j.value("scene", size_t(0))).value("nodes", std::vector<size_t>());
+			else
+			{
+				// no scene => all nodes that are not children
+				std::vector<bool> isChild(nodes.size(), false);
+				for (const auto& n : nodes)
+					for (const auto& c : n.value("children", std::vector<size_t>()))
+						isChild.at(c) = true;
+				for (size_t i = 0; i < nodes.size(); ++i)
+					if (!isChild[i]) roots.push_back(i);
+			}
+
+			for (auto r : roots)
+				collectInstances(nodes, r, glm::mat4(1.0f), 0, res);
+			return res;
+		}
+
+		glm::vec3 getVec3(const json& j, const char* name, glm::vec3 defaultValue)
+		{
+			if (!j.count(name)) return defaultValue;
+			const auto v = j[name].get<std::vector<float>>();
+			return glm::vec3(v.at(0), v.at(1), v.at(2));
+		}
+
+		std::vector<Material> getMaterials(const GltfFile& file)
+		{
+			std::vector<Material> res;
+			const auto materials = file.j.value("materials", json::array());
+			for (size_t i = 0; i < materials.size(); ++i)
+			{
+				const auto& m = materials[i];
+				Material mat;
+				mat.name = m.value("name", "material" + std::to_string(i));
+				mat.data = MaterialData::Default();
+
+				const auto pbr = m.value("pbrMetallicRoughness", json::object());
+				const auto baseColor = pbr.value("baseColorFactor", std::vector<float>{ 1.0f, 1.0f, 1.0f, 1.0f });
+				mat.data.albedo = glm::vec3(baseColor.at(0), baseColor.at(1), baseColor.at(2));
+				mat.data.metalness = pbr.value("metallicFactor", 1.0f);
+				mat.data.roughness = pbr.value("roughnessFactor", 1.0f);
+				mat.data.emission = getVec3(m, "emissiveFactor", glm::vec3(0.0f));
+				if (pbr.count("baseColorTexture"))
+					mat.textures.albedo = file.getTexture(pbr["baseColorTexture"]);
+
+				const auto alphaMode = m.value("alphaMode", std::string("OPAQUE"));
+				if (alphaMode != "OPAQUE")
+				{
+					mat.data.coverage = baseColor.at(3);
+					mat.data.flags |= MaterialData::Transparent;
+				}
+
+				const auto ext = m.value("extensions", json::object());
+				if (ext.count("KHR_materials_emissive_strength"))
+					mat.data.emission *= ext["KHR_materials_emissive_strength"].value("emissiveStrength", 1.0f);
+				if (ext.count("KHR_materials_ior"))
+					mat.data.ior = ext["KHR_materials_ior"].value("ior", 1.5f);
+				if (ext.count("KHR_materials_transmission"))
+					mat.data.translucency = ext["KHR_materials_transmission"].value("transmissionFactor", 0.0f);
+				if (ext.count("KHR_materials_specular"))
+					mat.data.specular = ext["KHR_materials_specular"].value("specularFactor", 1.0f);
+
+				res.push_back(std::move(mat));
+			}
+			return res;
+		}
+
+		/// \brief appends the primitive as one or more shapes (split at 65536 vertices)
+		void addPrimitive(const GltfFile& file, const json& prim, const glm::mat4& transform, float scale, uint32_t materialId,
+			std::vector<float>& vertices, std::vector<uint16_t>& indices, std::vector<bmf::Shape>& shapes)
+		{
+			if (prim.value("mode", 4) != 4) return; // only triangle lists
+			const auto& attribs = prim["attributes"];
+			if (!attribs.count("POSITION")) return;
+
+			const auto positions = file.readFloats(attribs["POSITION"].get<size_t>(), 3);
+			const size_t vertexCount = positions.size() / 3;
+			std::vector<float> normals;
+			if (attribs.count("NORMAL")) normals = file.readFloats(attribs["NORMAL"].get<size_t>(), 3);
+			std::vector<float> texcoords;
+			if (attribs.count("TEXCOORD_0")) texcoords = file.readFloats(attribs["TEXCOORD_0"].get<size_t>(), 2);
+
+			std::vector<uint32_t> srcIndices;
+			if (prim.count("indices")) srcIndices = file.readIndices(prim["indices"].get<size_t>());
+			else
+			{
+				srcIndices.resize(vertexCount);
+				for (uint32_t i = 0; i < uint32_t(vertexCount); ++i) srcIndices[i] = i;
+			}
+			srcIndices.resize(srcIndices.size() / 3 * 3);
+			for (auto i : srcIndices)
+				if (i >= vertexCount) throw std::runtime_error("gltf index out of bound");
+
+			// mirroring transforms flip the winding order
+			const glm::mat3 linear = glm::mat3(transform);
+			const bool flip = glm::determinant(linear) < 0.0f;
+			if (flip)
+				for (size_t i = 0; i < srcIndices.size(); i += 3)
+					std::swap(srcIndices[i + 1], srcIndices[i + 2]);
+
+			if (normals.empty())
+			{
+				// smooth normals from the (already flipped) triangles
+				normals.assign(vertexCount * 3, 0.0f);
+				for (size_t i = 0; i < srcIndices.size(); i += 3)
+				{
+					const auto p = [&](size_t c) { return glm::vec3(positions[srcIndices[i + c] * 3], positions[srcIndices[i + c] * 3 + 1], positions[srcIndices[i + c] * 3 + 2]); };
+					auto n = glm::cross(p(1) - p(0), p(2) - p(0));
+					if (flip) n = -n; // transformed with the mirroring matrix below
+					for (size_t c = 0; c < 3; ++c)
+						for (int k = 0; k < 3; ++k)
+							normals[srcIndices[i + c] * 3 + k] += n[k];
+				}
+			}
+
+			const glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+			const uint32_t attributes = bmf::Position | bmf::Normal | bmf::Texcoord0;
+			const size_t stride = bmf::getAttributeElementStride(attributes);
+			const size_t normalOffset = bmf::getAttributeElementOffset(attributes, bmf::Normal);
+			const size_t texcoordOffset = bmf::getAttributeElementOffset(attributes, bmf::Texcoord0);
+
+			// remap[v] is valid if stamp[v] == current shape
+			std::vector<uint16_t> remap(vertexCount);
+			std::vector<uint32_t> stamp(vertexCount, std::numeric_limits<uint32_t>::max());
+			uint32_t shapeId = 0;
+			bmf::Shape* shape = nullptr;
+			for (size_t tri = 0; tri < srcIndices.size(); tri += 3)
+			{
+				if (!shape || shape->vertexCount + 3 > s_maxShapeVertices)
+				{
+					shapeId = uint32_t(shapes.size());
+					shapes.push_back(bmf::Shape{ uint32_t(indices.size()), 0, uint32_t(vertices.size() / stride), 0, materialId });
+					shape = &shapes.back();
+				}
+				for (size_t c = tri; c < tri + 3; ++c)
+				{
+					const auto v = srcIndices[c];
+					if (stamp[v] != shapeId)
+					{
+						stamp[v] = shapeId;
+						remap[v] = uint16_t(shape->vertexCount++);
+						const auto p = glm::vec3(transform * glm::vec4(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2], 1.0f)) * scale;
+						auto n = normalMatrix * glm::vec3(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2]);
+						const float len = glm::length(n);
+						n = len > 0.0f ? n / len : glm::vec3(0.0f, 1.0f, 0.0f);
+						const auto start = vertices.size();
+						vertices.resize(start + stride, 0.0f);
+						float* dst = vertices.data() + start;
+						dst[0] = p.x; dst[1] = p.y; dst[2] = p.z;
+						dst[normalOffset] = n.x; dst[normalOffset + 1] = n.y; dst[normalOffset + 2] = n.z;
+						if (!texcoords.empty())
+						{
+							dst[texcoordOffset] = texcoords[v * 2];
+							dst[texcoordOffset + 1] = texcoords[v * 2 + 1];
+						}
+					}
+					indices.push_back(remap[v]);
+					++shape->indexCount;
+				}
+			}
+		}
+
+		/// \brief mesh with one shape per primitive. Returns a mesh without shapes if nothing could be imported
+		Mesh buildMesh(const GltfFile& file, const NodeInstance& instance, float scale, uint32_t defaultMaterial)
+		{
+			std::vector<float> vertices;
+			std::vector<uint16_t> indices;
+			std::vector<bmf::Shape> shapes;
+			const auto& mesh = file.j["meshes"].at(instance.index);
+			for (const auto& prim : mesh["primitives"])
+			{
+				const auto materialId = prim.count("material") ? prim["material"].get<uint32_t>() : defaultMaterial;
+				addPrimitive(file, prim, instance.transform, scale, materialId, vertices, indices, shapes);
+			}
+
+			const uint32_t attributes = bmf::Position | bmf::Normal | bmf::Texcoord0;
+			bmf::BinaryMesh16 res(attributes, std::move(vertices), std::move(indices), std::move(shapes));
+			if (!res.getShapes().empty())
+				res.generateBoundingVolumes();
+			return Mesh(std::move(res));
+		}
+
+		std::vector<Light> getLights(const GltfFile& file, const std::vector<NodeInstance>& instances, float scale)
+		{
+			std::vector<Light> res;
+			if (instances.empty()) return res;
+			const auto& lights = file.j["extensions"]["KHR_lights_punctual"]["lights"];
+			for (const auto& instance : instances)
+			{
+				const auto& l = lights.at(instance.index);
+				const auto color = getVec3(l, "color", glm::vec3(1.0f)) * l.value("intensity", 1.0f);
+				const auto type = l["type"].get<std::string>();
+				Light light;
+				if (type == "directional")
+				{
+					light.data.type = LightData::Directional;
+					light.data.direction = glm::normalize(glm::mat3(instance.transform) * glm::vec3(0.0f, 0.0f, -1.0f));
+				}
+				else
+				{
+					// spot lights are imported as point lights
+					light.data.type = LightData::Point;
+					light.data.position = glm::vec3(instance.transform[3]) * scale;
+					light.data.radius = 0.0f;
+				}
+				light.data.color = color;
+				res.push_back(light);
+			}
+			return res;
+		}
+	}
+
+	void importGltf(const std::filesystem::path& filename, ImportTarget& target, const ImportSettings& settings)
+	{
+		const auto file = loadGltf(filename);
+		const auto instances = getSceneInstances(file.j);
+
+		auto materials = getMaterials(file);
+		// primitives without material use an appended default material
+		bool needsDefault = false;
+		for (const auto& instance : instances.meshes)
+			for (const auto& prim : file.j["meshes"].at(instance.index)["primitives"])
+				needsDefault = needsDefault || !prim.count("material");
+		const auto defaultMaterial = uint32_t(materials.size());
+		if (needsDefault)
+		{
+			materials.emplace_back();
+			materials.back().name = "default";
+			materials.back().data = MaterialData::Default();
+		}
+		const auto materialCount = materials.size();
+		target.setMaterials(std::move(materials));
+
+		// build batches of meshes in parallel, pass them to the target in order
+		const size_t batchSize = settings.meshBatchSize ? settings.meshBatchSize : getThreadCount();
+		for (size_t first = 0; first < instances.meshes.size(); first += batchSize)
+		{
+			const size_t count = std::min(batchSize, instances.meshes.size() - first);
+			std::vector<Mesh> meshes(count);
+			parallelFor(0, count, [&](size_t i)
+			{
+				meshes[i] = buildMesh(file, instances.meshes[first + i], settings.scale, defaultMaterial);
+				for (const auto& s : meshes[i].triangle.getShapes())
+					if (s.materialId >= materialCount)
+						throw std::runtime_error("gltf material index out of bound");
+			});
+			for (auto& m : meshes)
+				if (!m.triangle.getShapes().empty())
+					target.addMesh(std::move(m));
+		}
+
+		target.setLights(getLights(file, instances.lights, settings.scale));
+
+		// first perspective camera
+		for (const auto& instance : instances.cameras)
+		{
+			const auto& cam = file.j["cameras"].at(instance.index);
+			if (cam.value("type", std::string()) != "perspective") continue;
+			const auto& p = cam["perspective"];
+			auto data = CameraData::Default();
+			data.position = glm::vec3(instance.transform[3]) * settings.scale;
+			data.direction = glm::normalize(glm::mat3(instance.transform) * glm::vec3(0.0f, 0.0f, -1.0f));
+			data.up = glm::normalize(glm::mat3(instance.transform) * glm::vec3(0.0f, 1.0f, 0.0f));
+			data.fov = p["yfov"].get<float>();
+			data.near = p.value("znear", data.near) * settings.scale;
+			if (p.count("zfar")) data.far = p["zfar"].get<float>() * settings.scale;
+			target.setCamera(Camera(data));
+			break;
+		}
+	}
+}
@@ -0,0 +1,257 @@
+#include "../include/hrsf/HdrImage.h"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <glm/glm.hpp>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr float s_pi = 3.14159265358979f;
+		constexpr size_t s_maxPixels = size_t(1) << 28; // 3 GB of float pixels
+
+		glm::vec3 rgbeToFloat(const uint8_t* rgbe)
+		{
+			if (rgbe[3] == 0) return glm::vec3(0.0f);
+			const float f = std::ldexp(1.0f, int(rgbe[3]) - (128 + 8));
+			return glm::vec3(float(rgbe[0]) + 0.5f, float(rgbe[1]) + 0.5f, float(rgbe[2]) + 0.5f) * f;
+		}
+
+		void floatToRgbe(const glm::vec3& c, uint8_t* rgbe)
+		{
+			const float v = std::max(c.x, std::max(c.y, c.z));
+			if (v < 1e-32f)
+			{
+				rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+				return;
+			}
+			int e;
+			const float scale = std::frexp(v, &e) * 256.0f / v;
+			rgbe[0] = uint8_t(std::max(c.x, 0.0f) * scale);
+			rgbe[1] = uint8_t(std::max(c.y, 0.0f) * scale);
+			rgbe[2] = uint8_t(std::max(c.z, 0.0f) * scale);
+			rgbe[3] = uint8_t(e + 128);
+		}
+
+		// reads one scanline in the new run length encoding (or flat if the scanline is not encoded)
+		void readScanline(std::istream& file, size_t width, std::vector<uint8_t>& rgbe)
+		{
+			uint8_t header[4];
+			if (!file.read(reinterpret_cast<char*>(header), 4))
+				throw std::runtime_error("unexpected end of hdr file");
+
+			const bool isRle = width >= 8 && width < 32768 && header[0] == 2 && header[1] == 2 && (header[2] & 0x80) == 0;
+			if (!isRle)
+			{
+				if (header[0] == 1 && header[1] == 1 && header[2] == 1)
+					throw std::runtime_error("old style run length encoded hdr files are not supported");
+				// flat scanline
+				std::copy(header, header + 4, rgbe.begin());
+				if (!file.read(reinterpret_cast<char*>(rgbe.data() + 4), std::streamsize(width * 4 - 4)))
+					throw std::runtime_error("unexpected end of hdr file");
+				return;
+			}
+
+			if ((size_t(header[2]) << 8 | size_t(header[3])) != width)
+				throw std::runtime_error("invalid hdr scanline width");
+
+			// each channel is encoded separately
+			for (size_t c = 0; c < 4; ++c)
+			{
+				size_t x = 0;
+				while (x < width)
+				{
+					uint8_t count;
+					if (!file.read(reinterpret_cast<char*>(&count), 1))
+						throw std::runtime_error("unexpected end of hdr file");
+					if (count > 128)
+					{
+						// run
+						count -= 128;
+						uint8_t value;
+						file.read(reinterpret_cast<char*>(&value), 1);
+						if (x + count > width)
+							throw std::runtime_error("invalid hdr run length");
+						for (uint8_t i = 0; i < count; ++i)
+							rgbe[(x++) * 4 + c] = value;
+					}
+					else
+					{
+						if (count == 0 || x + count > width)
+							throw std::runtime_error("invalid hdr run length");
+						for (uint8_t i = 0; i < count; ++i)
+						{
+							char value;
+							file.read(&value, 1);
+							rgbe[(x++) * 4 + c] = uint8_t(value);
+						}
+					}
+				}
+			}
+			if (!file)
+				throw std::runtime_error("unexpected end of hdr file");
+		}
+
+		void writeScanline(std::ostream& file, size_t width, const std::vector<uint8_t>& rgbe)
+		{
+			if (width < 8 || width >= 32768)
+			{
+				// encoding is not allowed
+				file.write(reinterpret_cast<const char*>(rgbe.data()), std::streamsize(width * 4));
+				return;
+			}
+
+			const uint8_t header[4] = { 2, 2, uint8_t(width >> 8), uint8_t(width & 0xFF) };
+			file.write(reinterpret_cast<const char*>(header), 4);
+
+			std::vector<uint8_t> out;
+			out.reserve(width + width / 64 + 1);
+			for (size_t c = 0; c < 4; ++c)
+			{
+				out.clear();
+				size_t x = 0;
+				while (x < width)
+				{
+					// length of the run starting at x
+					size_t run = 1;
+					while (x + run < width && run < 127 && rgbe[(x + run) * 4 + c] == rgbe[x * 4 + c])
+						++run;
+
+					if (run >= 3)
+					{
+						out.push_back(uint8_t(128 + run));
+						out.push_back(rgbe[x * 4 + c]);
+						x += run;
+						continue;
+					}
+
+					// literal sequence until the next run of at least 3 values
+					size_t end = x;
+					while (end < width && end - x < 128)
+					{
+						if (end + 2 < width && rgbe[end * 4 + c] == rgbe[(end + 1) * 4 + c] && rgbe[end * 4 + c] == rgbe[(end + 2) * 4 + c])
+							break;
+						++end;
+					}
+					out.push_back(uint8_t(end - x));
+					for (; x < end; ++x)
+						out.push_back(rgbe[x * 4 + c]);
+				}
+				file.write(reinterpret_cast<const char*>(out.data()), std::streamsize(out.size()));
+			}
+		}
+	}
+
+	glm::vec3 HdrImage::sampleEquirect(glm::vec2 uv) const
+	{
+		const float fx = uv.x * float(width) - 0.5f;
+		const float fy = std::min(std::max(uv.y * float(height) - 0.5f, 0.0f), float(height - 1));
+		const float x0f = std::floor(fx);
+		const float y0f = std::floor(fy);
+		const float tx = fx - x0f;
+		const float ty = fy - y0f;
+
+		const auto wrapX = [this](long long x)
+		{
+			x %= (long long)width;
+			return size_t(x < 0 ? x + (long long)width : x);
+		};
+		const size_t x0 = wrapX((long long)x0f);
+		const size_t x1 = wrapX((long long)x0f + 1);
+		const size_t y0 = size_t(y0f);
+		const size_t y1 = std::min(y0 + 1, height - 1);
+
+		const auto top = glm::mix(at(x0, y0), at(x1, y0), tx);
+		const auto bottom = glm::mix(at(x0, y1), at(x1, y1), tx);
+		return glm::mix(top, bottom, ty);
+	}
+
+	HdrImage HdrImage::load(const std::filesystem::path& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not open " + filename.string());
+
+		// header
+		std::string line;
+		std::getline(file, line);
+		if (line.rfind("#?", 0) != 0)
+			throw std::runtime_error(filename.string() + " is not a radiance file");
+
+		bool isRgbe = true;
+		while (std::getline(file, line) && !line.empty())
+		{
+			if (line.rfind("FORMAT=", 0) == 0)
+				isRgbe = line == "FORMAT=32-bit_rle_rgbe";
+		}
+		if (!isRgbe)
+			throw std::runtime_error(filename.string() + " unsupported hdr format (only 32-bit_rle_rgbe)");
+
+		// resolution string
+		std::getline(file, line);
+		char ySign, xSign;
+		char yAxis, xAxis;
+		size_t height, width;
+		if (std::sscanf(line.c_str(), "%c%c %zu %c%c %zu", &ySign, &yAxis, &height, &xSign, &xAxis, &width) != 6
+			|| yAxis != 'Y' || xAxis != 'X' || ySign != '-' || xSign != '+')
+			throw std::runtime_error(filename.string() + " unsupported hdr orientation: " + line);
+		// corrupt resolutions would overflow the scanline buffer or allocate without limit
+		if (width == 0 || height == 0 || width > s_maxPixels / height)
+			throw std::runtime_error(filename.string() + " invalid hdr resolution: " + line);
+
+		HdrImage img(width, height);
+		std::vector<uint8_t> rgbe(width * 4);
+		for (size_t y = 0; y < height; ++y)
+		{
+			readScanline(file, width, rgbe);
+			for (size_t x = 0; x < width; ++x)
+				img.at(x, y) = rgbeToFloat(&rgbe[x * 4]);
+		}
+
+		return img;
+	}
+
+	void HdrImage::save(const std::filesystem::path& filename) const
+	{
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not save " + filename.string());
+
+		file << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n";
+		file << "-Y " << height << " +X " << width << "\n";
+
+		std::vector<uint8_t> rgbe(width * 4);
+		for (size_t y = 0; y < height; ++y)
+		{
+			for (size_t x = 0; x < width; ++x)
+				floatToRgbe(at(x, y), &rgbe[x * 4]);
+			writeScanline(file, width, rgbe);
+		}
+	}
+
+	glm::vec3 equirectToDirection(glm::vec2 uv)
+	{
+		const float phi = 2.0f * s_pi * uv.x;
+		const float theta = s_pi * uv.y;
+		const float sinTheta = std::sin(theta);
+		return glm::vec3(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+	}
+
+	glm::vec2 directionToEquirect(const glm::vec3& dir)
+	{
+		float u = std::atan2(dir.z, dir.x) / (2.0f * s_pi);
+		if (u < 0.0f) u += 1.0f;
+		const float v = std::acos(std::min(std::max(dir.y, -1.0f), 1.0f)) / s_pi;
+		return glm::vec2(u, v);
+	}
+
+	float equirectPixelSolidAngle(size_t y, size_t width, size_t height)
+	{
+		const float theta = s_pi * (float(y) + 0.5f) / float(height);
+		return (2.0f * s_pi / float(width)) * (s_pi / float(height)) * std::sin(theta);
+	}
+}
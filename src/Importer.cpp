@@ -0,0 +1,52 @@
+#include "../include/hrsf/Importer.h"
+#include "../include/hrsf/SceneFormat.h"
+#include <cctype>
+
+namespace hrsf
+{
+	namespace
+	{
+		/// keeps all components in memory
+		class SceneCollector : public ImportTarget
+		{
+		public:
+			void setMaterials(std::vector<Material> materials) override { m_materials = std::move(materials); }
+			void addMesh(Mesh mesh) override { m_meshes.push_back(std::move(mesh)); }
+			void setLights(std::vector<Light> lights) override { m_lights = std::move(lights); }
+			void setCamera(Camera camera) override { m_camera = std::move(camera); }
+
+			SceneFormat getScene()
+			{
+				return SceneFormat(std::move(m_meshes), std::move(m_camera), std::move(m_lights), std::move(m_materials), Environment::Default());
+			}
+		private:
+			std::vector<Mesh> m_meshes;
+			std::vector<Material> m_materials;
+			std::vector<Light> m_lights;
+			Camera m_camera = Camera(CameraData::Default());
+		};
+	}
+
+	void importScene(const std::filesystem::path& filename, ImportTarget& target, const ImportSettings& settings)
+	{
+		auto ext = filename.extension().string();
+		for (auto& c : ext) c = char(std::tolower(c));
+
+		if (ext == ".obj") importObj(filename, target, settings);
+		else if (ext == ".gltf" || ext == ".glb") importGltf(filename, target, settings);
+		else if (ext == ".ply")
+		{
+			PlySettings plySettings;
+			plySettings.scale = settings.scale;
+			importPly(filename, target, plySettings);
+		}
+		else throw std::runtime_error("unsupported scene format " + filename.string());
+	}
+
+	SceneFormat importScene(const std::filesystem::path& filename, const ImportSettings& settings)
+	{
+		SceneCollector collector;
+		importScene(filename, collector, settings);
+		return collector.getScene();
+	}
+}
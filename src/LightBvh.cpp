@@ -0,0 +1,408 @@
+#include "../include/hrsf/LightBvh.h"
+#include "../include/hrsf/LightInfluence.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr float s_pi = 3.14159265358979f;
+		constexpr uint32_t s_magic = 0x424C5248; // "HRLB"
+		constexpr uint32_t s_fileVersion = 1;
+		// subtrees with more lights are built asynchronously
+		constexpr size_t s_parallelThreshold = 1024;
+
+		float getSurfaceArea(const glm::vec3& min, const glm::vec3& max)
+		{
+			const auto d = glm::max(max - min, glm::vec3(0.0f));
+			return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+
+		// smallest cone that contains both cones
+		void mergeCones(glm::vec3& axis, float& cosTheta, const glm::vec3& otherAxis, float otherCosTheta)
+		{
+			if (cosTheta <= -1.0f || otherCosTheta <= -1.0f)
+			{
+				cosTheta = -1.0f;
+				return;
+			}
+			const float theta = std::acos(std::min(cosTheta, 1.0f));
+			const float otherTheta = std::acos(std::min(otherCosTheta, 1.0f));
+			const float between = std::acos(std::min(std::max(glm::dot(axis, otherAxis), -1.0f), 1.0f));
+			if (std::min(between + otherTheta, s_pi) <= theta) return; // other cone is inside
+			if (std::min(between + theta, s_pi) <= otherTheta)
+			{
+				axis = otherAxis;
+				cosTheta = otherCosTheta;
+				return;
+			}
+			const float newTheta = (theta + between + otherTheta) * 0.5f;
+			if (newTheta >= s_pi)
+			{
+				cosTheta = -1.0f;
+				return;
+			}
+			// rotate axis towards the other axis
+			const auto ortho = otherAxis - axis * glm::dot(axis, otherAxis);
+			const float len = glm::length(ortho);
+			if (len > 1e-6f)
+			{
+				const float rotation = newTheta - theta;
+				axis = axis * std::cos(rotation) + ortho / len * std::sin(rotation);
+			}
+			cosTheta = std::cos(newTheta);
+		}
+
+		void mergeNode(LightBvhNode& dst, const LightBvhNode& src)
+		{
+			dst.boundsMin = glm::min(dst.boundsMin, src.boundsMin);
+			dst.boundsMax = glm::max(dst.boundsMax, src.boundsMax);
+			dst.power += src.power;
+			mergeCones(dst.coneAxis, dst.cosTheta, src.coneAxis, src.cosTheta);
+		}
+
+		LightBvhNode getEmptyNode()
+		{
+			LightBvhNode n = {};
+			n.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+			n.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+			n.power = 0.0f;
+			n.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+			n.cosTheta = 1.0f;
+			return n;
+		}
+	}
+
+	LightBvh::LightBvh(const std::vector<Light>& lights, const LightBvhSettings& settings)
+		:
+	m_settings(settings)
+	{
+		if (m_settings.maxLeafSize == 0 || m_settings.binCount < 2)
+			throw std::runtime_error("invalid light bvh settings");
+
+		std::vector<BuildLight> buildLights(lights.size());
+		for (uint32_t i = 0; i < uint32_t(lights.size()); ++i)
+		{
+			const auto& l = lights[i];
+			if (l.data.type == LightData::Directional)
+			{
+				m_infinite.push_back(i);
+				continue;
+			}
+			if (l.data.type != LightData::Point)
+				throw std::runtime_error("invalid light type");
+
+			m_indices.push_back(i);
+			auto& b = buildLights[i];
+			b.center = l.getPosition();
+			b.min = b.center - glm::vec3(l.data.radius);
+			b.max = b.center + glm::vec3(l.data.radius);
+			b.power = getLightPower(l.data);
+		}
+
+		if (m_indices.empty()) return;
+
+		m_nodes = buildRecursive(m_indices, buildLights, 0, m_indices.size(), 0);
+
+		// power in leaf order
+		m_powers.resize(m_indices.size());
+		for (size_t i = 0; i < m_indices.size(); ++i)
+			m_powers[i] = buildLights[m_indices[i]].power;
+
+		// convert relative right child offsets to absolute indices
+		for (uint32_t i = 0; i < uint32_t(m_nodes.size()); ++i)
+		{
+			if (!m_nodes[i].isLeaf())
+				m_nodes[i].childOrFirst += i;
+		}
+	}
+
+	std::vector<LightBvhNode> LightBvh::buildRecursive(std::vector<uint32_t>& indices, const std::vector<BuildLight>& lights,
+		size_t begin, size_t end, size_t depth) const
+	{
+		const size_t count = end - begin;
+		if (count <= m_settings.maxLeafSize)
+			return { makeLeaf(indices, lights, begin, end) };
+
+		// centroid bounds
+		glm::vec3 cmin(std::numeric_limits<float>::max());
+		glm::vec3 cmax(-std::numeric_limits<float>::max());
+		for (size_t i = begin; i < end; ++i)
+		{
+			cmin = glm::min(cmin, lights[indices[i]].center);
+			cmax = glm::max(cmax, lights[indices[i]].center);
+		}
+		const auto extent = cmax - cmin;
+		int axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		size_t mid = begin + count / 2;
+		if (extent[axis] > 0.0f)
+		{
+			// binned split search with the power weighted surface area heuristic
+			struct Bin
+			{
+				glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+				glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+				float power = 0.0f;
+				size_t count = 0;
+			};
+			const size_t numBins = m_settings.binCount;
+			std::vector<Bin> bins(numBins);
+			const float scale = float(numBins) / extent[axis];
+			const auto getBin = [&](uint32_t light)
+			{
+				return std::min(size_t((lights[light].center[axis] - cmin[axis]) * scale), numBins - 1);
+			};
+			for (size_t i = begin; i < end; ++i)
+			{
+				const auto& l = lights[indices[i]];
+				auto& b = bins[getBin(indices[i])];
+				b.min = glm::min(b.min, l.min);
+				b.max = glm::max(b.max, l.max);
+				b.power += l.power;
+				++b.count;
+			}
+
+			// cost of the right side for each split
+			std::vector<float> rightCost(numBins, 0.0f);
+			Bin acc;
+			for (size_t i = numBins - 1; i > 0; --i)
+			{
+				acc.min = glm::min(acc.min, bins[i].min);
+				acc.max = glm::max(acc.max, bins[i].max);
+				acc.power += bins[i].power;
+				acc.count += bins[i].count;
+				// small offset => lights without power are still split by area
+				rightCost[i] = (acc.power + 1e-6f) * getSurfaceArea(acc.min, acc.max) * float(acc.count);
+			}
+
+			float bestCost = std::numeric_limits<float>::max();
+			size_t bestSplit = 0;
+			acc = Bin();
+			for (size_t i = 0; i < numBins - 1; ++i)
+			{
+				acc.min = glm::min(acc.min, bins[i].min);
+				acc.max = glm::max(acc.max, bins[i].max);
+				acc.power += bins[i].power;
+				acc.count += bins[i].count;
+				if (acc.count == 0 || acc.count == count) continue;
+				const float cost = (acc.power + 1e-6f) * getSurfaceArea(acc.min, acc.max) * float(acc.count) + rightCost[i + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestSplit = i;
+				}
+			}
+
+			if (bestCost < std::numeric_limits<float>::max())
+			{
+				const auto it = std::partition(indices.begin() + begin, indices.begin() + end, [&](uint32_t light)
+				{
+					return getBin(light) <= bestSplit;
+				});
+				mid = size_t(it - indices.begin());
+			}
+		}
+		else
+		{
+			// all centers are equal
+			mid = begin + count / 2;
+		}
+
+		std::vector<LightBvhNode> left, right;
+		if (count > s_parallelThreshold && (size_t(1) << depth) < getThreadCount())
+		{
+			auto future = std::async(std::launch::async, [&]()
+			{
+				return buildRecursive(indices, lights, begin, mid, depth + 1);
+			});
+			right = buildRecursive(indices, lights, mid, end, depth + 1);
+			left = future.get();
+		}
+		else
+		{
+			left = buildRecursive(indices, lights, begin, mid, depth + 1);
+			right = buildRecursive(indices, lights, mid, end, depth + 1);
+		}
+
+		std::vector<LightBvhNode> res;
+		res.reserve(1 + left.size() + right.size());
+		auto node = left.front();
+		mergeNode(node, right.front());
+		node.count = 0;
+		node.childOrFirst = uint32_t(1 + left.size()); // relative offset, converted after the build
+		res.push_back(node);
+		res.insert(res.end(), left.begin(), left.end());
+		res.insert(res.end(), right.begin(), right.end());
+		return res;
+	}
+
+	LightBvhNode LightBvh::makeLeaf(const std::vector<uint32_t>& indices, const std::vector<BuildLight>& lights, size_t begin, size_t end)
+	{
+		auto node = getEmptyNode();
+		for (size_t i = begin; i < end; ++i)
+		{
+			const auto& l = lights[indices[i]];
+			node.boundsMin = glm::min(node.boundsMin, l.min);
+			node.boundsMax = glm::max(node.boundsMax, l.max);
+			node.power += l.power;
+		}
+		// point lights emit in all directions
+		node.cosTheta = -1.0f;
+		node.childOrFirst = uint32_t(begin);
+		node.count = uint32_t(end - begin);
+		return node;
+	}
+
+	void LightBvh::refit(const std::vector<Light>& lights)
+	{
+		if (lights.size() != m_indices.size() + m_infinite.size())
+			throw std::runtime_error("light bvh refit with a different light count");
+
+		// leaves
+		parallelFor(0, m_nodes.size(), [&](size_t i)
+		{
+			auto& node = m_nodes[i];
+			if (!node.isLeaf()) return;
+			const auto first = node.childOrFirst;
+			const auto count = node.count;
+			node = getEmptyNode();
+			for (size_t j = first; j < first + count; ++j)
+			{
+				const auto& l = lights[m_indices[j]];
+				const auto pos = l.getPosition();
+				node.boundsMin = glm::min(node.boundsMin, pos - glm::vec3(l.data.radius));
+				node.boundsMax = glm::max(node.boundsMax, pos + glm::vec3(l.data.radius));
+				m_powers[j] = getLightPower(l.data);
+				node.power += m_powers[j];
+			}
+			node.cosTheta = -1.0f;
+			node.childOrFirst = first;
+			node.count = count;
+		}, 256);
+
+		// children are always stored after their parent
+		for (size_t i = m_nodes.size(); i-- > 0;)
+		{
+			auto& node = m_nodes[i];
+			if (node.isLeaf()) continue;
+			const auto right = node.childOrFirst;
+			node.boundsMin = m_nodes[i + 1].boundsMin;
+			node.boundsMax = m_nodes[i + 1].boundsMax;
+			node.power = m_nodes[i + 1].power;
+			node.coneAxis = m_nodes[i + 1].coneAxis;
+			node.cosTheta = m_nodes[i + 1].cosTheta;
+			mergeNode(node, m_nodes[right]);
+		}
+	}
+
+	float LightBvh::getImportance(const LightBvhNode& node, const glm::vec3& position)
+	{
+		// power divided by the squared distance, clamped to the size of the bounds to avoid singularities
+		const auto center = (node.boundsMin + node.boundsMax) * 0.5f;
+		const auto diff = position - center;
+		const auto halfDiagonal = (node.boundsMax - node.boundsMin) * 0.5f;
+		const float dist2 = glm::dot(diff, diff);
+		return node.power / std::max(dist2, glm::dot(halfDiagonal, halfDiagonal) + 1e-6f);
+	}
+
+	uint32_t LightBvh::sample(const glm::vec3& position, float u, float& pmf) const
+	{
+		pmf = 0.0f;
+		if (m_nodes.empty()) return 0;
+
+		pmf = 1.0f;
+		uint32_t cur = 0;
+		while (!m_nodes[cur].isLeaf())
+		{
+			const auto left = cur + 1;
+			const auto right = m_nodes[cur].childOrFirst;
+			const float il = getImportance(m_nodes[left], position);
+			const float ir = getImportance(m_nodes[right], position);
+			const float pl = il + ir > 0.0f ? il / (il + ir) : 0.5f;
+			if (u < pl)
+			{
+				u = std::min(u / pl, 0.99999994f);
+				pmf *= pl;
+				cur = left;
+			}
+			else
+			{
+				u = std::min((u - pl) / (1.0f - pl), 0.99999994f);
+				pmf *= 1.0f - pl;
+				cur = right;
+			}
+		}
+
+		// choose inside the leaf proportional to the power
+		const auto& leaf = m_nodes[cur];
+		const auto first = leaf.childOrFirst;
+		const auto last = first + leaf.count;
+		const float total = std::accumulate(m_powers.begin() + first, m_powers.begin() + last, 0.0f);
+		uint32_t chosen = last - 1;
+		float p = 1.0f / float(leaf.count);
+		float acc = 0.0f;
+		for (uint32_t i = first; i < last; ++i)
+		{
+			p = total > 0.0f ? m_powers[i] / total : 1.0f / float(leaf.count);
+			acc += p;
+			if (u < acc)
+			{
+				chosen = i;
+				break;
+			}
+		}
+		pmf *= p;
+		return m_indices[chosen];
+	}
+
+	void LightBvh::save(const std::filesystem::path& filename) const
+	{
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not save " + filename.string());
+
+		const uint32_t header[5] = { s_magic, s_fileVersion, uint32_t(m_nodes.size()), uint32_t(m_indices.size()), uint32_t(m_infinite.size()) };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(m_nodes.data()), std::streamsize(m_nodes.size() * sizeof(LightBvhNode)));
+		file.write(reinterpret_cast<const char*>(m_indices.data()), std::streamsize(m_indices.size() * sizeof(uint32_t)));
+		file.write(reinterpret_cast<const char*>(m_powers.data()), std::streamsize(m_powers.size() * sizeof(float)));
+		file.write(reinterpret_cast<const char*>(m_infinite.data()), std::streamsize(m_infinite.size() * sizeof(uint32_t)));
+		if (!file)
+			throw std::runtime_error("could not write " + filename.string());
+	}
+
+	LightBvh LightBvh::load(const std::filesystem::path& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not open " + filename.string());
+
+		uint32_t header[5];
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		if (!file || header[0] != s_magic || header[1] != s_fileVersion)
+			throw std::runtime_error(filename.string() + " is not a valid light bvh file");
+
+		LightBvh bvh;
+		bvh.m_nodes.resize(header[2]);
+		bvh.m_indices.resize(header[3]);
+		bvh.m_powers.resize(header[3]);
+		bvh.m_infinite.resize(header[4]);
+		file.read(reinterpret_cast<char*>(bvh.m_nodes.data()), std::streamsize(bvh.m_nodes.size() * sizeof(LightBvhNode)));
+		file.read(reinterpret_cast<char*>(bvh.m_indices.data()), std::streamsize(bvh.m_indices.size() * sizeof(uint32_t)));
+		file.read(reinterpret_cast<char*>(bvh.m_powers.data()), std::streamsize(bvh.m_powers.size() * sizeof(float)));
+		file.read(reinterpret_cast<char*>(bvh.m_infinite.data()), std::streamsize(bvh.m_infinite.size() * sizeof(uint32_t)));
+		if (!file)
+			throw std::runtime_error("unexpected end of " + filename.string());
+		return bvh;
+	}
+}
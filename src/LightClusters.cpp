@@ -0,0 +1,210 @@
+#include "../include/hrsf/LightClusters.h"
+#include "../include/hrsf/LightInfluence.h"
+#include "../include/hrsf/Parallel.h"
+#include "../include/hrsf/Simd.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace hrsf
+{
+	void LightClusterGrid::SphereList::clear()
+	{
+		x.clear();
+		y.clear();
+		z.clear();
+		radius.clear();
+		index.clear();
+	}
+
+	void LightClusterGrid::SphereList::push(float px, float py, float pz, float r, uint32_t idx)
+	{
+		x.push_back(px);
+		y.push_back(py);
+		z.push_back(pz);
+		radius.push_back(r);
+		index.push_back(idx);
+	}
+
+	void LightClusterGrid::SphereList::pad()
+	{
+		// padding spheres are far away with a negative radius => never intersect
+		while (x.size() % 4 != 0)
+			push(0.0f, 0.0f, -1e30f, -1.0f, 0);
+	}
+
+	void LightClusterGrid::build(const CameraData& camera, const std::vector<Light>& lights, const LightClusterSettings& settings)
+	{
+		if (settings.tilesX == 0 || settings.tilesY == 0 || settings.slices == 0 || settings.width == 0 || settings.height == 0)
+			throw std::runtime_error("invalid light cluster settings");
+		if (camera.near <= 0.0f || camera.far <= camera.near)
+			throw std::runtime_error("invalid camera near and far planes");
+
+		m_settings = settings;
+		m_near = camera.near;
+		m_far = camera.far;
+		m_logFarNear = std::log(m_far / m_near);
+		m_tanY = std::tan(camera.fov * 0.5f);
+		m_tanX = m_tanY * float(settings.width) / float(settings.height);
+
+		// view space basis (x right, y up, z forward)
+		const auto forward = glm::normalize(camera.direction);
+		auto right = glm::cross(forward, camera.up);
+		if (glm::length(right) < 1e-6f) // up and direction are parallel
+			right = glm::cross(forward, std::abs(forward.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f));
+		right = glm::normalize(right);
+		const auto up = glm::cross(right, forward);
+
+		// transform and frustum cull
+		const float sideScaleX = std::sqrt(1.0f + m_tanX * m_tanX);
+		const float sideScaleY = std::sqrt(1.0f + m_tanY * m_tanY);
+		m_spheres.clear();
+		for (uint32_t i = 0; i < uint32_t(lights.size()); ++i)
+		{
+			const auto& l = lights[i];
+			if (l.data.type != LightData::Point) continue;
+			const auto p = l.getPosition() - camera.position;
+			const float vx = glm::dot(p, right);
+			const float vy = glm::dot(p, up);
+			const float vz = glm::dot(p, forward);
+			const float r = getLightRange(l.data, settings.cutoff);
+
+			if (vz + r < m_near || vz - r > m_far) continue;
+			if (std::abs(vx) - m_tanX * vz > r * sideScaleX) continue;
+			if (std::abs(vy) - m_tanY * vz > r * sideScaleY) continue;
+			m_spheres.push(vx, vy, vz, r, i);
+		}
+
+		// keep the per slice buffers between frames
+		m_sliceSpheres.resize(settings.slices);
+		m_sliceIndices.resize(settings.slices);
+		m_sliceCounts.resize(settings.slices);
+
+		parallelFor(0, settings.slices, [this](size_t slice)
+		{
+			buildSlice(uint32_t(slice));
+		});
+
+		// compact
+		const size_t tilesPerSlice = size_t(settings.tilesX) * settings.tilesY;
+		m_offsets.resize(tilesPerSlice * settings.slices + 1);
+		size_t total = 0;
+		for (const auto& s : m_sliceIndices)
+			total += s.size();
+		m_indices.resize(total);
+
+		uint32_t offset = 0;
+		for (uint32_t slice = 0; slice < settings.slices; ++slice)
+		{
+			const auto& counts = m_sliceCounts[slice];
+			for (size_t t = 0; t < tilesPerSlice; ++t)
+			{
+				m_offsets[slice * tilesPerSlice + t] = offset;
+				offset += counts[t];
+			}
+			const auto& indices = m_sliceIndices[slice];
+			std::copy(indices.begin(), indices.end(), m_indices.begin() + (offset - indices.size()));
+		}
+		m_offsets.back() = offset;
+	}
+
+	void LightClusterGrid::buildSlice(uint32_t slice)
+	{
+		const float zNear = getSliceDepth(slice);
+		const float zFar = getSliceDepth(slice + 1);
+
+		// lights that overlap the depth range of the slice
+		auto& candidates = m_sliceSpheres[slice];
+		candidates.clear();
+		for (size_t i = 0; i < m_spheres.x.size(); ++i)
+		{
+			if (m_spheres.z[i] + m_spheres.radius[i] < zNear || m_spheres.z[i] - m_spheres.radius[i] > zFar) continue;
+			candidates.push(m_spheres.x[i], m_spheres.y[i], m_spheres.z[i], m_spheres.radius[i], m_spheres.index[i]);
+		}
+		candidates.pad();
+
+		auto& indices = m_sliceIndices[slice];
+		auto& counts = m_sliceCounts[slice];
+		indices.clear();
+		counts.assign(size_t(m_settings.tilesX) * m_settings.tilesY, 0);
+
+		for (uint32_t ty = 0; ty < m_settings.tilesY; ++ty)
+		{
+			// ndc y range of the tile (tile 0 is at the top)
+			const float ndcY1 = 1.0f - 2.0f * float(ty) / float(m_settings.tilesY);
+			const float ndcY0 = 1.0f - 2.0f * float(ty + 1) / float(m_settings.tilesY);
+			const float minY = std::min(ndcY0 * m_tanY * zNear, ndcY0 * m_tanY * zFar);
+			const float maxY = std::max(ndcY1 * m_tanY * zNear, ndcY1 * m_tanY * zFar);
+
+			for (uint32_t tx = 0; tx < m_settings.tilesX; ++tx)
+			{
+				const float ndcX0 = -1.0f + 2.0f * float(tx) / float(m_settings.tilesX);
+				const float ndcX1 = -1.0f + 2.0f * float(tx + 1) / float(m_settings.tilesX);
+				const float minX = std::min(ndcX0 * m_tanX * zNear, ndcX0 * m_tanX * zFar);
+				const float maxX = std::max(ndcX1 * m_tanX * zNear, ndcX1 * m_tanX * zFar);
+
+				// sphere vs. axis aligned bounding box of the froxel
+				const size_t before = indices.size();
+				size_t i = 0;
+#ifdef HRSF_SSE2
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 bminX = _mm_set1_ps(minX), bmaxX = _mm_set1_ps(maxX);
+				const __m128 bminY = _mm_set1_ps(minY), bmaxY = _mm_set1_ps(maxY);
+				const __m128 bminZ = _mm_set1_ps(zNear), bmaxZ = _mm_set1_ps(zFar);
+				for (; i < candidates.x.size(); i += 4)
+				{
+					const __m128 x = _mm_loadu_ps(&candidates.x[i]);
+					const __m128 y = _mm_loadu_ps(&candidates.y[i]);
+					const __m128 z = _mm_loadu_ps(&candidates.z[i]);
+					const __m128 r = _mm_loadu_ps(&candidates.radius[i]);
+					// distance from the sphere center to the box per axis
+					const __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(bminX, x), zero), _mm_max_ps(_mm_sub_ps(x, bmaxX), zero));
+					const __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(bminY, y), zero), _mm_max_ps(_mm_sub_ps(y, bmaxY), zero));
+					const __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(bminZ, z), zero), _mm_max_ps(_mm_sub_ps(z, bmaxZ), zero));
+					const __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					const __m128 inside = _mm_and_ps(_mm_cmple_ps(dist2, _mm_mul_ps(r, r)), _mm_cmpge_ps(r, zero));
+					int mask = _mm_movemask_ps(inside);
+					while (mask)
+					{
+						const int bit = mask & -mask;
+						const size_t lane = bit == 1 ? 0 : bit == 2 ? 1 : bit == 4 ? 2 : 3;
+						indices.push_back(candidates.index[i + lane]);
+						mask &= mask - 1;
+					}
+				}
+#endif
+				for (; i < candidates.x.size(); ++i)
+				{
+					const float r = candidates.radius[i];
+					if (r < 0.0f) continue;
+					const float dx = std::max(minX - candidates.x[i], 0.0f) + std::max(candidates.x[i] - maxX, 0.0f);
+					const float dy = std::max(minY - candidates.y[i], 0.0f) + std::max(candidates.y[i] - maxY, 0.0f);
+					const float dz = std::max(zNear - candidates.z[i], 0.0f) + std::max(candidates.z[i] - zFar, 0.0f);
+					if (dx * dx + dy * dy + dz * dz <= r * r)
+						indices.push_back(candidates.index[i]);
+				}
+
+				counts[size_t(ty) * m_settings.tilesX + tx] = uint32_t(indices.size() - before);
+			}
+		}
+	}
+
+	uint32_t LightClusterGrid::getClusterIndex(uint32_t tileX, uint32_t tileY, uint32_t slice) const
+	{
+		return (slice * m_settings.tilesY + tileY) * m_settings.tilesX + tileX;
+	}
+
+	uint32_t LightClusterGrid::getSlice(float depth) const
+	{
+		if (depth <= m_near) return 0;
+		const auto slice = uint32_t(std::log(depth / m_near) / m_logFarNear * float(m_settings.slices));
+		return std::min(slice, m_settings.slices - 1);
+	}
+
+	float LightClusterGrid::getSliceDepth(uint32_t slice) const
+	{
+		if (slice >= m_settings.slices) return m_far;
+		return m_near * std::exp(m_logFarNear * float(slice) / float(m_settings.slices));
+	}
+}
@@ -0,0 +1,177 @@
+#include "../include/hrsf/LightInfluence.h"
+#include "../include/hrsf/Simd.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr float s_pi = 3.14159265358979f;
+		// distance of the irradiance that ranks point lights against directional lights in getImportance()
+		constexpr float s_referenceDistance = 1.0f;
+
+		float getLuminance(const glm::vec3& color)
+		{
+			return 0.2126f * color.x + 0.7152f * color.y + 0.0722f * color.z;
+		}
+	}
+
+	float getLightPower(const LightData& light)
+	{
+		const float luminance = getLuminance(light.color);
+		if (light.type == LightData::Point)
+			return 4.0f * s_pi * luminance; // intensity over the full sphere
+		return luminance;
+	}
+
+	float getLightRange(const LightData& light, float cutoff)
+	{
+		if (light.type != LightData::Point)
+			return std::numeric_limits<float>::infinity();
+		const float intensity = std::max(light.color.x, std::max(light.color.y, light.color.z));
+		return light.radius + std::sqrt(std::max(intensity, 0.0f) / cutoff);
+	}
+
+	LightInfluence::LightInfluence(float cutoff)
+		:
+		m_cutoff(cutoff)
+	{
+		if (cutoff <= 0.0f)
+			throw std::runtime_error("light cutoff must be greater than zero");
+	}
+
+	void LightInfluence::update(const std::vector<Light>& lights)
+	{
+		if (m_dirty || lights.size() != m_ranges.size())
+		{
+			rebuild(lights);
+			return;
+		}
+
+		for (auto i : m_animated)
+		{
+			const auto p = lights[i].getPosition();
+			m_x[i] = p.x;
+			m_y[i] = p.y;
+			m_z[i] = p.z;
+		}
+	}
+
+	void LightInfluence::invalidate()
+	{
+		m_dirty = true;
+	}
+
+	void LightInfluence::setCutoff(float cutoff)
+	{
+		if (cutoff <= 0.0f)
+			throw std::runtime_error("light cutoff must be greater than zero");
+		if (cutoff != m_cutoff) m_dirty = true;
+		m_cutoff = cutoff;
+	}
+
+	void LightInfluence::rebuild(const std::vector<Light>& lights)
+	{
+		const size_t n = lights.size();
+		m_x.resize(n);
+		m_y.resize(n);
+		m_z.resize(n);
+		m_ranges.resize(n);
+		m_powers.resize(n);
+		m_luminances.resize(n);
+		m_importance.resize(n);
+		m_animated.clear();
+
+		// importance: irradiance at the reference distance => point and directional lights share one unit
+		double totalIrradiance = 0.0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			const auto& l = lights[i];
+			const auto p = l.data.type == LightData::Point ? l.getPosition() : glm::vec3(0.0f);
+			m_x[i] = p.x;
+			m_y[i] = p.y;
+			m_z[i] = p.z;
+			m_ranges[i] = getLightRange(l.data, m_cutoff);
+			m_powers[i] = getLightPower(l.data);
+			m_luminances[i] = getLuminance(l.data.color);
+			m_importance[i] = l.data.type == LightData::Point ? m_luminances[i] / (s_referenceDistance * s_referenceDistance) : m_luminances[i];
+			totalIrradiance += m_importance[i];
+			if (l.data.type == LightData::Point && !l.path.isStatic())
+				m_animated.push_back(uint32_t(i));
+		}
+
+		const float invTotal = totalIrradiance > 0.0 ? float(1.0 / totalIrradiance) : 0.0f;
+		for (size_t i = 0; i < n; ++i)
+			m_importance[i] *= invTotal;
+
+		m_dirty = false;
+	}
+
+	void LightInfluence::cull(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const
+	{
+		const size_t n = m_ranges.size();
+		size_t i = 0;
+#ifdef HRSF_SSE2
+		const __m128 cx = _mm_set1_ps(center.x);
+		const __m128 cy = _mm_set1_ps(center.y);
+		const __m128 cz = _mm_set1_ps(center.z);
+		const __m128 r = _mm_set1_ps(radius);
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&m_x[i]), cx);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&m_y[i]), cy);
+			const __m128 dz = _mm_sub_ps(_mm_loadu_ps(&m_z[i]), cz);
+			const __m128 dist2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			const __m128 sum = _mm_add_ps(_mm_loadu_ps(&m_ranges[i]), r);
+			// infinite ranges compare true
+			int mask = _mm_movemask_ps(_mm_cmple_ps(dist2, _mm_mul_ps(sum, sum)));
+			for (uint32_t lane = 0; mask; ++lane, mask >>= 1)
+				if (mask & 1) out.push_back(uint32_t(i) + lane);
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			const float dx = m_x[i] - center.x;
+			const float dy = m_y[i] - center.y;
+			const float dz = m_z[i] - center.z;
+			const float sum = m_ranges[i] + radius;
+			if (dx * dx + dy * dy + dz * dz <= sum * sum)
+				out.push_back(uint32_t(i));
+		}
+	}
+
+	void LightInfluence::getMostImportant(const glm::vec3& position, size_t maxCount, std::vector<uint32_t>& out) const
+	{
+		// per thread scratch buffer (the function is const and may be called concurrently)
+		thread_local std::vector<std::pair<float, uint32_t>> candidates;
+		candidates.clear();
+		for (size_t i = 0; i < m_ranges.size(); ++i)
+		{
+			// irradiance at the position
+			if (std::isinf(m_ranges[i]))
+			{
+				candidates.emplace_back(m_luminances[i], uint32_t(i));
+				continue;
+			}
+			const float dx = m_x[i] - position.x;
+			const float dy = m_y[i] - position.y;
+			const float dz = m_z[i] - position.z;
+			const float dist2 = dx * dx + dy * dy + dz * dz;
+			if (dist2 > m_ranges[i] * m_ranges[i]) continue;
+			candidates.emplace_back(m_luminances[i] / std::max(dist2, 1e-4f), uint32_t(i));
+		}
+
+		const auto count = std::min(maxCount, candidates.size());
+		const auto greater = [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b)
+		{
+			return a.first > b.first || (a.first == b.first && a.second < b.second);
+		};
+		std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), greater);
+		for (size_t i = 0; i < count; ++i)
+			out.push_back(candidates[i].second);
+	}
+}
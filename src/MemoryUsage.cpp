@@ -0,0 +1,196 @@
+#include "../include/hrsf/MemoryUsage.h"
+#include "../include/hrsf/SceneFormat.h"
+
+namespace hrsf
+{
+	namespace
+	{
+		// accumulates allocated bytes and unused capacity
+		struct HeapCounter
+		{
+			size_t bytes = 0;
+			size_t slack = 0;
+
+			template<class T>
+			void add(const std::vector<T>& v)
+			{
+				bytes += v.capacity() * sizeof(T);
+				slack += (v.capacity() - v.size()) * sizeof(T);
+			}
+
+			template<class C>
+			void add(const std::basic_string<C>& s)
+			{
+				// short strings are stored inside the object
+				static const size_t s_inlineCapacity = std::basic_string<C>().capacity();
+				if (s.capacity() <= s_inlineCapacity) return;
+				bytes += (s.capacity() + 1) * sizeof(C);
+				slack += (s.capacity() - s.size()) * sizeof(C);
+			}
+
+			void add(const fs::path& p)
+			{
+				add(p.native());
+			}
+
+			void add(const Path& p)
+			{
+				add(p.getSections());
+			}
+
+			void add(const Camera& c)
+			{
+				add(c.positionPath);
+				add(c.lookAtPath);
+			}
+		};
+
+		template<class IndexT>
+		void addMesh(const bmf::BinaryMeshT<IndexT>& mesh, MeshMemoryUsage& res)
+		{
+			HeapCounter vertices, indices, shapes;
+			vertices.add(mesh.getVertices());
+			indices.add(mesh.getIndices());
+			shapes.add(mesh.getShapes());
+			res.vertices = vertices.bytes;
+			res.indices = indices.bytes;
+			res.shapes = shapes.bytes;
+			res.slack += vertices.slack + indices.slack + shapes.slack;
+		}
+	}
+
+	MeshMemoryUsage getMeshMemoryUsage(const Mesh& mesh)
+	{
+		MeshMemoryUsage res;
+		if (mesh.type == Mesh::Triangle) addMesh(mesh.triangle, res);
+		else addMesh(mesh.billboard, res);
+
+		HeapCounter paths;
+		paths.add(mesh.position);
+		paths.add(mesh.lookAt);
+		res.paths = paths.bytes;
+		res.slack += paths.slack;
+		return res;
+	}
+
+	MeshMemoryUsage MemoryUsage::getMeshTotal() const
+	{
+		MeshMemoryUsage res;
+		for (const auto& m : meshes)
+		{
+			res.vertices += m.vertices;
+			res.indices += m.indices;
+			res.shapes += m.shapes;
+			res.paths += m.paths;
+			res.slack += m.slack;
+		}
+		return res;
+	}
+
+	size_t MemoryUsage::total() const
+	{
+		return getMeshTotal().total() + meshArray + materials + lights + camera + benchmarks + environment + other;
+	}
+
+	std::string MemoryUsage::toString() const
+	{
+		const auto line = [](const std::string& name, size_t bytes)
+		{
+			return name + ": " + std::to_string(bytes) + " bytes\n";
+		};
+
+		std::string res;
+		const auto meshTotal = getMeshTotal();
+		res += line("total", total());
+		res += line("slack", meshTotal.slack + slack);
+		res += line("meshes", meshTotal.total() + meshArray);
+		res += line("  vertices", meshTotal.vertices);
+		res += line("  indices", meshTotal.indices);
+		res += line("  shapes", meshTotal.shapes);
+		res += line("  paths", meshTotal.paths);
+		res += line("materials", materials);
+		res += line("lights", lights);
+		res += line("camera", camera);
+		res += line("benchmarks", benchmarks);
+		res += line("environment", environment);
+		res += line("other", other);
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			const auto& m = meshes[i];
+			res += "mesh " + std::to_string(i) + ": " + std::to_string(m.total()) + " bytes (vertices " + std::to_string(m.vertices)
+				+ ", indices " + std::to_string(m.indices) + ", shapes " + std::to_string(m.shapes)
+				+ ", paths " + std::to_string(m.paths) + ", slack " + std::to_string(m.slack) + ")\n";
+		}
+		return res;
+	}
+
+	MemoryUsage SceneFormat::memoryUsage() const
+	{
+		MemoryUsage res;
+
+		HeapCounter meshArray;
+		meshArray.add(m_meshes);
+		res.meshArray = meshArray.bytes;
+		res.meshes.resize(m_meshes.size());
+		for (size_t i = 0; i < m_meshes.size(); ++i)
+			res.meshes[i] = getMeshMemoryUsage(m_meshes[i]);
+
+		HeapCounter materials;
+		materials.add(m_materials);
+		for (const auto& m : m_materials)
+		{
+			materials.add(m.name);
+			materials.add(m.textures.albedo);
+			materials.add(m.textures.specular);
+			materials.add(m.textures.coverage);
+		}
+
+		HeapCounter lights;
+		lights.add(m_lights);
+		for (const auto& l : m_lights)
+			lights.add(l.path);
+
+		HeapCounter camera;
+		camera.add(m_camera);
+
+		HeapCounter benchmarks;
+		benchmarks.add(m_benchmarkCameras);
+		for (const auto& b : m_benchmarkCameras)
+		{
+			benchmarks.add(b.name);
+			benchmarks.add(b.camera);
+		}
+
+		HeapCounter environment;
+		environment.add(m_environment.map);
+		environment.add(m_environment.ambient);
+		environment.add(m_environment.specularMips);
+		for (const auto& p : m_environment.specularMips)
+			environment.add(p);
+		environment.add(m_environment.cubeMap);
+		for (const auto& p : m_environment.cubeMap)
+			environment.add(p);
+
+		HeapCounter other;
+		other.add(m_references);
+		other.add(m_instances);
+		other.add(m_prefabs);
+		// prefab scenes are shared => they are counted by every scene that holds them
+		for (const auto& p : m_prefabs)
+		{
+			other.add(p.file);
+			other.bytes += sizeof(SceneFormat) + p.scene->memoryUsage().total();
+		}
+		for (const auto& r : m_references)
+			other.add(r.file);
+
+		res.materials = materials.bytes;
+		res.lights = lights.bytes;
+		res.camera = camera.bytes;
+		res.benchmarks = benchmarks.bytes;
+		res.environment = environment.bytes;
+		res.other = other.bytes;
+		res.slack = meshArray.slack + materials.slack + lights.slack + camera.slack + benchmarks.slack + environment.slack + other.slack;
+		return res;
+	}
+}
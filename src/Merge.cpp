@@ -0,0 +1,251 @@
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Cache.h"
+#include "../include/hrsf/Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+namespace hrsf
+{
+	namespace
+	{
+		// billboard vertices per remap task
+		constexpr size_t s_chunkSize = size_t(1) << 20;
+
+		struct RemapTask
+		{
+			Mesh* mesh;
+			const std::vector<uint32_t>* lookup; // lookup[a] = b: material id a of the source scene becomes b
+			size_t begin; // billboard vertex range, begin == end => shape material ids
+			size_t end;
+		};
+
+		void normalizeTextures(MaterialTextures& textures)
+		{
+			for (auto* p : { &textures.albedo, &textures.specular, &textures.coverage })
+				if (!p->empty()) *p = p->lexically_normal();
+		}
+
+		/// the name is ignored, materials are equal if they look the same
+		bool isEqual(const Material& a, const Material& b)
+		{
+			const auto& x = a.data;
+			const auto& y = b.data;
+			return x.albedo == y.albedo && x.coverage == y.coverage && x.emission == y.emission &&
+				x.metalness == y.metalness && x.roughness == y.roughness && x.flags == y.flags &&
+				x.translucency == y.translucency && x.specular == y.specular && x.ior == y.ior &&
+				a.textures.albedo == b.textures.albedo && a.textures.specular == b.textures.specular &&
+				a.textures.coverage == b.textures.coverage;
+		}
+
+		uint64_t getMaterialKey(const Material& m)
+		{
+			const auto& d = m.data;
+			// padding is not initialized => hash the members
+			const float values[] = {
+				d.albedo.x, d.albedo.y, d.albedo.z, d.coverage,
+				d.emission.x, d.emission.y, d.emission.z, d.metalness,
+				d.roughness, d.translucency, d.specular, d.ior
+			};
+			auto key = combineKeys(hashData(values, sizeof(values)), uint64_t(uint32_t(d.flags)));
+			for (const auto* p : { &m.textures.albedo, &m.textures.specular, &m.textures.coverage })
+				key = combineKeys(key, hashData(p->native().data(), p->native().size() * sizeof(fs::path::value_type)));
+			return key;
+		}
+
+		/// assigns the merged material ids
+		class MaterialTable
+		{
+		public:
+			MaterialTable(std::vector<Material>& materials, bool deduplicate)
+				:
+			m_materials(materials),
+			m_deduplicate(deduplicate)
+			{}
+
+			/// \brief returns the merged id of the material (the id of an equal material if deduplication is enabled)
+			uint32_t add(Material m)
+			{
+				if (m_deduplicate)
+				{
+					normalizeTextures(m.textures);
+					auto& ids = m_ids[getMaterialKey(m)];
+					for (const auto id : ids)
+						if (isEqual(m_materials[id], m)) return id;
+					ids.push_back(uint32_t(m_materials.size()));
+				}
+				m_materials.push_back(std::move(m));
+				return uint32_t(m_materials.size() - 1);
+			}
+		private:
+			std::vector<Material>& m_materials;
+			bool m_deduplicate;
+			std::unordered_map<uint64_t, std::vector<uint32_t>> m_ids;
+		};
+
+		bool isIdentity(const std::vector<uint32_t>& lookup)
+		{
+			for (uint32_t i = 0; i < uint32_t(lookup.size()); ++i)
+				if (lookup[i] != i) return false;
+			return true;
+		}
+
+		void throwOutOfRange(uint32_t materialId)
+		{
+			throw std::runtime_error("material id " + std::to_string(materialId) + " is out of range while merging");
+		}
+
+		/// \brief throws if a shape or billboard vertex references a material that does not exist.
+		/// Called before anything is moved => the scenes are unchanged if merging fails
+		void checkMaterialIds(const SceneFormat& scene)
+		{
+			const auto materialCount = scene.getMaterials().size();
+			for (const auto& mesh : scene.getMeshes())
+			{
+				const auto& shapes = mesh.type == Mesh::Triangle ? mesh.triangle.getShapes() : mesh.billboard.getShapes();
+				for (const auto& s : shapes)
+					if (s.materialId >= materialCount) throwOutOfRange(s.materialId);
+				if (mesh.type != Mesh::Billboard || !(mesh.billboard.getAttributes() & bmf::Material)) continue;
+
+				const auto attributes = mesh.billboard.getAttributes();
+				const auto stride = bmf::getAttributeElementStride(attributes);
+				const float* material = mesh.billboard.getVertices().data() + bmf::getAttributeElementOffset(attributes, bmf::Material);
+				const auto vertexCount = mesh.billboard.getNumVertices();
+				std::atomic<uint32_t> invalid(0);
+				std::atomic<bool> hasInvalid(false);
+				parallelFor(0, (vertexCount + s_chunkSize - 1) / s_chunkSize, [&](size_t chunk)
+				{
+					const auto end = std::min((chunk + 1) * s_chunkSize, vertexCount);
+					for (size_t v = chunk * s_chunkSize; v < end; ++v)
+					{
+						const auto id = bmf::asInt(material[v * stride]);
+						if (id < materialCount) continue;
+						invalid = id;
+						hasInvalid = true;
+						return;
+					}
+				});
+				if (hasInvalid) throwOutOfRange(invalid);
+			}
+		}
+
+		// the material ids were validated by checkMaterialIds()
+		uint32_t remap(const std::vector<uint32_t>& lookup, uint32_t materialId)
+		{
+			return lookup[materialId];
+		}
+
+		void runTask(const RemapTask& task)
+		{
+			const auto& lookup = *task.lookup;
+			auto& mesh = *task.mesh;
+			if (task.begin == task.end)
+			{
+				auto& shapes = mesh.type == Mesh::Triangle ? mesh.triangle.getShapes() : mesh.billboard.getShapes();
+				for (auto& s : shapes)
+					s.materialId = remap(lookup, s.materialId);
+				return;
+			}
+
+			const auto attributes = mesh.billboard.getAttributes();
+			const auto stride = bmf::getAttributeElementStride(attributes);
+			float* material = mesh.billboard.getVertices().data() + bmf::getAttributeElementOffset(attributes, bmf::Material);
+			for (size_t v = task.begin; v < task.end; ++v)
+				material[v * stride] = bmf::asFloat(remap(lookup, bmf::asInt(material[v * stride])));
+		}
+	}
+
+	void SceneFormat::merge(SceneFormat&& other, const MergeSettings& settings)
+	{
+		mergeScenes({ &other }, settings);
+	}
+
+	SceneFormat SceneFormat::mergeAll(std::vector<SceneFormat> scenes, const MergeSettings& settings)
+	{
+		if (scenes.empty()) return SceneFormat();
+		auto res = std::move(scenes.front());
+		std::vector<SceneFormat*> others;
+		others.reserve(scenes.size() - 1);
+		for (size_t i = 1; i < scenes.size(); ++i)
+			others.push_back(&scenes[i]);
+		res.mergeScenes(others, settings);
+		return res;
+	}
+
+	void SceneFormat::mergeScenes(const std::vector<SceneFormat*>& others, const MergeSettings& settings)
+	{
+		for (const auto* o : others)
+			if (o == this)
+				throw std::runtime_error("a scene cannot be merged with itself");
+
+		// prefab materials are not contiguous after deduplication => flat scenes only
+		expandReferences();
+		for (auto* o : others)
+			o->expandReferences();
+		checkMaterialIds(*this);
+		for (const auto* o : others)
+			checkMaterialIds(*o);
+
+		// reserve everything once
+		size_t meshCount = m_meshes.size();
+		size_t lightCount = m_lights.size();
+		size_t materialCount = m_materials.size();
+		size_t benchmarkCount = m_benchmarkCameras.size();
+		for (const auto* o : others)
+		{
+			meshCount += o->m_meshes.size();
+			lightCount += o->m_lights.size();
+			materialCount += o->m_materials.size();
+			benchmarkCount += o->m_benchmarkCameras.size();
+		}
+		m_meshes.reserve(meshCount);
+		m_lights.reserve(lightCount);
+		m_benchmarkCameras.reserve(benchmarkCount);
+
+		// lookups[0] for this scene, lookups[i + 1] for others[i]
+		std::vector<std::vector<uint32_t>> lookups(others.size() + 1);
+		std::vector<Material> materials;
+		materials.reserve(materialCount);
+		MaterialTable table(materials, settings.deduplicateMaterials);
+		for (auto& m : m_materials)
+			lookups[0].push_back(table.add(std::move(m)));
+		for (size_t i = 0; i < others.size(); ++i)
+			for (auto& m : others[i]->m_materials)
+				lookups[i + 1].push_back(table.add(std::move(m)));
+		m_materials = std::move(materials);
+
+		// the remap tasks point into m_meshes => no reallocation after this point
+		std::vector<RemapTask> tasks;
+		const auto addTasks = [&](size_t firstMesh, const std::vector<uint32_t>& lookup)
+		{
+			if (isIdentity(lookup)) return; // material ids did not change
+			for (size_t i = firstMesh; i < m_meshes.size(); ++i)
+			{
+				auto& m = m_meshes[i];
+				tasks.push_back({ &m, &lookup, 0, 0 });
+				if (m.type != Mesh::Billboard || !(m.billboard.getAttributes() & bmf::Material)) continue;
+				const auto vertexCount = m.billboard.getNumVertices();
+				for (size_t begin = 0; begin < vertexCount; begin += s_chunkSize)
+					tasks.push_back({ &m, &lookup, begin, std::min(begin + s_chunkSize, vertexCount) });
+			}
+		};
+
+		addTasks(0, lookups[0]);
+		for (size_t i = 0; i < others.size(); ++i)
+		{
+			auto& o = *others[i];
+			const auto firstMesh = m_meshes.size();
+			m_meshes.insert(m_meshes.end(), std::make_move_iterator(o.m_meshes.begin()), std::make_move_iterator(o.m_meshes.end()));
+			m_lights.insert(m_lights.end(), std::make_move_iterator(o.m_lights.begin()), std::make_move_iterator(o.m_lights.end()));
+			m_benchmarkCameras.insert(m_benchmarkCameras.end(),
+				std::make_move_iterator(o.m_benchmarkCameras.begin()), std::make_move_iterator(o.m_benchmarkCameras.end()));
+			addTasks(firstMesh, lookups[i + 1]);
+			o = SceneFormat();
+		}
+
+		parallelFor(0, tasks.size(), [&tasks](size_t i)
+		{
+			runTask(tasks[i]);
+		});
+	}
+}
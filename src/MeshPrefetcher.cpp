@@ -0,0 +1,221 @@
+#include "../include/hrsf/MeshPrefetcher.h"
+#include "../include/hrsf/SceneFormat.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace hrsf
+{
+	MeshPrefetcher::MeshPrefetcher(std::vector<MeshInfo> meshes, const PrefetchSettings& settings)
+		:
+		m_infos(std::move(meshes)),
+		m_settings(settings),
+		m_slots(m_infos.size())
+	{
+		if (settings.timeStep <= 0.0f || settings.horizon < 0.0f)
+			throw std::runtime_error("invalid prefetch settings");
+
+		for (uint32_t i = 0; i < std::max(settings.threadCount, 1u); ++i)
+			m_threads.emplace_back(&MeshPrefetcher::worker, this);
+	}
+
+	MeshPrefetcher::~MeshPrefetcher()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_queue.clear();
+		}
+		m_workAvailable.notify_all();
+		for (auto& t : m_threads)
+			t.join();
+	}
+
+	void MeshPrefetcher::update(const Camera& camera, float dt)
+	{
+		if (dt != 0.0f)
+		{
+			for (auto& info : m_infos)
+			{
+				info.position.update(dt);
+				info.lookAt.update(dt);
+			}
+		}
+
+		// camera states ahead
+		const auto frameCount = size_t(std::ceil(m_settings.horizon / m_settings.timeStep)) + 1;
+		m_frames.resize(frameCount);
+		camera.getPathMatrices(m_settings.aspect, m_settings.timeStep, frameCount, m_frames.data());
+
+		// moving meshes are stepped along with the camera
+		std::vector<std::pair<Path, Path>> moving; // position and look at
+		std::vector<uint32_t> movingIndices;
+		for (uint32_t i = 0; i < uint32_t(m_infos.size()); ++i)
+		{
+			if (m_infos[i].isStatic()) continue;
+			moving.emplace_back(m_infos[i].position, m_infos[i].lookAt);
+			movingIndices.push_back(i);
+		}
+
+		// priority: time until the mesh becomes relevant, the distance breaks ties
+		const float infinity = std::numeric_limits<float>::infinity();
+		m_priority.assign(m_infos.size(), infinity);
+		std::vector<BoundingBox> bounds(m_infos.size());
+		for (size_t i = 0; i < m_infos.size(); ++i)
+			bounds[i] = m_infos[i].isStatic() ? m_infos[i].bounds : BoundingBox::Empty();
+
+		for (size_t f = 0; f < frameCount; ++f)
+		{
+			if (f != 0)
+			{
+				for (auto& m : moving)
+				{
+					m.first.update(m_settings.timeStep);
+					m.second.update(m_settings.timeStep);
+				}
+			}
+			for (size_t k = 0; k < moving.size(); ++k)
+				bounds[movingIndices[k]] = getWorldBounds(moving[k].first, moving[k].second, m_infos[movingIndices[k]].bounds);
+
+			const auto& frame = m_frames[f];
+			for (size_t i = 0; i < m_infos.size(); ++i)
+			{
+				if (m_priority[i] != infinity) continue;
+				const auto& b = bounds[i];
+				if (m_infos[i].bounds.isEmpty())
+				{
+					// unknown bounds
+					m_priority[i] = 0.0f;
+					continue;
+				}
+				const bool visible = frame.frustum.isBoxVisible(b.min, b.max);
+				const bool close = m_settings.distance > 0.0f && b.intersectsSphere(frame.position, m_settings.distance);
+				if (!visible && !close) continue;
+
+				const auto closest = glm::clamp(frame.position, b.min, b.max);
+				const float distance = glm::length(closest - frame.position);
+				// normalized distance < 1 => frames stay ordered
+				m_priority[i] = float(f) + distance / (distance + 1.0f);
+			}
+		}
+
+		m_lastRequests.clear();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			// drop old requests that did not start yet
+			for (auto i : m_queue)
+				m_slots[i].state = State::Unloaded;
+			m_queue.clear();
+
+			for (uint32_t i = 0; i < uint32_t(m_infos.size()); ++i)
+				if (m_priority[i] != infinity && m_slots[i].state == State::Unloaded)
+					m_lastRequests.push_back(i);
+			std::stable_sort(m_lastRequests.begin(), m_lastRequests.end(), [this](uint32_t a, uint32_t b)
+			{
+				return m_priority[a] < m_priority[b];
+			});
+
+			m_queue.assign(m_lastRequests.rbegin(), m_lastRequests.rend());
+			for (auto i : m_queue)
+				m_slots[i].state = State::Queued;
+		}
+		m_workAvailable.notify_all();
+	}
+
+	std::shared_ptr<const Mesh> MeshPrefetcher::get(size_t index)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto& slot = m_slots.at(index);
+		if (slot.state == State::Queued)
+		{
+			// load on this thread
+			m_queue.erase(std::find(m_queue.begin(), m_queue.end(), uint32_t(index)));
+			slot.state = State::Unloaded;
+		}
+		if (slot.state == State::Unloaded)
+		{
+			slot.state = State::Loading;
+			lock.unlock();
+			std::shared_ptr<const Mesh> mesh;
+			std::exception_ptr error;
+			try
+			{
+				mesh = std::make_shared<const Mesh>(SceneFormat::loadMesh(m_infos[index].file));
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			lock.lock();
+			slot.mesh = std::move(mesh);
+			slot.error = error;
+			slot.state = error ? State::Failed : State::Loaded;
+			m_loadFinished.notify_all();
+		}
+
+		m_loadFinished.wait(lock, [&slot]() { return slot.state == State::Loaded || slot.state == State::Failed; });
+		if (slot.state == State::Failed)
+			std::rethrow_exception(slot.error);
+		return slot.mesh;
+	}
+
+	bool MeshPrefetcher::isLoaded(size_t index) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_slots.at(index).state == State::Loaded;
+	}
+
+	void MeshPrefetcher::unload(size_t index)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto& slot = m_slots.at(index);
+		m_loadFinished.wait(lock, [&slot]() { return slot.state != State::Loading; });
+		if (slot.state == State::Queued)
+			m_queue.erase(std::find(m_queue.begin(), m_queue.end(), uint32_t(index)));
+		slot.mesh.reset();
+		slot.error = nullptr;
+		slot.state = State::Unloaded;
+	}
+
+	size_t MeshPrefetcher::getPendingCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t count = m_queue.size();
+		for (const auto& s : m_slots)
+			if (s.state == State::Loading) ++count;
+		return count;
+	}
+
+	void MeshPrefetcher::worker()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_workAvailable.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+			if (m_stop) return;
+
+			const auto index = m_queue.back();
+			m_queue.pop_back();
+			m_slots[index].state = State::Loading;
+			lock.unlock();
+
+			std::shared_ptr<const Mesh> mesh;
+			std::exception_ptr error;
+			try
+			{
+				mesh = std::make_shared<const Mesh>(SceneFormat::loadMesh(m_infos[index].file));
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			lock.lock();
+			m_slots[index].mesh = std::move(mesh);
+			m_slots[index].error = error;
+			m_slots[index].state = error ? State::Failed : State::Loaded;
+			m_loadFinished.notify_all();
+		}
+	}
+}
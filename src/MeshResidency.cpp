@@ -0,0 +1,294 @@
+#include "../include/hrsf/MeshResidency.h"
+#include "../include/hrsf/SceneFormat.h"
+#include <algorithm>
+
+namespace hrsf
+{
+	namespace
+	{
+		/// \brief bytes of the mesh data based on the bmf sizes of the mesh json (0 if the json does not contain them)
+		size_t estimateBytes(const MeshInfo& info)
+		{
+			if (!info.hasCounts()) return 0;
+			const size_t indexSize = info.type == Mesh::Triangle ? sizeof(uint16_t) : sizeof(uint32_t);
+			return info.vertexCount * bmf::getAttributeElementStride(info.attributes) * sizeof(float) +
+				info.indexCount * indexSize + info.shapeCount * sizeof(bmf::Shape);
+		}
+	}
+
+	MeshResidency::MeshResidency(std::vector<MeshInfo> meshes, const ResidencySettings& settings)
+		:
+		m_infos(std::move(meshes)),
+		m_budget(settings.budget),
+		m_slots(m_infos.size())
+	{
+		for (uint32_t i = 0; i < std::max(settings.threadCount, 1u); ++i)
+			m_threads.emplace_back(&MeshResidency::worker, this);
+	}
+
+	MeshResidency::~MeshResidency()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_queue.clear();
+		}
+		m_workAvailable.notify_all();
+		m_loadFinished.notify_all();
+		for (auto& t : m_threads)
+			t.join();
+	}
+
+	void MeshResidency::request(size_t index, float priority)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto& slot = m_slots.at(index);
+			if (slot.state == State::Queued)
+				m_queue.erase({ -slot.priority, uint32_t(index) });
+			else if (slot.state != State::Unloaded && slot.state != State::Failed)
+				return;
+
+			slot.state = State::Queued;
+			slot.error = nullptr;
+			slot.priority = priority;
+			m_queue.insert({ -priority, uint32_t(index) });
+		}
+		m_workAvailable.notify_one();
+	}
+
+	std::shared_ptr<const Mesh> MeshResidency::acquire(size_t index)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		auto& slot = m_slots.at(index);
+		if (slot.state == State::Resident)
+		{
+			++m_counters.hits;
+			touch(uint32_t(index));
+			return slot.mesh;
+		}
+
+		++m_counters.misses;
+		while (true)
+		{
+			if (slot.state == State::Queued)
+			{
+				// load on this thread
+				m_queue.erase({ -slot.priority, uint32_t(index) });
+				slot.state = State::Unloaded;
+			}
+			if (slot.state == State::Unloaded)
+			{
+				slot.state = State::Loading;
+				load(lock, uint32_t(index));
+			}
+
+			m_loadFinished.wait(lock, [&slot]() { return slot.state != State::Loading; });
+			if (slot.state == State::Failed)
+				std::rethrow_exception(slot.error);
+			if (slot.state == State::Resident)
+			{
+				touch(uint32_t(index));
+				return slot.mesh;
+			}
+			// evicted by another load before this thread woke up
+		}
+	}
+
+	std::shared_ptr<const Mesh> MeshResidency::tryAcquire(size_t index)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& slot = m_slots.at(index);
+		if (slot.state != State::Resident)
+		{
+			++m_counters.misses;
+			return nullptr;
+		}
+		++m_counters.hits;
+		touch(uint32_t(index));
+		return slot.mesh;
+	}
+
+	bool MeshResidency::isResident(size_t index) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_slots.at(index).state == State::Resident;
+	}
+
+	void MeshResidency::pin(size_t index)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		++m_slots.at(index).pins;
+	}
+
+	void MeshResidency::unpin(size_t index)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& slot = m_slots.at(index);
+		if (slot.pins == 0)
+			throw std::runtime_error("mesh " + std::to_string(index) + " is not pinned");
+		// unpinned meshes may exceed the budget now
+		if (--slot.pins == 0)
+			makeRoom(0);
+	}
+
+	void MeshResidency::evict(size_t index)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto& slot = m_slots.at(index);
+			if (slot.state == State::Resident && !isLocked(uint32_t(index))) release(uint32_t(index));
+			else if (slot.state == State::Queued && !slot.pins)
+			{
+				m_queue.erase({ -slot.priority, uint32_t(index) });
+				slot.state = State::Unloaded;
+			}
+			else return;
+		}
+		// the removed request may have been the last pending one (see wait())
+		m_loadFinished.notify_all();
+	}
+
+	void MeshResidency::setBudget(size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget = bytes;
+		makeRoom(0);
+	}
+
+	size_t MeshResidency::getBudget() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_budget;
+	}
+
+	ResidencyCounters MeshResidency::getCounters() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_counters;
+	}
+
+	void MeshResidency::resetCounters()
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ResidencyCounters counters;
+		counters.residentBytes = m_counters.residentBytes;
+		counters.peakResidentBytes = m_counters.residentBytes;
+		m_counters = counters;
+	}
+
+	size_t MeshResidency::getPendingCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t count = m_queue.size();
+		for (const auto& s : m_slots)
+			if (s.state == State::Loading) ++count;
+		return count;
+	}
+
+	void MeshResidency::wait() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_loadFinished.wait(lock, [this]()
+		{
+			return m_stop || (m_queue.empty() && std::none_of(m_slots.begin(), m_slots.end(), [](const Slot& s) { return s.state == State::Loading; }));
+		});
+	}
+
+	void MeshResidency::load(std::unique_lock<std::mutex>& lock, uint32_t index)
+	{
+		const auto estimate = estimateBytes(m_infos[index]);
+		makeRoom(estimate);
+		m_reservedBytes += estimate;
+		lock.unlock();
+
+		std::shared_ptr<const Mesh> mesh;
+		std::exception_ptr error;
+		size_t bytes = 0;
+		try
+		{
+			auto loaded = std::make_shared<Mesh>(SceneFormat::loadMesh(m_infos[index].file));
+			bytes = getMeshMemoryUsage(*loaded).total();
+			mesh = std::move(loaded);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		lock.lock();
+		m_reservedBytes -= estimate;
+		auto& slot = m_slots[index];
+		slot.error = error;
+		if (error)
+		{
+			slot.state = State::Failed;
+		}
+		else
+		{
+			// replace the reservation with the actual bytes (the estimate does not include capacity and paths)
+			makeRoom(bytes);
+			slot.mesh = std::move(mesh);
+			slot.bytes = bytes;
+			slot.state = State::Resident;
+			m_lru.push_front(index);
+			slot.lru = m_lru.begin();
+			++m_counters.loads;
+			m_counters.bytesLoaded += bytes;
+			m_counters.residentBytes += bytes;
+			m_counters.peakResidentBytes = std::max(m_counters.peakResidentBytes, m_counters.residentBytes);
+		}
+		m_loadFinished.notify_all();
+	}
+
+	void MeshResidency::makeRoom(size_t bytes)
+	{
+		auto it = m_lru.end();
+		while (it != m_lru.begin() && m_counters.residentBytes + m_reservedBytes + bytes > m_budget)
+		{
+			const auto index = *--it;
+			if (isLocked(index)) continue;
+			++it; // stays valid when the previous element is erased
+			release(index);
+		}
+	}
+
+	void MeshResidency::release(uint32_t index)
+	{
+		auto& slot = m_slots[index];
+		m_lru.erase(slot.lru);
+		++m_counters.evictions;
+		m_counters.bytesEvicted += slot.bytes;
+		m_counters.residentBytes -= slot.bytes;
+		slot.mesh.reset();
+		slot.bytes = 0;
+		slot.state = State::Unloaded;
+	}
+
+	bool MeshResidency::isLocked(uint32_t index) const
+	{
+		// meshes that are held by a caller stay in memory anyway => evicting them would not free anything
+		const auto& slot = m_slots[index];
+		return slot.pins || slot.mesh.use_count() > 1;
+	}
+
+	void MeshResidency::touch(uint32_t index)
+	{
+		m_lru.splice(m_lru.begin(), m_lru, m_slots[index].lru);
+	}
+
+	void MeshResidency::worker()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_workAvailable.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+			if (m_stop) return;
+
+			const auto index = m_queue.begin()->second;
+			m_queue.erase(m_queue.begin());
+			m_slots[index].state = State::Loading;
+			load(lock, index);
+		}
+	}
+}
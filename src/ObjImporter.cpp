@@ -0,0 +1,499 @@
+#include "../include/hrsf/Importer.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+
+namespace hrsf
+{
+	namespace
+	{
+		namespace fs = std::filesystem;
+
+		constexpr int32_t s_missing = std::numeric_limits<int32_t>::min();
+		constexpr size_t s_maxShapeVertices = size_t(std::numeric_limits<uint16_t>::max()) + 1;
+
+		/// v/vt/vn indices of a triangle corner.
+		/// After parsing: absolute 1-based indices are > 0, relative (negative) indices are stored
+		/// as chunk-local 0-based indices with the corresponding relative bit set
+		struct ObjCorner
+		{
+			int32_t index[3];
+			uint8_t relative;
+		};
+
+		struct ObjChunk
+		{
+			std::vector<glm::vec3> positions;
+			std::vector<glm::vec2> texcoords;
+			std::vector<glm::vec3> normals;
+			std::vector<ObjCorner> corners; // 3 per triangle
+			std::vector<std::pair<size_t, std::string>> materialRuns; // first triangle, material name
+			std::vector<std::string> materialLibs;
+		};
+
+		std::string readFile(const fs::path& filename)
+		{
+			std::ifstream file(filename, std::ios::binary | std::ios::ate);
+			if (!file.is_open())
+				throw std::runtime_error("could not open " + filename.string());
+			std::string res(size_t(file.tellg()), '\0');
+			file.seekg(0);
+			file.read(res.data(), std::streamsize(res.size()));
+			return res;
+		}
+
+		bool isSpace(char c)
+		{
+			return c == ' ' || c == '\t' || c == '\r';
+		}
+
+		/// line parser that does not allocate
+		class Tokenizer
+		{
+		public:
+			explicit Tokenizer(std::string_view line) : m_line(line) {}
+
+			std::string_view next()
+			{
+				while (m_pos < m_line.size() && isSpace(m_line[m_pos])) ++m_pos;
+				const auto start = m_pos;
+				while (m_pos < m_line.size() && !isSpace(m_line[m_pos])) ++m_pos;
+				return m_line.substr(start, m_pos - start);
+			}
+
+			/// remaining line without surrounding whitespace
+			std::string_view rest()
+			{
+				while (m_pos < m_line.size() && isSpace(m_line[m_pos])) ++m_pos;
+				auto end = m_line.size();
+				while (end > m_pos && isSpace(m_line[end - 1])) --end;
+				return m_line.substr(m_pos, end - m_pos);
+			}
+
+			float nextFloat(float defaultValue = 0.0f)
+			{
+				const auto token = next();
+				float res = defaultValue;
+				// strtof instead of std::from_chars: floating point from_chars requires a recent standard library.
+				// The token is not null terminated => copy it (numbers are short)
+				char buffer[64];
+				if (!token.empty() && token.size() < sizeof(buffer))
+				{
+					std::memcpy(buffer, token.data(), token.size());
+					buffer[token.size()] = '\0';
+					char* end = nullptr;
+					const float value = std::strtof(buffer, &end);
+					if (end != buffer) res = value;
+				}
+				return res;
+			}
+		private:
+			std::string_view m_line;
+			size_t m_pos = 0;
+		};
+
+		/// \brief parses "v", "v/vt", "v//vn" or "v/vt/vn"
+		ObjCorner parseCorner(std::string_view token, const ObjChunk& chunk)
+		{
+			ObjCorner c = { { s_missing, s_missing, s_missing }, 0 };
+			const size_t localCount[3] = { chunk.positions.size(), chunk.texcoords.size(), chunk.normals.size() };
+			size_t start = 0;
+			for (int i = 0; i < 3 && start <= token.size(); ++i)
+			{
+				auto end = token.find('/', start);
+				if (end == std::string_view::npos) end = token.size();
+				int32_t value = 0;
+				if (end > start && std::from_chars(token.data() + start, token.data() + end, value).ec == std::errc() && value != 0)
+				{
+					if (value > 0) c.index[i] = value;
+					else
+					{
+						// relative to the last element => resolved after the chunk offsets are known
+						c.index[i] = int32_t(int64_t(localCount[i]) + value);
+						c.relative |= uint8_t(1 << i);
+					}
+				}
+				start = end + 1;
+			}
+			if (c.index[0] == s_missing)
+				throw std::runtime_error("obj face without position index: " + std::string(token));
+			return c;
+		}
+
+		void parseChunk(std::string_view text, ObjChunk& chunk)
+		{
+			std::vector<ObjCorner> face;
+			size_t pos = 0;
+			while (pos < text.size())
+			{
+				auto end = text.find('\n', pos);
+				if (end == std::string_view::npos) end = text.size();
+				Tokenizer line(text.substr(pos, end - pos));
+				pos = end + 1;
+
+				const auto key = line.next();
+				if (key == "v")
+				{
+					const float x = line.nextFloat();
+					const float y = line.nextFloat();
+					const float z = line.nextFloat();
+					chunk.positions.emplace_back(x, y, z);
+				}
+				else if (key == "vt")
+				{
+					const float u = line.nextFloat();
+					const float v = line.nextFloat();
+					chunk.texcoords.emplace_back(u, v);
+				}
+				else if (key == "vn")
+				{
+					const float x = line.nextFloat();
+					const float y = line.nextFloat();
+					const float z = line.nextFloat();
+					chunk.normals.emplace_back(x, y, z);
+				}
+				else if (key == "f")
+				{
+					face.clear();
+					for (auto token = line.next(); !token.empty(); token = line.next())
+						face.push_back(parseCorner(token, chunk));
+					// triangle fan
+					for (size_t i = 2; i < face.size(); ++i)
+					{
+						chunk.corners.push_back(face[0]);
+						chunk.corners.push_back(face[i - 1]);
+						chunk.corners.push_back(face[i]);
+					}
+				}
+				else if (key == "usemtl")
+					chunk.materialRuns.emplace_back(chunk.corners.size() / 3, std::string(line.rest()));
+				else if (key == "mtllib")
+					chunk.materialLibs.emplace_back(line.rest());
+			}
+		}
+
+		fs::path getTextureFilename(Tokenizer& line, const fs::path& root)
+		{
+			// options like "-bm 1.0" precede the filename => use the last token
+			std::string_view last;
+			for (auto token = line.next(); !token.empty(); token = line.next())
+				last = token;
+			if (last.empty()) return {};
+			return fs::absolute(root / fs::path(std::string(last)));
+		}
+
+		void loadMtl(const fs::path& filename, std::vector<Material>& materials)
+		{
+			const auto text = readFile(filename);
+			const auto root = filename.parent_path();
+			Material* mat = nullptr;
+			size_t pos = 0;
+			while (pos < text.size())
+			{
+				auto end = text.find('\n', pos);
+				if (end == std::string::npos) end = text.size();
+				Tokenizer line(std::string_view(text).substr(pos, end - pos));
+				pos = end + 1;
+
+				const auto key = line.next();
+				if (key == "newmtl")
+				{
+					materials.emplace_back();
+					mat = &materials.back();
+					mat->name = std::string(line.rest());
+					mat->data = MaterialData::Default();
+					continue;
+				}
+				if (!mat) continue;
+
+				auto& d = mat->data;
+				if (key == "Kd")
+				{
+					const float r = line.nextFloat();
+					const float g = line.nextFloat(r);
+					const float b = line.nextFloat(r);
+					d.albedo = glm::vec3(r, g, b);
+				}
+				else if (key == "Ke")
+				{
+					const float r = line.nextFloat();
+					const float g = line.nextFloat(r);
+					const float b = line.nextFloat(r);
+					d.emission = glm::vec3(r, g, b);
+				}
+				else if (key == "Ks")
+				{
+					const float r = line.nextFloat();
+					const float g = line.nextFloat(r);
+					const float b = line.nextFloat(r);
+					d.specular = std::max(r, std::max(g, b));
+				}
+				else if (key == "Ns")
+					d.roughness = std::min(1.0f, std::sqrt(2.0f / (std::max(line.nextFloat(), 0.0f) + 2.0f)));
+				else if (key == "Pr") // pbr extension
+					d.roughness = line.nextFloat(d.roughness);
+				else if (key == "Pm")
+					d.metalness = line.nextFloat();
+				else if (key == "Ni")
+					d.ior = line.nextFloat(1.0f);
+				else if (key == "d")
+					d.coverage = line.nextFloat(1.0f);
+				else if (key == "Tr")
+					d.coverage = 1.0f - line.nextFloat(0.0f);
+				else if (key == "map_Kd")
+					mat->textures.albedo = getTextureFilename(line, root);
+				else if (key == "map_Ks")
+					mat->textures.specular = getTextureFilename(line, root);
+				else if (key == "map_d")
+					mat->textures.coverage = getTextureFilename(line, root);
+			}
+
+			for (auto& m : materials)
+			{
+				if (m.data.coverage < 1.0f || !m.textures.coverage.empty())
+					m.data.flags |= MaterialData::Transparent;
+			}
+		}
+
+		struct CornerKey
+		{
+			int32_t v, t, n;
+			bool operator==(const CornerKey& o) const { return v == o.v && t == o.t && n == o.n; }
+		};
+
+		struct CornerHash
+		{
+			size_t operator()(const CornerKey& k) const
+			{
+				return size_t(k.v) * 73856093u ^ size_t(k.t) * 19349663u ^ size_t(k.n) * 83492791u;
+			}
+		};
+
+		struct ShapeData
+		{
+			std::vector<float> vertices;
+			std::vector<uint16_t> indices;
+			uint32_t materialId;
+		};
+
+		/// triangles [begin, end) of a chunk
+		struct TriangleRange
+		{
+			size_t chunk;
+			size_t begin;
+			size_t end;
+		};
+	}
+
+	void importObj(const std::filesystem::path& filename, ImportTarget& target, const ImportSettings& settings)
+	{
+		const auto text = readFile(filename);
+		const std::string_view view(text);
+
+		// split at line ends
+		std::vector<std::string_view> parts;
+		for (size_t begin = 0; begin < view.size();)
+		{
+			size_t end = std::min(view.size(), begin + std::max<size_t>(settings.chunkSize, 1));
+			while (end < view.size() && view[end - 1] != '\n') ++end;
+			parts.push_back(view.substr(begin, end - begin));
+			begin = end;
+		}
+
+		std::vector<ObjChunk> chunks(parts.size());
+		parallelFor(0, parts.size(), [&](size_t i)
+		{
+			parseChunk(parts[i], chunks[i]);
+		});
+
+		// offsets of the chunks in the global arrays
+		std::vector<size_t> offsets[3];
+		size_t counts[3] = { 0, 0, 0 };
+		for (const auto& c : chunks)
+		{
+			const size_t sizes[3] = { c.positions.size(), c.texcoords.size(), c.normals.size() };
+			for (int a = 0; a < 3; ++a)
+			{
+				offsets[a].push_back(counts[a]);
+				counts[a] += sizes[a];
+			}
+		}
+		if (counts[0] > size_t(std::numeric_limits<int32_t>::max()))
+			throw std::runtime_error(filename.string() + " has too many vertices");
+
+		// global arrays and absolute 0-based indices
+		std::vector<glm::vec3> positions(counts[0]);
+		std::vector<glm::vec2> texcoords(counts[1]);
+		std::vector<glm::vec3> normals(counts[2]);
+		parallelFor(0, chunks.size(), [&](size_t i)
+		{
+			auto& c = chunks[i];
+			for (size_t v = 0; v < c.positions.size(); ++v)
+				positions[offsets[0][i] + v] = c.positions[v] * settings.scale;
+			std::copy(c.texcoords.begin(), c.texcoords.end(), texcoords.begin() + offsets[1][i]);
+			std::copy(c.normals.begin(), c.normals.end(), normals.begin() + offsets[2][i]);
+
+			for (auto& corner : c.corners)
+			{
+				for (int a = 0; a < 3; ++a)
+				{
+					auto& idx = corner.index[a];
+					if (idx == s_missing) continue;
+					const int64_t abs = (corner.relative & (1 << a)) ? int64_t(offsets[a][i]) + idx : int64_t(idx) - 1;
+					if (abs < 0 || abs >= int64_t(counts[a]))
+						throw std::runtime_error(filename.string() + " face index out of range");
+					idx = int32_t(abs);
+				}
+				corner.relative = 0;
+			}
+		});
+
+		// materials
+		std::vector<Material> materials;
+		for (const auto& c : chunks)
+			for (const auto& lib : c.materialLibs)
+				loadMtl(filename.parent_path() / fs::path(lib), materials);
+		std::unordered_map<std::string, uint32_t> materialIds;
+		for (uint32_t m = 0; m < uint32_t(materials.size()); ++m)
+			materialIds.emplace(materials[m].name, m);
+		const auto getMaterialId = [&](const std::string& name)
+		{
+			auto it = materialIds.find(name);
+			if (it != materialIds.end()) return it->second;
+			// unknown materials (and faces before the first usemtl) get the default material
+			materials.emplace_back();
+			materials.back().name = name.empty() ? "default" : name;
+			materials.back().data = MaterialData::Default();
+			materialIds.emplace(name, uint32_t(materials.size() - 1));
+			return uint32_t(materials.size() - 1);
+		};
+
+		// group triangle ranges by material
+		std::vector<std::vector<TriangleRange>> materialRanges;
+		std::string currentMaterial;
+		for (size_t ci = 0; ci < chunks.size(); ++ci)
+		{
+			const auto& c = chunks[ci];
+			const size_t triangleCount = c.corners.size() / 3;
+			size_t begin = 0;
+			for (size_t r = 0; r <= c.materialRuns.size(); ++r)
+			{
+				const size_t end = r < c.materialRuns.size() ? c.materialRuns[r].first : triangleCount;
+				if (end > begin)
+				{
+					const auto id = getMaterialId(currentMaterial);
+					if (id >= materialRanges.size()) materialRanges.resize(id + 1);
+					materialRanges[id].push_back({ ci, begin, end });
+				}
+				if (r < c.materialRuns.size()) currentMaterial = c.materialRuns[r].second;
+				begin = std::max(begin, end);
+			}
+		}
+
+		// smooth normals for corners without normal index
+		std::vector<glm::vec3> smoothNormals;
+		for (const auto& c : chunks)
+		{
+			for (size_t i = 0; i < c.corners.size(); i += 3)
+			{
+				if (c.corners[i].index[2] != s_missing && c.corners[i + 1].index[2] != s_missing && c.corners[i + 2].index[2] != s_missing)
+					continue;
+				if (smoothNormals.empty()) smoothNormals.assign(positions.size(), glm::vec3(0.0f));
+				const auto& p0 = positions[c.corners[i].index[0]];
+				const auto& p1 = positions[c.corners[i + 1].index[0]];
+				const auto& p2 = positions[c.corners[i + 2].index[0]];
+				const auto n = glm::cross(p1 - p0, p2 - p0); // area weighted
+				for (size_t j = i; j < i + 3; ++j)
+					smoothNormals[c.corners[j].index[0]] += n;
+			}
+		}
+		parallelFor(0, smoothNormals.size(), [&](size_t i)
+		{
+			const float len = glm::length(smoothNormals[i]);
+			smoothNormals[i] = len > 0.0f ? smoothNormals[i] / len : glm::vec3(0.0f, 1.0f, 0.0f);
+		}, 4096);
+
+		// build the shapes per material
+		const uint32_t attributes = bmf::Position | bmf::Normal | bmf::Texcoord0;
+		const size_t stride = bmf::getAttributeElementStride(attributes);
+		const size_t normalOffset = bmf::getAttributeElementOffset(attributes, bmf::Normal);
+		const size_t texcoordOffset = bmf::getAttributeElementOffset(attributes, bmf::Texcoord0);
+		std::vector<std::vector<ShapeData>> materialShapes(materialRanges.size());
+		parallelFor(0, materialRanges.size(), [&](size_t m)
+		{
+			auto& shapes = materialShapes[m];
+			std::unordered_map<CornerKey, uint16_t, CornerHash> vertexMap;
+			for (const auto& range : materialRanges[m])
+			{
+				const auto& corners = chunks[range.chunk].corners;
+				for (size_t tri = range.begin; tri < range.end; ++tri)
+				{
+					// start a new shape if the triangle could overflow the 16 bit indices
+					if (shapes.empty() || shapes.back().vertices.size() / stride + 3 > s_maxShapeVertices)
+					{
+						shapes.push_back({ {}, {}, uint32_t(m) });
+						vertexMap.clear();
+					}
+					auto& shape = shapes.back();
+					for (size_t i = tri * 3; i < tri * 3 + 3; ++i)
+					{
+						const auto& c = corners[i];
+						const CornerKey key = { c.index[0], c.index[1], c.index[2] };
+						auto it = vertexMap.find(key);
+						if (it == vertexMap.end())
+						{
+							it = vertexMap.emplace(key, uint16_t(shape.vertices.size() / stride)).first;
+							const auto start = shape.vertices.size();
+							shape.vertices.resize(start + stride, 0.0f);
+							float* v = shape.vertices.data() + start;
+							const auto& p = positions[c.index[0]];
+							v[0] = p.x; v[1] = p.y; v[2] = p.z;
+							const auto& n = c.index[2] != s_missing ? normals[c.index[2]] : smoothNormals[c.index[0]];
+							v[normalOffset] = n.x; v[normalOffset + 1] = n.y; v[normalOffset + 2] = n.z;
+							if (c.index[1] != s_missing)
+							{
+								// obj has v = 0 at the bottom of the image, bmf (like gltf) at the top
+								v[texcoordOffset] = texcoords[c.index[1]].x;
+								v[texcoordOffset + 1] = 1.0f - texcoords[c.index[1]].y;
+							}
+						}
+						shape.indices.push_back(it->second);
+					}
+				}
+			}
+		});
+		chunks.clear();
+
+		// concatenate
+		std::vector<float> vertices;
+		std::vector<uint16_t> indices;
+		std::vector<bmf::Shape> shapes;
+		for (auto& list : materialShapes)
+		{
+			for (auto& s : list)
+			{
+				shapes.push_back(bmf::Shape{ uint32_t(indices.size()), uint32_t(s.indices.size()),
+					uint32_t(vertices.size() / stride), uint32_t(s.vertices.size() / stride), s.materialId });
+				vertices.insert(vertices.end(), s.vertices.begin(), s.vertices.end());
+				indices.insert(indices.end(), s.indices.begin(), s.indices.end());
+				s = {};
+			}
+		}
+
+		target.setMaterials(std::move(materials));
+		if (!shapes.empty())
+		{
+			bmf::BinaryMesh16 mesh(attributes, std::move(vertices), std::move(indices), std::move(shapes));
+			mesh.generateBoundingVolumes();
+			target.addMesh(Mesh(std::move(mesh)));
+		}
+		target.setLights({});
+	}
+}
@@ -0,0 +1,610 @@
+#include "../include/hrsf/Importer.h"
+#include "../include/hrsf/Bounds.h"
+#include "../include/hrsf/Parallel.h"
+#include "../include/hrsf/srgb.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <random>
+#include <sstream>
+
+namespace hrsf
+{
+	namespace
+	{
+		namespace fs = std::filesystem;
+
+		enum class PlyType
+		{
+			Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64
+		};
+
+		size_t getTypeSize(PlyType t)
+		{
+			switch (t)
+			{
+			case PlyType::Int8: case PlyType::UInt8: return 1;
+			case PlyType::Int16: case PlyType::UInt16: return 2;
+			case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+			case PlyType::Float64: return 8;
+			}
+			return 0;
+		}
+
+		PlyType getType(const std::string& name)
+		{
+			if (name == "char" || name == "int8") return PlyType::Int8;
+			if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+			if (name == "short" || name == "int16") return PlyType::Int16;
+			if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+			if (name == "int" || name == "int32") return PlyType::Int32;
+			if (name == "uint" || name == "uint32") return PlyType::UInt32;
+			if (name == "float" || name == "float32") return PlyType::Float32;
+			if (name == "double" || name == "float64") return PlyType::Float64;
+			throw std::runtime_error("unknown ply type " + name);
+		}
+
+		/// maximum value of unsigned types (used to normalize colors)
+		float getColorScale(PlyType t)
+		{
+			switch (t)
+			{
+			case PlyType::UInt8: return 1.0f / 255.0f;
+			case PlyType::UInt16: return 1.0f / 65535.0f;
+			default: return 1.0f;
+			}
+		}
+
+		struct PlyProperty
+		{
+			std::string name;
+			PlyType type;
+			bool isList = false;
+			PlyType countType; // for lists
+			size_t offset = 0; // byte offset in a binary vertex record
+		};
+
+		struct PlyElement
+		{
+			std::string name;
+			size_t count;
+			std::vector<PlyProperty> properties;
+		};
+
+		/// point with normalized color
+		struct PlyPoint
+		{
+			glm::vec3 position;
+			glm::vec3 normal;
+			glm::vec3 color; // srgb [0, 1]
+			float radius;
+		};
+
+		/// streams the vertex element of a ply file in chunks
+		class PlyReader
+		{
+		public:
+			explicit PlyReader(const fs::path& filename) :
+				m_file(filename, std::ios::binary),
+				m_filename(filename)
+			{
+				if (!m_file.is_open())
+					throw std::runtime_error("could not open " + filename.string());
+				readHeader(filename);
+				skipPrecedingElements();
+
+				const auto find = [this](const char* name) -> const PlyProperty*
+				{
+					for (const auto& p : m_vertex.properties)
+						if (p.name == name) return &p;
+					return nullptr;
+				};
+				for (int i = 0; i < 3; ++i)
+				{
+					m_position[i] = find(std::string(1, char('x' + i)).c_str());
+					if (!m_position[i]) throw std::runtime_error(filename.string() + " has no vertex positions");
+				}
+				const char* normals[] = { "nx", "ny", "nz" };
+				const char* colors[] = { "red", "green", "blue" };
+				const char* diffuse[] = { "diffuse_red", "diffuse_green", "diffuse_blue" };
+				for (int i = 0; i < 3; ++i)
+				{
+					m_normal[i] = find(normals[i]);
+					m_color[i] = find(colors[i]);
+					if (!m_color[i]) m_color[i] = find(diffuse[i]);
+				}
+				m_radius = find("radius");
+				for (const auto& p : m_vertex.properties)
+					if (p.isList) throw std::runtime_error(filename.string() + " vertex lists are not supported");
+			}
+
+			size_t getVertexCount() const { return m_vertex.count; }
+			bool hasNormals() const { return m_normal[0] && m_normal[1] && m_normal[2]; }
+			bool hasColors() const { return m_color[0] && m_color[1] && m_color[2]; }
+			bool hasRadius() const { return m_radius != nullptr; }
+
+			/// \brief reads the next maxCount (or less) points. Returns false if all points were read
+			bool read(size_t maxCount, std::vector<PlyPoint>& out)
+			{
+				const size_t count = std::min(maxCount, m_vertex.count - m_read);
+				out.resize(count);
+				if (count == 0) return false;
+				m_read += count;
+
+				if (m_ascii) readAscii(count, out);
+				else
+				{
+					m_buffer.resize(count * m_recordSize);
+					m_file.read(m_buffer.data(), std::streamsize(m_buffer.size()));
+					if (size_t(m_file.gcount()) != m_buffer.size())
+						throw std::runtime_error("unexpected end of ply file");
+					parallelFor(0, count, [&](size_t i)
+					{
+						decodeBinary(m_buffer.data() + i * m_recordSize, out[i]);
+					}, 4096);
+				}
+				return true;
+			}
+		private:
+			void readHeader(const fs::path& filename)
+			{
+				std::string line;
+				std::getline(m_file, line);
+				m_lineNumber = 1;
+				if (line.rfind("ply", 0) != 0)
+					throw std::runtime_error(filename.string() + " is not a ply file");
+
+				while (std::getline(m_file, line))
+				{
+					++m_lineNumber;
+					if (!line.empty() && line.back() == '\r') line.pop_back();
+					std::istringstream ss(line);
+					std::string key;
+					ss >> key;
+					if (key == "format")
+					{
+						std::string format;
+						ss >> format;
+						m_ascii = format == "ascii";
+						m_bigEndian = format == "binary_big_endian";
+						if (!m_ascii && !m_bigEndian && format != "binary_little_endian")
+							throw std::runtime_error(filename.string() + " unknown ply format " + format);
+					}
+					else if (key == "element")
+					{
+						m_elements.emplace_back();
+						ss >> m_elements.back().name >> m_elements.back().count;
+					}
+					else if (key == "property")
+					{
+						if (m_elements.empty()) throw std::runtime_error(filename.string() + " property without element");
+						PlyProperty p;
+						std::string type;
+						ss >> type;
+						if (type == "list")
+						{
+							std::string countType, valueType;
+							ss >> countType >> valueType;
+							p.isList = true;
+							p.countType = getType(countType);
+							p.type = getType(valueType);
+						}
+						else p.type = getType(type);
+						ss >> p.name;
+						m_elements.back().properties.push_back(p);
+					}
+					else if (key == "end_header") break;
+				}
+
+				size_t vertexIndex = m_elements.size();
+				for (size_t i = 0; i < m_elements.size(); ++i)
+					if (m_elements[i].name == "vertex") { vertexIndex = i; break; }
+				if (vertexIndex == m_elements.size())
+					throw std::runtime_error(filename.string() + " has no vertex element");
+				m_vertex = m_elements[vertexIndex];
+				m_elements.resize(vertexIndex); // elements that precede the vertices
+
+				m_recordSize = 0;
+				for (auto& p : m_vertex.properties)
+				{
+					p.offset = m_recordSize;
+					m_recordSize += getTypeSize(p.type);
+				}
+			}
+
+			void skipPrecedingElements()
+			{
+				for (const auto& e : m_elements)
+				{
+					for (size_t i = 0; i < e.count; ++i)
+					{
+						if (m_ascii)
+						{
+							std::string line;
+							std::getline(m_file, line);
+							++m_lineNumber;
+							continue;
+						}
+						for (const auto& p : e.properties)
+						{
+							size_t count = 1;
+							if (p.isList)
+							{
+								char buf[8];
+								m_file.read(buf, std::streamsize(getTypeSize(p.countType)));
+								count = size_t(readBinary(buf, p.countType));
+							}
+							m_file.ignore(std::streamsize(count * getTypeSize(p.type)));
+						}
+					}
+				}
+			}
+
+			double readBinary(const char* src, PlyType type) const
+			{
+				char buf[8];
+				const auto size = getTypeSize(type);
+				std::memcpy(buf, src, size);
+				if (m_bigEndian) std::reverse(buf, buf + size);
+				switch (type)
+				{
+				case PlyType::Int8: { int8_t v; std::memcpy(&v, buf, 1); return v; }
+				case PlyType::UInt8: { uint8_t v; std::memcpy(&v, buf, 1); return v; }
+				case PlyType::Int16: { int16_t v; std::memcpy(&v, buf, 2); return v; }
+				case PlyType::UInt16: { uint16_t v; std::memcpy(&v, buf, 2); return v; }
+				case PlyType::Int32: { int32_t v; std::memcpy(&v, buf, 4); return v; }
+				case PlyType::UInt32: { uint32_t v; std::memcpy(&v, buf, 4); return v; }
+				case PlyType::Float32: { float v; std::memcpy(&v, buf, 4); return v; }
+				case PlyType::Float64: { double v; std::memcpy(&v, buf, 8); return v; }
+				}
+				return 0.0;
+			}
+
+			void decodeBinary(const char* record, PlyPoint& p) const
+			{
+				const auto get = [&](const PlyProperty* prop, float scale)
+				{
+					return float(readBinary(record + prop->offset, prop->type)) * scale;
+				};
+				for (int i = 0; i < 3; ++i)
+				{
+					p.position[i] = get(m_position[i], 1.0f);
+					p.normal[i] = m_normal[i] ? get(m_normal[i], 1.0f) : 0.0f;
+					p.color[i] = m_color[i] ? get(m_color[i], getColorScale(m_color[i]->type)) : 1.0f;
+				}
+				p.radius = m_radius ? get(m_radius, 1.0f) : 0.0f;
+			}
+
+			void readAscii(size_t count, std::vector<PlyPoint>& out)
+			{
+				// one line per vertex => read the lines sequentially, parse them in parallel
+				m_lines.resize(count);
+				for (size_t i = 0; i < count; ++i)
+				{
+					if (!std::getline(m_file, m_lines[i]))
+						throw std::runtime_error("unexpected end of ply file");
+				}
+
+				const auto& props = m_vertex.properties;
+				const size_t firstLine = m_lineNumber + 1;
+				m_lineNumber += count;
+				parallelFor(0, count, [&](size_t i)
+				{
+					const auto& line = m_lines[i];
+					thread_local std::vector<double> values;
+					values.resize(props.size());
+					// strtod instead of std::from_chars: floating point from_chars requires a recent standard library
+					const char* cur = line.c_str();
+					for (size_t pi = 0; pi < props.size(); ++pi)
+					{
+						char* end = nullptr;
+						values[pi] = std::strtod(cur, &end);
+						if (end == cur)
+							throw std::runtime_error(m_filename.string() + " line " + std::to_string(firstLine + i) + ": expected " +
+								std::to_string(props.size()) + " vertex properties: " + line);
+						cur = end;
+					}
+					const auto get = [&](const PlyProperty* prop, float scale)
+					{
+						return float(values[prop - props.data()]) * scale;
+					};
+					auto& p = out[i];
+					for (int c = 0; c < 3; ++c)
+					{
+						p.position[c] = get(m_position[c], 1.0f);
+						p.normal[c] = m_normal[c] ? get(m_normal[c], 1.0f) : 0.0f;
+						p.color[c] = m_color[c] ? get(m_color[c], getColorScale(m_color[c]->type)) : 1.0f;
+					}
+					p.radius = m_radius ? get(m_radius, 1.0f) : 0.0f;
+				}, 1024);
+			}
+
+			std::ifstream m_file;
+			fs::path m_filename;
+			size_t m_lineNumber = 0; // lines read so far (ascii files)
+			bool m_ascii = false;
+			bool m_bigEndian = false;
+			std::vector<PlyElement> m_elements;
+			PlyElement m_vertex;
+			size_t m_recordSize = 0;
+			size_t m_read = 0;
+			const PlyProperty* m_position[3] = {};
+			const PlyProperty* m_normal[3] = {};
+			const PlyProperty* m_color[3] = {};
+			const PlyProperty* m_radius = nullptr;
+			std::vector<char> m_buffer;
+			std::vector<std::string> m_lines;
+		};
+
+		/// vertex layout of the billboard meshes
+		struct PointLayout
+		{
+			uint32_t attributes;
+			size_t stride;
+			size_t normalOffset;
+			size_t texcoordOffset;
+			size_t materialOffset;
+		};
+
+		/// quantized srgb color => palette index
+		uint32_t getPaletteIndex(const glm::vec3& color, uint32_t bits)
+		{
+			const uint32_t max = (1u << bits) - 1;
+			uint32_t res = 0;
+			for (int c = 0; c < 3; ++c)
+				res = (res << bits) | uint32_t(std::min(std::max(color[c], 0.0f), 1.0f) * float(max) + 0.5f);
+			return res;
+		}
+
+		glm::vec3 getPaletteColor(uint32_t index, uint32_t bits)
+		{
+			const uint32_t max = (1u << bits) - 1;
+			glm::vec3 res;
+			for (int c = 2; c >= 0; --c)
+			{
+				res[c] = float(index & max) / float(max);
+				index >>= bits;
+			}
+			return res;
+		}
+
+		/// writes points to temporary files (one per octant) with small buffers
+		class OctantFiles
+		{
+		public:
+			OctantFiles(const fs::path& prefix, size_t bufferFloats) :
+				m_bufferFloats(bufferFloats)
+			{
+				for (size_t i = 0; i < 8; ++i)
+				{
+					m_files[i] = prefix.string() + "_" + std::to_string(i) + ".tmp";
+					std::ofstream(m_files[i], std::ios::binary | std::ios::trunc);
+				}
+			}
+			/// removes the remaining files (also if the partitioning was aborted by an exception)
+			~OctantFiles()
+			{
+				for (const auto& f : m_files)
+				{
+					std::error_code ec;
+					fs::remove(f, ec);
+				}
+			}
+			OctantFiles(const OctantFiles&) = delete;
+			OctantFiles& operator=(const OctantFiles&) = delete;
+
+			void add(size_t octant, const float* vertex, size_t stride)
+			{
+				auto& b = m_buffers[octant];
+				b.insert(b.end(), vertex, vertex + stride);
+				++m_counts[octant];
+				if (b.size() >= m_bufferFloats) flush(octant);
+			}
+
+			void flush()
+			{
+				for (size_t i = 0; i < 8; ++i) flush(i);
+			}
+
+			const fs::path& getFile(size_t octant) const { return m_files[octant]; }
+			size_t getCount(size_t octant) const { return m_counts[octant]; }
+		private:
+			void flush(size_t octant)
+			{
+				auto& b = m_buffers[octant];
+				if (b.empty()) return;
+				std::ofstream file(m_files[octant], std::ios::binary | std::ios::app);
+				file.write(reinterpret_cast<const char*>(b.data()), std::streamsize(b.size() * sizeof(float)));
+				if (!file) throw std::runtime_error("could not write " + m_files[octant].string());
+				b.clear();
+			}
+
+			size_t m_bufferFloats;
+			fs::path m_files[8];
+			std::vector<float> m_buffers[8];
+			size_t m_counts[8] = {};
+		};
+
+		/// \brief random part and counter for temporary file names that do not collide between processes and concurrent imports
+		std::string getUniqueSuffix()
+		{
+			static const auto s_random = std::random_device()();
+			static std::atomic<uint32_t> s_counter{ 0 };
+			std::ostringstream ss;
+			ss << std::hex << s_random << "_" << std::dec << s_counter++;
+			return ss.str();
+		}
+
+		class PointPartitioner
+		{
+		public:
+			PointPartitioner(const PointLayout& layout, const PlySettings& settings, ImportTarget& target, fs::path tempPrefix) :
+				m_layout(layout), m_settings(settings), m_target(target), m_tempPrefix(std::move(tempPrefix)),
+				m_maxPoints(std::max<size_t>(settings.maxPointsPerMesh, 1))
+			{}
+
+			/// \brief splits the points that are provided by readChunk(floats) into meshes.
+			/// readChunk must fill the vector with vertices and return false if no vertices are left
+			void partition(const BoundingBox& bounds, size_t count, size_t depth, const std::function<bool(std::vector<float>&)>& readChunk)
+			{
+				std::vector<float> vertices;
+				if (count <= m_maxPoints || depth >= s_maxDepth)
+				{
+					// small enough (or degenerated): emit meshes with at most maxPointsPerMesh points
+					std::vector<float> chunk;
+					while (readChunk(chunk))
+					{
+						vertices.insert(vertices.end(), chunk.begin(), chunk.end());
+						while (vertices.size() >= m_maxPoints * m_layout.stride)
+						{
+							const auto end = vertices.begin() + std::ptrdiff_t(m_maxPoints * m_layout.stride);
+							emit(std::vector<float>(vertices.begin(), end));
+							vertices.erase(vertices.begin(), end);
+						}
+					}
+					if (!vertices.empty()) emit(std::move(vertices));
+					return;
+				}
+
+				// stream the points into octant files
+				const auto center = bounds.getCenter();
+				const auto prefix = m_tempPrefix.string() + "_" + std::to_string(m_nextNode++);
+				OctantFiles octants(prefix, s_octantBufferFloats);
+				BoundingBox childBounds[8];
+				for (auto& b : childBounds) b = BoundingBox::Empty();
+				std::vector<float> chunk;
+				while (readChunk(chunk))
+				{
+					for (size_t v = 0; v < chunk.size(); v += m_layout.stride)
+					{
+						const glm::vec3 p(chunk[v], chunk[v + 1], chunk[v + 2]);
+						const size_t octant = (p.x > center.x ? 1 : 0) | (p.y > center.y ? 2 : 0) | (p.z > center.z ? 4 : 0);
+						childBounds[octant].extend(p);
+						octants.add(octant, chunk.data() + v, m_layout.stride);
+					}
+				}
+				octants.flush();
+
+				for (size_t o = 0; o < 8; ++o)
+				{
+					const auto& file = octants.getFile(o);
+					if (octants.getCount(o))
+					{
+						std::ifstream in(file, std::ios::binary);
+						const size_t chunkFloats = std::max<size_t>(m_settings.chunkPoints, 1) * m_layout.stride;
+						partition(childBounds[o], octants.getCount(o), depth + 1, [&](std::vector<float>& dst)
+						{
+							dst.resize(chunkFloats);
+							in.read(reinterpret_cast<char*>(dst.data()), std::streamsize(chunkFloats * sizeof(float)));
+							dst.resize(size_t(in.gcount()) / sizeof(float) / m_layout.stride * m_layout.stride);
+							return !dst.empty();
+						});
+					}
+					std::error_code ec;
+					fs::remove(file, ec);
+				}
+			}
+		private:
+			void emit(std::vector<float> vertices)
+			{
+				bmf::BinaryMesh mesh(m_layout.attributes, std::move(vertices), {}, {});
+				m_target.addMesh(Mesh(std::move(mesh)));
+			}
+
+			static constexpr size_t s_maxDepth = 16;
+			static constexpr size_t s_octantBufferFloats = size_t(1) << 18;
+
+			const PointLayout& m_layout;
+			const PlySettings& m_settings;
+			ImportTarget& m_target;
+			fs::path m_tempPrefix;
+			size_t m_maxPoints;
+			size_t m_nextNode = 0;
+		};
+	}
+
+	void importPly(const std::filesystem::path& filename, ImportTarget& target, const PlySettings& settings)
+	{
+		if (settings.colorBits < 1 || settings.colorBits > 8)
+			throw std::runtime_error("PlySettings::colorBits must be in [1, 8]");
+		const size_t chunkPoints = std::max<size_t>(settings.chunkPoints, 1);
+
+		// pass 1: bounds and used colors
+		BoundingBox bounds = BoundingBox::Empty();
+		std::vector<uint8_t> usedColors(size_t(1) << (3 * settings.colorBits), 0);
+		PointLayout layout;
+		{
+			PlyReader reader(filename);
+			layout.attributes = bmf::Position | bmf::Material;
+			if (reader.hasNormals()) layout.attributes |= bmf::Normal;
+			if (reader.hasRadius() && settings.radiusAsTexcoord) layout.attributes |= bmf::Texcoord0;
+
+			std::vector<PlyPoint> points;
+			while (reader.read(chunkPoints, points))
+			{
+				for (const auto& p : points)
+				{
+					bounds.extend(p.position * settings.scale);
+					usedColors[getPaletteIndex(p.color, settings.colorBits)] = 1;
+				}
+			}
+		}
+		layout.stride = bmf::getAttributeElementStride(layout.attributes);
+		layout.normalOffset = bmf::getAttributeElementOffset(layout.attributes, bmf::Normal);
+		layout.texcoordOffset = bmf::getAttributeElementOffset(layout.attributes, bmf::Texcoord0);
+		layout.materialOffset = bmf::getAttributeElementOffset(layout.attributes, bmf::Material);
+
+		// one material per used palette color (in palette order => deterministic)
+		std::vector<Material> materials;
+		std::vector<uint32_t> paletteMaterial(usedColors.size(), 0);
+		for (uint32_t i = 0; i < uint32_t(usedColors.size()); ++i)
+		{
+			if (!usedColors[i]) continue;
+			const auto color = getPaletteColor(i, settings.colorBits);
+			char name[16];
+			std::snprintf(name, sizeof(name), "point%02X%02X%02X", toSrgb8(fromSrgb(color.x)), toSrgb8(fromSrgb(color.y)), toSrgb8(fromSrgb(color.z)));
+			paletteMaterial[i] = uint32_t(materials.size());
+			materials.emplace_back();
+			materials.back().name = name;
+			materials.back().data = MaterialData::Default();
+			materials.back().data.albedo = fromSrgb(color);
+		}
+		usedColors = {};
+		target.setMaterials(std::move(materials));
+
+		// pass 2: convert to the vertex layout and split spatially
+		PlyReader reader(filename);
+		std::vector<PlyPoint> points;
+		auto tempDirectory = settings.tempDirectory.empty() ? fs::temp_directory_path() : settings.tempDirectory;
+		const auto tempPrefix = tempDirectory / ("hrsf_ply_" + getUniqueSuffix());
+		PointPartitioner partitioner(layout, settings, target, tempPrefix);
+		partitioner.partition(bounds, reader.getVertexCount(), 0, [&](std::vector<float>& dst)
+		{
+			if (!reader.read(chunkPoints, points)) return false;
+			dst.assign(points.size() * layout.stride, 0.0f);
+			parallelFor(0, points.size(), [&](size_t i)
+			{
+				const auto& p = points[i];
+				float* v = dst.data() + i * layout.stride;
+				const auto pos = p.position * settings.scale;
+				v[0] = pos.x; v[1] = pos.y; v[2] = pos.z;
+				if (layout.attributes & bmf::Normal)
+				{
+					v[layout.normalOffset] = p.normal.x;
+					v[layout.normalOffset + 1] = p.normal.y;
+					v[layout.normalOffset + 2] = p.normal.z;
+				}
+				if (layout.attributes & bmf::Texcoord0)
+					v[layout.texcoordOffset] = p.radius * settings.scale;
+				const uint32_t materialId = paletteMaterial[getPaletteIndex(p.color, settings.colorBits)];
+				std::memcpy(v + layout.materialOffset, &materialId, sizeof(materialId));
+			}, 4096);
+			return true;
+		});
+
+		target.setLights({});
+	}
+}
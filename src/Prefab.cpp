@@ -0,0 +1,262 @@
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+
+namespace hrsf
+{
+	namespace
+	{
+		Path transformPath(const Path& path, const glm::mat3& linear)
+		{
+			if (path.isStatic()) return path;
+			// path positions are offsets => no translation
+			auto sections = path.getSections();
+			for (auto& s : sections)
+				s.position = linear * s.position;
+			return Path(std::move(sections), path.getScale());
+		}
+
+		template<class IndexT>
+		void transformVertices(bmf::BinaryMeshT<IndexT>& mesh, const glm::mat4& transform)
+		{
+			const auto attributes = mesh.getAttributes();
+			const auto stride = bmf::getAttributeElementStride(attributes);
+			if (!stride) return;
+			const auto positionOffset = bmf::getAttributeElementOffset(attributes, bmf::Position);
+			const auto normalOffset = bmf::getAttributeElementOffset(attributes, bmf::Normal);
+			const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+
+			auto& vertices = mesh.getVertices();
+			for (size_t v = 0; v + stride <= vertices.size(); v += stride)
+			{
+				if (attributes & bmf::Position)
+				{
+					float* p = vertices.data() + v + positionOffset;
+					const auto res = glm::vec3(transform * glm::vec4(p[0], p[1], p[2], 1.0f));
+					p[0] = res.x; p[1] = res.y; p[2] = res.z;
+				}
+				if (attributes & bmf::Normal)
+				{
+					float* n = vertices.data() + v + normalOffset;
+					auto res = normalMatrix * glm::vec3(n[0], n[1], n[2]);
+					const float len = glm::length(res);
+					if (len > 0.0f) res /= len;
+					n[0] = res.x; n[1] = res.y; n[2] = res.z;
+				}
+			}
+		}
+
+		glm::mat4 loadTransformJson(const nlohmann::json& j)
+		{
+			if (j.count("matrix"))
+			{
+				const auto m = j["matrix"].get<std::vector<float>>();
+				if (m.size() != 16)
+					throw std::runtime_error("reference matrix must have 16 elements");
+				glm::mat4 res;
+				for (int c = 0; c < 4; ++c)
+					for (int r = 0; r < 4; ++r)
+						res[c][r] = m[c * 4 + r];
+				return res;
+			}
+
+			const auto t = j.value("translation", std::vector<float>{ 0.0f, 0.0f, 0.0f });
+			const auto r = j.value("rotation", std::vector<float>{ 0.0f, 0.0f, 0.0f, 1.0f }); // x y z w
+			const auto s = j.value("scale", std::vector<float>{ 1.0f, 1.0f, 1.0f });
+			if (t.size() != 3 || r.size() != 4 || s.size() != 3)
+				throw std::runtime_error("invalid reference transform");
+			glm::mat4 res = glm::mat4_cast(glm::quat(r[3], r[0], r[1], r[2]));
+			for (int c = 0; c < 3; ++c)
+				res[c] = res[c] * s[c];
+			res[3] = glm::vec4(t[0], t[1], t[2], 1.0f);
+			return res;
+		}
+
+		fs::path getReferenceKey(const fs::path& file)
+		{
+			return fs::absolute(fs::path(file).replace_extension(".json")).lexically_normal();
+		}
+	}
+
+	Mesh transformMesh(const Mesh& mesh, const glm::mat4& transform, uint32_t materialOffset)
+	{
+		// the lookAt rotation pivots around the mesh space origin, which would move with baked vertices
+		if (!mesh.lookAt.isStatic() && glm::vec3(transform[3]) != glm::vec3(0.0f))
+			throw std::runtime_error("meshes with a lookAt path cannot be instanced with a translation");
+
+		auto res = mesh;
+		const glm::mat3 linear = glm::mat3(transform);
+		if (res.type == Mesh::Triangle)
+		{
+			transformVertices(res.triangle, transform);
+			res.triangle.offsetMaterial(materialOffset);
+			// mirroring transforms flip the winding order
+			if (glm::determinant(linear) < 0.0f)
+			{
+				auto& indices = res.triangle.getIndices();
+				for (size_t i = 0; i + 2 < indices.size(); i += 3)
+					std::swap(indices[i + 1], indices[i + 2]);
+			}
+		}
+		else
+		{
+			transformVertices(res.billboard, transform);
+			res.billboard.offsetMaterial(materialOffset);
+		}
+		res.position = transformPath(mesh.position, linear);
+		res.lookAt = transformPath(mesh.lookAt, linear);
+		return res;
+	}
+
+	Light transformLight(const Light& light, const glm::mat4& transform)
+	{
+		auto res = light;
+		const glm::mat3 linear = glm::mat3(transform);
+		if (light.data.type == LightData::Directional)
+			res.data.direction = glm::normalize(linear * light.data.direction);
+		else
+		{
+			res.data.position = glm::vec3(transform * glm::vec4(light.data.position, 1.0f));
+			// largest axis scale => the radius is not underestimated for non uniform scales
+			res.data.radius *= std::max(glm::length(linear[0]), std::max(glm::length(linear[1]), glm::length(linear[2])));
+		}
+		res.path = transformPath(light.path, linear);
+		return res;
+	}
+
+	const std::vector<SceneReference>& SceneFormat::getReferences() const
+	{
+		return m_references;
+	}
+
+	const std::vector<Prefab>& SceneFormat::getPrefabs() const
+	{
+		return m_prefabs;
+	}
+
+	const std::vector<PrefabInstance>& SceneFormat::getInstances() const
+	{
+		return m_instances;
+	}
+
+	void SceneFormat::addReference(const fs::path& file, const glm::mat4& transform, Component components)
+	{
+		m_references.push_back({ getReferenceKey(file), transform });
+		std::vector<fs::path> stack;
+		addInstances(m_references.back().file, transform, components, stack);
+	}
+
+	void SceneFormat::addInstances(const fs::path& file, const glm::mat4& transform, Component components, std::vector<fs::path>& stack)
+	{
+		const auto key = getReferenceKey(file);
+		if (std::find(stack.begin(), stack.end(), key) != stack.end())
+			throw std::runtime_error(key.string() + " references itself");
+
+		auto prefab = std::find_if(m_prefabs.begin(), m_prefabs.end(), [&key](const Prefab& p) { return p.file == key; });
+		if (prefab == m_prefabs.end())
+		{
+			const auto loadComponents = Component(uint32_t(components) & uint32_t(Component::Mesh | Component::Material | Component::Lights));
+			auto scene = std::make_shared<SceneFormat>(loadUnresolved(key, loadComponents));
+			const auto offset = uint32_t(m_materials.size());
+			m_materials.insert(m_materials.end(), scene->m_materials.begin(), scene->m_materials.end());
+			m_prefabs.push_back({ key, std::move(scene), offset });
+			prefab = m_prefabs.end() - 1;
+		}
+
+		const auto prefabIndex = uint32_t(prefab - m_prefabs.begin());
+		m_instances.push_back({ prefabIndex, transform });
+
+		// nested references (the scene pointer stays valid if m_prefabs grows)
+		const auto scene = prefab->scene;
+		stack.push_back(key);
+		for (const auto& r : scene->m_references)
+			addInstances(r.file, transform * r.transform, components, stack);
+		stack.pop_back();
+	}
+
+	size_t SceneFormat::getOwnMaterialCount() const
+	{
+		return m_prefabs.empty() ? m_materials.size() : m_prefabs.front().materialOffset;
+	}
+
+	std::vector<Mesh> SceneFormat::getInstanceMeshes(size_t instance) const
+	{
+		const auto& i = m_instances.at(instance);
+		const auto& prefab = m_prefabs[i.prefab];
+		std::vector<Mesh> res;
+		res.reserve(prefab.scene->m_meshes.size());
+		for (const auto& m : prefab.scene->m_meshes)
+			res.push_back(transformMesh(m, i.transform, prefab.materialOffset));
+		return res;
+	}
+
+	std::vector<Light> SceneFormat::getInstanceLights(size_t instance) const
+	{
+		const auto& i = m_instances.at(instance);
+		std::vector<Light> res;
+		for (const auto& l : m_prefabs[i.prefab].scene->m_lights)
+			res.push_back(transformLight(l, i.transform));
+		return res;
+	}
+
+	void SceneFormat::expandReferences()
+	{
+		if (m_instances.empty()) return;
+
+		std::vector<std::vector<Mesh>> meshes(m_instances.size());
+		parallelFor(0, m_instances.size(), [&](size_t i)
+		{
+			meshes[i] = getInstanceMeshes(i);
+		});
+
+		size_t meshCount = m_meshes.size();
+		for (const auto& m : meshes) meshCount += m.size();
+		m_meshes.reserve(meshCount);
+		for (size_t i = 0; i < m_instances.size(); ++i)
+		{
+			for (auto& m : meshes[i])
+				m_meshes.push_back(std::move(m));
+			for (auto& l : getInstanceLights(i))
+				m_lights.push_back(std::move(l));
+		}
+
+		m_references.clear();
+		m_prefabs.clear();
+		m_instances.clear();
+	}
+
+	SceneFormat SceneFormat::getExpanded() const
+	{
+		SceneFormat res(m_meshes, m_camera, m_lights, m_materials, m_environment);
+		res.m_benchmarkCameras = m_benchmarkCameras;
+		res.m_references = m_references;
+		res.m_prefabs = m_prefabs;
+		res.m_instances = m_instances;
+		res.expandReferences();
+		return res;
+	}
+
+	SceneFormat::json SceneFormat::getReferencesJson(const std::vector<SceneReference>& references, const fs::path& root)
+	{
+		auto res = json::array();
+		for (const auto& r : references)
+		{
+			std::vector<float> matrix;
+			for (int c = 0; c < 4; ++c)
+				for (int row = 0; row < 4; ++row)
+					matrix.push_back(r.transform[c][row]);
+			res.push_back({ {"file", getRelativePath(root, r.file)}, {"matrix", matrix} });
+		}
+		return res;
+	}
+
+	std::vector<SceneReference> SceneFormat::loadReferencesJson(const json& j, const fs::path& root)
+	{
+		std::vector<SceneReference> res;
+		for (const auto& r : j)
+			res.push_back({ getReferenceKey(getAbsolutePath(root, r["file"].get<std::string>())), loadTransformJson(r) });
+		return res;
+	}
+}
@@ -0,0 +1,510 @@
+#include "../include/hrsf/Pvs.h"
+#include "../include/hrsf/Bounds.h"
+#include "../include/hrsf/Cache.h"
+#include "../include/hrsf/Parallel.h"
+#include "../include/hrsf/SceneFormat.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr uint32_t s_magic = 0x56505248; // "HRPV"
+		constexpr uint32_t s_fileVersion = 3;
+
+		struct Triangle
+		{
+			glm::vec3 v[3];
+			uint32_t entry;
+		};
+
+		/// consecutive triangles of one entry with their bounds (unit of the frustum culling)
+		struct TriangleCluster
+		{
+			uint32_t first;
+			uint32_t count;
+			BoundingBox bounds;
+		};
+
+		constexpr uint32_t s_clusterSize = 64;
+
+		struct Point
+		{
+			glm::vec3 p;
+			uint32_t entry;
+		};
+
+		struct FaceBasis
+		{
+			glm::vec3 right;
+			glm::vec3 up;
+			glm::vec3 forward;
+		};
+
+		// +x, -x, +y, -y, +z, -z
+		const FaceBasis s_faces[6] = {
+			{ { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } },
+			{ { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f }, { -1.0f, 0.0f, 0.0f } },
+			{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f, 0.0f } },
+			{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, -1.0f, 0.0f } },
+			{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } },
+			{ { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, -1.0f } },
+		};
+
+		/// 90 degree cube face rasterizer with a 1 / depth buffer.
+		/// Both passes are conservative: occluders only write pixels that they cover completely (with their farthest depth in the pixel),
+		/// occludees are tested against every pixel that they touch (with their nearest depth in the pixel)
+		class Rasterizer
+		{
+		public:
+			Rasterizer(uint32_t resolution, float near)
+				:
+				m_res(resolution),
+				m_near(near),
+				m_invDepth(size_t(resolution) * resolution)
+			{}
+
+			void clear()
+			{
+				std::fill(m_invDepth.begin(), m_invDepth.end(), 0.0f);
+			}
+
+			/// \brief writes the depth of the pixels that are completely covered by the triangle
+			void drawOccluder(const glm::vec3* view)
+			{
+				glm::vec3 poly[4];
+				const int count = clip(view, poly);
+				if (count < 3) return;
+				rasterize(poly[0], poly[1], poly[2], true);
+				if (count == 4) rasterize(poly[0], poly[2], poly[3], true);
+			}
+
+			/// \return true if the triangle touches a pixel in which it is not occluded
+			bool testTriangle(const glm::vec3* view)
+			{
+				glm::vec3 poly[4];
+				const int count = clip(view, poly);
+				if (count < 3) return false;
+				return rasterize(poly[0], poly[1], poly[2], false) || (count == 4 && rasterize(poly[0], poly[2], poly[3], false));
+			}
+
+			/// \return true if the point is not occluded
+			bool testPoint(const glm::vec3& view) const
+			{
+				if (view.z < m_near) return false;
+				const float sx = (view.x / view.z * 0.5f + 0.5f) * float(m_res);
+				const float sy = (view.y / view.z * 0.5f + 0.5f) * float(m_res);
+				if (sx < 0.0f || sy < 0.0f || sx >= float(m_res) || sy >= float(m_res)) return false;
+				const size_t idx = size_t(sy) * m_res + size_t(sx);
+				return 1.0f / view.z >= m_invDepth[idx] * 0.999f;
+			}
+		private:
+			/// \brief clips the triangle against the near plane (Sutherland-Hodgman, at most 4 vertices)
+			int clip(const glm::vec3* view, glm::vec3* poly) const
+			{
+				int count = 0;
+				for (int i = 0; i < 3; ++i)
+				{
+					const auto& a = view[i];
+					const auto& b = view[(i + 1) % 3];
+					const bool aIn = a.z >= m_near;
+					const bool bIn = b.z >= m_near;
+					if (aIn) poly[count++] = a;
+					if (aIn != bIn)
+						poly[count++] = a + (b - a) * ((m_near - a.z) / (b.z - a.z));
+				}
+				return count;
+			}
+
+			/// \param occluder true: write the depth of completely covered pixels, false: test all touched pixels
+			/// \return true if the triangle is not occluded in a touched pixel (only for occluder = false)
+			bool rasterize(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, bool occluder)
+			{
+				const float res = float(m_res);
+				// screen position (x, y) and 1 / depth
+				const auto project = [res](const glm::vec3& v)
+				{
+					return glm::vec3((v.x / v.z * 0.5f + 0.5f) * res, (v.y / v.z * 0.5f + 0.5f) * res, 1.0f / v.z);
+				};
+				glm::vec3 p0 = project(a), p1 = project(b), p2 = project(c);
+
+				float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+				if (area == 0.0f) return false;
+				// no back face culling (conservative)
+				if (area < 0.0f)
+				{
+					std::swap(p1, p2);
+					area = -area;
+				}
+
+				const float boundsMinX = std::min(p0.x, std::min(p1.x, p2.x));
+				const float boundsMinY = std::min(p0.y, std::min(p1.y, p2.y));
+				const float boundsMaxX = std::max(p0.x, std::max(p1.x, p2.x));
+				const float boundsMaxY = std::max(p0.y, std::max(p1.y, p2.y));
+				if (boundsMaxX < 0.0f || boundsMaxY < 0.0f || boundsMinX > res || boundsMinY > res) return false;
+
+				// pixels that touch the bounding box
+				const auto toPixel = [res](float v) { return int(std::floor(std::min(std::max(v, 0.0f), res - 1.0f))); };
+				const int minX = toPixel(boundsMinX);
+				const int minY = toPixel(boundsMinY);
+				const int maxX = toPixel(boundsMaxX);
+				const int maxY = toPixel(boundsMaxY);
+
+				// edge functions w(x, y) = dx * x + dy * y + offset (>= 0 inside). Within a pixel, w varies by +-extent around the center
+				struct Edge { float dx, dy, offset, extent; };
+				const auto makeEdge = [](const glm::vec3& e0, const glm::vec3& e1)
+				{
+					Edge e;
+					e.dx = -(e1.y - e0.y);
+					e.dy = e1.x - e0.x;
+					e.offset = -e.dx * e0.x - e.dy * e0.y;
+					e.extent = 0.5f * (std::abs(e.dx) + std::abs(e.dy));
+					return e;
+				};
+				const Edge edges[3] = { makeEdge(p1, p2), makeEdge(p2, p0), makeEdge(p0, p1) };
+
+				// 1 / depth is linear in screen space. Clamp to the vertex range because the plane is extrapolated beyond the edges
+				const float invArea = 1.0f / area;
+				const float dzdx = (edges[0].dx * p0.z + edges[1].dx * p1.z + edges[2].dx * p2.z) * invArea;
+				const float dzdy = (edges[0].dy * p0.z + edges[1].dy * p1.z + edges[2].dy * p2.z) * invArea;
+				const float dzOffset = (edges[0].offset * p0.z + edges[1].offset * p1.z + edges[2].offset * p2.z) * invArea;
+				const float zExtent = 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+				const float zMin = std::min(p0.z, std::min(p1.z, p2.z));
+				const float zMax = std::max(p0.z, std::max(p1.z, p2.z));
+
+				for (int y = minY; y <= maxY; ++y)
+				{
+					const float py = float(y) + 0.5f;
+					for (int x = minX; x <= maxX; ++x)
+					{
+						const float px = float(x) + 0.5f;
+						bool touched = true;
+						bool covered = true;
+						for (const auto& e : edges)
+						{
+							const float w = e.dx * px + e.dy * py + e.offset;
+							touched = touched && w + e.extent >= 0.0f;
+							covered = covered && w - e.extent >= 0.0f;
+						}
+
+						const float invDepth = dzdx * px + dzdy * py + dzOffset;
+						const size_t idx = size_t(y) * m_res + size_t(x);
+						if (occluder)
+						{
+							if (covered)
+								m_invDepth[idx] = std::max(m_invDepth[idx], std::max(invDepth - zExtent, zMin));
+						}
+						else if (touched && std::min(invDepth + zExtent, zMax) >= m_invDepth[idx] * 0.999f)
+							return true;
+					}
+				}
+				return false;
+			}
+
+			uint32_t m_res;
+			float m_near;
+			std::vector<float> m_invDepth;
+		};
+
+		/// \brief splits the triangles into clusters of at most s_clusterSize triangles of the same entry
+		std::vector<TriangleCluster> getClusters(const std::vector<Triangle>& tris)
+		{
+			std::vector<TriangleCluster> clusters;
+			for (uint32_t i = 0; i < uint32_t(tris.size()); ++i)
+			{
+				if (clusters.empty() || clusters.back().count == s_clusterSize || tris[clusters.back().first].entry != tris[i].entry)
+					clusters.push_back({ i, 0, BoundingBox::Empty() });
+				auto& c = clusters.back();
+				++c.count;
+				for (const auto& v : tris[i].v)
+					c.bounds.extend(v);
+			}
+			return clusters;
+		}
+
+		/// \brief false if the box is completely outside the 90 degree frustum of the face (or behind the near plane)
+		bool isBoxInFace(const BoundingBox& box, const glm::vec3& eye, const FaceBasis& face, float near)
+		{
+			const auto d = box.getCenter() - eye;
+			const auto e = (box.max - box.min) * 0.5f;
+			const glm::vec3 c(glm::dot(d, face.right), glm::dot(d, face.up), glm::dot(d, face.forward));
+			const glm::vec3 r(glm::dot(glm::abs(face.right), e), glm::dot(glm::abs(face.up), e), glm::dot(glm::abs(face.forward), e));
+			// maximum of z - near, z - |x| and z - |y| over the box
+			if (c.z + r.z < near) return false;
+			if (c.z - std::abs(c.x) + r.z + r.x < 0.0f) return false;
+			if (c.z - std::abs(c.y) + r.z + r.y < 0.0f) return false;
+			return true;
+		}
+
+		float getPathDuration(const Path& path)
+		{
+			float res = 0.0f;
+			for (const auto& s : path.getSections())
+				res += s.time;
+			return res;
+		}
+
+		template<class IndexT>
+		void addShapes(const bmf::BinaryMeshT<IndexT>& mesh, const std::vector<bmf::Shape>& shapes, uint32_t firstEntry, bool triangles,
+			std::vector<Triangle>& tris, std::vector<Point>& points)
+		{
+			const auto stride = bmf::getAttributeElementStride(mesh.getAttributes());
+			const auto offset = bmf::getAttributeElementOffset(mesh.getAttributes(), bmf::Position);
+			const auto& vertices = mesh.getVertices();
+			const auto& indices = mesh.getIndices();
+			const auto getVertex = [&](size_t v)
+			{
+				const float* p = vertices.data() + v * stride + offset;
+				return glm::vec3(p[0], p[1], p[2]);
+			};
+
+			for (uint32_t s = 0; s < uint32_t(shapes.size()); ++s)
+			{
+				const auto& shape = shapes[s];
+				if (triangles)
+				{
+					for (size_t i = shape.indexOffset; i + 2 < size_t(shape.indexOffset) + shape.indexCount; i += 3)
+					{
+						Triangle t;
+						for (int k = 0; k < 3; ++k)
+							t.v[k] = getVertex(size_t(indices[i + k]) + shape.vertexOffset);
+						t.entry = firstEntry + s;
+						tris.push_back(t);
+					}
+				}
+				else
+				{
+					for (size_t v = shape.vertexOffset; v < size_t(shape.vertexOffset) + shape.vertexCount; ++v)
+						points.push_back({ getVertex(v), firstEntry + s });
+				}
+			}
+		}
+	}
+
+	Pvs Pvs::build(const SceneFormat& scene, const PvsSettings& settings)
+	{
+		if (settings.cellDuration <= 0.0f || settings.samplesPerCell == 0 || settings.resolution == 0 || settings.near <= 0.0f)
+			throw std::runtime_error("invalid pvs settings");
+
+		// sets store indices into getMeshes()
+		if (!scene.getInstances().empty())
+			throw std::runtime_error("pvs: the scene has prefab instances, call SceneFormat::expandReferences() first");
+
+		Pvs pvs;
+		pvs.m_cellDuration = settings.cellDuration;
+
+		// camera path
+		const auto& camera = scene.getCamera();
+		pvs.m_duration = getPathDuration(camera.positionPath);
+		pvs.m_cellCount = std::max(uint32_t(std::ceil(pvs.m_duration / settings.cellDuration)), 1u);
+		float start = 0.0f;
+		for (const auto& s : camera.positionPath.getSections())
+		{
+			pvs.m_sectionStart.push_back(start);
+			start += s.time;
+		}
+
+		// geometry
+		std::vector<Triangle> tris;
+		std::vector<Point> points;
+		std::vector<uint32_t> alwaysVisible;
+		const auto& meshes = scene.getMeshes();
+		for (uint32_t m = 0; m < uint32_t(meshes.size()); ++m)
+		{
+			const auto& mesh = meshes[m];
+			const auto first = uint32_t(pvs.m_entries.size());
+			const auto shapeCount = uint32_t(getShapeBounds(mesh).size());
+			for (uint32_t s = 0; s < shapeCount; ++s)
+				pvs.m_entries.push_back({ m, s });
+
+			if (!mesh.isStatic())
+			{
+				for (uint32_t s = 0; s < shapeCount; ++s)
+					alwaysVisible.push_back(first + s);
+				continue;
+			}
+
+			if (mesh.type == Mesh::Triangle)
+				addShapes(mesh.triangle, mesh.triangle.getShapes(), first, true, tris, points);
+			else if (!mesh.billboard.getShapes().empty())
+				addShapes(mesh.billboard, mesh.billboard.getShapes(), first, false, tris, points);
+			else
+			{
+				const std::vector<bmf::Shape> all = { bmf::Shape{ 0, 0, 0, uint32_t(mesh.billboard.getNumVertices()), 0 } };
+				addShapes(mesh.billboard, all, first, false, tris, points);
+			}
+		}
+
+		pvs.m_wordsPerCell = (pvs.m_entries.size() + 63) / 64;
+		pvs.m_bits.assign(pvs.m_wordsPerCell * pvs.m_cellCount, 0);
+		const auto clusters = getClusters(tris);
+
+		// one rasterizer and scratch buffer per worker, the workers take interleaved cells
+		const size_t workerCount = std::min<size_t>(getThreadCount(), pvs.m_cellCount);
+		parallelFor(0, workerCount, [&](size_t worker)
+		{
+			Rasterizer raster(settings.resolution, settings.near);
+			std::vector<glm::vec3> viewTris; // triangles of the clusters in the face frustum
+			std::vector<uint32_t> viewEntries;
+
+			for (size_t cell = worker; cell < pvs.m_cellCount; cell += workerCount)
+			{
+				uint64_t* bits = pvs.m_bits.data() + cell * pvs.m_wordsPerCell;
+				const auto setBit = [bits](uint32_t e) { bits[e / 64] |= uint64_t(1) << (e % 64); };
+				for (auto e : alwaysVisible)
+					setBit(e);
+
+				for (uint32_t sample = 0; sample < settings.samplesPerCell; ++sample)
+				{
+					// camera position at the sample time
+					const float t = std::min((float(cell) + (float(sample) + 0.5f) / float(settings.samplesPerCell)) * settings.cellDuration, pvs.m_duration);
+					auto path = camera.positionPath;
+					path.reset();
+					path.update(t);
+					const auto eye = camera.data.position + path.getPosition();
+
+					for (const auto& face : s_faces)
+					{
+						const auto toView = [&](const glm::vec3& p)
+						{
+							const auto d = p - eye;
+							return glm::vec3(glm::dot(d, face.right), glm::dot(d, face.up), glm::dot(d, face.forward));
+						};
+
+						viewTris.clear();
+						viewEntries.clear();
+						for (const auto& c : clusters)
+						{
+							if (!isBoxInFace(c.bounds, eye, face, settings.near)) continue;
+							for (uint32_t i = c.first; i < c.first + c.count; ++i)
+							{
+								for (int k = 0; k < 3; ++k)
+									viewTris.push_back(toView(tris[i].v[k]));
+								viewEntries.push_back(tris[i].entry);
+							}
+						}
+
+						raster.clear();
+						for (size_t i = 0; i < viewEntries.size(); ++i)
+							raster.drawOccluder(viewTris.data() + i * 3);
+						for (size_t i = 0; i < viewEntries.size(); ++i)
+						{
+							const auto e = viewEntries[i];
+							if (!(bits[e / 64] >> (e % 64) & 1) && raster.testTriangle(viewTris.data() + i * 3)) setBit(e);
+						}
+						for (const auto& p : points)
+							if (raster.testPoint(toView(p.p))) setBit(p.entry);
+					}
+				}
+			}
+		});
+
+		return pvs;
+	}
+
+	uint32_t Pvs::getCell(const PathCursor& cursor) const
+	{
+		if (m_sectionStart.empty()) return 0;
+		return getCell(m_sectionStart[std::min(cursor.section, m_sectionStart.size() - 1)] + cursor.time);
+	}
+
+	uint32_t Pvs::getCell(float time) const
+	{
+		if (m_cellCount <= 1 || m_duration <= 0.0f) return 0;
+		// the last cell may be shorter => wrap with the path duration
+		time = std::fmod(std::max(time, 0.0f), m_duration);
+		return std::min(uint32_t(time / m_cellDuration), m_cellCount - 1);
+	}
+
+	size_t Pvs::getVisibleCount(uint32_t cell) const
+	{
+		size_t count = 0;
+		const auto* bits = getBits(cell);
+		for (size_t i = 0; i < m_wordsPerCell; ++i)
+			for (uint64_t w = bits[i]; w; w &= w - 1)
+				++count;
+		return count;
+	}
+
+	void Pvs::save(const std::filesystem::path& filename) const
+	{
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not save " + filename.string());
+
+		const uint32_t header[6] = { s_magic, s_fileVersion, m_cellCount, uint32_t(m_sectionStart.size()), uint32_t(m_entries.size()), uint32_t(m_wordsPerCell) };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&m_cellDuration), sizeof(m_cellDuration));
+		file.write(reinterpret_cast<const char*>(&m_duration), sizeof(m_duration));
+		file.write(reinterpret_cast<const char*>(m_sectionStart.data()), std::streamsize(m_sectionStart.size() * sizeof(float)));
+		file.write(reinterpret_cast<const char*>(m_entries.data()), std::streamsize(m_entries.size() * sizeof(PvsEntry)));
+		file.write(reinterpret_cast<const char*>(m_bits.data()), std::streamsize(m_bits.size() * sizeof(uint64_t)));
+		if (!file)
+			throw std::runtime_error("could not write " + filename.string());
+	}
+
+	Pvs Pvs::load(const std::filesystem::path& filename)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not open " + filename.string());
+
+		uint32_t header[6];
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		if (!file || header[0] != s_magic || header[1] != s_fileVersion)
+			throw std::runtime_error(filename.string() + " is not a valid pvs file");
+
+		Pvs pvs;
+		pvs.m_cellCount = header[2];
+		pvs.m_sectionStart.resize(header[3]);
+		pvs.m_entries.resize(header[4]);
+		pvs.m_wordsPerCell = header[5];
+		if (pvs.m_wordsPerCell != (pvs.m_entries.size() + 63) / 64)
+			throw std::runtime_error(filename.string() + " is not a valid pvs file");
+		pvs.m_bits.resize(pvs.m_wordsPerCell * pvs.m_cellCount);
+		file.read(reinterpret_cast<char*>(&pvs.m_cellDuration), sizeof(pvs.m_cellDuration));
+		file.read(reinterpret_cast<char*>(&pvs.m_duration), sizeof(pvs.m_duration));
+		file.read(reinterpret_cast<char*>(pvs.m_sectionStart.data()), std::streamsize(pvs.m_sectionStart.size() * sizeof(float)));
+		file.read(reinterpret_cast<char*>(pvs.m_entries.data()), std::streamsize(pvs.m_entries.size() * sizeof(PvsEntry)));
+		file.read(reinterpret_cast<char*>(pvs.m_bits.data()), std::streamsize(pvs.m_bits.size() * sizeof(uint64_t)));
+		if (!file)
+			throw std::runtime_error("unexpected end of " + filename.string());
+		return pvs;
+	}
+
+	Pvs Pvs::loadOrBuild(const std::filesystem::path& sceneFile, const SceneFormat& scene, const PvsSettings& settings)
+	{
+		// key: file version (changes with the rasterization), settings, camera path and geometry (buffers and shapes)
+		const auto& camera = scene.getCamera();
+		const auto& sections = camera.positionPath.getSections();
+		uint64_t key = combineKeys(s_fileVersion, hashData(&settings, sizeof(settings)));
+		key = combineKeys(key, hashData(&camera.data.position, sizeof(camera.data.position)));
+		key = combineKeys(key, hashData(sections.data(), sections.size() * sizeof(PathSection)));
+		const float scale = camera.positionPath.getScale();
+		key = combineKeys(key, hashData(&scale, sizeof(scale)));
+		for (const auto& m : scene.getMeshes())
+		{
+			const auto& vertices = m.type == Mesh::Triangle ? m.triangle.getVertices() : m.billboard.getVertices();
+			key = combineKeys(key, hashData(vertices.data(), vertices.size() * sizeof(float)));
+			if (m.type == Mesh::Triangle)
+				key = combineKeys(key, hashData(m.triangle.getIndices().data(), m.triangle.getIndices().size() * sizeof(uint16_t)));
+			// entries are per shape => a different partition of the same buffers needs a different cache
+			const auto& shapes = m.type == Mesh::Triangle ? m.triangle.getShapes() : m.billboard.getShapes();
+			key = combineKeys(key, hashData(shapes.data(), shapes.size() * sizeof(bmf::Shape)));
+			key = combineKeys(key, uint64_t(m.isStatic()));
+		}
+
+		const auto cacheName = getCacheFilename(sceneFile, key, ".pvs");
+		if (std::filesystem::exists(cacheName))
+			return load(cacheName);
+
+		auto pvs = build(scene, settings);
+		writeCacheFile(cacheName, [&](const std::filesystem::path& f) { pvs.save(f); });
+		return pvs;
+	}
+}
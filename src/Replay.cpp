@@ -0,0 +1,146 @@
+#include "../include/hrsf/Replay.h"
+#include "../include/hrsf/SceneFormat.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace hrsf
+{
+	ReplayDriver::ReplayDriver(const SceneFormat& scene, const BenchmarkCamera& camera, const ReplaySettings& settings)
+		:
+		m_scene(scene),
+		m_camera(camera),
+		m_settings(settings)
+	{
+		if (settings.timeStep <= 0.0f)
+			throw std::runtime_error("replay time step must be greater than zero");
+		if (camera.duration < 0.0f)
+			throw std::runtime_error("benchmark camera " + camera.name + " has a negative duration");
+		// the statistics only cover getMeshes() and getLights()
+		if (!scene.getInstances().empty())
+			throw std::runtime_error("replay: the scene has prefab instances, call SceneFormat::expandReferences() first");
+
+		// small epsilon => a duration that is a multiple of the time step includes the last frame
+		m_frameCount = uint32_t(std::floor(camera.duration / settings.timeStep + 1e-4f)) + 1;
+
+		for (uint32_t m = 0; m < uint32_t(scene.getMeshes().size()); ++m)
+		{
+			const auto& mesh = scene.getMeshes()[m];
+			m_meshPaths.emplace_back(mesh.position, mesh.lookAt);
+
+			const auto bounds = getShapeBounds(mesh);
+			for (size_t s = 0; s < bounds.size(); ++s)
+			{
+				m_shapeMesh.push_back(m);
+				m_shapeBounds.push_back(bounds[s]);
+				if (mesh.type == Mesh::Triangle)
+					m_shapePrimitives.push_back(mesh.triangle.getShapes()[s].indexCount / 3);
+				else if (mesh.billboard.getShapes().empty())
+					m_shapePrimitives.push_back(uint32_t(mesh.billboard.getNumVertices()));
+				else
+					m_shapePrimitives.push_back(mesh.billboard.getShapes()[s].vertexCount);
+			}
+		}
+		for (const auto& l : scene.getLights())
+			m_lightPaths.push_back(l.path);
+
+		reset();
+	}
+
+	void ReplayDriver::reset()
+	{
+		m_camera.camera.positionPath.reset();
+		m_camera.camera.lookAtPath.reset();
+		for (auto& p : m_meshPaths)
+		{
+			p.first.reset();
+			p.second.reset();
+		}
+		for (auto& p : m_lightPaths)
+			p.reset();
+		m_frame.index = 0;
+		m_started = false;
+	}
+
+	bool ReplayDriver::next()
+	{
+		if (!m_started)
+		{
+			m_started = true;
+			computeFrame();
+			return true;
+		}
+		if (m_frame.index + 1 >= m_frameCount) return false;
+
+		const float dt = m_settings.timeStep;
+		m_camera.camera.positionPath.update(dt);
+		m_camera.camera.lookAtPath.update(dt);
+		for (auto& p : m_meshPaths)
+		{
+			p.first.update(dt);
+			p.second.update(dt);
+		}
+		for (auto& p : m_lightPaths)
+			p.update(dt);
+
+		++m_frame.index;
+		computeFrame();
+		return true;
+	}
+
+	void ReplayDriver::computeFrame()
+	{
+		auto& f = m_frame;
+		// multiplication instead of accumulation => no drift
+		f.time = float(f.index) * m_settings.timeStep;
+		f.camera = m_camera.camera.getCurrentData();
+		f.matrices = CameraMatrices::compute(f.camera, m_settings.aspect);
+
+		f.meshes.resize(m_meshPaths.size());
+		for (size_t i = 0; i < m_meshPaths.size(); ++i)
+		{
+			f.meshes[i].position = m_meshPaths[i].first.getPosition();
+			f.meshes[i].lookAt = m_meshPaths[i].second.getLookAt();
+		}
+
+		const auto& lights = m_scene.getLights();
+		f.lights.resize(lights.size());
+		for (size_t i = 0; i < lights.size(); ++i)
+		{
+			f.lights[i] = lights[i].data;
+			if (f.lights[i].type == LightData::Point)
+				f.lights[i].position += m_lightPaths[i].getPosition();
+		}
+
+		f.stats = FrameStats();
+		if (!m_settings.computeStats) return;
+
+		const auto& meshes = m_scene.getMeshes();
+		uint32_t lastVisibleMesh = uint32_t(-1);
+		for (size_t s = 0; s < m_shapeBounds.size(); ++s)
+		{
+			const auto m = m_shapeMesh[s];
+			const auto b = getWorldBounds(m_meshPaths[m].first, m_meshPaths[m].second, m_shapeBounds[s]);
+			if (b.isEmpty() || !f.matrices.frustum.isBoxVisible(b.min, b.max)) continue;
+
+			++f.stats.visibleShapes;
+			if (meshes[m].type == Mesh::Triangle) f.stats.visibleTriangles += m_shapePrimitives[s];
+			else f.stats.visibleBillboards += m_shapePrimitives[s];
+			// shapes are ordered by mesh
+			if (lastVisibleMesh != m)
+			{
+				++f.stats.visibleMeshes;
+				lastVisibleMesh = m;
+			}
+		}
+	}
+
+	std::vector<FrameStats> ReplayDriver::run()
+	{
+		reset();
+		std::vector<FrameStats> res;
+		res.reserve(m_frameCount);
+		while (next())
+			res.push_back(m_frame.stats);
+		return res;
+	}
+}
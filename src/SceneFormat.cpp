@@ -1,4 +1,7 @@
 #include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Cache.h"
+#include <cstring>
+#include <unordered_map>
 
 namespace hrsf
 {
@@ -19,6 +22,16 @@ namespace hrsf
 		return m_camera;
 	}
 
+	const std::vector<BenchmarkCamera>& SceneFormat::getBenchmarkCameras() const
+	{
+		return m_benchmarkCameras;
+	}
+
+	void SceneFormat::setBenchmarkCameras(std::vector<BenchmarkCamera> cameras)
+	{
+		m_benchmarkCameras = std::move(cameras);
+	}
+
 	const std::vector<Light>& SceneFormat::getLights() const
 	{
 		return m_lights;
@@ -40,11 +53,77 @@ namespace hrsf
 		return res;
 	}
 
+	std::vector<LightData> SceneFormat::getLightsData() const
+	{
+		std::vector<LightData> res;
+		res.resize(m_lights.size());
+		std::transform(m_lights.begin(), m_lights.end(), res.begin(), [](const Light& l)
+			{
+				return l.getCurrentData();
+			});
+		return res;
+	}
+
+	template<class T>
+	static void packLight(const LightData& src, uint8_t* dst)
+	{
+		T packed = {};
+		packed.type = src.type;
+		packed.position = src.position;
+		packed.color = src.color;
+		packed.radius = src.radius;
+		// memcpy because the mapped buffer might not be aligned
+		std::memcpy(dst, &packed, sizeof(T));
+	}
+
+	size_t SceneFormat::getLightsData(void* dst, BufferLayout layout) const
+	{
+		LightExportState state;
+		return getLightsData(dst, layout, state);
+	}
+
+	size_t SceneFormat::getLightsData(void* dst, BufferLayout layout, LightExportState& state) const
+	{
+		const auto stride = getLightStride(layout);
+		auto* bytes = static_cast<uint8_t*>(dst);
+		const bool writeAll = layout != state.layout || state.positions.size() != m_lights.size();
+		state.positions.resize(m_lights.size());
+		state.layout = layout;
+
+		size_t count = 0;
+		for (size_t i = 0; i < m_lights.size(); ++i)
+		{
+			const auto data = m_lights[i].getCurrentData();
+			if (!writeAll && data.position == state.positions[i]) continue;
+			state.positions[i] = data.position;
+
+			if (layout == BufferLayout::Scalar)
+				packLight<LightData>(data, bytes + i * stride);
+			else
+				packLight<LightDataStd430>(data, bytes + i * stride);
+			++count;
+		}
+		return count;
+	}
+
 	const Environment& SceneFormat::getEnvironment() const
 	{
 		return m_environment;
 	}
 
+	void SceneFormat::setEnvironment(Environment env)
+	{
+		m_environment = std::move(env);
+	}
+
+	void SceneFormat::update(float dt)
+	{
+		m_camera.positionPath.update(dt);
+		m_camera.lookAtPath.update(dt);
+		for (auto& l : m_lights)
+			l.path.update(dt);
+	}
+
 	void SceneFormat::removeUnusedMaterials()
 	{
 		std::vector<bool> isUsed(m_materials.size(), false);
@@ -69,6 +148,9 @@ namespace hrsf
 			else assert(false);
 		}
 
+		// prefab materials are used by the instances
+		std::fill(isUsed.begin() + getOwnMaterialCount(), isUsed.end(), true);
+
 		if (std::all_of(isUsed.begin(), isUsed.end(), [](bool used) {return used; }))
 			return; // all materials are used
 
@@ -123,12 +205,17 @@ namespace hrsf
 				newMaterials.push_back(m_materials[i]);
 		}
 
+		const auto removed = uint32_t(m_materials.size() - newMaterials.size());
+		for (auto& p : m_prefabs)
+			p.materialOffset -= removed;
 		m_materials = std::move(newMaterials);
 	}
 
 	void SceneFormat::offsetMaterials(uint32_t offset)
 	{
 		if (offset == 0) return;
+		for (auto& p : m_prefabs)
+			p.materialOffset += offset;
 		for(auto& m : m_meshes)
 		{
 			if (m.type == Mesh::Billboard)
@@ -141,79 +228,81 @@ namespace hrsf
 
 	void SceneFormat::verify() const
 	{
-		// verify mesh
-		for(const auto& m : m_meshes)
-		{
-			if (m.type == Mesh::Triangle)
-			{
-				m.triangle.verify();
-				// test that materials are not out of bound
-				for (const auto& s : m.triangle.getShapes())
-				{
-					if (s.materialId >= m_materials.size())
-						throw std::runtime_error("material id out of bound: " + std::to_string(s.materialId));
-				}
-			}
-			else if (m.type == Mesh::Billboard)
-			{
-				m.billboard.verify();
-				if(m.billboard.getAttributes() & bmf::Material)
-				{
-					auto mats = m.billboard.getMaterialAttribBuffer();
-					for(const auto& matId : mats)
-					{
-						if(size_t(matId) >= m_materials.size())
-							throw std::runtime_error("material id out of bound: " + std::to_string(matId));
-					}
-				}
-			}
-			else throw std::runtime_error("invalid mesh type");
-			m.position.verify();
-			m.lookAt.verify();
-		}
-
-		
-
-		// test that path have no negative times
-		for (const auto& l : m_lights)
-			l.path.verify();
+		const auto report = getVerifyReport();
+		if (!report.isValid())
+			throw std::runtime_error(report.toString());
+	}
 
-		m_camera.lookAtPath.verify();
-		m_camera.positionPath.verify();
+	SceneFormat SceneFormat::load(fs::path filename, Component components)
+	{
+		auto res = loadUnresolved(filename, components);
+		// copy => addInstances appends to m_references
+		const auto references = res.m_references;
+		res.m_references.clear();
+		for (const auto& r : references)
+			res.addReference(r.file, r.transform, components);
+		return res;
 	}
 
-	SceneFormat SceneFormat::load(fs::path filename)
+	SceneFormat SceneFormat::loadUnresolved(fs::path filename, Component components)
 	{
 		auto j = openFile(filename);
 
-		const auto version = j["version"].get<size_t>();
-		if (version != s_version)
-			throw std::runtime_error(filename.string() + " invalid version");
+		checkVersion(j, filename);
 
 		// get directory path from filename
 		const auto directory = absolute(filename).parent_path();
 
-		auto meshNames = j["meshes"].get<std::vector<std::string>>();
 		std::vector<Mesh> meshes;
-		meshes.reserve(meshNames.size());
-		for(auto& file : meshNames)
+		if (components & Component::Mesh)
 		{
-			meshes.emplace_back(loadMesh(directory / file));
+			auto meshNames = j["meshes"].get<std::vector<std::string>>();
+			meshes.reserve(meshNames.size());
+			for (auto& file : meshNames)
+			{
+				meshes.emplace_back(loadMesh(directory / file));
+			}
 		}
 
 		// load camera etc.
-		auto camera = loadCameraJson(j["camera"], directory);
-		auto env = loadEnvironmentJson(j["environment"], directory);
-		auto materials = loadMaterialsJson(j["materials"], directory);
-		auto lights = loadLightsJson(j["lights"], directory);
+		Camera camera;
+		camera.data = CameraData::Default();
+		if (components & Component::Camera)
+			camera = loadCameraJson(j["camera"], directory);
+		auto env = Environment::Default();
+		if (components & Component::Environment)
+			env = loadEnvironmentJson(j["environment"], directory);
+		std::vector<Material> materials;
+		if (components & Component::Material)
+			materials = loadMaterialsJson(j["materials"], directory);
+		std::vector<Light> lights;
+		if (components & Component::Lights)
+			lights = loadLightsJson(j["lights"], directory);
 
-		return SceneFormat(
+		SceneFormat res(
 			std::move(meshes),
 			std::move(camera),
 			std::move(lights),
 			std::move(materials),
 			std::move(env)
 		);
+
+		// optional
+		auto benchmarks = j.find("benchmarks");
+		if ((components & Component::Camera) && benchmarks != j.end())
+			res.m_benchmarkCameras = loadBenchmarkCamerasJson(*benchmarks, directory);
+		auto references = j.find("references");
+		if ((components & Component::Mesh) && references != j.end())
+			res.m_references = loadReferencesJson(*references, directory);
+
+		return res;
+	}
+
+	void SceneFormat::checkVersion(const json& j, const fs::path& filename)
+	{
+		const auto version = j["version"].get<size_t>();
+		if (version != s_version && version != s_referenceVersion)
+			throw std::runtime_error(filename.string() + " invalid version");
 	}
 
 	Mesh SceneFormat::loadMesh(fs::path filename)
@@ -221,6 +310,53 @@ namespace hrsf
 		return loadMeshJson(openFile(filename), absolute(filename).parent_path());
 	}
 
+	std::vector<MeshInfo> SceneFormat::loadMeshInfos(fs::path filename)
+	{
+		auto j = openFile(filename);
+
+		checkVersion(j, filename);
+
+		const auto directory = absolute(filename).parent_path();
+		std::vector<MeshInfo> res;
+		for (const auto& file : j["meshes"].get<std::vector<std::string>>())
+			res.emplace_back(loadMeshInfo(directory / file));
+		return res;
+	}
+
+	MeshInfo SceneFormat::loadMeshInfo(fs::path filename)
+	{
+		auto j = openFile(filename);
+		const auto root = absolute(filename).parent_path();
+
+		MeshInfo info;
+		info.file = fs::absolute(filename.replace_extension(".json"));
+		const auto strType = j["type"].get<std::string>();
+		if (strType == "Triangle") info.type = Mesh::Triangle;
+		else if (strType == "Billboard") info.type = Mesh::Billboard;
+		else throw std::runtime_error("unknown mesh type " + strType);
+
+		info.bounds = BoundingBox::Empty();
+		auto bbox = j.find("bbox");
+		if (bbox != j.end())
+		{
+			info.bounds.min = getVec3((*bbox)["min"]);
+			info.bounds.max = getVec3((*bbox)["max"]);
+		}
+
+		auto counts = j.find("counts");
+		if (counts != j.end())
+		{
+			info.attributes = (*counts)["attributes"].get<uint32_t>();
+			info.vertexCount = (*counts)["vertices"].get<size_t>();
+			info.indexCount = (*counts)["indices"].get<size_t>();
+			info.shapeCount = (*counts)["shapes"].get<size_t>();
+		}
+
+		info.position = getPathOrDefault(j, "position", root);
+		info.lookAt = getPathOrDefault(j, "lookAt", root);
+		return info;
+	}
+
 	Camera SceneFormat::loadCamera(fs::path filename)
 	{
 		return loadCameraJson(openFile(filename), absolute(filename).parent_path());
@@ -253,7 +389,9 @@ namespace hrsf
 		const fs::path rootDirectory = absFilename.parent_path();
 		
 		json j;
-		j["version"] = s_version;
+		// older readers would silently ignore the references
+		const bool writeReferences = (components & Component::Mesh) && !m_references.empty();
+		j["version"] = writeReferences ? s_referenceVersion : s_version;
 
 		if(components & Component::Mesh)
 		{
@@ -263,17 +401,7 @@ namespace hrsf
 			std::unordered_map<std::string, size_t> usedSuffixMap;
 			for(const auto& mesh : m_meshes)
 			{
-				auto suffix = generateMeshSuffix(mesh);
-				if(usedSuffixMap.find(suffix) == usedSuffixMap.end())
-				{ 
-					// create new entry
-					usedSuffixMap[suffix] = 0;
-				}
-				size_t id = ++usedSuffixMap[suffix];
-				if (id > 1 || suffix.empty())
-					suffix += std::to_string(id);
-
-				auto meshFilename = fs::path(absFilename.string() + suffix);
+				auto meshFilename = getMeshFilename(absFilename, mesh, m_materials, usedSuffixMap);
 				saveMesh(meshFilename, mesh);
 
 				arr.push_back(meshFilename.filename().string() + ".json");
@@ -282,7 +410,15 @@ namespace hrsf
 			j["meshes"] = arr;
 		}
 
-		auto mats = getMaterialsJson(m_materials, rootDirectory);;
+		if ((components & Component::Camera) && !m_benchmarkCameras.empty())
+			j["benchmarks"] = getBenchmarkCamerasJson(m_benchmarkCameras);
+
+		if (writeReferences)
+			j["references"] = getReferencesJson(m_references, rootDirectory);
+
+		// prefab materials are stored in the referenced files
+		auto mats = m_prefabs.empty() ? getMaterialsJson(m_materials, rootDirectory) :
+			getMaterialsJson(std::vector<Material>(m_materials.begin(), m_materials.begin() + getOwnMaterialCount()), rootDirectory);
 		auto lights = getLightsJson(m_lights);
 		auto camera = getCameraJson(m_camera);
 		auto env = getEnvironmentJson(m_environment, rootDirectory);
@@ -367,6 +503,27 @@ namespace hrsf
 			mesh.billboard.saveToFile(bmfFilename.string());
 		}
 
+		// local bounds for streaming (see loadMeshInfo)
+		auto bounds = BoundingBox::Empty();
+		for (const auto& b : getShapeBounds(mesh))
+			bounds.extend(b);
+		if (!bounds.isEmpty())
+		{
+			writeVec3(res["bbox"]["min"], bounds.min);
+			writeVec3(res["bbox"]["max"], bounds.max);
+		}
+
+		// bmf sizes for statistics without loading the bmf (see loadMeshInfo)
+		const auto writeCounts = [&res](const auto& bmf)
+		{
+			res["counts"]["attributes"] = bmf.getAttributes();
+			res["counts"]["vertices"] = bmf.getNumVertices();
+			res["counts"]["indices"] = bmf.getIndices().size();
+			res["counts"]["shapes"] = bmf.getShapes().size();
+		};
+		if (mesh.type == Mesh::Triangle) writeCounts(mesh.triangle);
+		else writeCounts(mesh.billboard);
+
 		if (!mesh.position.isStatic())
 			res["position"] = getPathJson(mesh.position);
 		if (!mesh.lookAt.isStatic())
@@ -520,6 +677,40 @@ namespace hrsf
 		if (!env.ambient.empty())
 			j["ambient"] = getRelativePath(root, env.ambient);
 
+		if (env.ambientIrradianceKey != 0)
+		{
+			auto& jsh = j["ambientIrradiance"];
+			jsh["key"] = keyToString(env.ambientIrradianceKey);
+			auto coeffs = json::array();
+			for (const auto& c : env.ambientIrradiance)
+			{
+				json jc;
+				writeVec3(jc, c); // coefficients are not converted to srgb
+				coeffs.push_back(std::move(jc));
+			}
+			jsh["sh"] = std::move(coeffs);
+		}
+
+		if (env.specularMipsKey != 0)
+		{
+			auto& jspec = j["specularMips"];
+			jspec["key"] = keyToString(env.specularMipsKey);
+			auto levels = json::array();
+			for (const auto& m : env.specularMips)
+				levels.push_back(getRelativePath(root, m));
+			jspec["levels"] = std::move(levels);
+		}
+
+		if (env.cubeMapKey != 0)
+		{
+			auto& jcube = j["cubeMap"];
+			jcube["key"] = keyToString(env.cubeMapKey);
+			auto faces = json::array();
+			for (const auto& f : env.cubeMap)
+				faces.push_back(getRelativePath(root, f));
+			jcube["faces"] = std::move(faces);
+		}
+
 		return j;
 	}
 
@@ -656,6 +847,39 @@ namespace hrsf
 		return materials;
 	}
 
+	SceneFormat::json SceneFormat::getBenchmarkCamerasJson(const std::vector<BenchmarkCamera>& cameras)
+	{
+		auto arr = json::array();
+		for (const auto& c : cameras)
+		{
+			json j;
+			j["name"] = c.name;
+			j["camera"] = getCameraJson(c.camera);
+			if (c.duration != 0.0f)
+				j["duration"] = c.duration;
+			arr.push_back(std::move(j));
+		}
+		return arr;
+	}
+
+	std::vector<BenchmarkCamera> SceneFormat::loadBenchmarkCamerasJson(const json& j, const fs::path& root)
+	{
+		if (!j.is_array())
+			throw std::runtime_error("benchmarks must be an array");
+
+		std::vector<BenchmarkCamera> res;
+		res.reserve(j.size());
+		for (const auto& b : j)
+		{
+			BenchmarkCamera c;
+			c.name = b["name"].get<std::string>();
+			c.camera = loadCameraJson(b["camera"], root);
+			c.duration = getOrDefault(b, "duration", 0.0f);
+			res.push_back(std::move(c));
+		}
+		return res;
+	}
+
 	Camera SceneFormat::loadCameraJson(const json& j, const fs::path& root)
 	{
 		if (j.is_string())
@@ -696,6 +920,40 @@ namespace hrsf
 		env.map = getFilename(j, "map", root);
 		env.ambient = getFilename(j, "ambient", root);
 
+		env.ambientIrradiance = Environment::Default().ambientIrradiance;
+		env.ambientIrradianceKey = 0;
+		const auto jsh = j.find("ambientIrradiance");
+		if (jsh != j.end())
+		{
+			const auto& coeffs = jsh->at("sh");
+			if (!coeffs.is_array() || coeffs.size() != env.ambientIrradiance.size())
+				throw std::runtime_error("ambientIrradiance must have 9 coefficients");
+			for (size_t i = 0; i < env.ambientIrradiance.size(); ++i)
+				env.ambientIrradiance[i] = getVec3(coeffs[i]);
+			env.ambientIrradianceKey = keyFromString(jsh->at("key").get<std::string>());
+		}
+
+		env.specularMipsKey = 0;
+		const auto jspec = j.find("specularMips");
+		if (jspec != j.end())
+		{
+			for (const auto& m : jspec->at("levels"))
+				env.specularMips.push_back(getAbsolutePath(root, m.get<std::string>()));
+			env.specularMipsKey = keyFromString(jspec->at("key").get<std::string>());
+		}
+
+		env.cubeMapKey = 0;
+		const auto jcube = j.find("cubeMap");
+		if (jcube != j.end())
+		{
+			const auto& faces = jcube->at("faces");
+			if (!faces.is_array() || faces.size() != 6)
+				throw std::runtime_error("cubeMap must have 6 faces");
+			for (const auto& f : faces)
+				env.cubeMap.push_back(getAbsolutePath(root, f.get<std::string>()));
+			env.cubeMapKey = keyFromString(jcube->at("key").get<std::string>());
+		}
+
 		return env;
 	}
 
@@ -768,7 +1026,23 @@ namespace hrsf
 		return s;
 	}
 
-	std::string SceneFormat::generateMeshSuffix(const Mesh& mesh) const
+	fs::path SceneFormat::getMeshFilename(const fs::path& sceneFilename, const Mesh& mesh, const std::vector<Material>& materials,
+		std::unordered_map<std::string, size_t>& usedSuffixMap)
+	{
+		auto suffix = generateMeshSuffix(mesh, materials);
+		if(usedSuffixMap.find(suffix) == usedSuffixMap.end())
+		{ 
+			// create new entry
+			usedSuffixMap[suffix] = 0;
+		}
+		size_t id = ++usedSuffixMap[suffix];
+		if (id > 1 || suffix.empty())
+			suffix += std::to_string(id);
+
+		return fs::path(sceneFilename.string() + suffix);
+	}
+
+	std::string SceneFormat::generateMeshSuffix(const Mesh& mesh, const std::vector<Material>& materials)
 	{
 		std::string suffix;
 
@@ -780,7 +1054,7 @@ namespace hrsf
 			return suffix + "Points";
 		}
 
-		if (mesh.isTransparent(m_materials))
+		if (mesh.isTransparent(materials))
 			suffix = "Trans" + suffix;
 		
 		return suffix;
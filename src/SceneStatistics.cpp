@@ -0,0 +1,405 @@
+#include "../include/hrsf/SceneStatistics.h"
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Parallel.h"
+#include <algorithm>
+#include <fstream>
+#include <set>
+
+namespace hrsf
+{
+	namespace
+	{
+		/// \brief true if the scene json has a "references" array (load() reports missing files)
+		bool hasReferences(std::filesystem::path filename)
+		{
+			std::ifstream file(filename.replace_extension(".json"));
+			if (!file.is_open()) return false;
+			nlohmann::json j;
+			file >> j;
+			return j.count("references") != 0;
+		}
+
+		template<class IndexT>
+		MeshStatistics getMeshStatistics(const bmf::BinaryMeshT<IndexT>& bmf, Mesh::Type type)
+		{
+			MeshStatistics res;
+			res.type = type;
+			res.attributes = bmf.getAttributes();
+			res.vertices = bmf.getNumVertices();
+			res.indices = bmf.getIndices().size();
+			res.shapes = bmf.getShapes().size();
+			if (type == Mesh::Triangle) res.triangles = res.indices / 3;
+			else res.billboards = res.vertices;
+			res.gpuBytes = bmf.getVertices().size() * sizeof(float) + bmf.getIndices().size() * sizeof(IndexT);
+			return res;
+		}
+
+		MeshStatistics getMeshStatistics(const Mesh& mesh)
+		{
+			auto res = mesh.type == Mesh::Triangle ? getMeshStatistics(mesh.triangle, mesh.type) : getMeshStatistics(mesh.billboard, mesh.type);
+			res.pathSections = mesh.position.getSections().size() + mesh.lookAt.getSections().size();
+			return res;
+		}
+
+		MeshStatistics getMeshStatistics(const MeshInfo& info)
+		{
+			MeshStatistics res;
+			res.file = info.file;
+			res.type = info.type;
+			res.attributes = info.attributes;
+			res.vertices = info.vertexCount;
+			res.indices = info.indexCount;
+			res.shapes = info.shapeCount;
+			if (info.type == Mesh::Triangle) res.triangles = res.indices / 3;
+			else res.billboards = res.vertices;
+			res.gpuBytes = res.vertices * bmf::getAttributeElementStride(res.attributes) * sizeof(float)
+				+ res.indices * (info.type == Mesh::Triangle ? sizeof(uint16_t) : sizeof(uint32_t));
+			res.pathSections = info.position.getSections().size() + info.lookAt.getSections().size();
+			return res;
+		}
+
+		/// adds triangles and billboards per material to usage (the last entry counts invalid ids)
+		/// \param materialOffset added to the material ids (prefab meshes)
+		void addMaterialUsage(const Mesh& mesh, std::vector<size_t>& usage, uint32_t materialOffset = 0)
+		{
+			const auto add = [&usage, materialOffset](uint32_t materialId, size_t count)
+			{
+				usage[std::min<size_t>(size_t(materialId) + materialOffset, usage.size() - 1)] += count;
+			};
+
+			if (mesh.type == Mesh::Triangle)
+			{
+				for (const auto& s : mesh.triangle.getShapes())
+					add(s.materialId, s.indexCount / 3);
+			}
+			else if (mesh.billboard.getAttributes() & bmf::Material)
+			{
+				for (auto id : mesh.billboard.getMaterialAttribBuffer())
+					add(id, 1);
+			}
+			else
+			{
+				for (const auto& s : mesh.billboard.getShapes())
+					add(s.materialId, s.vertexCount);
+			}
+		}
+
+		/// everything except the meshes
+		void addSceneStatistics(const SceneFormat& scene, SceneStatistics& res)
+		{
+			std::set<fs::path> textures;
+			const auto addTexture = [&textures](const fs::path& p)
+			{
+				if (!p.empty()) textures.insert(p);
+			};
+
+			for (const auto& m : scene.getMaterials())
+			{
+				res.materialNames.push_back(m.name);
+				addTexture(m.textures.albedo);
+				addTexture(m.textures.specular);
+				addTexture(m.textures.coverage);
+			}
+			const auto& env = scene.getEnvironment();
+			addTexture(env.map);
+			addTexture(env.ambient);
+			res.textures.assign(textures.begin(), textures.end());
+			for (const auto& t : res.textures)
+			{
+				std::error_code ec;
+				const auto size = fs::file_size(t, ec);
+				if (!ec) res.textureFileBytes += size_t(size);
+			}
+
+			size_t lightCount = 0;
+			const auto addLights = [&](const std::vector<Light>& lights)
+			{
+				for (const auto& l : lights)
+				{
+					if (l.data.type == LightData::Point) ++res.pointLights;
+					else ++res.directionalLights;
+					if (!l.path.isStatic()) ++res.animatedLights;
+					res.lightPathSections += l.path.getSections().size();
+				}
+				lightCount += lights.size();
+			};
+			addLights(scene.getLights());
+			// instance lights are separate lights on the gpu
+			for (const auto& i : scene.getInstances())
+				addLights(scene.getPrefabs()[i.prefab].scene->getLights());
+
+			const auto& cam = scene.getCamera();
+			res.cameraPathSections = cam.positionPath.getSections().size() + cam.lookAtPath.getSections().size();
+			res.benchmarkCameras = scene.getBenchmarkCameras().size();
+
+			res.prefabs = scene.getPrefabs().size();
+			res.prefabInstances = scene.getInstances().size();
+			res.lightBytes = lightCount * sizeof(LightData);
+			res.materialBytes = scene.getMaterials().size() * sizeof(MaterialData);
+		}
+
+		void finishMaterialUsage(std::vector<size_t>& usage, SceneStatistics& res)
+		{
+			res.invalidMaterialUsage = usage.back();
+			usage.pop_back();
+			res.materialUsage = std::move(usage);
+		}
+	}
+
+	size_t SceneStatistics::getVertexCount() const
+	{
+		size_t res = 0;
+		for (const auto& m : meshes) res += m.vertices;
+		return res;
+	}
+
+	size_t SceneStatistics::getTriangleCount() const
+	{
+		size_t res = 0;
+		for (const auto& m : meshes) res += m.triangles;
+		return res;
+	}
+
+	size_t SceneStatistics::getBillboardCount() const
+	{
+		size_t res = 0;
+		for (const auto& m : meshes) res += m.billboards;
+		return res;
+	}
+
+	size_t SceneStatistics::getInstancedTriangleCount() const
+	{
+		size_t res = 0;
+		for (const auto& m : meshes) res += m.triangles * m.instances;
+		return res;
+	}
+
+	size_t SceneStatistics::getInstancedBillboardCount() const
+	{
+		size_t res = 0;
+		for (const auto& m : meshes) res += m.billboards * m.instances;
+		return res;
+	}
+
+	size_t SceneStatistics::getMeshPathSections() const
+	{
+		size_t res = 0;
+		for (const auto& m : meshes) res += m.pathSections;
+		return res;
+	}
+
+	size_t SceneStatistics::getGpuBytes() const
+	{
+		size_t res = lightBytes + materialBytes;
+		for (const auto& m : meshes) res += m.gpuBytes;
+		return res;
+	}
+
+	std::string SceneStatistics::toString() const
+	{
+		std::string res;
+		const auto line = [&res](const std::string& name, size_t value)
+		{
+			res += name + ": " + std::to_string(value) + "\n";
+		};
+
+		line("meshes", meshes.size());
+		line("vertices", getVertexCount());
+		line("triangles", getTriangleCount());
+		line("billboards", getBillboardCount());
+		if (prefabInstances)
+		{
+			line("prefabs", prefabs);
+			line("prefab instances", prefabInstances);
+			line("instanced triangles", getInstancedTriangleCount());
+			line("instanced billboards", getInstancedBillboardCount());
+		}
+		line("materials", materialNames.size());
+		line("textures", textures.size());
+		line("point lights", pointLights);
+		line("directional lights", directionalLights);
+		line("animated lights", animatedLights);
+		line("path sections (meshes)", getMeshPathSections());
+		line("path sections (lights)", lightPathSections);
+		line("path sections (camera)", cameraPathSections);
+		line("benchmark cameras", benchmarkCameras);
+		line("gpu bytes (buffers)", getGpuBytes());
+		line("texture file bytes", textureFileBytes);
+
+		res += "\nmeshes:\n";
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			const auto& m = meshes[i];
+			res += "  " + std::to_string(i) + (m.type == Mesh::Triangle ? " triangle" : " billboard")
+				+ ": vertices " + std::to_string(m.vertices) + ", triangles " + std::to_string(m.triangles)
+				+ ", billboards " + std::to_string(m.billboards) + ", shapes " + std::to_string(m.shapes)
+				+ ", path sections " + std::to_string(m.pathSections) + ", gpu bytes " + std::to_string(m.gpuBytes);
+			if (!m.file.empty()) res += " (" + m.file.string() + ")";
+			if (!m.prefab.empty()) res += ", " + std::to_string(m.instances) + " instances of " + m.prefab.string();
+			res += "\n";
+		}
+
+		if (!materialUsage.empty())
+		{
+			res += "\nmaterial usage (triangles + billboards):\n";
+			for (size_t i = 0; i < materialUsage.size(); ++i)
+				res += "  " + std::to_string(i) + " " + materialNames[i] + ": " + std::to_string(materialUsage[i]) + "\n";
+			if (invalidMaterialUsage)
+				res += "  invalid: " + std::to_string(invalidMaterialUsage) + "\n";
+		}
+
+		res += "\ntextures:\n";
+		for (const auto& t : textures)
+			res += "  " + t.string() + "\n";
+
+		return res;
+	}
+
+	nlohmann::json SceneStatistics::toJson() const
+	{
+		nlohmann::json j;
+		j["vertices"] = getVertexCount();
+		j["triangles"] = getTriangleCount();
+		j["billboards"] = getBillboardCount();
+		if (prefabInstances)
+		{
+			j["prefabs"] = prefabs;
+			j["prefabInstances"] = prefabInstances;
+			j["instancedTriangles"] = getInstancedTriangleCount();
+			j["instancedBillboards"] = getInstancedBillboardCount();
+		}
+		j["gpuBytes"] = getGpuBytes();
+		j["textureFileBytes"] = textureFileBytes;
+
+		j["meshes"] = nlohmann::json::array();
+		for (const auto& m : meshes)
+		{
+			nlohmann::json mj;
+			if (!m.file.empty()) mj["file"] = m.file.string();
+			if (!m.prefab.empty())
+			{
+				mj["prefab"] = m.prefab.string();
+				mj["instances"] = m.instances;
+			}
+			mj["type"] = m.type == Mesh::Triangle ? "Triangle" : "Billboard";
+			mj["attributes"] = m.attributes;
+			mj["vertices"] = m.vertices;
+			mj["indices"] = m.indices;
+			mj["triangles"] = m.triangles;
+			mj["billboards"] = m.billboards;
+			mj["shapes"] = m.shapes;
+			mj["pathSections"] = m.pathSections;
+			mj["gpuBytes"] = m.gpuBytes;
+			j["meshes"].push_back(mj);
+		}
+
+		j["materials"] = nlohmann::json::array();
+		for (size_t i = 0; i < materialNames.size(); ++i)
+		{
+			nlohmann::json mj;
+			mj["name"] = materialNames[i];
+			if (!materialUsage.empty()) mj["usage"] = materialUsage[i];
+			j["materials"].push_back(mj);
+		}
+		if (!materialUsage.empty())
+			j["invalidMaterialUsage"] = invalidMaterialUsage;
+
+		j["textures"] = nlohmann::json::array();
+		for (const auto& t : textures)
+			j["textures"].push_back(t.string());
+
+		j["lights"]["point"] = pointLights;
+		j["lights"]["directional"] = directionalLights;
+		j["lights"]["animated"] = animatedLights;
+		j["lights"]["gpuBytes"] = lightBytes;
+
+		j["pathSections"]["meshes"] = getMeshPathSections();
+		j["pathSections"]["lights"] = lightPathSections;
+		j["pathSections"]["camera"] = cameraPathSections;
+		j["benchmarkCameras"] = benchmarkCameras;
+		j["materialGpuBytes"] = materialBytes;
+		return j;
+	}
+
+	SceneStatistics SceneStatistics::compute(const SceneFormat& scene)
+	{
+		SceneStatistics res;
+		addSceneStatistics(scene, res);
+
+		// own meshes and the meshes of each prefab (once)
+		struct MeshRef
+		{
+			const Mesh* mesh;
+			const Prefab* prefab;
+		};
+		std::vector<MeshRef> meshes;
+		for (const auto& m : scene.getMeshes())
+			meshes.push_back({ &m, nullptr });
+		for (const auto& p : scene.getPrefabs())
+			for (const auto& m : p.scene->getMeshes())
+				meshes.push_back({ &m, &p });
+		std::vector<size_t> instanceCounts(scene.getPrefabs().size());
+		for (const auto& i : scene.getInstances())
+			++instanceCounts[i.prefab];
+
+		res.meshes.resize(meshes.size());
+		// one histogram per mesh => no synchronization
+		std::vector<std::vector<size_t>> usage(meshes.size(), std::vector<size_t>(res.materialNames.size() + 1));
+		parallelFor(0, meshes.size(), [&](size_t i)
+		{
+			const auto& ref = meshes[i];
+			res.meshes[i] = getMeshStatistics(*ref.mesh);
+			if (ref.prefab)
+			{
+				res.meshes[i].prefab = ref.prefab->file;
+				res.meshes[i].instances = instanceCounts[size_t(ref.prefab - scene.getPrefabs().data())];
+			}
+			addMaterialUsage(*ref.mesh, usage[i], ref.prefab ? ref.prefab->materialOffset : 0);
+		});
+
+		std::vector<size_t> total(res.materialNames.size() + 1);
+		for (const auto& u : usage)
+			std::transform(u.begin(), u.end(), total.begin(), total.begin(), std::plus<size_t>());
+		finishMaterialUsage(total, res);
+		return res;
+	}
+
+	SceneStatistics SceneStatistics::load(const std::filesystem::path& filename, bool readMeshes)
+	{
+		// the referenced meshes, lights and materials are only known after loading the referenced scenes
+		if (hasReferences(filename))
+			return compute(SceneFormat::load(filename));
+
+		SceneStatistics res;
+		const auto scene = SceneFormat::load(filename, Component::Camera | Component::Lights | Component::Material | Component::Environment);
+		addSceneStatistics(scene, res);
+
+		const auto infos = SceneFormat::loadMeshInfos(filename);
+		res.meshes.resize(infos.size());
+		std::vector<size_t> total(res.materialNames.size() + 1);
+		std::mutex totalMutex;
+		parallelFor(0, infos.size(), [&](size_t i)
+		{
+			const auto& info = infos[i];
+			if (!readMeshes && info.hasCounts())
+			{
+				res.meshes[i] = getMeshStatistics(info);
+				return;
+			}
+
+			const auto mesh = SceneFormat::loadMesh(info.file);
+			res.meshes[i] = getMeshStatistics(mesh);
+			res.meshes[i].file = info.file;
+			if (!readMeshes) return;
+
+			std::vector<size_t> usage(total.size());
+			addMaterialUsage(mesh, usage);
+			std::lock_guard<std::mutex> lock(totalMutex);
+			std::transform(usage.begin(), usage.end(), total.begin(), total.begin(), std::plus<size_t>());
+		});
+
+		if (readMeshes)
+			finishMaterialUsage(total, res);
+		return res;
+	}
+}
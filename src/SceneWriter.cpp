@@ -0,0 +1,56 @@
+#include "../include/hrsf/SceneWriter.h"
+#include "../include/hrsf/SceneFormat.h"
+
+namespace hrsf
+{
+	SceneWriter::SceneWriter(std::filesystem::path filename) :
+		m_filename(fs::absolute(filename)),
+		m_camera(CameraData::Default()),
+		m_environment(Environment::Default())
+	{}
+
+	void SceneWriter::setMaterials(std::vector<Material> materials)
+	{
+		m_materials = std::move(materials);
+	}
+
+	void SceneWriter::addMesh(Mesh mesh)
+	{
+		const auto meshFilename = SceneFormat::getMeshFilename(m_filename, mesh, m_materials, m_usedSuffixMap);
+		SceneFormat::saveMesh(meshFilename, mesh);
+		m_meshFiles.push_back(meshFilename.filename().string() + ".json");
+	}
+
+	void SceneWriter::setLights(std::vector<Light> lights)
+	{
+		m_lights = std::move(lights);
+	}
+
+	void SceneWriter::setCamera(Camera camera)
+	{
+		m_camera = std::move(camera);
+	}
+
+	void SceneWriter::setEnvironment(Environment env)
+	{
+		m_environment = std::move(env);
+	}
+
+	size_t SceneWriter::getMeshCount() const
+	{
+		return m_meshFiles.size();
+	}
+
+	void SceneWriter::finish()
+	{
+		const auto root = m_filename.parent_path();
+		SceneFormat::json j;
+		j["version"] = SceneFormat::s_version;
+		j["meshes"] = m_meshFiles;
+		j["materials"] = SceneFormat::getMaterialsJson(m_materials, root);
+		j["lights"] = SceneFormat::getLightsJson(m_lights);
+		j["camera"] = SceneFormat::getCameraJson(m_camera);
+		j["environment"] = SceneFormat::getEnvironmentJson(m_environment, root);
+		SceneFormat::saveFile(j, m_filename);
+	}
+}
@@ -0,0 +1,138 @@
+#include "../include/hrsf/ShadowCascades.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace hrsf
+{
+	float getCascadeSplit(float nearDepth, float farDepth, uint32_t index, uint32_t count, float lambda)
+	{
+		// exact end points
+		if (index == 0) return nearDepth;
+		if (index >= count) return farDepth;
+		const float t = float(index) / float(count);
+		const float logSplit = nearDepth * std::pow(farDepth / nearDepth, t);
+		const float uniformSplit = nearDepth + (farDepth - nearDepth) * t;
+		return lambda * logSplit + (1.0f - lambda) * uniformSplit;
+	}
+
+	void fitShadowCascades(const CameraData& camera, const LightData& light, const BoundingBox& sceneBounds,
+		const CascadeSettings& settings, ShadowCascades& result)
+	{
+		if (light.type != LightData::Directional)
+			throw std::runtime_error("shadow cascades require a directional light");
+		if (settings.cascadeCount == 0 || settings.resolution == 0)
+			throw std::runtime_error("invalid cascade settings");
+
+		// camera basis
+		const auto camForward = glm::normalize(camera.direction);
+		auto camRight = glm::cross(camForward, camera.up);
+		if (glm::length(camRight) < 1e-6f) // up and direction are parallel (top-down view)
+			camRight = glm::cross(camForward, std::abs(camForward.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f));
+		camRight = glm::normalize(camRight);
+		const auto camUp = glm::cross(camRight, camForward);
+
+		// light basis
+		result.forward = glm::normalize(light.direction);
+		const auto upHint = std::abs(result.forward.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		result.right = glm::normalize(glm::cross(result.forward, upHint));
+		result.up = glm::cross(result.right, result.forward);
+
+		const auto toLight = [&result](const glm::vec3& p)
+		{
+			return glm::vec3(glm::dot(p, result.right), glm::dot(p, result.up), glm::dot(p, result.forward));
+		};
+
+		// scene corners in view depth and light space
+		float nearDepth = camera.near;
+		float farDepth = camera.far;
+		auto sceneLight = BoundingBox::Empty();
+		if (!sceneBounds.isEmpty())
+		{
+			float minDepth = std::numeric_limits<float>::max();
+			float maxDepth = -std::numeric_limits<float>::max();
+			for (int i = 0; i < 8; ++i)
+			{
+				const glm::vec3 corner(
+					(i & 1) ? sceneBounds.max.x : sceneBounds.min.x,
+					(i & 2) ? sceneBounds.max.y : sceneBounds.min.y,
+					(i & 4) ? sceneBounds.max.z : sceneBounds.min.z);
+				const float depth = glm::dot(corner - camera.position, camForward);
+				minDepth = std::min(minDepth, depth);
+				maxDepth = std::max(maxDepth, depth);
+				sceneLight.extend(toLight(corner));
+			}
+			// quantize the clipped range => splits (and texel sizes) stay constant for small camera movements
+			const float step = glm::length(sceneBounds.getSize()) / 64.0f;
+			if (step > 0.0f)
+			{
+				minDepth = std::floor(minDepth / step) * step;
+				maxDepth = std::ceil(maxDepth / step) * step;
+			}
+			nearDepth = std::min(std::max(nearDepth, minDepth), farDepth);
+			farDepth = std::max(std::min(farDepth, maxDepth), nearDepth);
+		}
+		if (farDepth <= nearDepth)
+			farDepth = nearDepth * 1.001f + 1e-4f; // camera is outside of the scene bounds
+
+		result.cascades.resize(settings.cascadeCount);
+
+		const float tanY = std::tan(camera.fov * 0.5f);
+		const float tanX = tanY * settings.aspect;
+		for (uint32_t c = 0; c < settings.cascadeCount; ++c)
+		{
+			auto& cascade = result.cascades[c];
+			cascade.nearDepth = getCascadeSplit(nearDepth, farDepth, c, settings.cascadeCount, settings.lambda);
+			cascade.farDepth = getCascadeSplit(nearDepth, farDepth, c + 1, settings.cascadeCount, settings.lambda);
+
+			// corners of the frustum slice
+			std::array<glm::vec3, 8> corners;
+			auto sliceLight = BoundingBox::Empty();
+			glm::vec3 center(0.0f);
+			for (int i = 0; i < 8; ++i)
+			{
+				const float depth = (i & 4) ? cascade.farDepth : cascade.nearDepth;
+				const float x = ((i & 1) ? 1.0f : -1.0f) * tanX * depth;
+				const float y = ((i & 2) ? 1.0f : -1.0f) * tanY * depth;
+				corners[i] = camera.position + camForward * depth + camRight * x + camUp * y;
+				center += corners[i];
+				sliceLight.extend(toLight(corners[i]));
+			}
+			center /= 8.0f;
+
+			// bounding sphere => the size does not change when the camera rotates
+			float radius = 0.0f;
+			for (const auto& p : corners)
+				radius = std::max(radius, glm::length(p - center));
+			// round to avoid size changes due to floating point noise
+			radius = std::ceil(radius * 16.0f) / 16.0f;
+			cascade.texelSize = 2.0f * radius / float(settings.resolution);
+
+			const auto lightCenter = toLight(center);
+			glm::vec3 lo = lightCenter - glm::vec3(radius);
+			glm::vec3 hi = lightCenter + glm::vec3(radius);
+
+			// depth: include all casters between the light and the slice
+			lo.z = sliceLight.min.z;
+			hi.z = sliceLight.max.z;
+			if (!sceneLight.isEmpty())
+			{
+				lo.z = sceneLight.min.z;
+				hi.z = std::max(std::min(hi.z, sceneLight.max.z), lo.z);
+			}
+
+			// snap to the texel grid. The xy extent stays exactly resolution * texelSize
+			// (clipping xy to the scene would change the extent and break the snapping)
+			lo.x = std::floor(lo.x / cascade.texelSize) * cascade.texelSize;
+			lo.y = std::floor(lo.y / cascade.texelSize) * cascade.texelSize;
+			hi.x = lo.x + cascade.texelSize * float(settings.resolution);
+			hi.y = lo.y + cascade.texelSize * float(settings.resolution);
+
+			cascade.lightMin = lo;
+			cascade.lightMax = hi;
+		}
+	}
+}
@@ -0,0 +1,392 @@
+#include "../include/hrsf/ShadowCasters.h"
+#include "../include/hrsf/Cache.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr uint32_t s_magic = 0x43535248; // "HRSC"
+		constexpr uint32_t s_fileVersion = 3;
+
+		glm::vec3 getLightPosition(const LightInfluence& influence, size_t i)
+		{
+			return glm::vec3(influence.getX()[i], influence.getY()[i], influence.getZ()[i]);
+		}
+
+		uint64_t getInfluenceKey(const LightInfluence& influence)
+		{
+			uint64_t key = hashData(influence.getX().data(), influence.size() * sizeof(float));
+			key = combineKeys(key, hashData(influence.getY().data(), influence.size() * sizeof(float)));
+			key = combineKeys(key, hashData(influence.getZ().data(), influence.size() * sizeof(float)));
+			key = combineKeys(key, hashData(influence.getRanges().data(), influence.size() * sizeof(float)));
+			return key;
+		}
+
+		/// number of entries that buildEntries() can produce for the mesh (billboards without shapes have one)
+		size_t getShapeCount(const Mesh& mesh)
+		{
+			if (mesh.type == Mesh::Triangle) return mesh.triangle.getShapes().size();
+			return std::max<size_t>(mesh.billboard.getShapes().size(), 1);
+		}
+	}
+
+	void ShadowCasterLists::build(const std::vector<Mesh>& meshes, const LightInfluence& influence, const ShadowCasterSettings& settings)
+	{
+		m_settings = settings;
+		buildEntries(meshes);
+		buildLists(influence);
+	}
+
+	void ShadowCasterLists::buildLists(const LightInfluence& influence)
+	{
+		buildGrid();
+
+		const size_t lightCount = influence.size();
+		m_staticLists.assign(lightCount, {});
+		m_dynamicLists.assign(lightCount, {});
+		m_lists.assign(lightCount, {});
+		m_lightPositions.resize(lightCount);
+		m_lightRanges.resize(lightCount);
+		m_animatedLights = influence.getAnimatedLights();
+
+		parallelFor(0, lightCount, [&](size_t l)
+		{
+			updateStaticList(l, influence);
+			updateDynamicList(l, influence);
+			combineLists(l);
+		}, 16);
+	}
+
+	bool ShadowCasterLists::update(const std::vector<Mesh>& meshes, const LightInfluence& influence)
+	{
+		if (influence.size() != m_lists.size())
+			throw std::runtime_error("light count changed since the shadow caster lists were built");
+
+		// lists loaded from the cache have neither bounds nor a grid yet
+		if (m_cellOffsets.empty())
+		{
+			buildEntries(meshes);
+			buildGrid();
+		}
+
+		// moved meshes
+		for (auto e : m_dynamicEntries)
+			m_worldBounds[e] = getWorldBounds(meshes[m_entries[e].mesh], m_localBounds[e]);
+
+		// the static part only needs to be updated for lights that moved
+		std::vector<uint8_t> moved(m_lists.size(), 0);
+		bool anyMoved = false;
+		for (size_t l = 0; l < m_lists.size(); ++l)
+		{
+			if (getLightPosition(influence, l) != m_lightPositions[l] || influence.getRanges()[l] != m_lightRanges[l])
+			{
+				moved[l] = 1;
+				anyMoved = true;
+			}
+		}
+		if (!anyMoved && m_dynamicEntries.empty()) return false;
+
+		parallelFor(0, m_lists.size(), [&](size_t l)
+		{
+			if (moved[l]) updateStaticList(l, influence);
+			updateDynamicList(l, influence);
+			combineLists(l);
+		}, 16);
+		return true;
+	}
+
+	void ShadowCasterLists::buildEntries(const std::vector<Mesh>& meshes)
+	{
+		m_entries.clear();
+		m_localBounds.clear();
+		m_dynamicEntries.clear();
+		for (uint32_t m = 0; m < uint32_t(meshes.size()); ++m)
+		{
+			const auto& mesh = meshes[m];
+
+			const auto bounds = getShapeBounds(mesh);
+			for (uint32_t s = 0; s < uint32_t(bounds.size()); ++s)
+			{
+				if (bounds[s].isEmpty()) continue;
+				if (!mesh.isStatic()) m_dynamicEntries.push_back(uint32_t(m_entries.size()));
+				m_entries.push_back({ m, s });
+				m_localBounds.push_back(bounds[s]);
+			}
+		}
+
+		m_worldBounds.resize(m_entries.size());
+		parallelFor(0, m_entries.size(), [&](size_t e)
+		{
+			m_worldBounds[e] = getWorldBounds(meshes[m_entries[e].mesh], m_localBounds[e]);
+		}, 256);
+	}
+
+	void ShadowCasterLists::buildGrid()
+	{
+		std::vector<uint8_t> isDynamic(m_entries.size(), 0);
+		for (auto e : m_dynamicEntries)
+			isDynamic[e] = 1;
+
+		m_gridBounds = BoundingBox::Empty();
+		glm::vec3 avgSize(0.0f);
+		size_t staticCount = 0;
+		for (size_t e = 0; e < m_entries.size(); ++e)
+		{
+			if (isDynamic[e]) continue;
+			m_gridBounds.extend(m_worldBounds[e]);
+			avgSize += m_worldBounds[e].getSize();
+			++staticCount;
+		}
+
+		m_cellOffsets.assign(1, 0);
+		m_cellEntries.clear();
+		m_gridDim[0] = m_gridDim[1] = m_gridDim[2] = 0;
+		if (staticCount == 0) return;
+
+		// cells should be about the size of a shape but the grid resolution is limited
+		const auto extent = m_gridBounds.getSize();
+		const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+		avgSize /= float(staticCount);
+		m_cellSize = m_settings.cellSize > 0.0f ? m_settings.cellSize : std::max(avgSize.x, std::max(avgSize.y, avgSize.z));
+		m_cellSize = std::max(m_cellSize, maxExtent / float(std::max(m_settings.maxCellsPerAxis, 1u)));
+		if (m_cellSize <= 0.0f) m_cellSize = 1.0f;
+		for (int i = 0; i < 3; ++i)
+			m_gridDim[i] = std::max(uint32_t(std::ceil(extent[i] / m_cellSize)), 1u);
+
+		const auto getCellRange = [this](const BoundingBox& b, uint32_t* lo, uint32_t* hi)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				lo[i] = uint32_t(std::max((b.min[i] - m_gridBounds.min[i]) / m_cellSize, 0.0f));
+				hi[i] = uint32_t(std::max((b.max[i] - m_gridBounds.min[i]) / m_cellSize, 0.0f));
+				lo[i] = std::min(lo[i], m_gridDim[i] - 1);
+				hi[i] = std::min(hi[i], m_gridDim[i] - 1);
+			}
+		};
+
+		// counting sort of the entries into the cells
+		const size_t cellCount = size_t(m_gridDim[0]) * m_gridDim[1] * m_gridDim[2];
+		m_cellOffsets.assign(cellCount + 1, 0);
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			std::vector<uint32_t> cursor;
+			if (pass == 1)
+			{
+				for (size_t c = 0; c < cellCount; ++c)
+					m_cellOffsets[c + 1] += m_cellOffsets[c];
+				m_cellEntries.resize(m_cellOffsets.back());
+				cursor.assign(m_cellOffsets.begin(), m_cellOffsets.end() - 1);
+			}
+
+			for (uint32_t e = 0; e < uint32_t(m_entries.size()); ++e)
+			{
+				if (isDynamic[e]) continue;
+				uint32_t lo[3], hi[3];
+				getCellRange(m_worldBounds[e], lo, hi);
+				for (uint32_t z = lo[2]; z <= hi[2]; ++z)
+					for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+						for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+						{
+							const size_t cell = (size_t(z) * m_gridDim[1] + y) * m_gridDim[0] + x;
+							if (pass == 0) ++m_cellOffsets[cell + 1];
+							else m_cellEntries[cursor[cell]++] = e;
+						}
+			}
+		}
+	}
+
+	void ShadowCasterLists::queryGrid(const glm::vec3& center, float radius, std::vector<uint32_t>& out) const
+	{
+		out.clear();
+		if (m_cellEntries.empty()) return;
+		if (!m_gridBounds.intersectsSphere(center, radius)) return;
+
+		uint32_t lo[3], hi[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			// clamp in float to handle infinite ranges
+			const float maxCell = float(m_gridDim[i] - 1);
+			lo[i] = uint32_t(std::min(std::max((center[i] - radius - m_gridBounds.min[i]) / m_cellSize, 0.0f), maxCell));
+			hi[i] = uint32_t(std::min(std::max((center[i] + radius - m_gridBounds.min[i]) / m_cellSize, 0.0f), maxCell));
+		}
+
+		for (uint32_t z = lo[2]; z <= hi[2]; ++z)
+			for (uint32_t y = lo[1]; y <= hi[1]; ++y)
+				for (uint32_t x = lo[0]; x <= hi[0]; ++x)
+				{
+					const size_t cell = (size_t(z) * m_gridDim[1] + y) * m_gridDim[0] + x;
+					for (uint32_t i = m_cellOffsets[cell]; i < m_cellOffsets[cell + 1]; ++i)
+					{
+						const auto e = m_cellEntries[i];
+						if (m_worldBounds[e].intersectsSphere(center, radius))
+							out.push_back(e);
+					}
+				}
+
+		// entries that span multiple cells are found multiple times
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	void ShadowCasterLists::updateStaticList(size_t light, const LightInfluence& influence)
+	{
+		m_lightPositions[light] = getLightPosition(influence, light);
+		m_lightRanges[light] = influence.getRanges()[light];
+		queryGrid(m_lightPositions[light], m_lightRanges[light], m_staticLists[light]);
+	}
+
+	void ShadowCasterLists::updateDynamicList(size_t light, const LightInfluence& influence)
+	{
+		auto& list = m_dynamicLists[light];
+		list.clear();
+		const auto center = getLightPosition(influence, light);
+		const float radius = influence.getRanges()[light];
+		for (auto e : m_dynamicEntries)
+			if (m_worldBounds[e].intersectsSphere(center, radius))
+				list.push_back(e);
+	}
+
+	void ShadowCasterLists::combineLists(size_t light)
+	{
+		// entries are ordered by mesh and shape => merging the index lists keeps the order
+		const auto& s = m_staticLists[light];
+		const auto& d = m_dynamicLists[light];
+		auto& res = m_lists[light];
+		res.resize(s.size() + d.size());
+		size_t i = 0, j = 0, k = 0;
+		while (i < s.size() || j < d.size())
+		{
+			if (j == d.size() || (i < s.size() && s[i] < d[j])) res[k++] = m_entries[s[i++]];
+			else res[k++] = m_entries[d[j++]];
+		}
+	}
+
+	uint64_t ShadowCasterLists::getGeometryKey(const std::vector<Mesh>& meshes)
+	{
+		// hashing the buffers is cheaper than the shape bounds and detects moved vertices or shapes
+		// that keep the mesh bounds and counts (the mesh json files would not change)
+		uint64_t key = 0;
+		for (const auto& m : meshes)
+		{
+			key = combineKeys(key, uint64_t(m.type));
+			const auto hashMesh = [&key](const auto& mesh)
+			{
+				key = combineKeys(key, hashData(mesh.getVertices().data(), mesh.getVertices().size() * sizeof(float)));
+				key = combineKeys(key, hashData(mesh.getIndices().data(), mesh.getIndices().size() * sizeof(mesh.getIndices()[0])));
+				key = combineKeys(key, hashData(mesh.getShapes().data(), mesh.getShapes().size() * sizeof(bmf::Shape)));
+			};
+			if (m.type == Mesh::Triangle) hashMesh(m.triangle);
+			else hashMesh(m.billboard);
+			const auto offset = m.position.getPosition();
+			key = combineKeys(key, hashData(&offset, sizeof(offset)));
+		}
+		return key;
+	}
+
+	void ShadowCasterLists::saveLists(const std::filesystem::path& filename, uint64_t key) const
+	{
+		std::ofstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("could not save " + filename.string());
+
+		// the entries are stored as well => a cache hit does not need the shape bounds
+		const uint32_t header[4] = { s_magic, s_fileVersion, uint32_t(m_staticLists.size()), uint32_t(m_entries.size()) };
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+		file.write(reinterpret_cast<const char*>(m_entries.data()), std::streamsize(m_entries.size() * sizeof(ShadowCaster)));
+		for (const auto& list : m_staticLists)
+		{
+			const auto count = uint32_t(list.size());
+			file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+			file.write(reinterpret_cast<const char*>(list.data()), std::streamsize(list.size() * sizeof(uint32_t)));
+		}
+		if (!file)
+			throw std::runtime_error("could not write " + filename.string());
+	}
+
+	bool ShadowCasterLists::loadLists(const std::filesystem::path& filename, uint64_t key, const std::vector<Mesh>& meshes)
+	{
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open()) return false;
+
+		uint32_t header[4];
+		uint64_t fileKey;
+		file.read(reinterpret_cast<char*>(header), sizeof(header));
+		file.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+		if (!file || header[0] != s_magic || header[1] != s_fileVersion || header[2] != m_staticLists.size() || fileKey != key)
+			return false;
+
+		size_t maxEntries = 0;
+		for (const auto& m : meshes)
+			maxEntries += getShapeCount(m);
+		if (header[3] > maxEntries) return false;
+		std::vector<ShadowCaster> entries(header[3]);
+		file.read(reinterpret_cast<char*>(entries.data()), std::streamsize(entries.size() * sizeof(ShadowCaster)));
+		if (!file) return false;
+		for (const auto& e : entries)
+			if (e.mesh >= meshes.size() || e.shape >= getShapeCount(meshes[e.mesh])) return false;
+
+		for (auto& list : m_staticLists)
+		{
+			uint32_t count = 0;
+			file.read(reinterpret_cast<char*>(&count), sizeof(count));
+			if (!file || count > entries.size()) return false;
+			list.resize(count);
+			file.read(reinterpret_cast<char*>(list.data()), std::streamsize(count * sizeof(uint32_t)));
+			if (!file) return false;
+			for (auto e : list)
+				if (e >= entries.size()) return false;
+		}
+		m_entries = std::move(entries);
+		return true;
+	}
+
+	ShadowCasterLists ShadowCasterLists::loadOrBuild(const std::filesystem::path& sceneFile, const std::vector<Mesh>& meshes,
+		const LightInfluence& influence, const ShadowCasterSettings& settings)
+	{
+		ShadowCasterLists res;
+		const bool staticMeshes = std::all_of(meshes.begin(), meshes.end(), [](const Mesh& m) { return m.isStatic(); });
+		if (!staticMeshes || !influence.getAnimatedLights().empty())
+		{
+			res.build(meshes, influence, settings);
+			return res;
+		}
+		res.m_settings = settings;
+
+		// the geometry key avoids computing the shape bounds on a cache hit
+		const uint64_t key = combineKeys(getGeometryKey(meshes), getInfluenceKey(influence));
+
+		const auto cacheName = getCacheFilename(sceneFile, key, ".casters.bin");
+		const size_t lightCount = influence.size();
+		res.m_staticLists.assign(lightCount, {});
+		res.m_dynamicLists.assign(lightCount, {});
+		res.m_lists.assign(lightCount, {});
+		res.m_lightPositions.resize(lightCount);
+		res.m_lightRanges.resize(lightCount);
+
+		if (res.loadLists(cacheName, key, meshes))
+		{
+			// the bounds and the grid are only required if something changes later (see update())
+			res.m_localBounds.clear();
+			res.m_worldBounds.clear();
+			for (size_t l = 0; l < lightCount; ++l)
+			{
+				res.m_lightPositions[l] = getLightPosition(influence, l);
+				res.m_lightRanges[l] = influence.getRanges()[l];
+				res.combineLists(l);
+			}
+			return res;
+		}
+
+		res.buildEntries(meshes);
+		res.buildLists(influence);
+		writeCacheFile(cacheName, [&](const std::filesystem::path& f) { res.saveLists(f, key); });
+		return res;
+	}
+}
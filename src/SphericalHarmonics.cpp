@@ -0,0 +1,87 @@
+#include "../include/hrsf/SphericalHarmonics.h"
+#include "../include/hrsf/HdrImage.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+
+namespace hrsf
+{
+	namespace
+	{
+		constexpr float s_pi = 3.14159265358979f;
+
+		std::array<float, 9> getShBasis(const glm::vec3& n)
+		{
+			return {
+				0.282095f,
+				0.488603f * n.y,
+				0.488603f * n.z,
+				0.488603f * n.x,
+				1.092548f * n.x * n.y,
+				1.092548f * n.y * n.z,
+				0.315392f * (3.0f * n.z * n.z - 1.0f),
+				1.092548f * n.x * n.z,
+				0.546274f * (n.x * n.x - n.y * n.y)
+			};
+		}
+	}
+
+	ShCoefficients projectRadianceSh(const HdrImage& equirect)
+	{
+		// accumulate each row in double precision and sum the rows in order
+		// => the result does not depend on the thread count
+		using RowSum = std::array<double, 27>;
+		std::vector<RowSum> rows(equirect.height);
+
+		parallelFor(0, equirect.height, [&](size_t y)
+		{
+			RowSum sum = {};
+			const float dOmega = equirectPixelSolidAngle(y, equirect.width, equirect.height);
+			const float v = (float(y) + 0.5f) / float(equirect.height);
+			for (size_t x = 0; x < equirect.width; ++x)
+			{
+				const float u = (float(x) + 0.5f) / float(equirect.width);
+				const auto basis = getShBasis(equirectToDirection(glm::vec2(u, v)));
+				const auto radiance = equirect.at(x, y) * dOmega;
+				for (size_t i = 0; i < 9; ++i)
+				{
+					sum[i * 3 + 0] += double(radiance.x * basis[i]);
+					sum[i * 3 + 1] += double(radiance.y * basis[i]);
+					sum[i * 3 + 2] += double(radiance.z * basis[i]);
+				}
+			}
+			rows[y] = sum;
+		}, 4);
+
+		RowSum total = {};
+		for (const auto& r : rows)
+			for (size_t i = 0; i < total.size(); ++i)
+				total[i] += r[i];
+
+		ShCoefficients res;
+		for (size_t i = 0; i < 9; ++i)
+			res[i] = glm::vec3(float(total[i * 3]), float(total[i * 3 + 1]), float(total[i * 3 + 2]));
+		return res;
+	}
+
+	ShCoefficients radianceToIrradianceSh(const ShCoefficients& radiance)
+	{
+		// Ramamoorthi and Hanrahan 2001: An Efficient Representation for Irradiance Environment Maps
+		constexpr float bandFactor[3] = { s_pi, 2.0f * s_pi / 3.0f, s_pi / 4.0f };
+		ShCoefficients res;
+		res[0] = radiance[0] * bandFactor[0];
+		for (size_t i = 1; i < 4; ++i)
+			res[i] = radiance[i] * bandFactor[1];
+		for (size_t i = 4; i < 9; ++i)
+			res[i] = radiance[i] * bandFactor[2];
+		return res;
+	}
+
+	glm::vec3 evalSh(const ShCoefficients& sh, const glm::vec3& n)
+	{
+		const auto basis = getShBasis(n);
+		glm::vec3 res(0.0f);
+		for (size_t i = 0; i < 9; ++i)
+			res += sh[i] * basis[i];
+		return res;
+	}
+}
@@ -0,0 +1,151 @@
+#include "../include/hrsf/TiledScene.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+
+namespace hrsf
+{
+	TiledScene::TiledScene(const std::filesystem::path& indexFile, const TiledSceneSettings& settings)
+		:
+		m_index(TileIndex::load(indexFile)),
+		m_scene(SceneFormat::load(m_index.scene)),
+		m_settings(settings),
+		m_slots(m_index.tiles.size())
+	{
+		if (settings.loadDistance < 0.0f || settings.unloadDistance < settings.loadDistance)
+			throw std::runtime_error("invalid tiled scene settings");
+
+		for (uint32_t i = 0; i < std::max(settings.threadCount, 1u); ++i)
+			m_threads.emplace_back(&TiledScene::worker, this);
+	}
+
+	TiledScene::~TiledScene()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_queue.clear();
+		}
+		m_workAvailable.notify_all();
+		for (auto& t : m_threads)
+			t.join();
+	}
+
+	void TiledScene::update(const glm::vec3& position)
+	{
+		std::vector<float> distances(m_index.tiles.size());
+		for (size_t i = 0; i < distances.size(); ++i)
+		{
+			const auto& b = m_index.tiles[i].bounds;
+			distances[i] = b.isEmpty() ? 0.0f : glm::length(glm::clamp(position, b.min, b.max) - position);
+		}
+
+		std::vector<uint32_t> requests;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			// drop old requests that did not start yet
+			for (auto i : m_queue)
+				m_slots[i].state = State::Unloaded;
+			m_queue.clear();
+
+			for (uint32_t i = 0; i < uint32_t(m_slots.size()); ++i)
+			{
+				auto& slot = m_slots[i];
+				// tiles that are currently loading are unloaded by a later update
+				if ((slot.state == State::Loaded || slot.state == State::Failed) && distances[i] > m_settings.unloadDistance)
+				{
+					slot.meshes.reset();
+					slot.error = nullptr;
+					slot.state = State::Unloaded;
+				}
+				if (slot.state == State::Unloaded && distances[i] <= m_settings.loadDistance)
+					requests.push_back(i);
+			}
+			std::stable_sort(requests.begin(), requests.end(), [&distances](uint32_t a, uint32_t b)
+			{
+				return distances[a] < distances[b];
+			});
+
+			m_queue.assign(requests.rbegin(), requests.rend());
+			for (auto i : m_queue)
+				m_slots[i].state = State::Queued;
+		}
+		m_workAvailable.notify_all();
+		m_loadFinished.notify_all();
+	}
+
+	std::shared_ptr<const std::vector<Mesh>> TiledScene::getTile(size_t index) const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const auto& slot = m_slots.at(index);
+		if (slot.state == State::Failed)
+			std::rethrow_exception(slot.error);
+		return slot.meshes;
+	}
+
+	std::vector<uint32_t> TiledScene::getLoadedTiles() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::vector<uint32_t> res;
+		for (uint32_t i = 0; i < uint32_t(m_slots.size()); ++i)
+			if (m_slots[i].state == State::Loaded) res.push_back(i);
+		return res;
+	}
+
+	size_t TiledScene::getPendingCount() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		size_t count = m_queue.size();
+		for (const auto& s : m_slots)
+			if (s.state == State::Loading) ++count;
+		return count;
+	}
+
+	void TiledScene::wait() const
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_loadFinished.wait(lock, [this]()
+		{
+			return m_stop || (m_queue.empty() && std::none_of(m_slots.begin(), m_slots.end(), [](const Slot& s) { return s.state == State::Loading; }));
+		});
+	}
+
+	std::vector<Mesh> TiledScene::loadTile(const std::filesystem::path& file)
+	{
+		std::vector<Mesh> res;
+		for (const auto& info : SceneFormat::loadMeshInfos(file))
+			res.push_back(SceneFormat::loadMesh(info.file));
+		return res;
+	}
+
+	void TiledScene::worker()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true)
+		{
+			m_workAvailable.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+			if (m_stop) return;
+
+			const auto index = m_queue.back();
+			m_queue.pop_back();
+			m_slots[index].state = State::Loading;
+			lock.unlock();
+
+			std::shared_ptr<const std::vector<Mesh>> meshes;
+			std::exception_ptr error;
+			try
+			{
+				meshes = std::make_shared<const std::vector<Mesh>>(loadTile(m_index.tiles[index].file));
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+
+			lock.lock();
+			m_slots[index].meshes = std::move(meshes);
+			m_slots[index].error = error;
+			m_slots[index].state = error ? State::Failed : State::Loaded;
+			m_loadFinished.notify_all();
+		}
+	}
+}
@@ -0,0 +1,511 @@
+#include "../include/hrsf/Tiling.h"
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Parallel.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <numeric>
+
+namespace hrsf
+{
+	namespace
+	{
+		using json = nlohmann::json;
+
+		constexpr size_t s_indexVersion = 1;
+		// billboards without shapes are counted in chunks by the adaptive grid
+		constexpr size_t s_billboardChunk = 4096;
+		constexpr size_t s_maxRegularCells = size_t(1) << 24;
+
+		size_t getPrimitiveCount(const Mesh& m)
+		{
+			return m.type == Mesh::Triangle ? m.triangle.getIndices().size() / 3 : m.billboard.getNumVertices();
+		}
+
+		BoundingBox getMeshBounds(const Mesh& m)
+		{
+			auto res = BoundingBox::Empty();
+			for (const auto& b : getShapeBounds(m))
+				res.extend(b);
+			return res;
+		}
+
+		/// primitives at a position (input of the adaptive grid)
+		struct GridItem
+		{
+			glm::vec3 center;
+			size_t primitives;
+		};
+
+		/// cells of a regular grid or a quadtree in the xz plane
+		class TileGrid
+		{
+		public:
+			static TileGrid regular(const BoundingBox& bounds, float tileSize)
+			{
+				TileGrid res;
+				res.m_origin = bounds.min;
+				res.m_tileSize = tileSize;
+				const auto size = bounds.getSize();
+				res.m_countX = std::max<size_t>(1, size_t(std::ceil(size.x / tileSize)));
+				res.m_countZ = std::max<size_t>(1, size_t(std::ceil(size.z / tileSize)));
+				if (double(res.m_countX) * double(res.m_countZ) > double(s_maxRegularCells))
+					throw std::runtime_error("tile size is too small for the scene bounds");
+				return res;
+			}
+
+			static TileGrid adaptive(const BoundingBox& bounds, const std::vector<GridItem>& items, size_t maxPrimitives, uint32_t maxDepth)
+			{
+				TileGrid res;
+				res.m_nodes.emplace_back();
+				std::vector<uint32_t> indices(items.size());
+				std::iota(indices.begin(), indices.end(), 0);
+				const auto center = bounds.getCenter();
+				const auto size = bounds.getSize();
+				res.split(0, center.x, center.z, std::max(size.x, size.z) * 0.5f, items, indices, maxPrimitives, maxDepth);
+				return res;
+			}
+
+			/// \brief cell id of the point (points outside of the grid are clamped)
+			size_t find(const glm::vec3& p) const
+			{
+				if (m_nodes.empty())
+				{
+					const auto cell = [this](float v, float origin, size_t count)
+					{
+						const float c = std::floor((v - origin) / m_tileSize);
+						return c <= 0.0f ? size_t(0) : std::min(size_t(c), count - 1);
+					};
+					return cell(p.z, m_origin.z, m_countZ) * m_countX + cell(p.x, m_origin.x, m_countX);
+				}
+
+				uint32_t node = 0;
+				while (m_nodes[node].firstChild)
+					node = m_nodes[node].firstChild + uint32_t(p.x >= m_nodes[node].x) + 2 * uint32_t(p.z >= m_nodes[node].z);
+				return node;
+			}
+		private:
+			struct Node
+			{
+				float x = 0.0f; // split position
+				float z = 0.0f;
+				uint32_t firstChild = 0; // 0 => leaf
+			};
+
+			void split(uint32_t node, float x, float z, float halfSize, const std::vector<GridItem>& items,
+				const std::vector<uint32_t>& indices, size_t maxPrimitives, uint32_t depth)
+			{
+				m_nodes[node].x = x;
+				m_nodes[node].z = z;
+				size_t count = 0;
+				for (const auto i : indices)
+					count += items[i].primitives;
+				// a single item cannot be divided
+				if (count <= maxPrimitives || depth == 0 || indices.size() <= 1) return;
+
+				const auto first = uint32_t(m_nodes.size());
+				m_nodes[node].firstChild = first;
+				m_nodes.resize(m_nodes.size() + 4);
+				std::array<std::vector<uint32_t>, 4> children;
+				for (const auto i : indices)
+					children[uint32_t(items[i].center.x >= x) + 2 * uint32_t(items[i].center.z >= z)].push_back(i);
+
+				const float h = halfSize * 0.5f;
+				for (uint32_t c = 0; c < 4; ++c)
+					split(first + c, x + ((c & 1) ? h : -h), z + ((c & 2) ? h : -h), h, items, children[c], maxPrimitives, depth - 1);
+			}
+
+			// regular grid
+			glm::vec3 m_origin = glm::vec3(0.0f);
+			float m_tileSize = 1.0f;
+			size_t m_countX = 1;
+			size_t m_countZ = 1;
+			// adaptive grid
+			std::vector<Node> m_nodes;
+		};
+
+		/// \brief parts of a static triangle mesh per cell (split by triangle centers, one shape per cell and source shape)
+		std::vector<std::pair<size_t, Mesh>> splitTriangles(const bmf::BinaryMesh16& src, const TileGrid& grid)
+		{
+			struct Part
+			{
+				std::vector<float> vertices;
+				std::vector<uint16_t> indices;
+				std::vector<bmf::Shape> shapes;
+			};
+
+			const auto attributes = src.getAttributes();
+			const auto stride = bmf::getAttributeElementStride(attributes);
+			const auto positionOffset = bmf::getAttributeElementOffset(attributes, bmf::Position);
+			const auto& vertices = src.getVertices();
+			const auto& indices = src.getIndices();
+			const auto getPosition = [&](size_t v)
+			{
+				const float* p = vertices.data() + v * stride + positionOffset;
+				return glm::vec3(p[0], p[1], p[2]);
+			};
+
+			std::map<size_t, Part> parts;
+			std::vector<size_t> cells;
+			std::vector<uint32_t> order;
+			std::vector<uint16_t> remap;
+			std::vector<uint32_t> stamp;
+			for (const auto& s : src.getShapes())
+			{
+				const size_t triangleCount = s.indexCount / 3;
+				cells.resize(triangleCount);
+				for (size_t t = 0; t < triangleCount; ++t)
+				{
+					const auto* tri = indices.data() + s.indexOffset + t * 3;
+					const auto centroid = (getPosition(s.vertexOffset + tri[0]) + getPosition(s.vertexOffset + tri[1]) + getPosition(s.vertexOffset + tri[2])) / 3.0f;
+					cells[t] = grid.find(centroid);
+				}
+				// triangles grouped by cell (stable => the triangle order within a cell is kept)
+				order.resize(triangleCount);
+				for (size_t t = 0; t < triangleCount; ++t)
+					order[t] = uint32_t(t);
+				std::stable_sort(order.begin(), order.end(), [&cells](uint32_t a, uint32_t b) { return cells[a] < cells[b]; });
+
+				// remap[v] is valid if stamp[v] == pass
+				remap.resize(s.vertexCount);
+				stamp.assign(s.vertexCount, 0);
+				uint32_t pass = 0;
+				for (size_t begin = 0; begin < triangleCount;)
+				{
+					const auto cell = cells[order[begin]];
+					++pass;
+					auto& part = parts[cell];
+					bmf::Shape shape = { uint32_t(part.indices.size()), 0, uint32_t(part.vertices.size() / stride), 0, s.materialId };
+					size_t end = begin;
+					for (; end < triangleCount && cells[order[end]] == cell; ++end)
+					{
+						const size_t t = order[end];
+						for (size_t k = 0; k < 3; ++k)
+						{
+							const auto v = indices[s.indexOffset + t * 3 + k];
+							if (stamp[v] != pass)
+							{
+								stamp[v] = pass;
+								remap[v] = uint16_t(shape.vertexCount++);
+								const auto first = vertices.begin() + (s.vertexOffset + v) * stride;
+								part.vertices.insert(part.vertices.end(), first, first + stride);
+							}
+							part.indices.push_back(remap[v]);
+						}
+						shape.indexCount += 3;
+					}
+					part.shapes.push_back(shape);
+					begin = end;
+				}
+			}
+
+			std::vector<std::pair<size_t, Mesh>> res;
+			for (auto& p : parts)
+			{
+				bmf::BinaryMesh16 mesh(attributes, std::move(p.second.vertices), std::move(p.second.indices), std::move(p.second.shapes));
+				mesh.generateBoundingVolumes();
+				res.emplace_back(p.first, Mesh(std::move(mesh)));
+			}
+			return res;
+		}
+
+		/// \brief parts of a static billboard mesh without shapes per cell
+		std::vector<std::pair<size_t, Mesh>> splitBillboards(const bmf::BinaryMesh& src, const TileGrid& grid)
+		{
+			const auto attributes = src.getAttributes();
+			const auto stride = bmf::getAttributeElementStride(attributes);
+			const auto positionOffset = bmf::getAttributeElementOffset(attributes, bmf::Position);
+			const auto& vertices = src.getVertices();
+
+			std::map<size_t, std::vector<float>> parts;
+			for (size_t v = 0; v < src.getNumVertices(); ++v)
+			{
+				const float* p = vertices.data() + v * stride + positionOffset;
+				auto& part = parts[grid.find(glm::vec3(p[0], p[1], p[2]))];
+				part.insert(part.end(), vertices.begin() + v * stride, vertices.begin() + (v + 1) * stride);
+			}
+
+			std::vector<std::pair<size_t, Mesh>> res;
+			for (auto& p : parts)
+				res.emplace_back(p.first, Mesh(bmf::BinaryMesh(attributes, std::move(p.second), {}, {})));
+			return res;
+		}
+
+		bool isSplittable(const Mesh& m)
+		{
+			if (m.type == Mesh::Triangle)
+				return (m.triangle.getAttributes() & bmf::Position) && !m.triangle.getShapes().empty();
+			return (m.billboard.getAttributes() & bmf::Position) && m.billboard.getShapes().empty();
+		}
+
+		struct TileContent
+		{
+			std::vector<const Mesh*> meshes; // unmodified scene meshes
+			std::vector<Mesh> parts; // parts of split meshes
+		};
+	}
+
+	/// friend of SceneFormat (writes the scene and tile manifests with the SceneFormat helpers)
+	class TileWriter
+	{
+	public:
+		static TileIndex write(const SceneFormat& scene, const fs::path& filename, const TilingSettings& settings)
+		{
+			const auto absFilename = fs::absolute(filename).replace_extension();
+			const auto bareName = absFilename.filename().string();
+
+			// scene meshes and prefab instances
+			std::vector<std::vector<Mesh>> instanceMeshes(scene.m_instances.size());
+			parallelFor(0, instanceMeshes.size(), [&](size_t i)
+			{
+				instanceMeshes[i] = scene.getInstanceMeshes(i);
+			});
+			std::vector<const Mesh*> meshes;
+			for (const auto& m : scene.m_meshes)
+				meshes.push_back(&m);
+			for (const auto& instance : instanceMeshes)
+				for (const auto& m : instance)
+					meshes.push_back(&m);
+
+			std::vector<BoundingBox> bounds(meshes.size());
+			parallelFor(0, meshes.size(), [&](size_t i)
+			{
+				bounds[i] = getMeshBounds(*meshes[i]);
+			});
+
+			// moving meshes (and meshes without positions) stay in the scene
+			std::vector<size_t> tiled;
+			std::vector<const Mesh*> global;
+			auto sceneBounds = BoundingBox::Empty();
+			for (size_t i = 0; i < meshes.size(); ++i)
+			{
+				if (meshes[i]->isStatic() && !bounds[i].isEmpty())
+				{
+					tiled.push_back(i);
+					sceneBounds.extend(bounds[i]);
+				}
+				else global.push_back(meshes[i]);
+			}
+
+			// without static meshes (empty scene bounds), only the scene is written and the index has no tiles
+			std::map<size_t, TileContent> tiles;
+			if (!tiled.empty())
+			{
+				const auto grid = settings.tileSize > 0.0f ? TileGrid::regular(sceneBounds, settings.tileSize) :
+					TileGrid::adaptive(sceneBounds, getGridItems(meshes, tiled, bounds), settings.maxTilePrimitives, settings.maxDepth);
+
+				// assign by bounds center, split meshes that overlap several cells
+				std::vector<const Mesh*> split;
+				for (const auto i : tiled)
+				{
+					const auto& b = bounds[i];
+					if (settings.splitMeshes && isSplittable(*meshes[i]) && grid.find(b.min) != grid.find(b.max))
+						split.push_back(meshes[i]);
+					else
+						tiles[grid.find(b.getCenter())].meshes.push_back(meshes[i]);
+				}
+				std::vector<std::vector<std::pair<size_t, Mesh>>> parts(split.size());
+				parallelFor(0, split.size(), [&](size_t i)
+				{
+					parts[i] = split[i]->type == Mesh::Triangle ? splitTriangles(split[i]->triangle, grid) : splitBillboards(split[i]->billboard, grid);
+				});
+				for (auto& meshParts : parts)
+					for (auto& p : meshParts)
+						tiles[p.first].parts.push_back(std::move(p.second));
+			}
+
+			// scene with the shared components
+			{
+				SceneFormat::json j;
+				j["version"] = SceneFormat::s_version;
+				std::unordered_map<std::string, size_t> usedSuffixMap;
+				auto arr = SceneFormat::json::array();
+				for (const auto* m : global)
+				{
+					const auto meshFilename = SceneFormat::getMeshFilename(absFilename, *m, scene.m_materials, usedSuffixMap);
+					SceneFormat::saveMesh(meshFilename, *m);
+					arr.push_back(meshFilename.filename().string() + ".json");
+				}
+				j["meshes"] = arr;
+				if (!scene.m_benchmarkCameras.empty())
+					j["benchmarks"] = SceneFormat::getBenchmarkCamerasJson(scene.m_benchmarkCameras);
+
+				SceneFormat::saveMaterials(absFilename.string() + "_material", scene.m_materials);
+				// lights of the prefab instances are appended like in expandReferences()
+				auto lights = scene.m_lights;
+				for (size_t i = 0; i < scene.m_instances.size(); ++i)
+					for (auto& l : scene.getInstanceLights(i))
+						lights.push_back(std::move(l));
+				SceneFormat::saveLights(absFilename.string() + "_light", lights);
+				SceneFormat::saveCamera(absFilename.string() + "_camera", scene.m_camera);
+				SceneFormat::saveEnvironment(absFilename.string() + "_env", scene.m_environment);
+				j["materials"] = bareName + "_material.json";
+				j["lights"] = bareName + "_light.json";
+				j["camera"] = bareName + "_camera.json";
+				j["environment"] = bareName + "_env.json";
+				SceneFormat::saveFile(j, absFilename);
+			}
+
+			// tile manifests
+			std::vector<std::pair<const size_t, TileContent>*> tileList;
+			for (auto& t : tiles)
+				tileList.push_back(&t);
+			TileIndex index;
+			index.scene = absFilename.string() + ".json";
+			index.tiles.resize(tileList.size());
+			parallelFor(0, tileList.size(), [&](size_t t)
+			{
+				const auto& content = tileList[t]->second;
+				const fs::path tileFilename = absFilename.string() + "_tile" + std::to_string(t);
+				auto& info = index.tiles[t];
+				info.file = tileFilename.string() + ".json";
+				info.bounds = BoundingBox::Empty();
+
+				std::vector<const Mesh*> tileMeshes = content.meshes;
+				for (const auto& p : content.parts)
+					tileMeshes.push_back(&p);
+
+				std::unordered_map<std::string, size_t> usedSuffixMap;
+				auto arr = SceneFormat::json::array();
+				for (const auto* m : tileMeshes)
+				{
+					const auto meshFilename = SceneFormat::getMeshFilename(tileFilename, *m, scene.m_materials, usedSuffixMap);
+					SceneFormat::saveMesh(meshFilename, *m);
+					arr.push_back(meshFilename.filename().string() + ".json");
+					info.bounds.extend(getMeshBounds(*m));
+					info.primitiveCount += getPrimitiveCount(*m);
+				}
+				info.meshCount = tileMeshes.size();
+
+				SceneFormat::json j;
+				j["version"] = SceneFormat::s_version;
+				j["meshes"] = arr;
+				j["materials"] = bareName + "_material.json";
+				j["lights"] = SceneFormat::json::array();
+				j["camera"] = bareName + "_camera.json";
+				j["environment"] = bareName + "_env.json";
+				SceneFormat::saveFile(j, tileFilename);
+			});
+
+			index.bounds = BoundingBox::Empty();
+			for (const auto& t : index.tiles)
+				index.bounds.extend(t.bounds);
+			index.save(absFilename.string() + "_tiles.json");
+			return index;
+		}
+
+		static void saveIndex(const TileIndex& index, const fs::path& filename)
+		{
+			const auto root = fs::absolute(filename).parent_path();
+			json j;
+			j["version"] = s_indexVersion;
+			j["scene"] = fs::relative(index.scene, root).generic_string();
+			writeBounds(j, index.bounds);
+			j["tiles"] = json::array();
+			for (const auto& t : index.tiles)
+			{
+				json tile;
+				tile["file"] = fs::relative(t.file, root).generic_string();
+				writeBounds(tile, t.bounds);
+				tile["meshes"] = t.meshCount;
+				tile["primitives"] = t.primitiveCount;
+				j["tiles"].push_back(std::move(tile));
+			}
+
+			std::ofstream file(filename);
+			if (!file.is_open())
+				throw std::runtime_error("could not save " + filename.string());
+			file << j.dump(3);
+		}
+
+		static TileIndex loadIndex(const fs::path& filename)
+		{
+			std::ifstream file(filename);
+			if (!file.is_open())
+				throw std::runtime_error("could not open " + filename.string());
+			json j;
+			file >> j;
+			if (j["version"].get<size_t>() != s_indexVersion)
+				throw std::runtime_error(filename.string() + " invalid version");
+
+			const auto root = fs::absolute(filename).parent_path();
+			TileIndex res;
+			res.scene = root / j["scene"].get<std::string>();
+			res.bounds = getBounds(j);
+			for (const auto& t : j["tiles"])
+			{
+				TileInfo info;
+				info.file = root / t["file"].get<std::string>();
+				info.bounds = getBounds(t);
+				info.meshCount = t["meshes"].get<size_t>();
+				info.primitiveCount = t["primitives"].get<size_t>();
+				res.tiles.push_back(std::move(info));
+			}
+			return res;
+		}
+	private:
+		/// empty bounds (infinite values) are omitted
+		static void writeBounds(json& j, const BoundingBox& bounds)
+		{
+			if (bounds.isEmpty()) return;
+			SceneFormat::writeVec3(j["min"], bounds.min);
+			SceneFormat::writeVec3(j["max"], bounds.max);
+		}
+
+		static BoundingBox getBounds(const json& j)
+		{
+			const auto min = j.find("min");
+			if (min == j.end()) return BoundingBox::Empty();
+			return { SceneFormat::getVec3(*min), SceneFormat::getVec3(j.at("max")) };
+		}
+
+		static std::vector<GridItem> getGridItems(const std::vector<const Mesh*>& meshes, const std::vector<size_t>& tiled,
+			const std::vector<BoundingBox>& bounds)
+		{
+			std::vector<GridItem> res;
+			for (const auto i : tiled)
+			{
+				const auto& m = *meshes[i];
+				if (m.type == Mesh::Triangle && isSplittable(m))
+				{
+					// one item per shape
+					const auto shapeBounds = getShapeBounds(m);
+					for (size_t s = 0; s < shapeBounds.size(); ++s)
+						if (!shapeBounds[s].isEmpty())
+							res.push_back({ shapeBounds[s].getCenter(), m.triangle.getShapes()[s].indexCount / 3 });
+				}
+				else if (m.type == Mesh::Billboard && isSplittable(m))
+				{
+					// one item per chunk of billboards
+					for (size_t first = 0; first < m.billboard.getNumVertices(); first += s_billboardChunk)
+					{
+						bmf::Shape chunk = {};
+						chunk.vertexOffset = uint32_t(first);
+						chunk.vertexCount = uint32_t(std::min(s_billboardChunk, m.billboard.getNumVertices() - first));
+						res.push_back({ getShapeBounds(m.billboard, chunk).getCenter(), chunk.vertexCount });
+					}
+				}
+				else res.push_back({ bounds[i].getCenter(), getPrimitiveCount(m) });
+			}
+			return res;
+		}
+	};
+
+	TileIndex writeTiles(const SceneFormat& scene, const std::filesystem::path& filename, const TilingSettings& settings)
+	{
+		return TileWriter::write(scene, filename, settings);
+	}
+
+	void TileIndex::save(const std::filesystem::path& filename) const
+	{
+		TileWriter::saveIndex(*this, filename);
+	}
+
+	TileIndex TileIndex::load(const std::filesystem::path& filename)
+	{
+		return TileWriter::loadIndex(filename);
+	}
+}
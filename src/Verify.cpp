@@ -0,0 +1,236 @@
+#include "../include/hrsf/SceneFormat.h"
+#include "../include/hrsf/Parallel.h"
+#include "../include/hrsf/Simd.h"
+#include "../include/hrsf/VerifyReport.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace hrsf
+{
+	namespace
+	{
+		// vertices per billboard material task
+		constexpr size_t s_chunkSize = size_t(1) << 20;
+		// reported vertices per task (the total count is always reported)
+		constexpr size_t s_maxReportedVertices = 8;
+
+		struct VerifyTask
+		{
+			enum Type
+			{
+				MeshStructure,
+				BillboardMaterials,
+			} type;
+			uint32_t source; // index into the mesh sources (own meshes and prefabs)
+			uint32_t mesh;
+			size_t begin; // vertex range for BillboardMaterials
+			size_t end;
+		};
+
+		/// meshes that are verified against their own material list (the root scene or a prefab)
+		struct MeshSource
+		{
+			const std::vector<Mesh>* meshes;
+			size_t materialCount;
+			std::string location; // prefix of the issue locations
+		};
+
+		// verify functions throw => collect the message instead
+		template<class T>
+		void collect(const T& object, const std::string& location, std::vector<VerifyIssue>& issues)
+		{
+			try
+			{
+				object.verify();
+			}
+			catch (const std::exception& e)
+			{
+				issues.push_back({ location, e.what() });
+			}
+		}
+	}
+
+	std::string VerifyReport::toString() const
+	{
+		std::string res;
+		for (const auto& i : issues)
+			res += i.location + ": " + i.message + "\n";
+		return res;
+	}
+
+	size_t findInvalidMaterialIds(const float* vertices, size_t vertexCount, size_t stride, size_t offset,
+		uint32_t materialCount, std::vector<size_t>& out, size_t maxOut)
+	{
+		const auto isInvalid = [&](size_t v)
+		{
+			uint32_t id;
+			std::memcpy(&id, vertices + v * stride + offset, sizeof(id));
+			return id >= materialCount;
+		};
+
+		size_t count = 0;
+		size_t v = 0;
+#ifdef HRSF_SSE2
+		// unsigned compare: flip the sign bit and use the signed compare
+		const __m128i signBit = _mm_set1_epi32(int(0x80000000u));
+		const __m128i limit = _mm_xor_si128(_mm_set1_epi32(int(materialCount)), signBit);
+		const __m128i limitMinusOne = _mm_sub_epi32(limit, _mm_set1_epi32(1));
+		const float* base = vertices + offset;
+		for (; v + 4 <= vertexCount; v += 4)
+		{
+			// strided load of 4 material ids
+			const __m128 ids = _mm_set_ps(base[(v + 3) * stride], base[(v + 2) * stride], base[(v + 1) * stride], base[v * stride]);
+			const __m128i flipped = _mm_xor_si128(_mm_castps_si128(ids), signBit);
+			// id >= materialCount <=> id > materialCount - 1
+			const int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(flipped, limitMinusOne)));
+			if (mask == 0 && materialCount != 0) continue;
+			// rare case => scalar path for exact indices
+			for (size_t i = v; i < v + 4; ++i)
+			{
+				if (!isInvalid(i)) continue;
+				if (out.size() < maxOut) out.push_back(i);
+				++count;
+			}
+		}
+#endif
+		for (; v < vertexCount; ++v)
+		{
+			if (!isInvalid(v)) continue;
+			if (out.size() < maxOut) out.push_back(v);
+			++count;
+		}
+		return count;
+	}
+
+	VerifyReport SceneFormat::getVerifyReport() const
+	{
+		// prefab meshes are verified once (with the prefab materials), not per instance
+		std::vector<MeshSource> sources;
+		sources.push_back({ &m_meshes, m_materials.size(), "" });
+		for (size_t p = 0; p < m_prefabs.size(); ++p)
+		{
+			const auto& prefab = *m_prefabs[p].scene;
+			sources.push_back({ &prefab.m_meshes, prefab.m_materials.size(), "prefab " + std::to_string(p) + " (" + m_prefabs[p].file.string() + ") " });
+		}
+
+		// split the work into independent tasks => large billboard meshes are processed by multiple threads
+		std::vector<VerifyTask> tasks;
+		for (uint32_t src = 0; src < uint32_t(sources.size()); ++src)
+		{
+			const auto& meshes = *sources[src].meshes;
+			for (uint32_t m = 0; m < uint32_t(meshes.size()); ++m)
+			{
+				const auto& mesh = meshes[m];
+				tasks.push_back({ VerifyTask::MeshStructure, src, m, 0, 0 });
+				if (mesh.type == Mesh::Billboard && (mesh.billboard.getAttributes() & bmf::Material))
+				{
+					const auto vertexCount = mesh.billboard.getNumVertices();
+					for (size_t begin = 0; begin < vertexCount; begin += s_chunkSize)
+						tasks.push_back({ VerifyTask::BillboardMaterials, src, m, begin, std::min(begin + s_chunkSize, vertexCount) });
+				}
+			}
+		}
+
+		std::vector<std::vector<VerifyIssue>> taskIssues(tasks.size());
+		parallelFor(0, tasks.size(), [&](size_t t)
+		{
+			const auto& task = tasks[t];
+			const auto& source = sources[task.source];
+			const auto& mesh = (*source.meshes)[task.mesh];
+			const auto location = source.location + "mesh " + std::to_string(task.mesh);
+			auto& issues = taskIssues[t];
+
+			if (task.type == VerifyTask::BillboardMaterials)
+			{
+				const auto attribs = mesh.billboard.getAttributes();
+				const auto stride = bmf::getAttributeElementStride(attribs);
+				std::vector<size_t> invalid;
+				const auto count = findInvalidMaterialIds(mesh.billboard.getVertices().data() + task.begin * stride, task.end - task.begin,
+					stride, bmf::getAttributeElementOffset(attribs, bmf::Material), uint32_t(source.materialCount), invalid, s_maxReportedVertices);
+				for (auto v : invalid)
+				{
+					const auto id = bmf::asInt(mesh.billboard.getVertices()[(task.begin + v) * stride + bmf::getAttributeElementOffset(attribs, bmf::Material)]);
+					issues.push_back({ location + " vertex " + std::to_string(task.begin + v), "material id out of bound: " + std::to_string(id) });
+				}
+				if (count > invalid.size())
+					issues.push_back({ location + " vertices " + std::to_string(task.begin) + "-" + std::to_string(task.end - 1),
+						std::to_string(count - invalid.size()) + " more material ids out of bound" });
+				return;
+			}
+
+			if (mesh.type == Mesh::Triangle)
+			{
+				collect(mesh.triangle, location, issues);
+				const auto& shapes = mesh.triangle.getShapes();
+				for (size_t s = 0; s < shapes.size(); ++s)
+				{
+					if (shapes[s].materialId >= source.materialCount)
+						issues.push_back({ location + " shape " + std::to_string(s), "material id out of bound: " + std::to_string(shapes[s].materialId) });
+				}
+			}
+			else if (mesh.type == Mesh::Billboard)
+				collect(mesh.billboard, location, issues);
+			else
+				issues.push_back({ location, "invalid mesh type" });
+
+			collect(mesh.position, location + " position", issues);
+			collect(mesh.lookAt, location + " lookAt", issues);
+		});
+
+		VerifyReport report;
+		for (auto& issues : taskIssues)
+			report.issues.insert(report.issues.end(), std::make_move_iterator(issues.begin()), std::make_move_iterator(issues.end()));
+
+		for (size_t i = 0; i < m_lights.size(); ++i)
+			collect(m_lights[i].path, "light " + std::to_string(i) + " path", report.issues);
+		for (size_t p = 1; p < sources.size(); ++p)
+		{
+			const auto& lights = m_prefabs[p - 1].scene->m_lights;
+			for (size_t i = 0; i < lights.size(); ++i)
+				collect(lights[i].path, sources[p].location + "light " + std::to_string(i) + " path", report.issues);
+		}
+
+		// instance list
+		for (size_t i = 0; i < m_instances.size(); ++i)
+		{
+			const auto& instance = m_instances[i];
+			const auto location = "instance " + std::to_string(i);
+			if (instance.prefab >= m_prefabs.size())
+			{
+				report.issues.push_back({ location, "prefab index out of bound: " + std::to_string(instance.prefab) });
+				continue;
+			}
+			bool finite = true;
+			for (int c = 0; c < 4; ++c)
+				for (int r = 0; r < 4; ++r)
+					finite = finite && std::isfinite(instance.transform[c][r]);
+			if (!finite)
+				report.issues.push_back({ location, "transform is not finite" });
+			else if (glm::determinant(glm::mat3(instance.transform)) == 0.0f)
+				report.issues.push_back({ location, "transform is not invertible" });
+			if (glm::vec3(instance.transform[3]) != glm::vec3(0.0f))
+			{
+				const auto& meshes = m_prefabs[instance.prefab].scene->m_meshes;
+				for (size_t m = 0; m < meshes.size(); ++m)
+					if (!meshes[m].lookAt.isStatic())
+						report.issues.push_back({ location, "prefab mesh " + std::to_string(m) + " has a lookAt path and cannot be translated" });
+			}
+		}
+
+		collect(m_camera.positionPath, "camera positionPath", report.issues);
+		collect(m_camera.lookAtPath, "camera lookAtPath", report.issues);
+
+		for (const auto& b : m_benchmarkCameras)
+		{
+			const auto location = "benchmark " + b.name;
+			if (b.duration < 0.0f)
+				report.issues.push_back({ location, "negative duration" });
+			collect(b.camera.positionPath, location + " positionPath", report.issues);
+			collect(b.camera.lookAtPath, location + " lookAtPath", report.issues);
+		}
+
+		return report;
+	}
+}